@@ -4,6 +4,13 @@
 #include "fractalNoise.h"
 
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
 #define XX_PRIME32_1 2654435761U
 #define XX_PRIME32_2 2246822519U
 #define XX_PRIME32_3 3266489917U
@@ -11,7 +18,8 @@
 #define XX_PRIME32_5 374761393U
 
 
-static uint32_t xxSeed = 0U;
+// per-thread, so that map generation can run on worker threads
+static __thread uint32_t xxSeed = 0U;
 
 
 
@@ -140,3 +148,275 @@ double getXYFractal( int inX, int inY, double inRoughness, double inScale ) {
     
     return sum * oneOverIntMax;
     }
+
+
+
+
+// row versions
+// Hash step is done several lanes at a time, but all double math is done
+// one value at a time with the same expressions as the single-cell
+// versions above, so that results match bit-for-bit.
+
+
+#define ROW_BATCH 64
+
+
+#if !defined(__AVX2__) && defined(__SSE2__)
+// SSE2 has no 32-bit low multiply
+static inline __m128i mulLo32( __m128i inA, __m128i inB ) {
+    __m128i even = _mm_mul_epu32( inA, inB );
+    __m128i odd = _mm_mul_epu32( _mm_srli_epi64( inA, 32 ),
+                                 _mm_srli_epi64( inB, 32 ) );
+    return _mm_unpacklo_epi32(
+        _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+        _mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+    }
+#endif
+
+
+
+// xxTweakedHash2D( inXs[i], inY ) with inSeed for each i
+static void xxTweakedHash2DRow( uint32_t inSeed, const uint32_t *inXs,
+                                uint32_t inY, int inNum,
+                                uint32_t *outHashes ) {
+    
+    // part of hash that doesn't depend on x
+    uint32_t rowBase = inSeed + XX_PRIME32_5 + inY * XX_PRIME32_3;
+
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i base8 = _mm256_set1_epi32( (int)rowBase );
+    __m256i p2_8 = _mm256_set1_epi32( (int)XX_PRIME32_2 );
+    __m256i p3_8 = _mm256_set1_epi32( (int)XX_PRIME32_3 );
+    
+    for( ; i + 8 <= inNum; i += 8 ) {
+        __m256i h = _mm256_add_epi32( 
+            _mm256_loadu_si256( (const __m256i*)&( inXs[i] ) ), base8 );
+        h = _mm256_mullo_epi32( h, p2_8 );
+        h = _mm256_xor_si256( h, _mm256_srli_epi32( h, 13 ) );
+        h = _mm256_mullo_epi32( h, p3_8 );
+        h = _mm256_xor_si256( h, _mm256_srli_epi32( h, 16 ) );
+        _mm256_storeu_si256( (__m256i*)&( outHashes[i] ), h );
+        }
+#elif defined(__SSE2__)
+    __m128i base4 = _mm_set1_epi32( (int)rowBase );
+    __m128i p2_4 = _mm_set1_epi32( (int)XX_PRIME32_2 );
+    __m128i p3_4 = _mm_set1_epi32( (int)XX_PRIME32_3 );
+    
+    for( ; i + 4 <= inNum; i += 4 ) {
+        __m128i h = _mm_add_epi32( 
+            _mm_loadu_si128( (const __m128i*)&( inXs[i] ) ), base4 );
+        h = mulLo32( h, p2_4 );
+        h = _mm_xor_si128( h, _mm_srli_epi32( h, 13 ) );
+        h = mulLo32( h, p3_4 );
+        h = _mm_xor_si128( h, _mm_srli_epi32( h, 16 ) );
+        _mm_storeu_si128( (__m128i*)&( outHashes[i] ), h );
+        }
+#endif
+
+    // scalar tail, same steps as xxTweakedHash2D
+    for( ; i < inNum; i++ ) {
+        uint32_t h32 = inXs[i] + rowBase;
+        h32 *= XX_PRIME32_2;
+        h32 ^= h32 >> 13;
+        h32 *= XX_PRIME32_3;
+        h32 ^= h32 >> 16;
+        outHashes[i] = h32;
+        }
+    }
+
+
+
+void getXYRandomRow( uint32_t inSeed, int inXStart, int inY, int inNumValues,
+                     double *outValues ) {
+    uint32_t xs[ ROW_BATCH ];
+    uint32_t hashes[ ROW_BATCH ];
+    
+    for( int b=0; b<inNumValues; b += ROW_BATCH ) {
+        int num = inNumValues - b;
+        if( num > ROW_BATCH ) {
+            num = ROW_BATCH;
+            }
+        
+        for( int i=0; i<num; i++ ) {
+            xs[i] = (uint32_t)( inXStart + b + i );
+            }
+        xxTweakedHash2DRow( inSeed, xs, (uint32_t)inY, num, hashes );
+
+        for( int i=0; i<num; i++ ) {
+            outValues[ b + i ] = hashes[i] * oneOverIntMax;
+            }
+        }
+    }
+
+
+
+// getXYRandomBN( x / inDivisor, inY / inDivisor ) for inNum cells
+// starting at inXStart, inNum <= ROW_BATCH
+static void getXYRandomBNRow( uint32_t inSeed, int inXStart, int inY,
+                              int inNum, double inDivisor,
+                              double *outValues ) {
+    
+    double fY = inY / inDivisor;
+    
+    int floorY = lrint( floor( fY ) );
+    int ceilY = floorY + 1;
+    
+    double yOffset = fY - floorY;
+    
+    int floorXs[ ROW_BATCH ];
+    double xOffsets[ ROW_BATCH ];
+    
+    for( int i=0; i<inNum; i++ ) {
+        double fX = ( inXStart + i ) / inDivisor;
+        
+        floorXs[i] = lrint( floor( fX ) );
+        xOffsets[i] = fX - floorXs[i];
+        }
+
+
+    // hashes of lattice corners to left and right of each cell,
+    // in top and bottom rows
+    uint32_t xs[ ROW_BATCH + 1 ];
+    uint32_t topHashes[ ROW_BATCH + 1 ];
+    uint32_t bottomHashes[ ROW_BATCH + 1 ];
+
+    // where each cell's left corner is in hash arrays
+    // (right corner is next one)
+    int cornerIndex[ ROW_BATCH ];
+    
+    int latticeStart = floorXs[0];
+    int latticeSpan = floorXs[ inNum - 1 ] + 2 - latticeStart;
+    
+    if( latticeSpan <= ROW_BATCH + 1 ) {
+        // cells share corners (divisor >= 1)
+        // hash each lattice column once
+        for( int j=0; j<latticeSpan; j++ ) {
+            xs[j] = (uint32_t)( latticeStart + j );
+            }
+        xxTweakedHash2DRow( inSeed, xs, floorY, latticeSpan, topHashes );
+        xxTweakedHash2DRow( inSeed, xs, ceilY, latticeSpan, bottomHashes );
+
+        for( int i=0; i<inNum; i++ ) {
+            cornerIndex[i] = floorXs[i] - latticeStart;
+            }
+        }
+    else {
+        // cells skip lattice columns, hash each cell's corners
+        // left corners in first half of arrays, right in second half
+        int half = ( ROW_BATCH + 1 ) / 2;
+        
+        for( int b=0; b<inNum; b += half ) {
+            int num = inNum - b;
+            if( num > half ) {
+                num = half;
+                }
+            for( int i=0; i<num; i++ ) {
+                xs[i] = (uint32_t)( floorXs[ b + i ] );
+                xs[ half + i ] = (uint32_t)( floorXs[ b + i ] + 1 );
+                }
+            // right corners start at half, hash whole span
+            int span = half + num;
+            
+            uint32_t top[ ROW_BATCH + 1 ];
+            uint32_t bottom[ ROW_BATCH + 1 ];
+            
+            xxTweakedHash2DRow( inSeed, xs, floorY, span, top );
+            xxTweakedHash2DRow( inSeed, xs, ceilY, span, bottom );
+            
+            for( int i=0; i<num; i++ ) {
+                double cornerA1 = top[i];
+                double cornerA2 = top[ half + i ];
+                double cornerB1 = bottom[i];
+                double cornerB2 = bottom[ half + i ];
+                
+                double xOffset = xOffsets[ b + i ];
+                
+                double topBlend = 
+                    cornerA2 * xOffset + (1-xOffset) * cornerA1;
+                
+                double bottomBlend = 
+                    cornerB2 * xOffset + (1-xOffset) * cornerB1;
+                
+                outValues[ b + i ] = 
+                    bottomBlend * yOffset + (1-yOffset) * topBlend;
+                }
+            }
+        return;
+        }
+    
+
+    for( int i=0; i<inNum; i++ ) {
+        int c = cornerIndex[i];
+        
+        double cornerA1 = topHashes[c];
+        double cornerA2 = topHashes[ c + 1 ];
+
+        double cornerB1 = bottomHashes[c];
+        double cornerB2 = bottomHashes[ c + 1 ];
+
+        double xOffset = xOffsets[i];
+        
+        double topBlend = cornerA2 * xOffset + (1-xOffset) * cornerA1;
+    
+        double bottomBlend = cornerB2 * xOffset + (1-xOffset) * cornerB1;
+    
+        outValues[i] = bottomBlend * yOffset + (1-yOffset) * topBlend;
+        }
+    }
+
+
+
+void getXYFractalRow( uint32_t inSeed, int inXStart, int inY, int inNumValues,
+                      double inRoughness, double inScale,
+                      double *outValues ) {
+    double b = inRoughness;
+    double a = 1 - b;
+
+    // one row of noise per octave, same divisors as getXYFractal
+    double n32[ ROW_BATCH ];
+    double n16[ ROW_BATCH ];
+    double n8[ ROW_BATCH ];
+    double n4[ ROW_BATCH ];
+    double n2[ ROW_BATCH ];
+    double n1[ ROW_BATCH ];
+    
+    for( int s=0; s<inNumValues; s += ROW_BATCH ) {
+        int num = inNumValues - s;
+        if( num > ROW_BATCH ) {
+            num = ROW_BATCH;
+            }
+        int x = inXStart + s;
+        
+        getXYRandomBNRow( inSeed, x, inY, num, 32 * inScale, n32 );
+        getXYRandomBNRow( inSeed, x, inY, num, 16 * inScale, n16 );
+        getXYRandomBNRow( inSeed, x, inY, num, 8 * inScale, n8 );
+        getXYRandomBNRow( inSeed, x, inY, num, 4 * inScale, n4 );
+        getXYRandomBNRow( inSeed, x, inY, num, 2 * inScale, n2 );
+        getXYRandomBNRow( inSeed, x, inY, num, inScale, n1 );
+        
+        for( int i=0; i<num; i++ ) {
+            double sum =
+                a * n32[i]
+                +
+                b * (
+                    a * n16[i]
+                    +
+                    b * (
+                        a * n8[i]
+                        +
+                        b * (
+                            a * n4[i]
+                            +
+                            b * (
+                                a * n2[i]
+                                +
+                                b * (
+                                    n1[i]
+                                    ) ) ) ) );
+            
+            outValues[ s + i ] = sum * oneOverIntMax;
+            }
+        }
+    }
@@ -1,7 +1,7 @@
 #include <stdint.h>
 
 
-// sets seed for all subsequent calls
+// sets seed for all subsequent calls on this thread
 void setXYRandomSeed( uint32_t inSeed );
 
 
@@ -15,3 +15,19 @@ double getXYRandom( int inX, int inY );
 // BUT can be larger than 1 sometimes
 double getXYFractal( int inX, int inY, double inRoughness, double inScale );
 
+
+
+
+// row versions of the above
+// fill outValues with inNumValues values for cells inXStart, inXStart + 1,
+// ... in row inY, using inSeed instead of seed set by setXYRandomSeed
+//
+// results are bit-identical to calling single-cell versions for each cell
+// (with inSeed set), but much faster
+void getXYRandomRow( uint32_t inSeed, int inXStart, int inY, int inNumValues,
+                     double *outValues );
+
+
+void getXYFractalRow( uint32_t inSeed, int inXStart, int inY, int inNumValues,
+                      double inRoughness, double inScale,
+                      double *outValues );
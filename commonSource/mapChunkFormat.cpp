@@ -0,0 +1,186 @@
+#include "mapChunkFormat.h"
+
+
+
+void appendChunkVarInt( SimpleVector<unsigned char> *ioBuffer, int inValue ) {
+    // zig-zag, so small negative values stay short
+    unsigned int v = 
+        ( (unsigned int)inValue << 1 ) ^ (unsigned int)( inValue >> 31 );
+    
+    while( v >= 0x80 ) {
+        ioBuffer->push_back( (unsigned char)( ( v & 0x7F ) | 0x80 ) );
+        v >>= 7;
+        }
+    ioBuffer->push_back( (unsigned char)v );
+    }
+
+
+
+char readChunkVarInt( unsigned char *inData, int inLength, int *ioPos,
+                      int *outValue ) {
+    unsigned int v = 0;
+    int shift = 0;
+    
+    while( *ioPos < inLength && shift < 35 ) {
+        unsigned char b = inData[ *ioPos ];
+        (*ioPos)++;
+        
+        v |= (unsigned int)( b & 0x7F ) << shift;
+        
+        if( ( b & 0x80 ) == 0 ) {
+            *outValue = (int)( v >> 1 ) ^ -(int)( v & 1 );
+            return true;
+            }
+        shift += 7;
+        }
+    
+    return false;
+    }
+
+
+
+void startBinaryChunk( SimpleVector<unsigned char> *ioBuffer ) {
+    ioBuffer->push_back( MAP_CHUNK_FORMAT_BINARY );
+    }
+
+
+
+void appendChunkEmptyRun( SimpleVector<unsigned char> *ioBuffer,
+                          int inNumCells, int inBiome ) {
+    appendChunkVarInt( ioBuffer, inNumCells );
+    appendChunkVarInt( ioBuffer, inBiome );
+    }
+
+
+
+void appendChunkCell( SimpleVector<unsigned char> *ioBuffer,
+                      int inBiome, int inFloor, int inObject,
+                      int inNumContained, int *inContained,
+                      int *inSubContainedStackSizes,
+                      int **inSubContainedStacks ) {
+    
+    appendChunkVarInt( ioBuffer, 0 );
+    
+    appendChunkVarInt( ioBuffer, inBiome );
+    appendChunkVarInt( ioBuffer, inFloor );
+    appendChunkVarInt( ioBuffer, inObject );
+    appendChunkVarInt( ioBuffer, inNumContained );
+    
+    for( int c=0; c<inNumContained; c++ ) {
+        appendChunkVarInt( ioBuffer, inContained[c] );
+        
+        if( inSubContainedStackSizes == NULL ||
+            inSubContainedStacks == NULL ||
+            inSubContainedStacks[c] == NULL ) {
+            appendChunkVarInt( ioBuffer, 0 );
+            continue;
+            }
+        
+        int numSub = inSubContainedStackSizes[c];
+        
+        appendChunkVarInt( ioBuffer, numSub );
+        
+        for( int s=0; s<numSub; s++ ) {
+            appendChunkVarInt( ioBuffer, inSubContainedStacks[c][s] );
+            }
+        }
+    }
+
+
+
+char decodeBinaryChunk( unsigned char *inData, int inLength,
+                        int inNumCells,
+                        int *outBiomes, int *outFloors, int *outObjects,
+                        SimpleVector<int> *outContainedStacks,
+                        SimpleVector< SimpleVector<int> > 
+                        *outSubContainedStacks ) {
+    
+    if( inLength < 1 || inData[0] != MAP_CHUNK_FORMAT_BINARY ) {
+        return false;
+        }
+    
+    int pos = 1;
+    int cell = 0;
+    
+    while( cell < inNumCells ) {
+        int tag;
+        if( ! readChunkVarInt( inData, inLength, &pos, &tag ) ) {
+            return false;
+            }
+        
+        if( tag < 0 || tag > inNumCells - cell ) {
+            return false;
+            }
+
+        if( tag > 0 ) {
+            int biome;
+            if( ! readChunkVarInt( inData, inLength, &pos, &biome ) ) {
+                return false;
+                }
+            for( int i=0; i<tag; i++ ) {
+                outBiomes[cell] = biome;
+                outFloors[cell] = 0;
+                outObjects[cell] = 0;
+                outContainedStacks[cell].deleteAll();
+                outSubContainedStacks[cell].deleteAll();
+                cell++;
+                }
+            continue;
+            }
+        
+        int numContained;
+        
+        if( ! readChunkVarInt( inData, inLength, &pos, &( outBiomes[cell] ) )
+            ||
+            ! readChunkVarInt( inData, inLength, &pos, &( outFloors[cell] ) )
+            ||
+            ! readChunkVarInt( inData, inLength, &pos, &( outObjects[cell] ) )
+            ||
+            ! readChunkVarInt( inData, inLength, &pos, &numContained ) ) {
+            return false;
+            }
+
+        // each contained item takes at least two bytes
+        if( numContained < 0 || numContained > ( inLength - pos ) / 2 ) {
+            return false;
+            }
+        
+        SimpleVector<int> *stack = &( outContainedStacks[cell] );
+        SimpleVector< SimpleVector<int> > *subStacks = 
+            &( outSubContainedStacks[cell] );
+        
+        stack->deleteAll();
+        subStacks->deleteAll();
+        
+        for( int c=0; c<numContained; c++ ) {
+            int id, numSub;
+            
+            if( ! readChunkVarInt( inData, inLength, &pos, &id ) ||
+                ! readChunkVarInt( inData, inLength, &pos, &numSub ) ) {
+                return false;
+                }
+            
+            if( numSub < 0 || numSub > inLength - pos ) {
+                return false;
+                }
+            
+            stack->push_back( id );
+            
+            SimpleVector<int> newSubStack;
+            subStacks->push_back( newSubStack );
+            
+            SimpleVector<int> *subStack = subStacks->getElement( c );
+            
+            for( int s=0; s<numSub; s++ ) {
+                int subID;
+                if( ! readChunkVarInt( inData, inLength, &pos, &subID ) ) {
+                    return false;
+                    }
+                subStack->push_back( subID );
+                }
+            }
+        cell++;
+        }
+    
+    return true;
+    }
@@ -0,0 +1,69 @@
+#include "minorGems/util/SimpleVector.h"
+
+
+// Formats for the cell data inside an MC (map chunk) message.
+// The MC header is the same for all formats; only the zipped body differs.
+//
+// Server lists the highest format it can send as an extra line at the end
+// of its SN message (servers that predate this don't, and only accept
+// LOGIN without a format).  Client asks for a format at LOGIN only if the
+// server listed one, and server sends text to clients that don't ask.
+
+
+// space-separated  biome:floor:object,contained:sub:sub,contained
+#define MAP_CHUNK_FORMAT_TEXT 0
+
+// first byte is MAP_CHUNK_FORMAT_BINARY, then a sequence of groups,
+// row-major, each starting with a varint tag:
+//    tag > 0:   run of tag empty cells (no floor, object, or contained)
+//               followed by their shared biome
+//    tag == 0:  one full cell:
+//               biome, floor, object, numContained,
+//               then for each contained:  id, numSubContained, sub ids
+//
+// All values are zig-zag varints (7 bits per byte, low bits first).
+#define MAP_CHUNK_FORMAT_BINARY 1
+
+
+// highest format that this build can read and write
+#define MAP_CHUNK_FORMAT_LATEST MAP_CHUNK_FORMAT_BINARY
+
+
+
+void appendChunkVarInt( SimpleVector<unsigned char> *ioBuffer, int inValue );
+
+
+// returns false if data runs out before varint ends
+char readChunkVarInt( unsigned char *inData, int inLength, int *ioPos,
+                      int *outValue );
+
+
+
+// appends header byte for binary format
+void startBinaryChunk( SimpleVector<unsigned char> *ioBuffer );
+
+
+void appendChunkEmptyRun( SimpleVector<unsigned char> *ioBuffer,
+                          int inNumCells, int inBiome );
+
+
+// inSubContainedStackSizes and inSubContainedStacks can be NULL if
+// nothing is sub-contained, and individual sub stacks can be NULL
+void appendChunkCell( SimpleVector<unsigned char> *ioBuffer,
+                      int inBiome, int inFloor, int inObject,
+                      int inNumContained, int *inContained,
+                      int *inSubContainedStackSizes,
+                      int **inSubContainedStacks );
+
+
+
+// decodes a whole binary chunk body of inNumCells cells into
+// arrays with inNumCells elements each
+//
+// returns false if data is malformed or has wrong number of cells
+char decodeBinaryChunk( unsigned char *inData, int inLength,
+                        int inNumCells,
+                        int *outBiomes, int *outFloors, int *outObjects,
+                        SimpleVector<int> *outContainedStacks,
+                        SimpleVector< SimpleVector<int> > 
+                        *outSubContainedStacks );
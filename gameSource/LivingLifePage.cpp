@@ -16,8 +16,10 @@
 #include "musicPlayer.h"
 
 #include "liveAnimationTriggers.h"
+#include "messageFramer.h"
 
 #include "../commonSource/fractalNoise.h"
+#include "../commonSource/mapChunkFormat.h"
 
 #include "minorGems/util/SimpleVector.h"
 #include "minorGems/util/MinPriorityQueue.h"
@@ -113,6 +115,113 @@ static char savingSpeechMask = false;
 
 
 
+// if true, time spent in each per-frame map pass is summed up
+// and printed every 10 seconds
+static char printFrameTimes = false;
+
+enum FramePass {
+    passMovingCells = 0,
+    passExtraMovingObjects,
+    passTutorialTrigger,
+    passDrawMovingCells,
+    NUM_FRAME_PASSES
+    };
+
+static const char *framePassNames[ NUM_FRAME_PASSES ] = {
+    "moving cells",
+    "extra moving objects",
+    "tutorial trigger",
+    "draw moving cells" };
+
+static double framePassSeconds[ NUM_FRAME_PASSES ] = { 0, 0, 0, 0 };
+
+static int framePassNumFrames = 0;
+static double framePassLastPrintTime = 0;
+
+static double frameSpriteDraws = 0;
+static double frameAtlasBatches = 0;
+
+
+static double startFramePass() {
+    if( ! printFrameTimes ) {
+        return 0;
+        }
+    return game_getCurrentTime();
+    }
+
+
+static void endFramePass( FramePass inPass, double inStartTime ) {
+    if( ! printFrameTimes ) {
+        return;
+        }
+    framePassSeconds[ inPass ] += game_getCurrentTime() - inStartTime;
+    }
+
+
+static void countFramePasses( int inNumMovingCells, int inNumTutorialCells ) {
+    // always fetch, so counts are reset every frame
+    SpriteDrawStats drawStats = getSpriteDrawStats();
+    
+    if( ! printFrameTimes ) {
+        return;
+        }
+    
+    framePassNumFrames++;
+    
+    frameSpriteDraws += drawStats.spriteDraws;
+    frameAtlasBatches += drawStats.atlasBatches;
+    
+    double curTime = game_getCurrentTime();
+    
+    if( framePassLastPrintTime == 0 ) {
+        framePassLastPrintTime = curTime;
+        }
+    
+    if( curTime - framePassLastPrintTime < 10 ) {
+        return;
+        }
+    
+    printf( "Average map pass times over %d frames "
+            "(%d moving cells, %d tutorial cells):\n", 
+            framePassNumFrames, inNumMovingCells, inNumTutorialCells );
+    
+    for( int p=0; p<NUM_FRAME_PASSES; p++ ) {
+        printf( "    %s:  %.4f ms\n", framePassNames[p],
+                1000 * framePassSeconds[p] / framePassNumFrames );
+        framePassSeconds[p] = 0;
+        }
+    
+    AtlasStats atlasStats = getAtlasStats();
+    
+    printf( "    sprite draw calls:  %.1f now, %.1f if batched by atlas page "
+            "(%d sprites in %d atlas pages, %.0f%% full)\n",
+            frameSpriteDraws / framePassNumFrames,
+            frameAtlasBatches / framePassNumFrames,
+            atlasStats.slotsUsed, atlasStats.pagesUsed,
+            100 * atlasStats.fillFraction );
+    
+    frameSpriteDraws = 0;
+    frameAtlasBatches = 0;
+    
+    SpriteLoadStats loadStats = getSpriteLoadStats();
+    
+    printf( "    sprite loading:  %d decoded on worker (%.3f ms avg, "
+            "%.3f ms max), %d uploaded (%d from pack, %.3f ms per frame), "
+            "backlog %d decoding, %d waiting for upload\n",
+            loadStats.numDecoded,
+            loadStats.numDecoded > 0 
+              ? 1000 * loadStats.decodeSeconds / loadStats.numDecoded : 0,
+            1000 * loadStats.maxDecodeSeconds,
+            loadStats.numUploaded, loadStats.numFromPack,
+            1000 * loadStats.uploadSeconds / framePassNumFrames,
+            loadStats.decodeBacklog, loadStats.uploadBacklog );
+    
+    framePassNumFrames = 0;
+    framePassLastPrintTime = curTime;
+    }
+
+
+
 
 // most recent home at end
 
@@ -498,23 +607,26 @@ static void replaceLastMessageSent( char *inNewMessage ) {
 
 
 
-SimpleVector<unsigned char> serverSocketBuffer;
+MessageFramer serverSocketBuffer;
 
 
 // reads all waiting data from socket and stores it in buffer
 // returns false on socket error
 static char readServerSocketFull( int inServerSocket ) {
 
-    unsigned char buffer[512];
+    // read right into buffer
+    int space;
+    unsigned char *dest = serverSocketBuffer.getWriteSpace( 512, &space );
     
-    int numRead = readFromSocket( inServerSocket, buffer, 512 );
+    int numRead = readFromSocket( inServerSocket, dest, space );
     
     
     while( numRead > 0 ) {
-        serverSocketBuffer.appendArray( buffer, numRead );
+        serverSocketBuffer.commitWrite( numRead );
         numServerBytesRead += numRead;
 
-        numRead = readFromSocket( inServerSocket, buffer, 512 );
+        dest = serverSocketBuffer.getWriteSpace( 512, &space );
+        numRead = readFromSocket( inServerSocket, dest, space );
         }    
 
     if( numRead == -1 ) {
@@ -859,7 +971,8 @@ char *getNextServerMessage() {
         // wait for full binary data chunk to arrive completely
         // after message before we report that the message is ready
 
-        if( serverSocketBuffer.size() >= pendingCompressedChunkSize ) {
+        if( serverSocketBuffer.getNumBytes() >= 
+            pendingCompressedChunkSize ) {
             char *returnMessage = pendingMapChunkMessage;
             pendingMapChunkMessage = NULL;
 
@@ -873,24 +986,18 @@ char *getNextServerMessage() {
         }
     
     if( pendingCMData ) {
-        if( serverSocketBuffer.size() >= pendingCMCompressedSize ) {
+        if( serverSocketBuffer.getNumBytes() >= pendingCMCompressedSize ) {
             pendingCMData = false;
             
+            // in place in buffer
             unsigned char *compressedData = 
-                new unsigned char[ pendingCMCompressedSize ];
-            
-            for( int i=0; i<pendingCMCompressedSize; i++ ) {
-                compressedData[i] = serverSocketBuffer.getElementDirect( i );
-                }
-            serverSocketBuffer.deleteStartElements( pendingCMCompressedSize );
+                serverSocketBuffer.takeBytes( pendingCMCompressedSize );
             
             unsigned char *decompressedMessage =
                 zipDecompress( compressedData, 
                                pendingCMCompressedSize,
                                pendingCMDecompressedSize );
 
-            delete [] compressedData;
-
             if( decompressedMessage == NULL ) {
                 printf( "Decompressing CM message failed\n" );
                 return NULL;
@@ -916,9 +1023,11 @@ char *getNextServerMessage() {
 
     // find first terminal character #
 
-    int index = serverSocketBuffer.getElementIndex( '#' );
+    int messageLength;
+    char *bufferedMessage = 
+        serverSocketBuffer.getNextMessage( &messageLength );
         
-    if( index == -1 ) {
+    if( bufferedMessage == NULL ) {
         return NULL;
         }
 
@@ -936,15 +1045,11 @@ char *getNextServerMessage() {
 
 
     
-    char *message = new char[ index + 1 ];
-    
-    for( int i=0; i<index; i++ ) {
-        message[i] = (char)( serverSocketBuffer.getElementDirect( i ) );
-        }
-    // delete message and terminal character
-    serverSocketBuffer.deleteStartElements( index + 1 );
+    // copy out of buffer, because MC messages are held while
+    // more data is read in
+    char *message = new char[ messageLength + 1 ];
     
-    message[ index ] = '\0';
+    memcpy( message, bufferedMessage, messageLength + 1 );
 
     if( getMessageType( message ) == MAP_CHUNK ) {
         pendingMapChunkMessage = message;
@@ -1213,7 +1318,7 @@ void LivingLifePage::computePathToDest( LiveObject *inObject ) {
             if( mapY >= 0 && mapY < mMapD &&
                 mapX >= 0 && mapX < mMapD ) { 
 
-                int mapI = mapY * mMapD + mapX;
+                int mapI = getMapI( mapX, mapY );
             
                 // note that unknowns (-1) count as blocked too
                 if( mMap[ mapI ] == 0
@@ -1237,7 +1342,7 @@ void LivingLifePage::computePathToDest( LiveObject *inObject ) {
             if( mapY >= 0 && mapY < mMapD &&
                 mapX >= 0 && mapX < mMapD ) { 
 
-                int mapI = mapY * mMapD + mapX;
+                int mapI = getMapI( mapX, mapY );
                 
                 if( mMap[ mapI ] > 0 ) {
                     ObjectRecord *o = getObject( mMap[ mapI ] );
@@ -1646,6 +1751,62 @@ void LivingLifePage::clearMap() {
         
         mMapPlayerPlacedFlags[i] = false;
         }
+    
+    for( int i=0; i<mMapMovingCells.size(); i++ ) {
+        mMapCellMovingFlags[ mMapMovingCells.getElementDirect( i ) ] = false;
+        }
+    mMapMovingCells.deleteAll();
+    
+    for( int i=0; i<mMapTutorialCells.size(); i++ ) {
+        mMapCellTutorialFlags[ mMapTutorialCells.getElementDirect( i ) ] = 
+            false;
+        }
+    mMapTutorialCells.deleteAll();
+    }
+
+
+
+// tutorial page number of an object, or -1 if it's not a tutorial marker
+static int getTutorialPage( int inObjectID, char *outIsFinal = NULL ) {
+    if( inObjectID <= 0 ) {
+        return -1;
+        }
+    
+    ObjectRecord *o = getObject( inObjectID );
+    
+    char *tutLoc = strstr( o->description, "tutorial" );
+    
+    if( tutLoc == NULL ) {
+        return -1;
+        }
+    
+    int tutPage = -1;
+    
+    sscanf( tutLoc, "tutorial %d", &tutPage );
+    
+    if( outIsFinal != NULL ) {
+        *outIsFinal = ( strstr( o->description, "done" ) != NULL );
+        }
+    
+    return tutPage;
+    }
+
+
+
+void LivingLifePage::noteMapCellChanged( int inMapI ) {
+    if( mMapMoveSpeeds[ inMapI ] > 0 &&
+        ! mMapCellMovingFlags[ inMapI ] ) {
+        
+        mMapCellMovingFlags[ inMapI ] = true;
+        mMapMovingCells.push_back( inMapI );
+        }
+    
+    if( ! mMapCellTutorialFlags[ inMapI ] &&
+        getTutorialPage( mMap[ inMapI ] ) != -1 ) {
+        
+        mMapCellTutorialFlags[ inMapI ] = true;
+        mMapTutorialCells.push_back( inMapI );
+        }
     }
 
 
@@ -1657,8 +1818,6 @@ LivingLifePage::LivingLifePage()
           mFirstServerMessagesReceived( 0 ),
           mMapGlobalOffsetSet( false ),
           mMapD( MAP_D ),
-          mMapOffsetX( 0 ),
-          mMapOffsetY( 0 ),
           mEKeyEnabled( false ),
           mEKeyDown( false ),
           mGuiPanelSprite( loadSprite( "guiPanel.tga", false ) ),
@@ -1868,6 +2027,7 @@ LivingLifePage::LivingLifePage()
     mLiveTutorialTriggerNumber = -1;
 
 
+    setMapOffset( 0, 0 );
 
     mMap = new int[ mMapD * mMapD ];
     mMapBiomes = new int[ mMapD * mMapD ];
@@ -1902,6 +2062,12 @@ LivingLifePage::LivingLifePage()
     
     mMapPlayerPlacedFlags = new char[ mMapD * mMapD ];
     
+    mMapCellMovingFlags = new char[ mMapD * mMapD ];
+    mMapCellTutorialFlags = new char[ mMapD * mMapD ];
+    
+    memset( mMapCellMovingFlags, false, mMapD * mMapD );
+    memset( mMapCellTutorialFlags, false, mMapD * mMapD );
+    
 
     clearMap();
 
@@ -2085,6 +2251,9 @@ LivingLifePage::~LivingLifePage() {
     delete [] mMapCellDrawnFlags;
 
     delete [] mMapPlayerPlacedFlags;
+    
+    delete [] mMapCellMovingFlags;
+    delete [] mMapCellTutorialFlags;
 
     if( nextActionMessageToSend != NULL ) {
         delete [] nextActionMessageToSend;
@@ -2765,7 +2934,7 @@ void LivingLifePage::drawMapCell( int inMapI,
         
         if( mCurMouseOverID > 0 &&
             ! mCurMouseOverSelf &&
-            mCurMouseOverSpot.y * mMapD + mCurMouseOverSpot.x == inMapI ) {
+            getMapI( mCurMouseOverSpot.x, mCurMouseOverSpot.y ) == inMapI ) {
             
             if( mCurMouseOverBehind ) {
                 highlight = inHighlightOnly;
@@ -2780,7 +2949,7 @@ void LivingLifePage::drawMapCell( int inMapI,
             for( int i=0; i<mPrevMouseOverSpots.size(); i++ ) {
                 GridPos prev = mPrevMouseOverSpots.getElementDirect( i );
                 
-                if( prev.y * mMapD + prev.x == inMapI ) {
+                if( getMapI( prev.x, prev.y ) == inMapI ) {
                     if( mPrevMouseOverSpotsBehind.getElementDirect( i ) ) {
                         highlight = inHighlightOnly;
                         }
@@ -2995,6 +3164,102 @@ FloatColor trailColor = { 0, 0.5, 0, 0.25 };
 
 
 
+void LivingLifePage::setMapOffset( int inX, int inY ) {
+    mMapOffsetX = inX;
+    mMapOffsetY = inY;
+    
+    // array spot of map 0,0 is world pos of map 0,0, wrapped
+    mMapWrapX = ( mMapOffsetX - mMapD / 2 ) % mMapD;
+    mMapWrapY = ( mMapOffsetY - mMapD / 2 ) % mMapD;
+    
+    if( mMapWrapX < 0 ) {
+        mMapWrapX += mMapD;
+        }
+    if( mMapWrapY < 0 ) {
+        mMapWrapY += mMapD;
+        }
+    }
+
+
+
+int LivingLifePage::getMapI( int inMapX, int inMapY ) {
+    int x = inMapX + mMapWrapX;
+    int y = inMapY + mMapWrapY;
+    
+    if( x >= mMapD ) {
+        x -= mMapD;
+        }
+    if( y >= mMapD ) {
+        y -= mMapD;
+        }
+    
+    return y * mMapD + x;
+    }
+
+
+
+int LivingLifePage::getMapX( int inMapI ) {
+    int x = inMapI % mMapD - mMapWrapX;
+    
+    if( x < 0 ) {
+        x += mMapD;
+        }
+    return x;
+    }
+
+
+
+int LivingLifePage::getMapY( int inMapI ) {
+    int y = inMapI / mMapD - mMapWrapY;
+    
+    if( y < 0 ) {
+        y += mMapD;
+        }
+    return y;
+    }
+
+
+
+void LivingLifePage::resetMapCell( int inMapI, int inWorldX, int inWorldY ) {
+    // starts uknown, not empty
+    mMap[inMapI] = -1;
+    mMapBiomes[inMapI] = -1;
+    mMapFloors[inMapI] = -1;
+    
+    // each cell is different, but always the same
+    mMapAnimationFrameCount[inMapI] =
+        lrint( getXYRandom( inWorldX, inWorldY ) * 10000 );
+    mMapAnimationLastFrameCount[inMapI] = mMapAnimationFrameCount[inMapI];
+    
+    mMapAnimationFrozenRotFrameCount[inMapI] = 0;
+    mMapAnimationFrozenRotFrameCountUsed[inMapI] = false;
+    
+    mMapFloorAnimationFrameCount[inMapI] =
+        lrint( getXYRandom( inWorldX, inWorldY ) * 13853 );
+    
+    mMapCurAnimType[inMapI] = ground;
+    mMapLastAnimType[inMapI] = ground;
+    mMapLastAnimFade[inMapI] = 0;
+    
+    mMapDropOffsets[inMapI].x = 0;
+    mMapDropOffsets[inMapI].y = 0;
+    mMapDropRot[inMapI] = 0;
+    mMapDropSounds[inMapI] = blankSoundUsage;
+    
+    mMapMoveOffsets[inMapI].x = 0;
+    mMapMoveOffsets[inMapI].y = 0;
+    mMapMoveSpeeds[inMapI] = 0;
+    
+    mMapTileFlips[inMapI] = false;
+    
+    mMapContainedStacks[inMapI].deleteAll();
+    mMapSubContainedStacks[inMapI].deleteAll();
+    
+    mMapPlayerPlacedFlags[inMapI] = false;
+    }
+
+
+
 int LivingLifePage::getMapIndex( int inWorldX, int inWorldY ) {
     int mapTargetX = inWorldX - mMapOffsetX + mMapD / 2;
     int mapTargetY = inWorldY - mMapOffsetY + mMapD / 2;
@@ -3002,7 +3267,7 @@ int LivingLifePage::getMapIndex( int inWorldX, int inWorldY ) {
     if( mapTargetY >= 0 && mapTargetY < mMapD &&
         mapTargetX >= 0 && mapTargetX < mMapD ) {
                     
-        return mapTargetY * mMapD + mapTargetX;
+        return getMapI( mapTargetX, mapTargetY );
         }
     return -1;
     }
@@ -3911,7 +4176,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
 
         
         for( int x=xStartFloor; x<=xEndFloor; x++ ) {
-            int mapI = y * mMapD + x;
+            int mapI = getMapI( x, y );
             
             char inBounds = isInBounds( x, y, mMapD );
 
@@ -3995,7 +4260,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
                                  nX <= x + s->numTilesWide; nX++ ) {
                                 
                                 if( nX >=0 && nX < mMapD ) {
-                                    int nI = nY * mMapD + nX;
+                                    int nI = getMapI( nX, nY );
                                     
                                     int nB = -1;
                                     
@@ -4036,7 +4301,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
                                      sX < x + s->numTilesWide; sX++ ) {
                                 
                                     if( sX >=0 && sX < mMapD ) {
-                                        int sI = sY * mMapD + sX;
+                                        int sI = getMapI( sX, sY );
                                         
                                         mMapCellDrawnFlags[sI] = true;
                                         }
@@ -4055,14 +4320,14 @@ void LivingLifePage::draw( doublePair inViewCenter,
                     int diagB = -1;
                     
                     if( isInBounds( x -1, y, mMapD ) ) {    
-                        leftB = mMapBiomes[ mapI - 1 ];
+                        leftB = mMapBiomes[ getMapI( x - 1, y ) ];
                         }
                     if( isInBounds( x, y + 1, mMapD ) ) {    
-                        aboveB = mMapBiomes[ mapI + mMapD ];
+                        aboveB = mMapBiomes[ getMapI( x, y + 1 ) ];
                         }
                     
                     if( isInBounds( x + 1, y + 1, mMapD ) ) {    
-                        diagB = mMapBiomes[ mapI + mMapD + 1 ];
+                        diagB = mMapBiomes[ getMapI( x + 1, y + 1 ) ];
                         }
                     
                     if( leftB == b &&
@@ -4101,7 +4366,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
             int worldX = x + mMapOffsetX - mMapD / 2;
 
 
-            int mapI = y * mMapD + x;
+            int mapI = getMapI( x, y );
 
             int oID = mMapFloors[mapI];
 
@@ -4130,15 +4395,18 @@ void LivingLifePage::draw( doublePair inViewCenter,
                 
                 if( cellOID > 0 && getObject( cellOID )->floorHugging ) {
                     
-                    if( x > 0 && mMapFloors[ mapI - 1 ] > 0 ) {
+                    int leftI = getMapI( x - 1, y );
+                    int rightI = getMapI( x + 1, y );
+                    
+                    if( x > 0 && mMapFloors[ leftI ] > 0 ) {
                         // floor to our left
-                        passIDs[1] = mMapFloors[ mapI - 1 ];
+                        passIDs[1] = mMapFloors[ leftI ];
                         drawHuggingFloor = true;
                         }
                     
-                    if( x < mMapD - 1 && mMapFloors[ mapI + 1 ] > 0 ) {
+                    if( x < mMapD - 1 && mMapFloors[ rightI ] > 0 ) {
                         // floor to our right
-                        passIDs[2] = mMapFloors[ mapI + 1 ];
+                        passIDs[2] = mMapFloors[ rightI ];
                         drawHuggingFloor = true;
                         
                         }
@@ -4363,7 +4631,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
         int screenX = 
             CELL_D * ( mCurMouseOverCell.x + mMapOffsetX - mMapD / 2 );        
         
-        int mapI = mCurMouseOverCell.y * mMapD + mCurMouseOverCell.x;
+        int mapI = getMapI( mCurMouseOverCell.x, mCurMouseOverCell.y );
         
         int id = mMap[mapI];
         
@@ -4422,7 +4690,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
             CELL_D * ( prev.x + mMapOffsetX - mMapD / 2 );        
 
         
-        int mapI = prev.y * mMapD + prev.x;
+        int mapI = getMapI( prev.x, prev.y );
         
         int id = mMap[mapI];
         
@@ -4727,20 +4995,22 @@ void LivingLifePage::draw( doublePair inViewCenter,
     
     memset( cellDrawn, false, MAP_NUM_CELLS );
     
-    for( int y=0; y<mMapD; y++ ) {
-        for( int x=0; x<mMapD; x++ ) {
-            int mapI = y * mMapD + x;
+    double passStartTime = startFramePass();
+    
+    for( int m=0; m<mMapMovingCells.size(); m++ ) {
+        int mapI = mMapMovingCells.getElementDirect( m );
+        
+        if( mMapMoveSpeeds[ mapI ] > 0 &&
+            mMap[ mapI ] > 0 ) {
             
-            if( mMap[ mapI ] > 0 &&
-                mMapMoveSpeeds[ mapI ] > 0 ) {
-                
-                movingObjectsIndices[ numMoving ] = mapI;
-
-                numMoving++;
-                }
+            movingObjectsIndices[ numMoving ] = mapI;
+            
+            numMoving++;
             }
         }
     
+    endFramePass( passDrawMovingCells, passStartTime );
+    
 
     for( int y=yEnd; y>=yStart; y-- ) {
         
@@ -4756,7 +5026,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
             int worldX = x + mMapOffsetX - mMapD / 2;
 
 
-            int mapI = y * mMapD + x;
+            int mapI = getMapI( x, y );
 
             if( cellDrawn[mapI] ) {
                 continue;
@@ -4922,8 +5192,8 @@ void LivingLifePage::draw( doublePair inViewCenter,
                 }
             
 
-            int oX = mapI % mMapD;
-            int oY = mapI / mMapD;
+            int oX = getMapX( mapI );
+            int oY = getMapY( mapI );
             
             int movingX = lrint( oX + mMapMoveOffsets[mapI].x );
 
@@ -4989,7 +5259,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
                 int mapX = movingWorldPos.x - mMapOffsetX + mMapD / 2;
                 int mapY = movingWorldPos.y - mMapOffsetY + mMapD / 2;
                     
-                int mapI = mapY * mMapD + mapX;
+                int mapI = getMapI( mapX, mapY );
 
 
                 int movingScreenX = CELL_D * movingWorldPos.x;
@@ -5087,7 +5357,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
 
         // first permanent, non-wall objects
         for( int x=xStart; x<=xEnd; x++ ) {
-            int mapI = y * mMapD + x;
+            int mapI = getMapI( x, y );
             
             if( cellDrawn[ mapI ] ) {
                 continue;
@@ -5113,7 +5383,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
 
         // then non-permanent, non-wall objects
         for( int x=xStart; x<=xEnd; x++ ) {
-            int mapI = y * mMapD + x;
+            int mapI = getMapI( x, y );
             
             if( cellDrawn[ mapI ] ) {
                 continue;
@@ -5147,7 +5417,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
 
         // then permanent, wall objects
         for( int x=xStart; x<=xEnd; x++ ) {
-            int mapI = y * mMapD + x;
+            int mapI = getMapI( x, y );
             
             if( cellDrawn[ mapI ] ) {
                 continue;
@@ -5178,7 +5448,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
         
         int screenY = CELL_D * worldY;
         
-        int mapI = mCurMouseOverSpot.y * mMapD + mCurMouseOverSpot.x;
+        int mapI = getMapI( mCurMouseOverSpot.x, mCurMouseOverSpot.y );
         int screenX = 
             CELL_D * ( mCurMouseOverSpot.x + mMapOffsetX - mMapD / 2 );
         
@@ -5195,7 +5465,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
         
             int screenY = CELL_D * worldY;
         
-            int mapI = prev.y * mMapD + prev.x;
+            int mapI = getMapI( prev.x, prev.y );
             int screenX = 
                 CELL_D * ( prev.x + mMapOffsetX - mMapD / 2 );
         
@@ -5458,7 +5728,7 @@ void LivingLifePage::draw( doublePair inViewCenter,
 
                     if( worldX >= xLimit ) {
                         
-                        int mapI = y * mMapD + x;
+                        int mapI = getMapI( x, y );
                     
                         int screenX = CELL_D * worldX;
                         
@@ -8000,11 +8270,22 @@ void LivingLifePage::step() {
     
 
 
+    countFramePasses( mMapMovingCells.size(), mMapTutorialCells.size() );
+    
     // move moving objects
-    int numCells = mMapD * mMapD;
+    double passStartTime = startFramePass();
     
-    for( int i=0; i<numCells; i++ ) {
-                
+    for( int m=0; m<mMapMovingCells.size(); m++ ) {
+        int i = mMapMovingCells.getElementDirect( m );
+        
+        if( mMapMoveSpeeds[i] <= 0 ) {
+            // stopped, or cell reset since
+            mMapCellMovingFlags[i] = false;
+            mMapMovingCells.deleteElement( m );
+            m--;
+            continue;
+            }
+        
         if( mMapMoveSpeeds[i] > 0 &&
             ( mMapMoveOffsets[ i ].x != 0 ||
               mMapMoveOffsets[ i ].y != 0  ) ) {
@@ -8047,7 +8328,12 @@ void LivingLifePage::step() {
         }
     
     
+    endFramePass( passMovingCells, passStartTime );
+    
+    
     // step extra moving objects
+    passStartTime = startFramePass();
+    
     for( int i=0; i<mMapExtraMovingObjects.size(); i++ ) {
         
         ExtraMapObject *o = mMapExtraMovingObjects.getElement( i );
@@ -8087,6 +8373,8 @@ void LivingLifePage::step() {
                 putInMap( mapI, o );
                 mMap[ mapI ] = 
                     mMapExtraMovingObjectsDestObjectIDs.getElementDirect( i );
+                
+                noteMapCellChanged( mapI );
                 }
             
             mMapExtraMovingObjects.deleteElement( i );
@@ -8101,6 +8389,8 @@ void LivingLifePage::step() {
             }
         }
     
+    endFramePass( passExtraMovingObjects, passStartTime );
+    
 
 
 
@@ -8531,62 +8821,57 @@ void LivingLifePage::step() {
     if( mTutorialNumber > 0 && ourObject != NULL ) {
         
         // search map for closest tutorial trigger
+        passStartTime = startFramePass();
 
         double closeDist = 999999;
         int closestNumber = -1;
 
         char closestIsFinal = false;
         
-
-        for( int y=0; y<mMapD; y++ ) {
+        // ties go to lowest y, then lowest x, as if whole map was
+        // scanned in order
+        int closestX = mMapD;
+        int closestY = mMapD;
         
+
+        for( int t=0; t<mMapTutorialCells.size(); t++ ) {
+            int mapI = mMapTutorialCells.getElementDirect( t );
+            
+            char isFinal;
+            int tutPage = getTutorialPage( mMap[ mapI ], &isFinal );
+            
+            if( tutPage == -1 ) {
+                // marker gone, or cell reset since
+                mMapCellTutorialFlags[ mapI ] = false;
+                mMapTutorialCells.deleteElement( t );
+                t--;
+                continue;
+                }
+            
+            int x = getMapX( mapI );
+            int y = getMapY( mapI );
+            
+            int worldX = x + mMapOffsetX - mMapD / 2;
             int worldY = y + mMapOffsetY - mMapD / 2;
             
-            for( int x=0; x<mMapD; x++ ) {
-                
-                int worldX = x + mMapOffsetX - mMapD / 2;
-                
-                doublePair worldPos  = { (double)worldX, (double)worldY };
-                
-                double dist = distance( worldPos, ourObject->currentPos );
+            doublePair worldPos  = { (double)worldX, (double)worldY };
+            
+            double dist = distance( worldPos, ourObject->currentPos );
+            
+            if( dist < closeDist ||
+                ( dist == closeDist &&
+                  ( y < closestY || ( y == closestY && x < closestX ) ) ) ) {
                 
-                if( dist < closeDist ) {
-                    
-                    int mapI = y * mMapD + x;
-                    
-                    int mapID = mMap[ mapI ];
-                    
-                    if( mapID > 0 ) {
-                        
-                        ObjectRecord *mapO = getObject( mapID );
-                        
-                        char *tutLoc = strstr( mapO->description, "tutorial" );
-                        if( tutLoc != NULL ) {
-                            
-                            int tutPage = -1;
-                            
-                            sscanf( tutLoc, "tutorial %d", &tutPage );
-                            
-
-                            if( tutPage != -1 ) {
-                                
-                                closeDist = dist;
-                                closestNumber = tutPage;
-                                
-                                if( strstr( mapO->description, "done" ) 
-                                    != NULL ) {
-                                    closestIsFinal = true;
-                                    }
-                                else {
-                                    closestIsFinal = false;
-                                    }
-                                }
-                            }
-                        }
-                    }
+                closeDist = dist;
+                closestNumber = tutPage;
+                closestIsFinal = isFinal;
+                closestX = x;
+                closestY = y;
                 }
             }
         
+        endFramePass( passTutorialTrigger, passStartTime );
+        
 
         if( closeDist > 4 &&
             mLiveTutorialTriggerNumber != -1 ) {
@@ -8898,12 +9183,17 @@ void LivingLifePage::step() {
             int maxPlayers = 0;
             mRequiredVersion = versionNumber;
             
+            // older servers don't list a map chunk format, and
+            // don't accept one in LOGIN
+            int serverChunkFormat = -1;
+            
             sscanf( message, 
                     "SN\n"
                     "%d/%d\n"
                     "%d\n"
+                    "%d\n"
                     "%d\n", &currentPlayers, &maxPlayers, &number, 
-                    &mRequiredVersion );
+                    &mRequiredVersion, &serverChunkFormat );
             
 
             if( mRequiredVersion > versionNumber ||
@@ -8948,22 +9238,40 @@ void LivingLifePage::step() {
             // So pad the email with up to 80 space characters
             // Thus, the login message is always this same length
             
+            char *formatString;
+            
+            if( serverChunkFormat >= MAP_CHUNK_FORMAT_TEXT ) {
+                int format = MAP_CHUNK_FORMAT_LATEST;
+                
+                if( serverChunkFormat < format ) {
+                    format = serverChunkFormat;
+                    }
+                formatString = autoSprintf( " %d", format );
+                }
+            else {
+                formatString = stringDuplicate( "" );
+                }
+            
             char *outMessage;
             if( strlen( userEmail ) <= 80 ) {    
-                outMessage = autoSprintf( "LOGIN %-80s %s %s %d#",
+                outMessage = autoSprintf( "LOGIN %-80s %s %s %d%s#",
                                           userEmail, pwHash, keyHash,
-                                          mTutorialNumber );
+                                          mTutorialNumber,
+                                          formatString );
                 }
             else {
                 // their email is too long for this trick
                 // don't cut it off.
                 // but note that the playback will fail if email.ini
                 // doesn't match on the playback machine
-                outMessage = autoSprintf( "LOGIN %s %s %s %d#",
+                outMessage = autoSprintf( "LOGIN %s %s %s %d%s#",
                                           userEmail, pwHash, keyHash,
-                                          mTutorialNumber );
+                                          mTutorialNumber,
+                                          formatString );
                 }
             
+            delete [] formatString;
+            
             delete [] pwHash;
             delete [] keyHash;
 
@@ -9146,237 +9454,42 @@ void LivingLifePage::step() {
             int newMapOffsetX = x + sizeX/2;
             int newMapOffsetY = y + sizeY/2;
             
-            // move old cached map cells over to line up with new center
-
-            int xMove = mMapOffsetX - newMapOffsetX;
-            int yMove = mMapOffsetY - newMapOffsetY;
-            
-            int *newMap = new int[ mMapD * mMapD ];
-            int *newMapBiomes = new int[ mMapD * mMapD ];
-            int *newMapFloors = new int[ mMapD * mMapD ];
-            
-
-            double *newMapAnimationFrameCount = new double[ mMapD * mMapD ];
-            double *newMapAnimationLastFrameCount = new double[ mMapD * mMapD ];
-
-            double *newMapAnimationFrozenRotFameCount = 
-                new double[ mMapD * mMapD ];
-
-            char *newMapAnimationFrozenRotFameCountUsed = 
-                new char[ mMapD * mMapD ];
-
-            int *newMapFloorAnimationFrameCount = new int[ mMapD * mMapD ];
-        
-            AnimType *newMapCurAnimType = new AnimType[ mMapD * mMapD ];
-            AnimType *newMapLastAnimType = new AnimType[ mMapD * mMapD ];
-            double *newMapLastAnimFade = new double[ mMapD * mMapD ];
-            
-            doublePair *newMapDropOffsets = new doublePair[ mMapD * mMapD ];
-            double *newMapDropRot = new double[ mMapD * mMapD ];
-            SoundUsage *newMapDropSounds = new SoundUsage[ mMapD * mMapD ];
-
-            doublePair *newMapMoveOffsets = new doublePair[ mMapD * mMapD ];
-            double *newMapMoveSpeeds = new double[ mMapD * mMapD ];
-
-
-            char *newMapTileFlips= new char[ mMapD * mMapD ];
+            // map arrays wrap around, so cells that are still in our
+            // sub-map stay where they are
+            // only reset the ones that scrolled in, which are holding
+            // cells that scrolled out
+            int oldWorldStartX = mMapOffsetX - mMapD / 2;
+            int oldWorldStartY = mMapOffsetY - mMapD / 2;
             
-            SimpleVector<int> *newMapContainedStacks = 
-                new SimpleVector<int>[ mMapD * mMapD ];
+            setMapOffset( newMapOffsetX, newMapOffsetY );
             
-            SimpleVector< SimpleVector<int> > *newMapSubContainedStacks = 
-                new SimpleVector< SimpleVector<int> >[ mMapD * mMapD ];
-
-            char *newMapPlayerPlacedFlags = new char[ mMapD * mMapD ];
-
+            int worldStartX = mMapOffsetX - mMapD / 2;
+            int worldStartY = mMapOffsetY - mMapD / 2;
             
-            for( int i=0; i<mMapD *mMapD; i++ ) {
-                // starts uknown, not empty
-                newMap[i] = -1;
-                newMapBiomes[i] = -1;
-                newMapFloors[i] = -1;
-
-                int newX = i % mMapD;
-                int newY = i / mMapD;
-
-                int worldX = newX + mMapOffsetX - mMapD / 2;
-                int worldY = newY + mMapOffsetY - mMapD / 2;
-                
-                // each cell is different, but always the same
-                newMapAnimationFrameCount[i] =
-                    lrint( getXYRandom( worldX, worldY ) * 10000 );
-                newMapAnimationLastFrameCount[i] =
-                    newMapAnimationFrameCount[i];
+            for( int mapY=0; mapY<mMapD; mapY++ ) {
+                int worldY = worldStartY + mapY;
                 
-                newMapAnimationFrozenRotFameCount[i] = 0;
-                newMapAnimationFrozenRotFameCountUsed[i] = false;
+                int oldMapY = worldY - oldWorldStartY;
                 
-                newMapFloorAnimationFrameCount[i] =
-                    lrint( getXYRandom( worldX, worldY ) * 13853 );
+                char rowWasInMap = ( oldMapY >= 0 && oldMapY < mMapD );
                 
-                
-
-                newMapCurAnimType[i] = ground;
-                newMapLastAnimType[i] = ground;
-                newMapLastAnimFade[i] = 0;
-                newMapDropOffsets[i].x = 0;
-                newMapDropOffsets[i].y = 0;
-                newMapDropRot[i] = 0;
-                
-                newMapDropSounds[i] = blankSoundUsage;
-                
-                newMapMoveOffsets[i].x = 0;
-                newMapMoveOffsets[i].y = 0;
-                newMapMoveSpeeds[i] = 0;
-
-                newMapTileFlips[i] = false;
-                newMapPlayerPlacedFlags[i] = false;
-                
-
-                
-                int oldX = newX - xMove;
-                int oldY = newY - yMove;
-                
-                if( oldX >= 0 && oldX < mMapD
-                    &&
-                    oldY >= 0 && oldY < mMapD ) {
+                for( int mapX=0; mapX<mMapD; mapX++ ) {
+                    int worldX = worldStartX + mapX;
                     
-                    int oI = oldY * mMapD + oldX;
-
-                    newMap[i] = mMap[oI];
-                    newMapBiomes[i] = mMapBiomes[oI];
-                    newMapFloors[i] = mMapFloors[oI];
-
-                    newMapAnimationFrameCount[i] = mMapAnimationFrameCount[oI];
-                    newMapAnimationLastFrameCount[i] = 
-                        mMapAnimationLastFrameCount[oI];
-
-                    newMapAnimationFrozenRotFameCount[i] = 
-                        mMapAnimationFrozenRotFrameCount[oI];
-
-                    newMapAnimationFrozenRotFameCountUsed[i] = 
-                        mMapAnimationFrozenRotFrameCountUsed[oI];
-
-                    newMapFloorAnimationFrameCount[i] = 
-                        mMapFloorAnimationFrameCount[oI];
+                    int oldMapX = worldX - oldWorldStartX;
                     
-                    newMapCurAnimType[i] = mMapCurAnimType[oI];
-                    newMapLastAnimType[i] = mMapLastAnimType[oI];
-                    newMapLastAnimFade[i] = mMapLastAnimFade[oI];
-                    newMapDropOffsets[i] = mMapDropOffsets[oI];
-                    newMapDropRot[i] = mMapDropRot[oI];
-                    newMapDropSounds[i] = mMapDropSounds[oI];
-
-                    newMapMoveOffsets[i] = mMapMoveOffsets[oI];
-                    newMapMoveSpeeds[i] = mMapMoveSpeeds[oI];
-
-                    newMapTileFlips[i] = mMapTileFlips[oI];
+                    if( rowWasInMap && oldMapX >= 0 && oldMapX < mMapD ) {
+                        continue;
+                        }
                     
-
-                    newMapContainedStacks[i] = mMapContainedStacks[oI];
-                    newMapSubContainedStacks[i] = mMapSubContainedStacks[oI];
-
-                    newMapPlayerPlacedFlags[i] = 
-                        mMapPlayerPlacedFlags[oI];
+                    resetMapCell( getMapI( mapX, mapY ), worldX, worldY );
                     }
                 }
             
-            memcpy( mMap, newMap, mMapD * mMapD * sizeof( int ) );
-            memcpy( mMapBiomes, newMapBiomes, mMapD * mMapD * sizeof( int ) );
-            memcpy( mMapFloors, newMapFloors, mMapD * mMapD * sizeof( int ) );
-
-            memcpy( mMapAnimationFrameCount, newMapAnimationFrameCount, 
-                    mMapD * mMapD * sizeof( double ) );
-            memcpy( mMapAnimationLastFrameCount, 
-                    newMapAnimationLastFrameCount, 
-                    mMapD * mMapD * sizeof( double ) );
-
-            memcpy( mMapAnimationFrozenRotFrameCount, 
-                    newMapAnimationFrozenRotFameCount, 
-                    mMapD * mMapD * sizeof( double ) );
-
-            memcpy( mMapAnimationFrozenRotFrameCountUsed, 
-                    newMapAnimationFrozenRotFameCountUsed, 
-                    mMapD * mMapD * sizeof( char ) );
-
-            
-            memcpy( mMapFloorAnimationFrameCount, 
-                    newMapFloorAnimationFrameCount, 
-                    mMapD * mMapD * sizeof( int ) );
-
-            
-            memcpy( mMapCurAnimType, newMapCurAnimType, 
-                    mMapD * mMapD * sizeof( AnimType ) );
-            memcpy( mMapLastAnimType, newMapLastAnimType,
-                    mMapD * mMapD * sizeof( AnimType ) );
-            memcpy( mMapLastAnimFade, newMapLastAnimFade,
-                    mMapD * mMapD * sizeof( double ) );
-            memcpy( mMapDropOffsets, newMapDropOffsets,
-                    mMapD * mMapD * sizeof( doublePair ) );
-            memcpy( mMapDropRot, newMapDropRot,
-                    mMapD * mMapD * sizeof( double ) );
-            memcpy( mMapDropSounds, newMapDropSounds,
-                    mMapD * mMapD * sizeof( SoundUsage ) );
-
-            memcpy( mMapMoveOffsets, newMapMoveOffsets,
-                    mMapD * mMapD * sizeof( doublePair ) );
-            memcpy( mMapMoveSpeeds, newMapMoveSpeeds,
-                    mMapD * mMapD * sizeof( double ) );
-
-            
-            memcpy( mMapTileFlips, newMapTileFlips,
-                    mMapD * mMapD * sizeof( char ) );
-            
-            // can't memcpy vectors
-            // need to assign them so copy constructors are invoked
-            for( int i=0; i<mMapD *mMapD; i++ ) {
-                mMapContainedStacks[i] = newMapContainedStacks[i];
-                mMapSubContainedStacks[i] = newMapSubContainedStacks[i];
-                }
-            
-
-            memcpy( mMapPlayerPlacedFlags, newMapPlayerPlacedFlags,
-                    mMapD * mMapD * sizeof( char ) );
-            
-            delete [] newMap;
-            delete [] newMapBiomes;
-            delete [] newMapFloors;
-            delete [] newMapAnimationFrameCount;
-            delete [] newMapAnimationLastFrameCount;
-            delete [] newMapAnimationFrozenRotFameCount;
-            delete [] newMapAnimationFrozenRotFameCountUsed;
-            delete [] newMapFloorAnimationFrameCount;
-            
-            delete [] newMapCurAnimType;
-            delete [] newMapLastAnimType;
-            delete [] newMapLastAnimFade;
-            delete [] newMapDropOffsets;
-            delete [] newMapDropRot;
-            delete [] newMapDropSounds;
-
-            delete [] newMapMoveOffsets;
-            delete [] newMapMoveSpeeds;
-            
-            delete [] newMapTileFlips;
-            delete [] newMapContainedStacks;
-            delete [] newMapSubContainedStacks;
-            
-            delete [] newMapPlayerPlacedFlags;
-            
-            
-
-            mMapOffsetX = newMapOffsetX;
-            mMapOffsetY = newMapOffsetY;
-            
             
+            // in place in buffer
             unsigned char *compressedChunk = 
-                new unsigned char[ compressedSize ];
-    
-            
-            for( int i=0; i<compressedSize; i++ ) {
-                compressedChunk[i] = serverSocketBuffer.getElementDirect( i );
-                }
-            serverSocketBuffer.deleteStartElements( compressedSize );
+                serverSocketBuffer.takeBytes( compressedSize );
 
             
             unsigned char *decompressedChunk =
@@ -9384,13 +9497,79 @@ void LivingLifePage::step() {
                                compressedSize,
                                binarySize );
             
-            delete [] compressedChunk;
+            char chunkDecompressed = ( decompressedChunk != NULL );
             
             if( decompressedChunk == NULL ) {
                 printf( "Decompressing chunk failed\n" );
                 }
-            else {
+            else if( binarySize > 0 && 
+                     decompressedChunk[0] == MAP_CHUNK_FORMAT_BINARY ) {
+                
+                int numCells = sizeX * sizeY;
+                
+                int *cellBiomes = new int[ numCells ];
+                int *cellFloors = new int[ numCells ];
+                int *cellObjects = new int[ numCells ];
+                SimpleVector<int> *cellContained = 
+                    new SimpleVector<int>[ numCells ];
+                SimpleVector< SimpleVector<int> > *cellSubContained =
+                    new SimpleVector< SimpleVector<int> >[ numCells ];
+                
+                if( ! decodeBinaryChunk( decompressedChunk, binarySize,
+                                         numCells,
+                                         cellBiomes, cellFloors, cellObjects,
+                                         cellContained, cellSubContained ) ) {
+                    printf( "Decoding binary map chunk failed\n" );
+                    }
+                else {
+                    for( int i=0; i<numCells; i++ ) {
+                        int cX = i % sizeX;
+                        int cY = i / sizeX;
+                        
+                        int mapX = cX + x - mMapOffsetX + mMapD / 2;
+                        int mapY = cY + y - mMapOffsetY + mMapD / 2;
+                        
+                        if( mapX >= 0 && mapX < mMapD
+                            &&
+                            mapY >= 0 && mapY < mMapD ) {
+                            
+                            int mapI = getMapI( mapX, mapY );
+                            int oldMapID = mMap[mapI];
+                            
+                            mMapBiomes[mapI] = cellBiomes[i];
+                            mMapFloors[mapI] = cellFloors[i];
+                            mMap[mapI] = cellObjects[i];
+
+                            if( mMap[mapI] != oldMapID ) {
+                                // our placement status cleared
+                                mMapPlayerPlacedFlags[mapI] = false;
+                                }
+                            
+                            noteMapCellChanged( mapI );
+                            
+                            mMapContainedStacks[mapI].deleteAll();
+                            mMapSubContainedStacks[mapI].deleteAll();
+                            
+                            for( int c=0; c<cellContained[i].size(); c++ ) {
+                                mMapContainedStacks[mapI].push_back(
+                                    cellContained[i].getElementDirect( c ) );
+                                mMapSubContainedStacks[mapI].push_back(
+                                    cellSubContained[i].getElementDirect( 
+                                        c ) );
+                                }
+                            }
+                        }
+                    }
+                
+                delete [] decompressedChunk;
                 
+                delete [] cellBiomes;
+                delete [] cellFloors;
+                delete [] cellObjects;
+                delete [] cellContained;
+                delete [] cellSubContained;
+                }
+            else {
                 unsigned char *binaryChunk = 
                     new unsigned char[ binarySize + 1 ];
             
@@ -9399,7 +9578,7 @@ void LivingLifePage::step() {
                 delete [] decompressedChunk;
  
             
-                // for now, binary chunk is actually just ASCII
+                // text format
                 binaryChunk[ binarySize ] = '\0';
             
                 
@@ -9425,7 +9604,7 @@ void LivingLifePage::step() {
                             mapY >= 0 && mapY < mMapD ) {
                             
                             
-                            int mapI = mapY * mMapD + mapX;
+                            int mapI = getMapI( mapX, mapY );
                             int oldMapID = mMap[mapI];
                             
                             sscanf( tokens->getElementDirect(i),
@@ -9438,6 +9617,8 @@ void LivingLifePage::step() {
                                 // our placement status cleared
                                 mMapPlayerPlacedFlags[mapI] = false;
                                 }
+                            
+                            noteMapCellChanged( mapI );
 
                             mMapContainedStacks[mapI].deleteAll();
                             mMapSubContainedStacks[mapI].deleteAll();
@@ -9498,6 +9679,9 @@ void LivingLifePage::step() {
                 
                 tokens->deallocateStringElements();
                 delete tokens;
+                }
+            
+            if( chunkDecompressed ) {
                 
                 if( !( mFirstServerMessagesReceived & 1 ) ) {
                     // first map chunk just recieved
@@ -9615,7 +9799,7 @@ void LivingLifePage::step() {
                         &&
                         mapY >= 0 && mapY < mMapD ) {
                         
-                        int mapI = mapY * mMapD + mapX;
+                        int mapI = getMapI( mapX, mapY );
                         
                         int oldFloor = mMapFloors[ mapI ];
 
@@ -9872,6 +10056,8 @@ void LivingLifePage::step() {
                             mMapMoveOffsets[mapI].y = 0;
                             }
                         
+                        noteMapCellChanged( mapI );
+                        
                         
                         TransRecord *nextDecayTrans = getTrans( -1, newID );
                         
@@ -10004,7 +10190,7 @@ void LivingLifePage::step() {
                                                 mapRY >= 0 && mapRY < mMapD ) {
                         
                                                 int mapRI = 
-                                                    mapRY * mMapD + mapRX;
+                                                    getMapI( mapRX, mapRY );
                         
                                                 int cellID = mMap[ mapRI ];
                                                 
@@ -11088,8 +11274,8 @@ void LivingLifePage::step() {
                                         mapHeldOriginY < mMapD ) {
                                         
                                         int mapHeldOriginI = 
-                                            mapHeldOriginY * mMapD + 
-                                            mapHeldOriginX;
+                                            getMapI( mapHeldOriginX,
+                                                     mapHeldOriginY );
                                         
                                         if( mMapMoveSpeeds[ mapHeldOriginI ]
                                             > 0 &&
@@ -11139,7 +11325,7 @@ void LivingLifePage::step() {
                                         &&
                                         mapY >= 0 && mapY < mMapD ) {
                                         
-                                        int mapI = mapY * mMapD + mapX;
+                                        int mapI = getMapI( mapX, mapY );
                                         
                                         existing->heldFrozenRotFrameCount =
                                             mMapAnimationFrozenRotFrameCount
@@ -14446,6 +14632,8 @@ void LivingLifePage::makeActive( char inFresh ) {
     savingSpeechEnabled = SettingsManager::getIntSetting( "allowSavingSpeech",
                                                           0 );
 
+    printFrameTimes = SettingsManager::getIntSetting( "printFrameTimes", 0 );
+
 
     for( int i=0; i<mGraveInfo.size(); i++ ) {
         delete [] mGraveInfo.getElement(i)->relationName;
@@ -14560,7 +14748,7 @@ void LivingLifePage::makeActive( char inFresh ) {
 
     playerActionPending = false;
     
-    serverSocketBuffer.deleteAll();
+    serverSocketBuffer.clear();
 
     if( nextActionMessageToSend != NULL ) {    
         delete [] nextActionMessageToSend;
@@ -14604,7 +14792,7 @@ void LivingLifePage::checkForPointerHit( PointerHitRecord *inRecord,
     int clickDestMapX = clickDestX - mMapOffsetX + mMapD / 2;
     int clickDestMapY = clickDestY - mMapOffsetY + mMapD / 2;
     
-    int clickDestMapI = clickDestMapY * mMapD + clickDestMapX;
+    int clickDestMapI = getMapI( clickDestMapX, clickDestMapY );
     
     if( clickDestMapY >= 0 && clickDestMapY < mMapD &&
         clickDestMapX >= 0 && clickDestMapX < mMapD ) {
@@ -14739,7 +14927,7 @@ void LivingLifePage::checkForPointerHit( PointerHitRecord *inRecord,
                 }
             
 
-            int mapI = mapY * mMapD + mapX;
+            int mapI = getMapI( mapX, mapY );
 
             int oID = mMap[ mapI ];
             
@@ -14910,7 +15098,7 @@ void LivingLifePage::checkForPointerHit( PointerHitRecord *inRecord,
                 continue;
                 }
 
-            int mapI = mapY * mMapD + mapX;
+            int mapI = getMapI( mapX, mapY );
 
             int oID = mMap[ mapI ];
             
@@ -15154,7 +15342,7 @@ void LivingLifePage::pointerMove( float inX, float inY ) {
     if( p.hitAnObject && mapY >= 0 && mapY < mMapD &&
         mapX >= 0 && mapX < mMapD ) {
         
-        destID = mMap[ mapY * mMapD + mapX ];
+        destID = mMap[ getMapI( mapX, mapY ) ];
         }
 
 
@@ -15238,7 +15426,7 @@ void LivingLifePage::pointerMove( float inX, float inY ) {
         
         if( p.hitSlotIndex != -1 ) {
             mCurMouseOverID = 
-                mMapContainedStacks[ mapY * mMapD + mapX ].
+                mMapContainedStacks[ getMapI( mapX, mapY ) ].
                 getElementDirect( p.hitSlotIndex );
             }
         
@@ -15295,7 +15483,7 @@ char LivingLifePage::getCellBlocksWalking( int inMapX, int inMapY ) {
     if( inMapY >= 0 && inMapY < mMapD &&
         inMapX >= 0 && inMapX < mMapD ) {
         
-        int destID = mMap[ inMapY * mMapD + inMapX ];
+        int destID = mMap[ getMapI( inMapX, inMapY ) ];
         
         
         if( destID > 0 && getObject( destID )->blocksWalking ) {
@@ -15316,7 +15504,7 @@ char LivingLifePage::getCellBlocksWalking( int inMapX, int inMapY ) {
                 endX = mMapD - 1;
                 }
             for( int x=startX; x<=endX; x++ ) {
-                int nID = mMap[ inMapY * mMapD + x ];
+                int nID = mMap[ getMapI( x, inMapY ) ];
 
                 if( nID > 0 ) {
                     ObjectRecord *nO = getObject( nID );
@@ -15537,10 +15725,10 @@ void LivingLifePage::pointerDown( float inX, float inY ) {
     if( mapY >= 0 && mapY < mMapD &&
         mapX >= 0 && mapX < mMapD ) {
         
-        destID = mMap[ mapY * mMapD + mapX ];
-        floorDestID = mMapFloors[ mapY * mMapD + mapX ];
+        destID = mMap[ getMapI( mapX, mapY ) ];
+        floorDestID = mMapFloors[ getMapI( mapX, mapY ) ];
         
-        destNumContained = mMapContainedStacks[ mapY * mMapD + mapX ].size();
+        destNumContained = mMapContainedStacks[ getMapI( mapX, mapY ) ].size();
         
 
         // if holding something, and this is a set-down action
@@ -15548,7 +15736,7 @@ void LivingLifePage::pointerDown( float inX, float inY ) {
         if( modClick &&
             ourLiveObject->holdingID != 0 ) {
         
-            int mapI = mapY * mMapD + mapX;
+            int mapI = getMapI( mapX, mapY );
             
             int id = mMap[mapI];
             
@@ -15727,7 +15915,7 @@ void LivingLifePage::pointerDown( float inX, float inY ) {
                     if( mapPY >= 0 && mapPY < mMapD &&
                         mapPX >= 0 && mapPX < mMapD ) {
                         
-                        int oID = mMap[ mapPY * mMapD + mapPX ];
+                        int oID = mMap[ getMapI( mapPX, mapPY ) ];
 
                         if( oID == 0 
                             ||
@@ -16106,7 +16294,7 @@ void LivingLifePage::pointerDown( float inX, float inY ) {
                     x >= 0 && x < mMapD ) {
                  
                     
-                    int mapI = y * mMapD + x;
+                    int mapI = getMapI( x, y );
                     
                     if( mMap[ mapI ] == 0
                         ||
@@ -16288,7 +16476,7 @@ void LivingLifePage::pointerDown( float inX, float inY ) {
                 if( mapY >= 0 && mapY < mMapD &&
                     mapX >= 0 && mapX < mMapD ) {
                     
-                    int mapI = mapY * mMapD + mapX;
+                    int mapI = getMapI( mapX, mapY );
                     
                     if( mMapMoveSpeeds[ mapI ] > 0 ) {        
                         
@@ -16968,5 +17156,7 @@ void LivingLifePage::putInMap( int inMapI, ExtraMapObject *inObj ) {
     
     mMapContainedStacks[ inMapI ] = inObj->containedStack;
     mMapSubContainedStacks[ inMapI ] = inObj->subContainedStack;
+    
+    noteMapCellChanged( inMapI );
     }
 
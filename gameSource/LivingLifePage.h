@@ -509,6 +509,46 @@ class LivingLifePage : public GamePage {
         
         int mMapOffsetX;
         int mMapOffsetY;
+        
+        // the map arrays above are a ring buffer:  a world cell stays in 
+        // the same spot in them for as long as it is in our sub-map, so 
+        // recentering only has to reset the cells that scroll in
+        //
+        // mMapWrapX,Y is where map 0,0 (bottom left of sub-map) lives
+        int mMapWrapX;
+        int mMapWrapY;
+        
+        void setMapOffset( int inX, int inY );
+
+        // index into map arrays of a map x,y (each 0 to mMapD - 1)
+        int getMapI( int inMapX, int inMapY );
+        
+        // map x,y of an index into map arrays
+        int getMapX( int inMapI );
+        int getMapY( int inMapI );
+        
+        // back to unknown, and clears all state left over from
+        // whatever cell was in this spot before
+        void resetMapCell( int inMapI, int inWorldX, int inWorldY );
+        
+        
+        // map cells that per-frame passes need to visit, so they don't
+        // have to sweep whole map
+        // 
+        // cells are added whenever a message changes them, and dropped
+        // by the pass that finds they no longer belong
+        // flags mark which cells are in each list
+        
+        // objects moving into cell (mMapMoveSpeeds > 0)
+        SimpleVector<int> mMapMovingCells;
+        char *mMapCellMovingFlags;
+        
+        // tutorial markers
+        SimpleVector<int> mMapTutorialCells;
+        char *mMapCellTutorialFlags;
+        
+        // call after changing object or move speed in a cell
+        void noteMapCellChanged( int inMapI );
 
 
         char mEKeyEnabled;
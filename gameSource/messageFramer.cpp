@@ -0,0 +1,141 @@
+#include "messageFramer.h"
+
+#include <string.h>
+
+
+
+MessageFramer::MessageFramer( int inInitialCapacity )
+        : mData( new unsigned char[ inInitialCapacity ] ),
+          mCapacity( inInitialCapacity ),
+          mStart( 0 ),
+          mEnd( 0 ),
+          mScanPos( 0 ) {
+    }
+
+
+
+MessageFramer::~MessageFramer() {
+    delete [] mData;
+    }
+
+
+
+unsigned char *MessageFramer::getWriteSpace( int inMinBytes,
+                                             int *outNumBytes ) {
+
+    if( mStart == mEnd ) {
+        // all consumed, start over at front for free
+        mStart = 0;
+        mEnd = 0;
+        mScanPos = 0;
+        }
+
+    if( mCapacity - mEnd < inMinBytes ) {
+
+        int numBytes = mEnd - mStart;
+
+        if( mCapacity - numBytes >= inMinBytes &&
+            mStart >= numBytes ) {
+            // enough room if we slide unconsumed bytes down to front
+            // and we've consumed at least as much as we'd move,
+            // so moves add up to no more than bytes received
+            memmove( mData, &( mData[ mStart ] ), numBytes );
+            }
+        else {
+            int newCapacity = mCapacity * 2;
+
+            while( newCapacity - numBytes < inMinBytes ) {
+                newCapacity *= 2;
+                }
+
+            unsigned char *newData = new unsigned char[ newCapacity ];
+
+            memcpy( newData, &( mData[ mStart ] ), numBytes );
+
+            delete [] mData;
+            mData = newData;
+            mCapacity = newCapacity;
+            }
+
+        mScanPos -= mStart;
+        mEnd = numBytes;
+        mStart = 0;
+        }
+
+    *outNumBytes = mCapacity - mEnd;
+
+    return &( mData[ mEnd ] );
+    }
+
+
+
+void MessageFramer::commitWrite( int inNumBytes ) {
+    mEnd += inNumBytes;
+    }
+
+
+
+void MessageFramer::append( unsigned char *inData, int inLength ) {
+    int space;
+    unsigned char *dest = getWriteSpace( inLength, &space );
+
+    memcpy( dest, inData, inLength );
+
+    commitWrite( inLength );
+    }
+
+
+
+char *MessageFramer::getNextMessage( int *outLength ) {
+
+    if( mScanPos < mStart ) {
+        mScanPos = mStart;
+        }
+
+    unsigned char *terminal =
+        (unsigned char*)memchr( &( mData[ mScanPos ] ), '#',
+                                mEnd - mScanPos );
+
+    if( terminal == NULL ) {
+        // don't scan these bytes again
+        mScanPos = mEnd;
+        return NULL;
+        }
+
+    int index = terminal - mData;
+
+    *terminal = '\0';
+
+    char *message = (char*)&( mData[ mStart ] );
+
+    if( outLength != NULL ) {
+        *outLength = index - mStart;
+        }
+
+    mStart = index + 1;
+    mScanPos = mStart;
+
+    return message;
+    }
+
+
+
+unsigned char *MessageFramer::takeBytes( int inNumBytes ) {
+    unsigned char *bytes = &( mData[ mStart ] );
+
+    mStart += inNumBytes;
+
+    if( mScanPos < mStart ) {
+        mScanPos = mStart;
+        }
+
+    return bytes;
+    }
+
+
+
+void MessageFramer::clear() {
+    mStart = 0;
+    mEnd = 0;
+    mScanPos = 0;
+    }
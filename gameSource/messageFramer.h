@@ -0,0 +1,85 @@
+#ifndef MESSAGE_FRAMER_H_INCLUDED
+#define MESSAGE_FRAMER_H_INCLUDED
+
+
+#include <stddef.h>
+
+
+
+// Buffer of bytes received from a socket, split into #-terminated
+// messages, with binary payloads (like MC and CM data) mixed in.
+//
+// Data is received straight into the buffer's free space, and messages
+// are handed out in place, so nothing is copied byte-by-byte or
+// shifted down for each message taken.  The search for # picks up
+// where the last one left off, so a message arriving in many small
+// pieces is only scanned once.
+//
+// Consumed bytes at the front are only reclaimed when more space is
+// needed, by moving what's left down in one block.
+//
+// Pointers returned by getNextMessage and takeBytes are only valid until
+// the next call that adds data (getWriteSpace or append).
+class MessageFramer {
+
+    public:
+
+        MessageFramer( int inInitialCapacity = 4096 );
+
+        ~MessageFramer();
+
+
+        // gets free space at end of buffer to receive into directly
+        // there will be at least inMinBytes of it
+        // returns pointer to space, and its size in outNumBytes
+        unsigned char *getWriteSpace( int inMinBytes, int *outNumBytes );
+
+        // marks inNumBytes of space from getWriteSpace as filled
+        void commitWrite( int inNumBytes );
+
+
+        // copies data onto end of buffer
+        void append( unsigned char *inData, int inLength );
+
+
+        // number of unconsumed bytes
+        int getNumBytes() {
+            return mEnd - mStart;
+            }
+
+
+        // next full message, with terminal # replaced by \0
+        //
+        // message is consumed, and its length (without #) is
+        // returned in outLength
+        //
+        // NULL if no full message available
+        char *getNextMessage( int *outLength = NULL );
+
+
+        // consumes next inNumBytes raw bytes, returning pointer to them
+        // inNumBytes must be no more than getNumBytes()
+        unsigned char *takeBytes( int inNumBytes );
+
+
+        // discards all data
+        void clear();
+
+
+    private:
+
+        unsigned char *mData;
+        int mCapacity;
+
+        // unconsumed bytes are [mStart, mEnd)
+        int mStart;
+        int mEnd;
+
+        // no # in [mStart, mScanPos)
+        int mScanPos;
+
+    };
+
+
+
+#endif
@@ -3539,17 +3539,15 @@ int recomputeObjectHeight( int inNumSprites, int *inSprites,
 
             char hit = false;
             
-            if( spriteRec->hitMap != NULL ) {
+            if( spriteRec->hitMap != NULL || 
+                spriteRec->packEntry != NULL ) {
                 int h = spriteRec->h;
                 int w = spriteRec->w;
-                char *hitMap = spriteRec->hitMap;
                 
                 for( int y=0; y<h; y++ ) {
                     for( int x=0; x<w; x++ ) {
-                     
-                        int p = y * spriteRec->w + x;
                         
-                        if( hitMap[p] ) {
+                        if( getSpritePixelHit( spriteRec, x, y ) ) {
                             hit = true;
                             // can be negative if anchor above top
                             // pixel
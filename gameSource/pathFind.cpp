@@ -3,6 +3,7 @@
 #include <math.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 
 #include "minorGems/util/SimpleVector.h"
@@ -21,11 +22,15 @@ typedef struct pathSearchRecord {
         double estimate;
         double total;
         
-        // index of pred in done queue
+        // index of pred record in arena, -1 for start
         int predIndex;
+
+        // bumped every time record is (re)queued, so that ties are
+        // broken first-come-first-served
+        unsigned int queueOrder;
         
-        // links to create structure of search queue
-        pathSearchRecord *nextSearchRecord;
+        // position in open heap
+        int heapIndex;
 
     } pathSearchRecord;
 
@@ -46,11 +51,6 @@ static char equal( GridPos inA, GridPos inB ) {
 
 
 
-typedef struct pathSearchQueue {
-        pathSearchRecord *head;
-    } pathSearchQueue;
-
-
 // returns true if A better than B (sorting function
 inline static char isRecordBetter( pathSearchRecord *inA, 
                                    pathSearchRecord *inB ) {
@@ -63,6 +63,10 @@ inline static char isRecordBetter( pathSearchRecord *inA,
             if( inA->estimate < inB->estimate ) {
                 return true;
                 }
+            else if( inA->estimate == inB->estimate ) {
+                // queued first wins
+                return inA->queueOrder < inB->queueOrder;
+                }
             }
         else {
             return true;
@@ -71,99 +75,168 @@ inline static char isRecordBetter( pathSearchRecord *inA,
     return false;
     }
 
-    
 
-// sorted insertion
-static void insertSearchRecord( pathSearchQueue *inQueue, 
-                                pathSearchRecord *inRecordToInsert ) {
-    
-    // empty queue
-    if( inQueue->head == NULL ) {
-        inQueue->head = inRecordToInsert;
-        return;
-        }
 
-    // better than head
-    if( isRecordBetter( inRecordToInsert, inQueue->head ) ) {
-        inRecordToInsert->nextSearchRecord = inQueue->head;    
-        inQueue->head = inRecordToInsert;
-        return;
-        }
-    
-    // general case, search for spot to insert
-    
-    pathSearchRecord *currentRecord = inQueue->head;
-    pathSearchRecord *nextRecord = currentRecord->nextSearchRecord;
-
-    while( nextRecord != NULL ) {
+// memory reused from search to search, grown as needed
+// one per thread, so a steady stream of searches does no allocation
+// other than the returned path
+typedef struct pathSearchArena {
+        int numSquaresAllocated;
         
-        if( isRecordBetter( inRecordToInsert, nextRecord ) ) {
-            
-            // insert here
-            inRecordToInsert->nextSearchRecord = nextRecord;
-            
-            currentRecord->nextSearchRecord = inRecordToInsert;
-            return;
-            }
-        else {
-            // keep going
-            currentRecord = nextRecord;
-            nextRecord = currentRecord->nextSearchRecord;
+        // all records touched in this search, in order of creation
+        pathSearchRecord *records;
+        int numRecords;
+        
+        // binary min-heap of indices into records
+        int *heap;
+        int heapSize;
+        
+        // index of open record for each square, or -1
+        int *openRecordIndex;
+        
+        // one bit per square, set when square done
+        unsigned char *doneBits;
+
+        // path steps, goal first
+        GridPos *pathSteps;
+    } pathSearchArena;
+
+
+static __thread pathSearchArena arena = { 0, NULL, 0, NULL, 0, 
+                                          NULL, NULL, NULL };
+
+
+
+static void prepareArena( int inNumSquares ) {
+    if( inNumSquares > arena.numSquaresAllocated ) {
+        if( arena.records != NULL ) {
+            delete [] arena.records;
+            delete [] arena.heap;
+            delete [] arena.openRecordIndex;
+            delete [] arena.doneBits;
+            delete [] arena.pathSteps;
             }
+        
+        // each square gets at most one record
+        arena.records = new pathSearchRecord[ inNumSquares ];
+        arena.heap = new int[ inNumSquares ];
+        arena.openRecordIndex = new int[ inNumSquares ];
+        arena.doneBits = new unsigned char[ inNumSquares / 8 + 1 ];
+        arena.pathSteps = new GridPos[ inNumSquares ];
+        
+        arena.numSquaresAllocated = inNumSquares;
         }
     
+    arena.numRecords = 0;
+    arena.heapSize = 0;
 
-    // hit null, insert at end
-    currentRecord->nextSearchRecord = inRecordToInsert;
+    memset( arena.openRecordIndex, 0xFF, inNumSquares * sizeof( int ) );
+    memset( arena.doneBits, 0, inNumSquares / 8 + 1 );
     }
 
 
 
-// sorted removal
-static pathSearchRecord *pullSearchRecord( pathSearchQueue *inQueue, 
-                                    int inSquareIndex ) {
+inline static char isDone( int inSquareIndex ) {
+    return ( arena.doneBits[ inSquareIndex >> 3 ] >> 
+             ( inSquareIndex & 7 ) ) & 1;
+    }
 
-    if( inQueue->head == NULL ) {
-        return NULL;
-        }
 
-    if( inQueue->head->squareIndex == inSquareIndex ) {
-        // pull head
-        pathSearchRecord *currentRecord = inQueue->head;
+inline static void setDone( int inSquareIndex ) {
+    arena.doneBits[ inSquareIndex >> 3 ] |= 
+        (unsigned char)( 1 << ( inSquareIndex & 7 ) );
+    }
 
-        inQueue->head = currentRecord->nextSearchRecord;
 
-        currentRecord->nextSearchRecord = NULL;
 
-        return currentRecord;
-        }
-    
+inline static char isHeapBetter( int inHeapIndexA, int inHeapIndexB ) {
+    return isRecordBetter( &( arena.records[ arena.heap[ inHeapIndexA ] ] ),
+                           &( arena.records[ arena.heap[ inHeapIndexB ] ] ) );
+    }
 
-    pathSearchRecord *previousRecord = inQueue->head;
-    pathSearchRecord *currentRecord = previousRecord->nextSearchRecord;
-    
 
-    while( currentRecord != NULL && 
-           currentRecord->squareIndex != inSquareIndex ) {
+inline static void heapSwap( int inHeapIndexA, int inHeapIndexB ) {
+    int recA = arena.heap[ inHeapIndexA ];
+    int recB = arena.heap[ inHeapIndexB ];
+    
+    arena.heap[ inHeapIndexA ] = recB;
+    arena.heap[ inHeapIndexB ] = recA;
     
-        previousRecord = currentRecord;
+    arena.records[ recB ].heapIndex = inHeapIndexA;
+    arena.records[ recA ].heapIndex = inHeapIndexB;
+    }
+
+
+
+static void heapSiftUp( int inHeapIndex ) {
+    while( inHeapIndex > 0 ) {
+        int parent = ( inHeapIndex - 1 ) / 2;
         
-        currentRecord = previousRecord->nextSearchRecord;
+        if( ! isHeapBetter( inHeapIndex, parent ) ) {
+            return;
+            }
+        heapSwap( inHeapIndex, parent );
+        inHeapIndex = parent;
         }
-    
-    if( currentRecord == NULL ) {
-        return NULL;
+    }
+
+
+
+static void heapSiftDown( int inHeapIndex ) {
+    while( true ) {
+        int best = inHeapIndex;
+        int left = 2 * inHeapIndex + 1;
+        int right = left + 1;
+        
+        if( left < arena.heapSize && isHeapBetter( left, best ) ) {
+            best = left;
+            }
+        if( right < arena.heapSize && isHeapBetter( right, best ) ) {
+            best = right;
+            }
+        
+        if( best == inHeapIndex ) {
+            return;
+            }
+        heapSwap( inHeapIndex, best );
+        inHeapIndex = best;
         }
+    }
+
+
+
+static void heapPush( int inRecordIndex ) {
+    int h = arena.heapSize;
+    arena.heapSize++;
+    
+    arena.heap[ h ] = inRecordIndex;
+    arena.records[ inRecordIndex ].heapIndex = h;
     
-    // else pull it
+    heapSiftUp( h );
+    }
+
 
-    // skip it in the pointer chain
-    previousRecord->nextSearchRecord = currentRecord->nextSearchRecord;
+
+static int heapPopBest() {
+    int best = arena.heap[ 0 ];
     
+    arena.heapSize--;
     
-    currentRecord->nextSearchRecord = NULL;
+    if( arena.heapSize > 0 ) {
+        heapSwap( 0, arena.heapSize );
+        heapSiftDown( 0 );
+        }
+    return best;
+    }
+
 
-    return currentRecord;
+
+// record's key changed, restore heap order
+static void heapUpdate( int inRecordIndex ) {
+    int h = arena.records[ inRecordIndex ].heapIndex;
+    
+    heapSiftUp( h );
+    heapSiftDown( arena.records[ inRecordIndex ].heapIndex );
     }
 
 
@@ -194,31 +267,14 @@ char pathFind( int inMapH, int inMapW,
     int xTotalDelta = abs( inGoal.x - inStart.x );
     int yTotalDelta = abs( inGoal.y - inStart.y );
 
-
-    // insertion-sorted queue of records waiting to be searched
-    pathSearchQueue recordsToSearch;
-
     
-    // keep records here, even after we're done with them,
-    // to ensure they get deleted
-    SimpleVector<pathSearchRecord*> searchQueueRecords;
-
+    int numFloorSquares = inMapH * inMapW;
 
-    SimpleVector<pathSearchRecord> doneQueue;
+    prepareArena( numFloorSquares );
+    
+    unsigned int nextQueueOrder = 0;
     
     
-    int numFloorSquares = inMapH * inMapW;
-
-
-    // quick lookup of touched but not done squares
-    // indexed by floor square index number
-    char *openMap = new char[ numFloorSquares ];
-    memset( openMap, false, numFloorSquares );
-
-    char *doneMap = new char[ numFloorSquares ];
-    memset( doneMap, false, numFloorSquares );
-
-            
     pathSearchRecord startRecord = 
         { inStart,
           inStart.y * inMapW + inStart.x,
@@ -226,61 +282,40 @@ char pathFind( int inMapH, int inMapW,
           getGridDistance( inStart, inGoal ),
           getGridDistance( inStart, inGoal ),
           -1,
-          NULL };
+          nextQueueOrder++,
+          0 };
 
-    // can't keep pointers in a SimpleVector 
-    // (change as vector expands itself)
-    // push heap pointers into vector instead
-    pathSearchRecord *heapRecord = new pathSearchRecord( startRecord );
-    
-    searchQueueRecords.push_back( heapRecord );
+    arena.records[ 0 ] = startRecord;
+    arena.numRecords = 1;
     
+    heapPush( 0 );
     
-    recordsToSearch.head = heapRecord;
-
-
-    openMap[ startRecord.squareIndex ] = true;
+    arena.openRecordIndex[ startRecord.squareIndex ] = 0;
     
 
-
-    char done = false;
-            
+    int goalRecordIndex = -1;
             
-    //while( searchQueueRecords.size() > 0 && !done ) {
-    while( recordsToSearch.head != NULL && !done ) {
+    while( arena.heapSize > 0 && goalRecordIndex == -1 ) {
 
-        // head of queue is best
-        pathSearchRecord bestRecord = *( recordsToSearch.head );
+        // top of heap is best
+        int predIndex = heapPopBest();
         
-        recordsToSearch.head = recordsToSearch.head->nextSearchRecord;
-
-
-        if( false )
-            printf( "Best record found:  "
-                    "(%d,%d), cost %d, total %f, "
-                    "pred %d, this index %d\n",
-                    bestRecord.pos.x, bestRecord.pos.y,
-                    bestRecord.cost, bestRecord.total,
-                    bestRecord.predIndex, doneQueue.size() );
-        
-        doneMap[ bestRecord.squareIndex ] = true;
-        openMap[ bestRecord.squareIndex ] = false;
+        pathSearchRecord *bestRecord = &( arena.records[ predIndex ] );
 
         
-        doneQueue.push_back( bestRecord );
-
-        int predIndex = doneQueue.size() - 1;
+        setDone( bestRecord->squareIndex );
+        arena.openRecordIndex[ bestRecord->squareIndex ] = -1;
 
         
-        if( equal( bestRecord.pos, inGoal ) ) {
+        if( equal( bestRecord->pos, inGoal ) ) {
             // goal record has lowest total score in queue
-            done = true;
+            goalRecordIndex = predIndex;
             }
         else {
             // add neighbors
             GridPos neighbors[8];
                     
-            GridPos bestPos = bestRecord.pos;
+            GridPos bestPos = bestRecord->pos;
 
             
             // pick which neighbors to explore first
@@ -338,7 +373,7 @@ char pathFind( int inMapH, int inMapW,
             
             
             // one step to neighbors from best record
-            int cost = bestRecord.cost + 1;
+            int cost = bestRecord->cost + 1;
 
             for( int n=0; n<8; n++ ) {
                 int y = neighbors[n].y;
@@ -367,39 +402,16 @@ char pathFind( int inMapH, int inMapW,
                 if( ! inBlockedMap[ neighborSquareIndex ] ) {
                     // floor
                     
-                    char alreadyOpen = openMap[ neighborSquareIndex ];
-                    char alreadyDone = doneMap[ neighborSquareIndex ];
+                    int openIndex = 
+                        arena.openRecordIndex[ neighborSquareIndex ];
                     
-                    if( !alreadyOpen && !alreadyDone ) {
-                        
-                        // for testing, color touched nodes
-                        // mGridColors[ neighborSquareIndex ].r = 1;
+                    if( openIndex == -1 && ! isDone( neighborSquareIndex ) ) {
                         
                         // add this neighbor
                         double dist = 
                             getGridDistance( neighbors[n], 
                                              inGoal );
                             
-                        // add cross-product to heuristic
-                        // to make paths prettier
-                        
-                        // idea from:
-                        // theory.stanford.edu/~amitp/GameProgramming/
-
-                        // problem:  diagonal paths are hard to watch
-                        // because they are so bumpy
-                        /*
-                        int dx1 = neighbors[n].x - inGoal.x;
-                        int dy1 = neighbors[n].y - inGoal.y;
-                        
-                        int dx2 = inStart.x - inGoal.x;
-                        int dy2 = inStart.y - inGoal.y;
-                        
-                        int cross = abs( dx1 * dy2 - dx2*dy1 );
-                        
-                        dist += cross * 0.001;
-                        */
-                        
                         // track how we got here (pred)
                         pathSearchRecord nRecord = { neighbors[n],
                                                      neighborSquareIndex,
@@ -407,36 +419,39 @@ char pathFind( int inMapH, int inMapW,
                                                      dist,
                                                      dist + cost,
                                                      predIndex,
-                                                     NULL };
-                        pathSearchRecord *heapRecord =
-                            new pathSearchRecord( nRecord );
+                                                     nextQueueOrder++,
+                                                     0 };
                         
-                        searchQueueRecords.push_back( heapRecord );
+                        int newIndex = arena.numRecords;
+                        arena.numRecords++;
                         
-                        insertSearchRecord( 
-                            &recordsToSearch, heapRecord );
+                        arena.records[ newIndex ] = nRecord;
 
-                        openMap[ neighborSquareIndex ] = true;
+                        heapPush( newIndex );
+                        
+                        arena.openRecordIndex[ neighborSquareIndex ] = 
+                            newIndex;
                         }
-                    else if( alreadyOpen ) {
-                        pathSearchRecord *heapRecord =
-                            pullSearchRecord( &recordsToSearch,
-                                              neighborSquareIndex );
+                    else if( openIndex != -1 ) {
+                        pathSearchRecord *openRecord = 
+                            &( arena.records[ openIndex ] );
                         
                         // did we reach this node through a shorter path
                         // than before?
-                        if( cost < heapRecord->cost ) {
+                        if( cost < openRecord->cost ) {
                             
                             // update it!
-                            heapRecord->cost = cost;
-                            heapRecord->total = heapRecord->estimate + cost;
+                            openRecord->cost = cost;
+                            openRecord->total = openRecord->estimate + cost;
                             
                             // found a new predecessor for this node
-                            heapRecord->predIndex = predIndex;
+                            openRecord->predIndex = predIndex;
                             }
-
-                        // reinsert
-                        insertSearchRecord( &recordsToSearch, heapRecord );
+                        
+                        // requeue behind records with same score
+                        openRecord->queueOrder = nextQueueOrder++;
+                        
+                        heapUpdate( openIndex );
                         }
                             
                     }
@@ -446,40 +461,25 @@ char pathFind( int inMapH, int inMapW,
             }
         }
 
-    char failed = false;
-    if( ! done ) {
-        failed = true;
-        }
-    
-
-    delete [] openMap;
-    delete [] doneMap;
     
-
-    if( failed && outClosest != NULL ) {
-        // find visited spot with closest
+    if( goalRecordIndex == -1 ) {
         
-        double minEst = inMapW + inMapH;
-        GridPos minPos = inStart;
+        if( outClosest != NULL ) {
+            // find visited spot with closest
+        
+            double minEst = inMapW + inMapH;
+            GridPos minPos = inStart;
+        
+            for( int i=0; i<arena.numRecords; i++ ) {
+                pathSearchRecord *r = &( arena.records[i] );
+                if( r->estimate < minEst ) {
+                    minEst = r->estimate;
+                    minPos = r->pos;
+                    }
+                }        
+            *outClosest = minPos;
+            }
         
-        for( int i=0; i<searchQueueRecords.size(); i++ ) {
-            pathSearchRecord *r = searchQueueRecords.getElementDirect( i );
-            if( r->estimate < minEst ) {
-                minEst = r->estimate;
-                minPos = r->pos;
-                }
-            }        
-        *outClosest = minPos;
-        }
-    
-
-
-    for( int i=0; i<searchQueueRecords.size(); i++ ) {
-        delete *( searchQueueRecords.getElement( i ) );
-        }
-    
-    
-    if( failed ) {
         return false;
         }
     
@@ -491,49 +491,32 @@ char pathFind( int inMapH, int inMapW,
     
     
             
-    // follow index to reconstruct path
-    // last in done queue is best-reached goal node
-
-    int currentIndex = doneQueue.size() - 1;
-            
-    pathSearchRecord *currentRecord = 
-        doneQueue.getElement( currentIndex );
-
-    pathSearchRecord *predRecord = 
-        doneQueue.getElement( currentRecord->predIndex );
-            
-    done = false;
-
-    SimpleVector<GridPos> finalPath;
-    finalPath.push_back( currentRecord->pos );
-
-    while( ! equal(  predRecord->pos, inStart ) ) {
-        currentRecord = predRecord;
-        finalPath.push_back( currentRecord->pos );
-
-        predRecord = 
-            doneQueue.getElement( currentRecord->predIndex );
-        
-        }
+    // follow pred indices from goal to reconstruct path
 
-    // finally, add start
-    finalPath.push_back( predRecord->pos );
+    int numSteps = 0;
     
-
-    SimpleVector<GridPos> finalPathReversed;
-    
-    int numSteps = finalPath.size();
+    int currentIndex = goalRecordIndex;
     
-    for( int i=numSteps-1; i>=0; i-- ) {
-        finalPathReversed.push_back( *( finalPath.getElement( i ) ) );
+    while( currentIndex != -1 ) {
+        pathSearchRecord *currentRecord = &( arena.records[ currentIndex ] );
+        
+        arena.pathSteps[ numSteps ] = currentRecord->pos;
+        numSteps++;
+        
+        currentIndex = currentRecord->predIndex;
         }
-
+    
 
     if( outFullPathLength != NULL ) {
-        *outFullPathLength = finalPath.size();
+        *outFullPathLength = numSteps;
         }
     if( outFullPath != NULL ) {
-        *outFullPath = finalPathReversed.getElementArray();
+        GridPos *path = new GridPos[ numSteps ];
+        
+        for( int i=0; i<numSteps; i++ ) {
+            path[i] = arena.pathSteps[ numSteps - 1 - i ];
+            }
+        *outFullPath = path;
         }
     
     
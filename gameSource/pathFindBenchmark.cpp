@@ -0,0 +1,766 @@
+// compares pathFind against the old sorted-linked-list implementation
+// on random start/goal pairs over blocked maps
+//
+// Blocked maps are built by stamping the objects from a test map file
+// (same format as server's testMap.txt) at random spots, on top of
+// random scattered blocking, like a dense camp.
+//
+// Usage:
+// pathFindBenchmark [test_map_file] [map_d] [num_pairs]
+
+
+#include "pathFind.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/random/CustomRandomSource.h"
+#include "minorGems/system/Time.h"
+
+
+
+// old implementation, kept here as a reference
+// (heap-allocates a record per touched square, sorted-list open set)
+
+typedef struct old_pathSearchRecord {
+        GridPos pos;
+        
+        int squareIndex;
+        
+        int cost;
+        double estimate;
+        double total;
+        
+        // index of pred in done queue
+        int predIndex;
+        
+        // links to create structure of search queue
+        old_pathSearchRecord *nextSearchRecord;
+
+    } old_pathSearchRecord;
+
+
+static double old_getGridDistance( GridPos inA, GridPos inB ) {
+    int dX = inA.x - inB.x;
+    int dY = inA.y - inB.y;
+    
+    // manhattan distance
+    return fabs( dX ) + fabs( dY );
+    //return sqrt( dX * dX + dY * dY );
+    }
+
+
+static char old_equal( GridPos inA, GridPos inB ) {
+    return inA.x == inB.x && inA.y == inB.y;
+    }
+
+
+
+typedef struct old_pathSearchQueue {
+        old_pathSearchRecord *head;
+    } old_pathSearchQueue;
+
+
+// returns true if A better than B (sorting function
+inline static char old_isRecordBetter( old_pathSearchRecord *inA, 
+                                   old_pathSearchRecord *inB ) {
+    
+    if( inA->total <= inB->total ) {
+        
+        if( inA->total == inB->total ) {
+            
+            // pick record with lower estimated cost to break tie
+            if( inA->estimate < inB->estimate ) {
+                return true;
+                }
+            }
+        else {
+            return true;
+            }
+        }
+    return false;
+    }
+
+    
+
+// sorted insertion
+static void old_insertSearchRecord( old_pathSearchQueue *inQueue, 
+                                old_pathSearchRecord *inRecordToInsert ) {
+    
+    // empty queue
+    if( inQueue->head == NULL ) {
+        inQueue->head = inRecordToInsert;
+        return;
+        }
+
+    // better than head
+    if( old_isRecordBetter( inRecordToInsert, inQueue->head ) ) {
+        inRecordToInsert->nextSearchRecord = inQueue->head;    
+        inQueue->head = inRecordToInsert;
+        return;
+        }
+    
+    // general case, search for spot to insert
+    
+    old_pathSearchRecord *currentRecord = inQueue->head;
+    old_pathSearchRecord *nextRecord = currentRecord->nextSearchRecord;
+
+    while( nextRecord != NULL ) {
+        
+        if( old_isRecordBetter( inRecordToInsert, nextRecord ) ) {
+            
+            // insert here
+            inRecordToInsert->nextSearchRecord = nextRecord;
+            
+            currentRecord->nextSearchRecord = inRecordToInsert;
+            return;
+            }
+        else {
+            // keep going
+            currentRecord = nextRecord;
+            nextRecord = currentRecord->nextSearchRecord;
+            }
+        }
+    
+
+    // hit null, insert at end
+    currentRecord->nextSearchRecord = inRecordToInsert;
+    }
+
+
+
+// sorted removal
+static old_pathSearchRecord *old_pullSearchRecord( old_pathSearchQueue *inQueue, 
+                                    int inSquareIndex ) {
+
+    if( inQueue->head == NULL ) {
+        return NULL;
+        }
+
+    if( inQueue->head->squareIndex == inSquareIndex ) {
+        // pull head
+        old_pathSearchRecord *currentRecord = inQueue->head;
+
+        inQueue->head = currentRecord->nextSearchRecord;
+
+        currentRecord->nextSearchRecord = NULL;
+
+        return currentRecord;
+        }
+    
+
+    old_pathSearchRecord *previousRecord = inQueue->head;
+    old_pathSearchRecord *currentRecord = previousRecord->nextSearchRecord;
+    
+
+    while( currentRecord != NULL && 
+           currentRecord->squareIndex != inSquareIndex ) {
+    
+        previousRecord = currentRecord;
+        
+        currentRecord = previousRecord->nextSearchRecord;
+        }
+    
+    if( currentRecord == NULL ) {
+        return NULL;
+        }
+    
+    // else pull it
+
+    // skip it in the pointer chain
+    previousRecord->nextSearchRecord = currentRecord->nextSearchRecord;
+    
+    
+    currentRecord->nextSearchRecord = NULL;
+
+    return currentRecord;
+    }
+
+
+
+
+
+static char oldPathFind( int inMapH, int inMapW,
+               char *inBlockedMap, 
+               GridPos inStart, GridPos inGoal,
+               int *outFullPathLength,
+               GridPos **outFullPath,
+               GridPos *outClosest ) {
+
+    // watch for degen case where start and goal are old_equal
+    if( old_equal( inStart, inGoal ) ) {
+        
+        if( outFullPathLength != NULL ) {
+            *outFullPathLength = 0;
+            }
+        if( outFullPath != NULL ) {
+            *outFullPath = NULL;
+            }
+        return true;
+        }
+        
+
+    
+    int xTotalDelta = abs( inGoal.x - inStart.x );
+    int yTotalDelta = abs( inGoal.y - inStart.y );
+
+
+    // insertion-sorted queue of records waiting to be searched
+    old_pathSearchQueue recordsToSearch;
+
+    
+    // keep records here, even after we're done with them,
+    // to ensure they get deleted
+    SimpleVector<old_pathSearchRecord*> searchQueueRecords;
+
+
+    SimpleVector<old_pathSearchRecord> doneQueue;
+    
+    
+    int numFloorSquares = inMapH * inMapW;
+
+
+    // quick lookup of touched but not done squares
+    // indexed by floor square index number
+    char *openMap = new char[ numFloorSquares ];
+    memset( openMap, false, numFloorSquares );
+
+    char *doneMap = new char[ numFloorSquares ];
+    memset( doneMap, false, numFloorSquares );
+
+            
+    old_pathSearchRecord startRecord = 
+        { inStart,
+          inStart.y * inMapW + inStart.x,
+          0,
+          old_getGridDistance( inStart, inGoal ),
+          old_getGridDistance( inStart, inGoal ),
+          -1,
+          NULL };
+
+    // can't keep pointers in a SimpleVector 
+    // (change as vector expands itself)
+    // push heap pointers into vector instead
+    old_pathSearchRecord *heapRecord = new old_pathSearchRecord( startRecord );
+    
+    searchQueueRecords.push_back( heapRecord );
+    
+    
+    recordsToSearch.head = heapRecord;
+
+
+    openMap[ startRecord.squareIndex ] = true;
+    
+
+
+    char done = false;
+            
+            
+    //while( searchQueueRecords.size() > 0 && !done ) {
+    while( recordsToSearch.head != NULL && !done ) {
+
+        // head of queue is best
+        old_pathSearchRecord bestRecord = *( recordsToSearch.head );
+        
+        recordsToSearch.head = recordsToSearch.head->nextSearchRecord;
+
+
+        if( false )
+            printf( "Best record found:  "
+                    "(%d,%d), cost %d, total %f, "
+                    "pred %d, this index %d\n",
+                    bestRecord.pos.x, bestRecord.pos.y,
+                    bestRecord.cost, bestRecord.total,
+                    bestRecord.predIndex, doneQueue.size() );
+        
+        doneMap[ bestRecord.squareIndex ] = true;
+        openMap[ bestRecord.squareIndex ] = false;
+
+        
+        doneQueue.push_back( bestRecord );
+
+        int predIndex = doneQueue.size() - 1;
+
+        
+        if( old_equal( bestRecord.pos, inGoal ) ) {
+            // goal record has lowest total score in queue
+            done = true;
+            }
+        else {
+            // add neighbors
+            GridPos neighbors[8];
+                    
+            GridPos bestPos = bestRecord.pos;
+
+            
+            // pick which neighbors to explore first
+            // we want our path to walk in the long direction first
+            if( yTotalDelta > xTotalDelta ) {    
+                neighbors[0].x = bestPos.x;
+                neighbors[0].y = bestPos.y - 1;
+
+                neighbors[1].x = bestPos.x;
+                neighbors[1].y = bestPos.y + 1;
+                
+                neighbors[2].x = bestPos.x - 1;
+                neighbors[2].y = bestPos.y;
+                
+                neighbors[3].x = bestPos.x + 1;
+                neighbors[3].y = bestPos.y;                
+                }
+            else {
+                neighbors[2].x = bestPos.x;
+                neighbors[2].y = bestPos.y - 1;
+
+                neighbors[3].x = bestPos.x;
+                neighbors[3].y = bestPos.y + 1;
+                
+                neighbors[0].x = bestPos.x - 1;
+                neighbors[0].y = bestPos.y;
+                
+                neighbors[1].x = bestPos.x + 1;
+                neighbors[1].y = bestPos.y;
+                }
+            
+            // always prefer straight to diagonal
+            neighbors[4].x = bestPos.x - 1;
+            neighbors[4].y = bestPos.y - 1;
+            
+            neighbors[5].x = bestPos.x - 1;
+            neighbors[5].y = bestPos.y + 1;
+            
+            neighbors[6].x = bestPos.x + 1;
+            neighbors[6].y = bestPos.y + 1;
+            
+            neighbors[7].x = bestPos.x + 1;
+            neighbors[7].y = bestPos.y - 1;
+
+            // watch for case where our current pos is blocked
+            // this can only happen when our start pos is blocked
+            int bestSquareIndex = bestPos.y * inMapW + bestPos.x;
+            
+            char currentBlocked = false;
+            
+            if( inBlockedMap[ bestSquareIndex ] ) {
+                currentBlocked = true;
+                }
+            
+            
+            
+            // one step to neighbors from best record
+            int cost = bestRecord.cost + 1;
+
+            for( int n=0; n<8; n++ ) {
+                int y = neighbors[n].y;
+                int x = neighbors[n].x;
+                
+                // skip neighbors that are off the edge of the map
+                if( x < 0 || x >= inMapW ||
+                    y < 0 || y >= inMapH ) {
+                
+                    continue;
+                    }
+                
+                
+                if( currentBlocked && 
+                    y == bestPos.y - 1 ) {
+                    // forbid "down" (including diag down) moves 
+                    // if our current position is blocked
+                    // object we're standing on is drawn in front of us
+                    // so it looks weird
+                    continue;
+                    }
+                
+
+                int neighborSquareIndex = y * inMapW + x;
+                
+                if( ! inBlockedMap[ neighborSquareIndex ] ) {
+                    // floor
+                    
+                    char alreadyOpen = openMap[ neighborSquareIndex ];
+                    char alreadyDone = doneMap[ neighborSquareIndex ];
+                    
+                    if( !alreadyOpen && !alreadyDone ) {
+                        
+                        // for testing, color touched nodes
+                        // mGridColors[ neighborSquareIndex ].r = 1;
+                        
+                        // add this neighbor
+                        double dist = 
+                            old_getGridDistance( neighbors[n], 
+                                             inGoal );
+                            
+                        // add cross-product to heuristic
+                        // to make paths prettier
+                        
+                        // idea from:
+                        // theory.stanford.edu/~amitp/GameProgramming/
+
+                        // problem:  diagonal paths are hard to watch
+                        // because they are so bumpy
+                        /*
+                        int dx1 = neighbors[n].x - inGoal.x;
+                        int dy1 = neighbors[n].y - inGoal.y;
+                        
+                        int dx2 = inStart.x - inGoal.x;
+                        int dy2 = inStart.y - inGoal.y;
+                        
+                        int cross = abs( dx1 * dy2 - dx2*dy1 );
+                        
+                        dist += cross * 0.001;
+                        */
+                        
+                        // track how we got here (pred)
+                        old_pathSearchRecord nRecord = { neighbors[n],
+                                                     neighborSquareIndex,
+                                                     cost,
+                                                     dist,
+                                                     dist + cost,
+                                                     predIndex,
+                                                     NULL };
+                        old_pathSearchRecord *heapRecord =
+                            new old_pathSearchRecord( nRecord );
+                        
+                        searchQueueRecords.push_back( heapRecord );
+                        
+                        old_insertSearchRecord( 
+                            &recordsToSearch, heapRecord );
+
+                        openMap[ neighborSquareIndex ] = true;
+                        }
+                    else if( alreadyOpen ) {
+                        old_pathSearchRecord *heapRecord =
+                            old_pullSearchRecord( &recordsToSearch,
+                                              neighborSquareIndex );
+                        
+                        // did we reach this node through a shorter path
+                        // than before?
+                        if( cost < heapRecord->cost ) {
+                            
+                            // update it!
+                            heapRecord->cost = cost;
+                            heapRecord->total = heapRecord->estimate + cost;
+                            
+                            // found a new predecessor for this node
+                            heapRecord->predIndex = predIndex;
+                            }
+
+                        // reinsert
+                        old_insertSearchRecord( &recordsToSearch, heapRecord );
+                        }
+                            
+                    }
+                }
+                    
+
+            }
+        }
+
+    char failed = false;
+    if( ! done ) {
+        failed = true;
+        }
+    
+
+    delete [] openMap;
+    delete [] doneMap;
+    
+
+    if( failed && outClosest != NULL ) {
+        // find visited spot with closest
+        
+        double minEst = inMapW + inMapH;
+        GridPos minPos = inStart;
+        
+        for( int i=0; i<searchQueueRecords.size(); i++ ) {
+            old_pathSearchRecord *r = searchQueueRecords.getElementDirect( i );
+            if( r->estimate < minEst ) {
+                minEst = r->estimate;
+                minPos = r->pos;
+                }
+            }        
+        *outClosest = minPos;
+        }
+    
+
+
+    for( int i=0; i<searchQueueRecords.size(); i++ ) {
+        delete *( searchQueueRecords.getElement( i ) );
+        }
+    
+    
+    if( failed ) {
+        return false;
+        }
+    
+
+    if( outClosest != NULL ) {
+        // reached goal
+        *outClosest = inGoal;
+        }
+    
+    
+            
+    // follow index to reconstruct path
+    // last in done queue is best-reached goal node
+
+    int currentIndex = doneQueue.size() - 1;
+            
+    old_pathSearchRecord *currentRecord = 
+        doneQueue.getElement( currentIndex );
+
+    old_pathSearchRecord *predRecord = 
+        doneQueue.getElement( currentRecord->predIndex );
+            
+    done = false;
+
+    SimpleVector<GridPos> finalPath;
+    finalPath.push_back( currentRecord->pos );
+
+    while( ! old_equal(  predRecord->pos, inStart ) ) {
+        currentRecord = predRecord;
+        finalPath.push_back( currentRecord->pos );
+
+        predRecord = 
+            doneQueue.getElement( currentRecord->predIndex );
+        
+        }
+
+    // finally, add start
+    finalPath.push_back( predRecord->pos );
+    
+
+    SimpleVector<GridPos> finalPathReversed;
+    
+    int numSteps = finalPath.size();
+    
+    for( int i=numSteps-1; i>=0; i-- ) {
+        finalPathReversed.push_back( *( finalPath.getElement( i ) ) );
+        }
+
+
+    if( outFullPathLength != NULL ) {
+        *outFullPathLength = finalPath.size();
+        }
+    if( outFullPath != NULL ) {
+        *outFullPath = finalPathReversed.getElementArray();
+        }
+    
+    
+    return true;
+    }
+
+
+
+static CustomRandomSource randSource( 2981 );
+
+
+
+// reads x,y of every non-empty object in test map file
+static void readTestMap( const char *inFileName,
+                         SimpleVector<GridPos> *outBlocked ) {
+    FILE *f = fopen( inFileName, "r" );
+    
+    if( f == NULL ) {
+        printf( "Failed to open test map %s, using random blocking only\n",
+                inFileName );
+        return;
+        }
+    
+    while( true ) {
+        int x, y, biome, floor, id;
+        char stringBuff[1000];
+        
+        int numRead = fscanf( f, "%d %d %d %d %999s", 
+                              &x, &y, &biome, &floor, stringBuff );
+        if( numRead != 5 ) {
+            break;
+            }
+        
+        id = atoi( stringBuff );
+        
+        if( id > 0 ) {
+            GridPos p = { x, y };
+            outBlocked->push_back( p );
+            }
+        }
+    fclose( f );
+    
+    if( outBlocked->size() == 0 ) {
+        return;
+        }
+
+    // make relative to bottom-left of bounding box
+    int minX = outBlocked->getElementDirect( 0 ).x;
+    int minY = outBlocked->getElementDirect( 0 ).y;
+    
+    for( int i=0; i<outBlocked->size(); i++ ) {
+        GridPos p = outBlocked->getElementDirect( i );
+        if( p.x < minX ) minX = p.x;
+        if( p.y < minY ) minY = p.y;
+        }
+    for( int i=0; i<outBlocked->size(); i++ ) {
+        GridPos *p = outBlocked->getElement( i );
+        p->x -= minX;
+        p->y -= minY;
+        }
+    }
+
+
+
+static void makeBlockedMap( int inD, SimpleVector<GridPos> *inStamp,
+                            char *outMap ) {
+    
+    double density = randSource.getRandomBoundedDouble( 0.1, 0.35 );
+    
+    for( int i=0; i<inD * inD; i++ ) {
+        outMap[i] = randSource.getRandomBoundedDouble( 0, 1 ) < density;
+        }
+    
+    if( inStamp->size() > 0 ) {
+        int numStamps = inD * inD / 16;
+        
+        for( int s=0; s<numStamps; s++ ) {
+            int oX = randSource.getRandomBoundedInt( 0, inD - 1 );
+            int oY = randSource.getRandomBoundedInt( 0, inD - 1 );
+            
+            for( int i=0; i<inStamp->size(); i++ ) {
+                GridPos p = inStamp->getElementDirect( i );
+                
+                int x = p.x + oX;
+                int y = p.y + oY;
+                
+                if( x < inD && y < inD ) {
+                    outMap[ y * inD + x ] = true;
+                    }
+                }
+            }
+        }
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+    
+    const char *testMapFile = "../server/sampleTestMap.txt";
+    int d = 32;
+    int numPairs = 5000;
+    
+    if( inNumArgs > 1 ) {
+        testMapFile = inArgs[1];
+        }
+    if( inNumArgs > 2 ) {
+        sscanf( inArgs[2], "%d", &d );
+        }
+    if( inNumArgs > 3 ) {
+        sscanf( inArgs[3], "%d", &numPairs );
+        }
+    
+    SimpleVector<GridPos> stamp;
+    readTestMap( testMapFile, &stamp );
+
+    printf( "Testing %d start/goal pairs on %dx%d maps, "
+            "stamping %d test map objects\n",
+            numPairs, d, d, stamp.size() );
+    
+    char *blockedMap = new char[ d * d ];
+    
+    double oldTime = 0;
+    double newTime = 0;
+    
+    int numFound = 0;
+    int numMismatch = 0;
+    int totalSteps = 0;
+    
+    for( int i=0; i<numPairs; i++ ) {
+        
+        // new map every 50 pairs
+        if( i % 50 == 0 ) {
+            makeBlockedMap( d, &stamp, blockedMap );
+            }
+        
+        GridPos start = { randSource.getRandomBoundedInt( 0, d - 1 ),
+                          randSource.getRandomBoundedInt( 0, d - 1 ) };
+        GridPos goal = { randSource.getRandomBoundedInt( 0, d - 1 ),
+                         randSource.getRandomBoundedInt( 0, d - 1 ) };
+        
+        // start may be blocked (standing on something), goal never is
+        blockedMap[ goal.y * d + goal.x ] = false;
+        
+
+        int oldLength = 0;
+        GridPos *oldPath = NULL;
+        GridPos oldClosest = { -1, -1 };
+
+        double t = Time::getCurrentTime();
+        
+        char oldFound = oldPathFind( d, d, blockedMap, start, goal,
+                                     &oldLength, &oldPath, &oldClosest );
+        
+        oldTime += Time::getCurrentTime() - t;
+        
+
+        int newLength = 0;
+        GridPos *newPath = NULL;
+        GridPos newClosest = { -1, -1 };
+        
+        t = Time::getCurrentTime();
+        
+        char newFound = pathFind( d, d, blockedMap, start, goal,
+                                  &newLength, &newPath, &newClosest );
+        
+        newTime += Time::getCurrentTime() - t;
+        
+
+        char match = 
+            oldFound == newFound &&
+            oldClosest.x == newClosest.x && oldClosest.y == newClosest.y;
+
+        if( match && newFound ) {
+            numFound++;
+            totalSteps += newLength;
+            
+            if( oldLength != newLength ) {
+                match = false;
+                }
+            else {
+                for( int s=0; s<newLength; s++ ) {
+                    if( oldPath[s].x != newPath[s].x ||
+                        oldPath[s].y != newPath[s].y ) {
+                        match = false;
+                        break;
+                        }
+                    }
+                }
+            }
+        
+        if( ! match ) {
+            numMismatch++;
+            }
+        
+        if( oldPath != NULL ) {
+            delete [] oldPath;
+            }
+        if( newPath != NULL ) {
+            delete [] newPath;
+            }
+        }
+    
+    delete [] blockedMap;
+    
+    printf( "%d paths found, %d total steps, %d mismatches\n",
+            numFound, totalSteps, numMismatch );
+    
+    printf( "Old:  %f sec (%f ms per search)\n", 
+            oldTime, 1000 * oldTime / numPairs );
+    printf( "New:  %f sec (%f ms per search)\n", 
+            newTime, 1000 * newTime / numPairs );
+    
+    if( newTime > 0 ) {
+        printf( "Speedup:  %.2fx\n", oldTime / newTime );
+        }
+    
+    return 0;
+    }
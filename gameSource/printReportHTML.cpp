@@ -333,6 +333,10 @@ RawRGBAImage *readTGAFileRawFromBuffer( unsigned char *inBuffer,
     return NULL;
     }
 
+RawRGBAImage *readTGAFileRawBase( const char *inTGAFileName ) {
+    return NULL;
+    }
+
 char startRecording16BitMonoSound( int inSampleRate ) {
     return false;
     }
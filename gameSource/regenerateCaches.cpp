@@ -8,6 +8,7 @@
 #include "soundBank.h"
 
 #include "groundSprites.h"
+#include "spritePack.h"
 
 
 #include "minorGems/io/file/File.h"
@@ -102,6 +103,13 @@ int main() {
     deleteCache( "categories" );
     deleteCache( "animations" );
     deleteCache( "transitions" );
+
+    // otherwise sprite bank would load it while we rebuild it
+    File spritePackFile( NULL, SPRITE_PACK_FILE_NAME );
+    
+    if( spritePackFile.exists() ) {
+        spritePackFile.remove();
+        }
     
     File groundTileCacheFolder( NULL, "groundTileCache" );
     
@@ -133,6 +141,14 @@ int main() {
         }
     
     initSpriteBankFinish();
+    printf( "\n" );
+
+    
+    num = buildSpritePackStart();
+    
+    runRebuild( "sprite pack", num, &buildSpritePackStep );
+    
+    buildSpritePackFinish();
 
     freeSpriteBank();
     printf( "\n" );
@@ -0,0 +1,308 @@
+#include "spriteAtlas.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+#include <stdio.h>
+
+
+// empty pixels around each sprite, so that filtering doesn't pull in
+// neighboring sprites
+#define ATLAS_PADDING 1
+
+// shelf heights are rounded up to this, so that sprites of about the same
+// height can share shelves
+#define ATLAS_SHELF_STEP 8
+
+
+
+typedef struct AtlasSpan {
+        int x;
+        int w;
+    } AtlasSpan;
+
+
+typedef struct AtlasShelf {
+        int page;
+        int y;
+        int h;
+
+        // width taken by slots
+        int usedW;
+
+        // sorted by x, neighbors always merged
+        SimpleVector<AtlasSpan> *freeSpans;
+    } AtlasShelf;
+
+
+
+static SimpleVector<AtlasShelf> shelves;
+
+// where next new shelf goes in each page
+// 0 for pages not in use
+static int pageTopY[ ATLAS_MAX_PAGES ];
+
+static int slotsUsed = 0;
+static double slotPixelsUsed = 0;
+
+
+
+void initSpriteAtlas() {
+    for( int p=0; p<ATLAS_MAX_PAGES; p++ ) {
+        pageTopY[p] = 0;
+        }
+    slotsUsed = 0;
+    slotPixelsUsed = 0;
+    }
+
+
+
+void freeSpriteAtlas() {
+    for( int i=0; i<shelves.size(); i++ ) {
+        delete shelves.getElementDirect( i ).freeSpans;
+        }
+    shelves.deleteAll();
+
+    initSpriteAtlas();
+    }
+
+
+
+// returns index of span in shelf at least inW wide, or -1
+static int findSpan( AtlasShelf *inShelf, int inW ) {
+    for( int i=0; i<inShelf->freeSpans->size(); i++ ) {
+        if( inShelf->freeSpans->getElementDirect( i ).w >= inW ) {
+            return i;
+            }
+        }
+    return -1;
+    }
+
+
+
+AtlasSlot allocateAtlasSlot( int inW, int inH ) {
+    AtlasSlot slot = { -1, 0, 0, 0, 0 };
+
+    if( inW > ATLAS_MAX_SPRITE_D || inH > ATLAS_MAX_SPRITE_D ||
+        inW <= 0 || inH <= 0 ) {
+        return slot;
+        }
+
+    int w = inW + 2 * ATLAS_PADDING;
+    int h = inH + 2 * ATLAS_PADDING;
+
+    int shelfH =
+        ( ( h + ATLAS_SHELF_STEP - 1 ) / ATLAS_SHELF_STEP ) * ATLAS_SHELF_STEP;
+
+
+    // shelf that wastes least height
+    int bestShelf = -1;
+    int bestSpan = -1;
+    int bestWaste = ATLAS_PAGE_D;
+
+    for( int i=0; i<shelves.size(); i++ ) {
+        AtlasShelf *s = shelves.getElement( i );
+
+        if( s->h < h ) {
+            continue;
+            }
+
+        // don't fill tall shelves with short sprites, unless nothing
+        // else is using shelf yet
+        if( s->usedW > 0 && s->h > shelfH + shelfH / 4 ) {
+            continue;
+            }
+
+        int waste = s->h - h;
+
+        if( waste >= bestWaste ) {
+            continue;
+            }
+
+        int span = findSpan( s, w );
+
+        if( span != -1 ) {
+            bestShelf = i;
+            bestSpan = span;
+            bestWaste = waste;
+            }
+        }
+
+
+    if( bestShelf == -1 ) {
+        // start a new shelf in first page with room for it
+        for( int p=0; p<ATLAS_MAX_PAGES; p++ ) {
+            if( pageTopY[p] + shelfH <= ATLAS_PAGE_D ) {
+
+                AtlasShelf s;
+                s.page = p;
+                s.y = pageTopY[p];
+                s.h = shelfH;
+                s.usedW = 0;
+                s.freeSpans = new SimpleVector<AtlasSpan>();
+
+                AtlasSpan wholeShelf = { 0, ATLAS_PAGE_D };
+                s.freeSpans->push_back( wholeShelf );
+
+                shelves.push_back( s );
+
+                pageTopY[p] += shelfH;
+
+                bestShelf = shelves.size() - 1;
+                bestSpan = 0;
+                break;
+                }
+            }
+        }
+
+    if( bestShelf == -1 ) {
+        // atlas full
+        return slot;
+        }
+
+
+    AtlasShelf *s = shelves.getElement( bestShelf );
+
+    AtlasSpan *span = s->freeSpans->getElement( bestSpan );
+
+    slot.page = s->page;
+    slot.x = span->x;
+    slot.y = s->y;
+    slot.w = w;
+    slot.h = h;
+
+    span->x += w;
+    span->w -= w;
+
+    if( span->w == 0 ) {
+        s->freeSpans->deleteElement( bestSpan );
+        }
+
+    s->usedW += w;
+
+    slotsUsed++;
+    slotPixelsUsed += w * h;
+
+    return slot;
+    }
+
+
+
+void freeAtlasSlot( AtlasSlot *inSlot ) {
+    if( inSlot->page == -1 ) {
+        return;
+        }
+
+    int shelfIndex = -1;
+
+    for( int i=0; i<shelves.size(); i++ ) {
+        AtlasShelf *s = shelves.getElement( i );
+
+        if( s->page == inSlot->page && s->y == inSlot->y ) {
+            shelfIndex = i;
+            break;
+            }
+        }
+
+    if( shelfIndex == -1 ) {
+        printf( "Atlas slot at %d,%d in page %d not found in any shelf\n",
+                inSlot->x, inSlot->y, inSlot->page );
+        inSlot->page = -1;
+        return;
+        }
+
+    AtlasShelf *s = shelves.getElement( shelfIndex );
+
+    SimpleVector<AtlasSpan> *spans = s->freeSpans;
+
+    // insert in x order
+    int insertAt = 0;
+    while( insertAt < spans->size() &&
+           spans->getElementDirect( insertAt ).x < inSlot->x ) {
+        insertAt++;
+        }
+
+    AtlasSpan freed = { inSlot->x, inSlot->w };
+
+    spans->push_back( freed );
+
+    for( int i=spans->size() - 1; i>insertAt; i-- ) {
+        *( spans->getElement( i ) ) = spans->getElementDirect( i - 1 );
+        }
+    *( spans->getElement( insertAt ) ) = freed;
+
+    // merge with right neighbor
+    if( insertAt + 1 < spans->size() ) {
+        AtlasSpan *next = spans->getElement( insertAt + 1 );
+        AtlasSpan *cur = spans->getElement( insertAt );
+
+        if( cur->x + cur->w == next->x ) {
+            cur->w += next->w;
+            spans->deleteElement( insertAt + 1 );
+            }
+        }
+
+    // merge with left neighbor
+    if( insertAt > 0 ) {
+        AtlasSpan *prev = spans->getElement( insertAt - 1 );
+        AtlasSpan *cur = spans->getElement( insertAt );
+
+        if( prev->x + prev->w == cur->x ) {
+            prev->w += cur->w;
+            spans->deleteElement( insertAt );
+            }
+        }
+
+    s->usedW -= inSlot->w;
+
+    slotsUsed--;
+    slotPixelsUsed -= inSlot->w * inSlot->h;
+
+    int page = inSlot->page;
+
+    inSlot->page = -1;
+
+
+    // give empty shelves at top of page back to page, so it can be
+    // cut into shelves of other heights
+    char removed = true;
+
+    while( removed ) {
+        removed = false;
+
+        for( int i=0; i<shelves.size(); i++ ) {
+            AtlasShelf *t = shelves.getElement( i );
+
+            if( t->page == page && t->usedW == 0 &&
+                t->y + t->h == pageTopY[page] ) {
+
+                pageTopY[page] = t->y;
+
+                delete t->freeSpans;
+                shelves.deleteElement( i );
+
+                removed = true;
+                break;
+                }
+            }
+        }
+    }
+
+
+
+AtlasStats getAtlasStats() {
+    AtlasStats stats = { 0, slotsUsed, 0 };
+
+    for( int p=0; p<ATLAS_MAX_PAGES; p++ ) {
+        if( pageTopY[p] > 0 ) {
+            stats.pagesUsed++;
+            }
+        }
+
+    if( stats.pagesUsed > 0 ) {
+        stats.fillFraction =
+            slotPixelsUsed /
+            ( (double)stats.pagesUsed * ATLAS_PAGE_D * ATLAS_PAGE_D );
+        }
+
+    return stats;
+    }
@@ -0,0 +1,60 @@
+#ifndef SPRITE_ATLAS_INCLUDED
+#define SPRITE_ATLAS_INCLUDED
+
+
+// Packs live sprites into a few large atlas pages, so that sprites
+// drawn one after another can share a texture.
+//
+// Each page is cut into horizontal shelves, and each shelf into
+// spans.  Sprites are placed in the shelf that wastes the least height,
+// and their spans are given back to the shelf when they are freed, so
+// pages can be reused as sprites are loaded and evicted.
+
+
+#define ATLAS_PAGE_D 2048
+
+#define ATLAS_MAX_PAGES 4
+
+// bigger sprites are left in their own textures
+#define ATLAS_MAX_SPRITE_D 512
+
+
+typedef struct AtlasSlot {
+        // -1 if not in atlas
+        int page;
+
+        // area in page, including padding
+        int x, y;
+        int w, h;
+    } AtlasSlot;
+
+
+
+void initSpriteAtlas();
+
+void freeSpriteAtlas();
+
+
+// returns slot with page -1 if sprite is too big or atlas is full
+AtlasSlot allocateAtlasSlot( int inW, int inH );
+
+
+// sets page of slot to -1 after freeing
+// ignores slots that are not in atlas
+void freeAtlasSlot( AtlasSlot *inSlot );
+
+
+
+typedef struct AtlasStats {
+        int pagesUsed;
+        int slotsUsed;
+
+        // fraction of pixels in used pages covered by slots
+        double fillFraction;
+    } AtlasStats;
+
+
+AtlasStats getAtlasStats();
+
+
+#endif
@@ -14,8 +14,13 @@
 
 #include "minorGems/game/game.h"
 
+#include "minorGems/util/SettingsManager.h"
+
+#include "minorGems/system/Time.h"
+
 
 #include "folderCache.h"
+#include "spriteDecoder.h"
 
 
 
@@ -55,6 +60,22 @@ static SimpleVector<SpriteLoadingRecord> loadingSprites;
 
 static SimpleVector<int> loadedSprites;
 
+// sprites in pack waiting for upload from mapped pixels
+static SimpleVector<int> packedSpritesToUpload;
+
+
+static SpriteDrawStats drawStats = { 0, 0 };
+
+static int lastDrawnPage = -1;
+static char lastDrawnMultiplicative = false;
+
+
+// decoded sprites are uploaded until this much time is used in a step
+// (at least one is uploaded per step, so backlog always drains)
+static double uploadSecondsPerStep = 0.004;
+
+static SpriteLoadStats loadStats = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
 
 
 int getMaxSpriteID() {
@@ -79,43 +100,21 @@ int initSpriteBankStart( char *outRebuildingCache ) {
 
     cache = initFolderCache( "sprites", outRebuildingCache );
 
-    unsigned char onePixel[4] = { 0, 0, 0, 0 };
-    
-
-    blankSprite = fillSprite( onePixel, 1, 1 );
-    
-    return cache.numFiles;
-    }
+    initSpriteAtlas();
 
+    // missing when regenerateCaches is about to rebuild it
+    openSpritePack( SPRITE_PACK_FILE_NAME );
 
+    uploadSecondsPerStep = 
+        SettingsManager::getIntSetting( "spriteUploadMillisecondsPerFrame", 
+                                        4 ) / 1000.0;
 
-
-// expands true regions by making neighbor pixels true also
-void expandMap( char *inMap, int inW, int inH ) {
-    int numPixels = inW * inH;
-    
-    char *copy = new char[ numPixels ];
-    
-    memcpy( copy, inMap, numPixels );
+    unsigned char onePixel[4] = { 0, 0, 0, 0 };
     
-    // avoid edges
-    for( int y = 1; y < inH-1; y++ ) {
-        for( int x = 1; x < inW-1; x++ ) {
-            int index = y * inW + x;
-            
-            if( copy[index] ) {
-                // make neighbors true also
 
-                inMap[index-1] = true;
-                inMap[index+1] = true;
-
-                inMap[index-inW] = true;
-                inMap[index+inW] = true;                
-                }
-            }
-        }
+    blankSprite = fillSprite( onePixel, 1, 1 );
     
-    delete [] copy;
+    return cache.numFiles;
     }
 
 
@@ -145,6 +144,8 @@ float initSpriteBankStep() {
         r->hitMap = NULL;
         r->loading = false;
         r->numStepsUnused = 0;
+        r->atlasSlot.page = -1;
+        r->packEntry = NULL;
         
         r->remappable = true;
         r->remapTarget = true;
@@ -274,6 +275,130 @@ void initSpriteBankFinish() {
         }
 
     printf( "Loaded %d tagged sprites from sprites folder\n", numRecords );
+
+
+    // sizes and offsets known now for packed sprites, before their
+    // images are loaded
+    // pack entries for sprites no longer in folder are ignored, and
+    // sprites added since pack was built are loaded from their TGAs
+    int numPacked = 0;
+    
+    int numPackEntries = getNumSpritePackEntries();
+    
+    for( int i=0; i<numPackEntries; i++ ) {
+        SpritePackEntry *e = getSpritePackEntry( i );
+        
+        SpriteRecord *r = getSpriteRecord( e->id );
+        
+        if( r == NULL ) {
+            continue;
+            }
+        
+        r->packEntry = e;
+        
+        r->w = e->w;
+        r->h = e->h;
+        
+        r->maxD = r->w;
+        if( r->h > r->maxD ) {
+            r->maxD = r->h;
+            }
+        
+        r->centerXOffset = e->centerXOffset;
+        r->centerYOffset = e->centerYOffset;
+        
+        r->visibleW = e->visibleW;
+        r->visibleH = e->visibleH;
+        
+        numPacked++;
+        }
+    
+    if( numPackEntries > 0 ) {
+        printf( "Found %d of them in sprite pack\n", numPacked );
+        }
+    }
+
+
+
+static int packSpriteID;
+static int numSpritesToPack;
+static int numSpritesPacked;
+
+
+int buildSpritePackStart() {
+    packSpriteID = 0;
+    numSpritesPacked = 0;
+    numSpritesToPack = 0;
+    
+    if( ! startSpritePack( SPRITE_PACK_FILE_NAME ) ) {
+        packSpriteID = mapSize;
+        return 0;
+        }
+
+    for( int i=0; i<mapSize; i++ ) {
+        if( idMap[i] != NULL ) {
+            numSpritesToPack++;
+            }
+        }
+    
+    return numSpritesToPack;
+    }
+
+
+
+float buildSpritePackStep() {
+    // skip to next sprite
+    while( packSpriteID < mapSize && idMap[ packSpriteID ] == NULL ) {
+        packSpriteID++;
+        }
+    
+    if( packSpriteID == mapSize ) {
+        return 1.0;
+        }
+    
+    char *fileNameTGA = autoSprintf( "%d.tga", packSpriteID );
+    
+    File *spriteFile = spritesDir.getChildFile( fileNameTGA );
+    
+    delete [] fileNameTGA;
+    
+    char *fullName = spriteFile->getFullFileName();
+    
+    delete spriteFile;
+    
+    RawRGBAImage *image = readTGAFileRawBase( fullName );
+    
+    delete [] fullName;
+    
+    DecodedSprite decoded;
+    
+    decodeSpriteImage( packSpriteID, image, &decoded );
+    
+    if( decoded.image != NULL ) {
+        addToSpritePack( &decoded );
+        
+        delete decoded.image;
+        delete [] decoded.hitMap;
+        }
+    
+    packSpriteID++;
+    numSpritesPacked++;
+    
+    if( numSpritesToPack == 0 ) {
+        return 1.0;
+        }
+    return (float)numSpritesPacked / (float)numSpritesToPack;
+    }
+
+
+
+void buildSpritePackFinish() {
+    int numWritten = finishSpritePack();
+    
+    if( numWritten >= 0 ) {
+        printf( "Wrote %d sprites to %s\n", numWritten, 
+                SPRITE_PACK_FILE_NAME );
+        }
     }
 
 
@@ -283,7 +408,13 @@ static void loadSpriteImage( int inID ) {
     
     if( r != NULL ) {
         
-        if( r->sprite == NULL && ! r->loading ) {
+        if( r->sprite == NULL && ! r->loading && r->packEntry != NULL ) {
+            // nothing to read or decode, uploaded in stepSpriteBank
+            packedSpritesToUpload.push_back( inID );
+            
+            r->loading = true;
+            }
+        else if( r->sprite == NULL && ! r->loading ) {
                 
             File spritesDir( NULL, "sprites" );
             
@@ -330,6 +461,7 @@ static void freeSpriteRecord( int inID ) {
             
             if( idMap[inID]->sprite != NULL ) {    
                 freeSprite( idMap[inID]->sprite );
+                freeAtlasSlot( &( idMap[inID]->atlasSlot ) );
                 
                 for( int i=0; i<loadedSprites.size(); i++ ) {
                     int id = loadedSprites.getElementDirect( i );
@@ -389,6 +521,37 @@ void freeSpriteBank() {
     if( blankSprite != NULL ) {
         freeSprite( blankSprite );
         }
+    
+    freeSpriteDecoder();
+    
+    freeSpriteAtlas();
+
+    packedSpritesToUpload.deleteAll();
+    
+    closeSpritePack();
+    }
+
+
+
+static void uploadSprite( SpriteRecord *inR, unsigned char *inRGBA,
+                          int inW, int inH ) {
+    inR->sprite = fillSprite( inRGBA, inW, inH );
+    
+    inR->w = inW;
+    inR->h = inH;
+    
+    inR->atlasSlot = allocateAtlasSlot( inR->w, inR->h );
+    
+    doublePair offset = { (double)( inR->centerAnchorXOffset ),
+                          (double)( inR->centerAnchorYOffset ) };
+    
+    setSpriteCenterOffset( inR->sprite, offset );
+    
+    
+    inR->maxD = inR->w;
+    if( inR->h > inR->maxD ) {
+        inR->maxD = inR->h;
+        }
     }
 
 
@@ -402,128 +565,111 @@ void stepSpriteBank() {
             int length;
             unsigned char *data = getAsyncFileData( loadingR->asyncLoadHandle, 
                                                     &length );
-            SpriteRecord *r = getSpriteRecord( loadingR->spriteID );
-
             
             if( data == NULL ) {
                 printf( "Reading sprite data from file failed, sprite ID %d\n",
                         loadingR->spriteID );
-                }
-            else {
                 
-                
-                RawRGBAImage *spriteImage = readTGAFileRawFromBuffer( data, 
-                                                                      length );
-
-                if( spriteImage != NULL && spriteImage->mNumChannels != 4 ) {
-                    printf( "Sprite loading for id %d not a 4-channel image, "
-                            "failed to load.\n",
-                            loadingR->spriteID );
-                    delete spriteImage;
-                    spriteImage = NULL;
-                    }
-                            
-                if( spriteImage != NULL ) {
-                
-                        
-                    r->sprite =
-                        fillSprite( spriteImage->mRGBABytes, 
-                                    spriteImage->mWidth,
-                                    spriteImage->mHeight );
-                
-                    r->w = spriteImage->mWidth;
-                    r->h = spriteImage->mHeight;                
-                    
-                    doublePair offset = { (double)( r->centerAnchorXOffset ),
-                                          (double)( r->centerAnchorYOffset ) };
-                    
-                    setSpriteCenterOffset( r->sprite, offset );
-
-                                          
-
-                    r->maxD = r->w;
-                    if( r->h > r->maxD ) {
-                        r->maxD = r->h;
-                        }        
-                    
-                    int numPixels = r->w * r->h;
-                    r->hitMap = new char[ numPixels ];
-                    
-                    memset( r->hitMap, 1, numPixels );
-                    
-                    
-                    int numBytes = numPixels * 4;
-                    
-                    unsigned char *bytes = spriteImage->mRGBABytes;
-                    
-                    // track max/min x and y to compute average for center
-
-                    int minX = r->w;
-                    int maxX = 0;
-                    
-                    int minY = r->h;
-                    int maxY = 0;
-                    
-                    int w = r->w;
-                    
-
-                    // alpha is 4th byte
-                    int p=0;
-                    for( int b=3; b<numBytes; b+=4 ) {
-                        if( bytes[b] < 64 ) {
-                            r->hitMap[p] = 0;
-                            }
-                        else {
-                            int y = p / w;
-                            int x = p % w;
-
-                            if( y < minY ) {
-                                minY = y;
-                                }
-                            if( y > maxY ) {
-                                maxY = y;
-                                }
-
-                            if( x < minX ) {
-                                minX = x;
-                                }
-                            if( x > maxX ) {
-                                maxX = x;
-                                }
-                            }
-                        
-                        p++;
-                        }
-                    
-                    for( int e=0; e<3; e++ ) {    
-                        expandMap( r->hitMap, r->w, r->h );
-                        }
-
-                    r->centerXOffset = 
-                        ( maxX + minX ) / 2 - 
-                        r->w / 2;
+                SpriteRecord *r = getSpriteRecord( loadingR->spriteID );
 
-                    r->centerYOffset = 
-                        ( maxY + minY ) / 2 - 
-                        r->h / 2;
-                    
-                    r->visibleW = maxX - minX;
-                    r->visibleH = maxY - minY;
+                r->numStepsUnused = 0;
+                loadedSprites.push_back( loadingR->spriteID );
+                }
+            else {
+                // decoded on worker thread, uploaded below when done
+                startSpriteDecode( loadingR->spriteID, data, length );
+                }
+            
+            loadingSprites.deleteElement( i );
+            i--;
+            }
+        }
+    
 
-                    delete spriteImage;
-                    }
-                
-                delete [] data;
+    // upload packed and decoded sprites, until out of time for this step
+    double uploadStartTime = Time::getCurrentTime();
+    int numUploaded = 0;
+    
+    DecodedSprite decoded;
+    
+    while( numUploaded == 0 || 
+           Time::getCurrentTime() - uploadStartTime < uploadSecondsPerStep ) {
+        
+        if( packedSpritesToUpload.size() > 0 ) {
+            int id = packedSpritesToUpload.getElementDirect( 0 );
+            packedSpritesToUpload.deleteElement( 0 );
+            
+            numUploaded++;
+            
+            SpriteRecord *r = getSpriteRecord( id );
+            
+            if( r == NULL || ! r->loading || r->sprite != NULL ) {
+                // deleted while waiting
+                continue;
                 }
             
+            SpritePackEntry *e = r->packEntry;
+            
+            uploadSprite( r, getSpritePackPixels( e ), e->w, e->h );
+            
+            // hit map stays in pack
+            
             r->numStepsUnused = 0;
-            loadedSprites.push_back( loadingR->spriteID );
-
-            loadingSprites.deleteElement( i );
-            i++;
+            loadedSprites.push_back( id );
+            
+            loadStats.numFromPack++;
+            continue;
+            }
+        
+        if( ! getDecodedSprite( &decoded ) ) {
+            break;
+            }
+        
+        numUploaded++;
+        
+        loadStats.numDecoded++;
+        loadStats.decodeSeconds += decoded.decodeSeconds;
+        
+        if( decoded.decodeSeconds > loadStats.maxDecodeSeconds ) {
+            loadStats.maxDecodeSeconds = decoded.decodeSeconds;
+            }
+        
+        SpriteRecord *r = getSpriteRecord( decoded.spriteID );
+        
+        if( r == NULL || ! r->loading || r->sprite != NULL ) {
+            // sprite deleted or replaced while decoding
+            if( decoded.image != NULL ) {
+                delete decoded.image;
+                delete [] decoded.hitMap;
+                }
+            continue;
+            }
+        
+        if( decoded.image != NULL ) {
+            RawRGBAImage *spriteImage = decoded.image;
+            
+            uploadSprite( r, spriteImage->mRGBABytes, 
+                          spriteImage->mWidth,
+                          spriteImage->mHeight );
+            
+            r->hitMap = decoded.hitMap;
+            
+            r->centerXOffset = decoded.centerXOffset;
+            r->centerYOffset = decoded.centerYOffset;
+            
+            r->visibleW = decoded.visibleW;
+            r->visibleH = decoded.visibleH;
+            
+            delete spriteImage;
             }
+        
+        r->numStepsUnused = 0;
+        loadedSprites.push_back( decoded.spriteID );
         }
     
+    loadStats.numUploaded += numUploaded;
+    loadStats.uploadSeconds += Time::getCurrentTime() - uploadStartTime;
+    
 
     for( int i=0; i<loadedSprites.size(); i++ ) {
         int id = loadedSprites.getElementDirect( i );
@@ -538,6 +684,8 @@ void stepSpriteBank() {
             freeSprite( r->sprite );
             r->sprite = NULL;
             
+            freeAtlasSlot( &( r->atlasSlot ) );
+            
             delete [] r->hitMap;
             r->hitMap = NULL;
 
@@ -654,8 +802,51 @@ SpriteHandle getSprite( int inID ) {
         return blankSprite;
         }
             
-    idMap[inID]->numStepsUnused = 0;
-    return idMap[inID]->sprite;
+    SpriteRecord *r = idMap[inID];
+    
+    r->numStepsUnused = 0;
+    
+    drawStats.spriteDraws++;
+    
+    if( r->atlasSlot.page == -1 ||
+        r->atlasSlot.page != lastDrawnPage ||
+        r->multiplicativeBlend != lastDrawnMultiplicative ) {
+        drawStats.atlasBatches++;
+        }
+    
+    lastDrawnPage = r->atlasSlot.page;
+    lastDrawnMultiplicative = r->multiplicativeBlend;
+    
+    return r->sprite;
+    }
+
+
+
+SpriteLoadStats getSpriteLoadStats() {
+    SpriteLoadStats stats = loadStats;
+    
+    stats.decodeBacklog = getNumSpritesDecoding();
+    stats.uploadBacklog = getNumSpritesDecoded();
+    
+    loadStats.numDecoded = 0;
+    loadStats.decodeSeconds = 0;
+    loadStats.maxDecodeSeconds = 0;
+    loadStats.numUploaded = 0;
+    loadStats.numFromPack = 0;
+    loadStats.uploadSeconds = 0;
+    
+    return stats;
+    }
+
+
+
+SpriteDrawStats getSpriteDrawStats() {
+    SpriteDrawStats stats = drawStats;
+    
+    drawStats.spriteDraws = 0;
+    drawStats.atlasBatches = 0;
+    
+    return stats;
     }
 
 
@@ -901,6 +1092,9 @@ int addSprite( const char *inTag, SpriteHandle inSprite,
     r->w = inSourceImage->getWidth();
     r->h = inSourceImage->getHeight();
     
+    r->atlasSlot = allocateAtlasSlot( r->w, r->h );
+    r->packEntry = NULL;
+    
     r->visibleW = r->w;
     r->visibleH = r->h;
 
@@ -1308,7 +1502,10 @@ void deleteSpriteFromBank( int inID ) {
 
 char getSpriteHit( int inID, int inXCenterOffset, int inYCenterOffset ) {
     if( inID < mapSize ) {
-        if( idMap[inID] != NULL && idMap[inID]->sprite != NULL ) {
+        // packed sprites can be hit-tested before their images load
+        if( idMap[inID] != NULL && 
+            ( idMap[inID]->sprite != NULL || 
+              idMap[inID]->packEntry != NULL ) ) {
             
             SpriteRecord *r = idMap[inID];
 
@@ -1319,9 +1516,7 @@ char getSpriteHit( int inID, int inXCenterOffset, int inYCenterOffset ) {
                 &&
                 pixY >=0 && pixY < r->h ) {
 
-                int pixI = r->w * pixY + pixX;
-                
-                return r->hitMap[ pixI ];
+                return getSpritePixelHit( r, pixX, pixY );
                 }
             }
         }
@@ -1331,3 +1526,15 @@ char getSpriteHit( int inID, int inXCenterOffset, int inYCenterOffset ) {
 
 
 
+char getSpritePixelHit( SpriteRecord *inRecord, int inX, int inY ) {
+    if( inRecord->hitMap != NULL ) {
+        return inRecord->hitMap[ inRecord->w * inY + inX ];
+        }
+    else if( inRecord->packEntry != NULL ) {
+        return getSpritePackHit( inRecord->packEntry, inX, inY );
+        }
+    return false;
+    }
+
+
+
@@ -4,6 +4,9 @@
 
 #include "minorGems/game/gameGraphics.h"
 
+#include "spriteAtlas.h"
+#include "spritePack.h"
+
 
 typedef struct SpriteRecord {
         int id;
@@ -46,6 +49,14 @@ typedef struct SpriteRecord {
         
         char remappable;
         char remapTarget;
+        
+        // space held in atlas while sprite is loaded
+        // page -1 if not in atlas
+        AtlasSlot atlasSlot;
+
+        // pixels, hit map and offsets in mapped sprite pack
+        // NULL if sprite not in pack (loaded from its TGA instead)
+        SpritePackEntry *packEntry;
 
     } SpriteRecord;
 
@@ -72,6 +83,17 @@ int getMaxSpriteID();
 
 
 
+// decodes every sprite's TGA and writes a sprite pack, for regenerateCaches
+// call after bank init is complete
+// returns number of sprites to pack
+int buildSpritePackStart();
+
+// returns progress... ready for Finish when progress == 1.0
+float buildSpritePackStep();
+void buildSpritePackFinish();
+
+
+
 void freeSpriteBank();
 
 
@@ -94,6 +116,46 @@ char markSpriteLive( int inID );
 
 
 
+// counts sprites fetched with getSprite for drawing
+typedef struct SpriteDrawStats {
+        // each one currently its own texture bind and draw call
+        int spriteDraws;
+        
+        // draw calls needed if runs of sprites that share an atlas page
+        // and blend mode were each submitted as one batch
+        int atlasBatches;
+    } SpriteDrawStats;
+
+
+// resets counts
+SpriteDrawStats getSpriteDrawStats();
+
+
+
+// streamed sprite loading since last call
+typedef struct SpriteLoadStats {
+        // TGA decode and hit map building, on worker thread
+        int numDecoded;
+        double decodeSeconds;
+        double maxDecodeSeconds;
+        
+        // texture upload, on main thread
+        // numFromPack of these came straight from the sprite pack
+        int numUploaded;
+        int numFromPack;
+        double uploadSeconds;
+        
+        // right now
+        int decodeBacklog;
+        int uploadBacklog;
+    } SpriteLoadStats;
+
+
+// resets counts
+SpriteLoadStats getSpriteLoadStats();
+
+
+
 // return array destroyed by caller, NULL if none found
 SpriteRecord **searchSprites( const char *inSearch, 
                               int inNumToSkip, 
@@ -132,6 +194,11 @@ void deleteSpriteFromBank( int inID );
 char getSpriteHit( int inID, int inXCenterOffset, int inYCenterOffset );
 
 
+// hit map lookup in image pixel coordinates
+// false if sprite's hit map not available
+char getSpritePixelHit( SpriteRecord *inRecord, int inX, int inY );
+
+
 
 // for randomly remapping sprites to other sprites
 void setRemapSeed( int inSeed );
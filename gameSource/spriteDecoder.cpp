@@ -0,0 +1,306 @@
+#include "spriteDecoder.h"
+
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/system/Time.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+// expands true regions by making neighbor pixels true also
+void expandMap( char *inMap, int inW, int inH ) {
+    int numPixels = inW * inH;
+
+    char *copy = new char[ numPixels ];
+
+    memcpy( copy, inMap, numPixels );
+
+    // avoid edges
+    for( int y = 1; y < inH-1; y++ ) {
+        for( int x = 1; x < inW-1; x++ ) {
+            int index = y * inW + x;
+
+            if( copy[index] ) {
+                // make neighbors true also
+
+                inMap[index-1] = true;
+                inMap[index+1] = true;
+
+                inMap[index-inW] = true;
+                inMap[index+inW] = true;
+                }
+            }
+        }
+
+    delete [] copy;
+    }
+
+
+
+typedef struct SpriteDecodeJob {
+        int spriteID;
+        unsigned char *data;
+        int length;
+    } SpriteDecodeJob;
+
+
+
+static MutexLock queueLock;
+static BinarySemaphore jobAddedSemaphore;
+
+// all protected by queueLock
+static SimpleVector<SpriteDecodeJob> jobs;
+static SimpleVector<DecodedSprite> decodedSprites;
+static int numJobsInProgress = 0;
+static char threadStopSignal = false;
+
+
+
+void decodeSpriteImage( int inSpriteID, RawRGBAImage *inImage,
+                        DecodedSprite *outSprite ) {
+    outSprite->spriteID = inSpriteID;
+    outSprite->image = NULL;
+    outSprite->hitMap = NULL;
+    outSprite->centerXOffset = 0;
+    outSprite->centerYOffset = 0;
+    outSprite->visibleW = 0;
+    outSprite->visibleH = 0;
+
+    outSprite->decodeSeconds = 0;
+
+    RawRGBAImage *spriteImage = inImage;
+
+    if( spriteImage != NULL && spriteImage->mNumChannels != 4 ) {
+        printf( "Sprite loading for id %d not a 4-channel image, "
+                "failed to load.\n",
+                inSpriteID );
+        delete spriteImage;
+        spriteImage = NULL;
+        }
+
+    if( spriteImage != NULL ) {
+        int w = spriteImage->mWidth;
+        int h = spriteImage->mHeight;
+
+        int numPixels = w * h;
+        char *hitMap = new char[ numPixels ];
+
+        memset( hitMap, 1, numPixels );
+
+
+        int numBytes = numPixels * 4;
+
+        unsigned char *bytes = spriteImage->mRGBABytes;
+
+        // track max/min x and y to compute average for center
+
+        int minX = w;
+        int maxX = 0;
+
+        int minY = h;
+        int maxY = 0;
+
+
+        // alpha is 4th byte
+        int p=0;
+        for( int b=3; b<numBytes; b+=4 ) {
+            if( bytes[b] < 64 ) {
+                hitMap[p] = 0;
+                }
+            else {
+                int y = p / w;
+                int x = p % w;
+
+                if( y < minY ) {
+                    minY = y;
+                    }
+                if( y > maxY ) {
+                    maxY = y;
+                    }
+
+                if( x < minX ) {
+                    minX = x;
+                    }
+                if( x > maxX ) {
+                    maxX = x;
+                    }
+                }
+
+            p++;
+            }
+
+        for( int e=0; e<3; e++ ) {
+            expandMap( hitMap, w, h );
+            }
+
+        outSprite->image = spriteImage;
+        outSprite->hitMap = hitMap;
+
+        outSprite->centerXOffset = ( maxX + minX ) / 2 - w / 2;
+        outSprite->centerYOffset = ( maxY + minY ) / 2 - h / 2;
+
+        outSprite->visibleW = maxX - minX;
+        outSprite->visibleH = maxY - minY;
+        }
+    }
+
+
+
+static void decodeSprite( SpriteDecodeJob *inJob, DecodedSprite *outSprite ) {
+    double startTime = Time::getCurrentTime();
+
+    RawRGBAImage *spriteImage = readTGAFileRawFromBuffer( inJob->data,
+                                                          inJob->length );
+
+    decodeSpriteImage( inJob->spriteID, spriteImage, outSprite );
+
+    outSprite->decodeSeconds = Time::getCurrentTime() - startTime;
+    }
+
+
+
+class SpriteDecodeThread : public Thread {
+
+        virtual void run() {
+
+            while( true ) {
+
+                SpriteDecodeJob job;
+                char gotJob = false;
+
+                queueLock.lock();
+
+                if( threadStopSignal ) {
+                    queueLock.unlock();
+                    break;
+                    }
+
+                if( jobs.size() > 0 ) {
+                    job = jobs.getElementDirect( 0 );
+                    jobs.deleteElement( 0 );
+                    numJobsInProgress++;
+                    gotJob = true;
+                    }
+
+                queueLock.unlock();
+
+
+                if( ! gotJob ) {
+                    jobAddedSemaphore.wait();
+                    continue;
+                    }
+
+                DecodedSprite decoded;
+
+                decodeSprite( &job, &decoded );
+
+                delete [] job.data;
+
+                queueLock.lock();
+                decodedSprites.push_back( decoded );
+                numJobsInProgress--;
+                queueLock.unlock();
+                }
+            }
+
+    };
+
+
+static SpriteDecodeThread *decodeThread = NULL;
+
+
+
+void startSpriteDecode( int inSpriteID, unsigned char *inData, int inLength ) {
+    if( decodeThread == NULL ) {
+        threadStopSignal = false;
+
+        decodeThread = new SpriteDecodeThread();
+        decodeThread->start();
+        }
+
+    SpriteDecodeJob job = { inSpriteID, inData, inLength };
+
+    queueLock.lock();
+    jobs.push_back( job );
+    queueLock.unlock();
+
+    jobAddedSemaphore.signal();
+    }
+
+
+
+char getDecodedSprite( DecodedSprite *outSprite ) {
+    char found = false;
+
+    queueLock.lock();
+
+    if( decodedSprites.size() > 0 ) {
+        *outSprite = decodedSprites.getElementDirect( 0 );
+        decodedSprites.deleteElement( 0 );
+        found = true;
+        }
+
+    queueLock.unlock();
+
+    return found;
+    }
+
+
+
+int getNumSpritesDecoding() {
+    queueLock.lock();
+    int num = jobs.size() + numJobsInProgress;
+    queueLock.unlock();
+
+    return num;
+    }
+
+
+
+int getNumSpritesDecoded() {
+    queueLock.lock();
+    int num = decodedSprites.size();
+    queueLock.unlock();
+
+    return num;
+    }
+
+
+
+void freeSpriteDecoder() {
+    if( decodeThread != NULL ) {
+        queueLock.lock();
+        threadStopSignal = true;
+        queueLock.unlock();
+
+        jobAddedSemaphore.signal();
+
+        decodeThread->join();
+
+        delete decodeThread;
+        decodeThread = NULL;
+        }
+
+    for( int i=0; i<jobs.size(); i++ ) {
+        delete [] jobs.getElementDirect( i ).data;
+        }
+    jobs.deleteAll();
+
+    for( int i=0; i<decodedSprites.size(); i++ ) {
+        DecodedSprite *d = decodedSprites.getElement( i );
+
+        if( d->image != NULL ) {
+            delete d->image;
+            }
+        if( d->hitMap != NULL ) {
+            delete [] d->hitMap;
+            }
+        }
+    decodedSprites.deleteAll();
+    }
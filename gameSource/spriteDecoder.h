@@ -0,0 +1,72 @@
+#ifndef SPRITE_DECODER_INCLUDED
+#define SPRITE_DECODER_INCLUDED
+
+
+#include "minorGems/game/gameGraphics.h"
+
+
+// Decodes streamed sprite TGA data and builds hit maps on a worker
+// thread, so that the main thread only has to upload finished images.
+//
+// Worker thread is started with first decode, and stopped by
+// freeSpriteDecoder.
+//
+// These calls are NOT thread safe for multiple calling threads.
+
+
+
+// expands true regions by making neighbor pixels true also
+void expandMap( char *inMap, int inW, int inH );
+
+
+
+typedef struct DecodedSprite {
+        int spriteID;
+
+        // NULL if decoding failed
+        RawRGBAImage *image;
+
+        // 0 where alpha <0.25, for registering mouse clicks on sprite
+        char *hitMap;
+
+        // center of non-transparent area of sprite
+        // offset relative to w/2, h/2
+        int centerXOffset, centerYOffset;
+
+        // size of visible a>= 0.25 area of sprite
+        int visibleW, visibleH;
+
+        double decodeSeconds;
+    } DecodedSprite;
+
+
+
+// builds hit map and offsets for an already-read image on calling thread,
+// for offline tools
+// takes ownership of inImage (NULL allowed, for a failed read)
+void decodeSpriteImage( int inSpriteID, RawRGBAImage *inImage,
+                        DecodedSprite *outSprite );
+
+
+
+// takes ownership of inData
+void startSpriteDecode( int inSpriteID, unsigned char *inData, int inLength );
+
+
+// returns true and fills outSprite if a decoded sprite is ready
+// caller takes ownership of image and hitMap
+char getDecodedSprite( DecodedSprite *outSprite );
+
+
+// sprites waiting for or being decoded
+int getNumSpritesDecoding();
+
+// sprites decoded but not taken with getDecodedSprite yet
+int getNumSpritesDecoded();
+
+
+// stops worker and frees anything still queued
+void freeSpriteDecoder();
+
+
+#endif
@@ -0,0 +1,429 @@
+#include "spritePack.h"
+
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+
+static unsigned char *packMap = NULL;
+static uint64_t packMapSize = 0;
+
+static SpritePackEntry *packEntries = NULL;
+static int numPackEntries = 0;
+
+
+#ifdef _WIN32
+static HANDLE packFileHandle = INVALID_HANDLE_VALUE;
+static HANDLE packMappingHandle = NULL;
+#endif
+
+
+
+// maps whole file copy-on-write, so that pages are only read in as used
+// and nothing ever writes back to the pack
+// returns NULL on failure
+static unsigned char *mapFile( const char *inFileName, uint64_t *outSize ) {
+#ifdef _WIN32
+    packFileHandle = CreateFileA( inFileName, GENERIC_READ, FILE_SHARE_READ,
+                                  NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, NULL );
+
+    if( packFileHandle == INVALID_HANDLE_VALUE ) {
+        return NULL;
+        }
+
+    LARGE_INTEGER size;
+
+    if( ! GetFileSizeEx( packFileHandle, &size ) ||
+        size.QuadPart == 0 ||
+        (uint64_t)size.QuadPart > (uint64_t)(size_t)-1 ) {
+        CloseHandle( packFileHandle );
+        packFileHandle = INVALID_HANDLE_VALUE;
+        return NULL;
+        }
+
+    packMappingHandle = CreateFileMappingA( packFileHandle, NULL,
+                                            PAGE_WRITECOPY, 0, 0, NULL );
+
+    if( packMappingHandle == NULL ) {
+        CloseHandle( packFileHandle );
+        packFileHandle = INVALID_HANDLE_VALUE;
+        return NULL;
+        }
+
+    void *m = MapViewOfFile( packMappingHandle, FILE_MAP_COPY, 0, 0, 0 );
+
+    if( m == NULL ) {
+        CloseHandle( packMappingHandle );
+        packMappingHandle = NULL;
+        CloseHandle( packFileHandle );
+        packFileHandle = INVALID_HANDLE_VALUE;
+        return NULL;
+        }
+
+    *outSize = size.QuadPart;
+    return (unsigned char*)m;
+#else
+    int fd = open( inFileName, O_RDONLY );
+
+    if( fd == -1 ) {
+        return NULL;
+        }
+
+    struct stat st;
+
+    if( fstat( fd, &st ) != 0 ||
+        st.st_size == 0 ||
+        (uint64_t)st.st_size > (uint64_t)(size_t)-1 ) {
+        close( fd );
+        return NULL;
+        }
+
+    void *m = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, 0 );
+
+    // mapping stays valid after fd closed
+    close( fd );
+
+    if( m == MAP_FAILED ) {
+        return NULL;
+        }
+
+    *outSize = st.st_size;
+    return (unsigned char*)m;
+#endif
+    }
+
+
+
+static void unmapFile() {
+#ifdef _WIN32
+    UnmapViewOfFile( packMap );
+    CloseHandle( packMappingHandle );
+    packMappingHandle = NULL;
+    CloseHandle( packFileHandle );
+    packFileHandle = INVALID_HANDLE_VALUE;
+#else
+    munmap( packMap, packMapSize );
+#endif
+    }
+
+
+
+static uint64_t getHitMapBytes( int inW, int inH ) {
+    return ( (uint64_t)inW * inH + 7 ) / 8;
+    }
+
+
+
+char openSpritePack( const char *inFileName ) {
+    closeSpritePack();
+
+    uint64_t size;
+
+    unsigned char *map = mapFile( inFileName, &size );
+
+    if( map == NULL ) {
+        return false;
+        }
+
+    packMap = map;
+    packMapSize = size;
+
+
+    SpritePackHeader *header = (SpritePackHeader*)packMap;
+
+    char good = true;
+
+    if( size < sizeof( SpritePackHeader ) ||
+        memcmp( header->magic, "OLSP", 4 ) != 0 ||
+        header->version != SPRITE_PACK_VERSION ||
+        header->entrySize != sizeof( SpritePackEntry ) ||
+        header->entriesOffset % SPRITE_PACK_ALIGN != 0 ||
+        header->entriesOffset > size ||
+        ( size - header->entriesOffset ) / sizeof( SpritePackEntry ) <
+        header->numEntries ) {
+        good = false;
+        }
+
+    if( good ) {
+        SpritePackEntry *entries =
+            (SpritePackEntry*)( packMap + header->entriesOffset );
+
+        for( unsigned int i=0; i<header->numEntries; i++ ) {
+            SpritePackEntry *e = &( entries[i] );
+
+            uint64_t pixelBytes = (uint64_t)e->w * e->h * 4;
+
+            if( e->w <= 0 || e->h <= 0 ||
+                ( i > 0 && e->id <= entries[i-1].id ) ||
+                e->pixelOffset > size ||
+                size - e->pixelOffset < pixelBytes ||
+                e->hitMapOffset > size ||
+                size - e->hitMapOffset < getHitMapBytes( e->w, e->h ) ) {
+                good = false;
+                break;
+                }
+            }
+
+        if( good ) {
+            packEntries = entries;
+            numPackEntries = header->numEntries;
+            }
+        }
+
+    if( ! good ) {
+        printf( "Sprite pack %s is not valid, ignoring it\n", inFileName );
+        closeSpritePack();
+        return false;
+        }
+
+    return true;
+    }
+
+
+
+void closeSpritePack() {
+    if( packMap != NULL ) {
+        unmapFile();
+        }
+
+    packMap = NULL;
+    packMapSize = 0;
+    packEntries = NULL;
+    numPackEntries = 0;
+    }
+
+
+
+int getNumSpritePackEntries() {
+    return numPackEntries;
+    }
+
+
+
+SpritePackEntry *getSpritePackEntry( int inIndex ) {
+    return &( packEntries[ inIndex ] );
+    }
+
+
+
+unsigned char *getSpritePackPixels( SpritePackEntry *inEntry ) {
+    return &( packMap[ inEntry->pixelOffset ] );
+    }
+
+
+
+unsigned char *getSpritePackHitMap( SpritePackEntry *inEntry ) {
+    return &( packMap[ inEntry->hitMapOffset ] );
+    }
+
+
+
+char getSpritePackHit( SpritePackEntry *inEntry, int inX, int inY ) {
+    unsigned char *bits = getSpritePackHitMap( inEntry );
+
+    int p = inY * inEntry->w + inX;
+
+    return ( bits[ p >> 3 ] >> ( p & 7 ) ) & 1;
+    }
+
+
+
+
+static FILE *writeFile = NULL;
+static char *writeFileName = NULL;
+static char *writeTempFileName = NULL;
+
+static uint64_t writePos = 0;
+static char writeFailed = false;
+
+static SimpleVector<SpritePackEntry> writeEntries;
+
+
+
+static void writeBytes( const void *inBytes, uint64_t inLength ) {
+    if( writeFailed ) {
+        return;
+        }
+
+    if( fwrite( inBytes, 1, inLength, writeFile ) != inLength ) {
+        writeFailed = true;
+        }
+    writePos += inLength;
+    }
+
+
+
+static void writeAlignPadding() {
+    unsigned char zeros[ SPRITE_PACK_ALIGN ];
+    memset( zeros, 0, SPRITE_PACK_ALIGN );
+
+    int extra = writePos % SPRITE_PACK_ALIGN;
+
+    if( extra != 0 ) {
+        writeBytes( zeros, SPRITE_PACK_ALIGN - extra );
+        }
+    }
+
+
+
+static void clearWriteState() {
+    if( writeFileName != NULL ) {
+        delete [] writeFileName;
+        writeFileName = NULL;
+        }
+    if( writeTempFileName != NULL ) {
+        delete [] writeTempFileName;
+        writeTempFileName = NULL;
+        }
+    writeFile = NULL;
+    writePos = 0;
+    writeFailed = false;
+    writeEntries.deleteAll();
+    }
+
+
+
+char startSpritePack( const char *inFileName ) {
+    clearWriteState();
+
+    writeFileName = stringDuplicate( inFileName );
+    writeTempFileName = autoSprintf( "%s.temp", inFileName );
+
+    writeFile = fopen( writeTempFileName, "wb" );
+
+    if( writeFile == NULL ) {
+        printf( "Failed to open %s for writing sprite pack\n",
+                writeTempFileName );
+        clearWriteState();
+        return false;
+        }
+
+    // placeholder, filled in when done
+    SpritePackHeader header;
+    memset( &header, 0, sizeof( header ) );
+
+    writeBytes( &header, sizeof( header ) );
+
+    return true;
+    }
+
+
+
+void addToSpritePack( DecodedSprite *inSprite ) {
+    if( writeFile == NULL || inSprite->image == NULL ) {
+        return;
+        }
+
+    RawRGBAImage *image = inSprite->image;
+
+    int w = image->mWidth;
+    int h = image->mHeight;
+
+    SpritePackEntry e;
+    memset( &e, 0, sizeof( e ) );
+
+    e.id = inSprite->spriteID;
+    e.w = w;
+    e.h = h;
+    e.centerXOffset = inSprite->centerXOffset;
+    e.centerYOffset = inSprite->centerYOffset;
+    e.visibleW = inSprite->visibleW;
+    e.visibleH = inSprite->visibleH;
+
+    writeAlignPadding();
+    e.pixelOffset = writePos;
+    writeBytes( image->mRGBABytes, (uint64_t)w * h * 4 );
+
+
+    uint64_t numBitBytes = getHitMapBytes( w, h );
+
+    unsigned char *bits = new unsigned char[ numBitBytes ];
+    memset( bits, 0, numBitBytes );
+
+    int numPixels = w * h;
+
+    for( int p=0; p<numPixels; p++ ) {
+        if( inSprite->hitMap[p] ) {
+            bits[ p >> 3 ] |= ( 1 << ( p & 7 ) );
+            }
+        }
+
+    writeAlignPadding();
+    e.hitMapOffset = writePos;
+    writeBytes( bits, numBitBytes );
+
+    delete [] bits;
+
+    writeEntries.push_back( e );
+    }
+
+
+
+int finishSpritePack() {
+    if( writeFile == NULL ) {
+        return -1;
+        }
+
+    SpritePackHeader header;
+    memset( &header, 0, sizeof( header ) );
+
+    memcpy( header.magic, "OLSP", 4 );
+    header.version = SPRITE_PACK_VERSION;
+    header.entrySize = sizeof( SpritePackEntry );
+    header.numEntries = writeEntries.size();
+
+    writeAlignPadding();
+    header.entriesOffset = writePos;
+
+    for( int i=0; i<writeEntries.size(); i++ ) {
+        writeBytes( writeEntries.getElement( i ), sizeof( SpritePackEntry ) );
+        }
+
+    if( fseek( writeFile, 0, SEEK_SET ) != 0 ) {
+        writeFailed = true;
+        }
+    writeBytes( &header, sizeof( header ) );
+
+    if( fclose( writeFile ) != 0 ) {
+        writeFailed = true;
+        }
+    writeFile = NULL;
+
+    int numWritten = writeEntries.size();
+
+    if( ! writeFailed ) {
+        // rename won't replace an existing file on Windows
+        remove( writeFileName );
+
+        if( rename( writeTempFileName, writeFileName ) != 0 ) {
+            writeFailed = true;
+            }
+        }
+
+    if( writeFailed ) {
+        printf( "Failed to write sprite pack %s\n", writeFileName );
+        remove( writeTempFileName );
+        numWritten = -1;
+        }
+
+    clearWriteState();
+
+    return numWritten;
+    }
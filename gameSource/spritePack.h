@@ -0,0 +1,112 @@
+#ifndef SPRITE_PACK_INCLUDED
+#define SPRITE_PACK_INCLUDED
+
+
+#include <stdint.h>
+
+#include "spriteDecoder.h"
+
+
+// One file holding every sprite's decoded pixels, expanded hit map and
+// computed offsets, built offline by regenerateCaches.
+//
+// The client maps the file into memory, so loading a sprite is a texture
+// upload straight from the mapped pixels, with no TGA decoding, and hit
+// tests can be answered from the mapped hit map without loading the
+// sprite at all.
+//
+// File layout (native byte order):
+//    SpritePackHeader
+//    for each sprite, RGBA pixels (w * h * 4 bytes, rows in the order
+//       readTGAFileRaw returns them), then hit map
+//    SpritePackEntry table, sorted by sprite ID
+//
+// Hit maps are one bit per pixel, row major, lowest bit first.
+// Each block starts on a SPRITE_PACK_ALIGN byte boundary.
+
+
+#define SPRITE_PACK_FILE_NAME "spritePack.bin"
+
+#define SPRITE_PACK_VERSION 1
+
+#define SPRITE_PACK_ALIGN 16
+
+
+
+typedef struct SpritePackHeader {
+        // "OLSP"
+        char magic[4];
+
+        uint32_t version;
+
+        // catches packs written by a build with different struct layout
+        uint32_t entrySize;
+
+        uint32_t numEntries;
+
+        uint64_t entriesOffset;
+    } SpritePackHeader;
+
+
+
+typedef struct SpritePackEntry {
+        int32_t id;
+
+        int32_t w, h;
+
+        // center of non-transparent area of sprite
+        // offset relative to w/2, h/2
+        int32_t centerXOffset, centerYOffset;
+
+        // size of visible a>= 0.25 area of sprite
+        int32_t visibleW, visibleH;
+
+        int32_t unused;
+
+        uint64_t pixelOffset;
+        uint64_t hitMapOffset;
+    } SpritePackEntry;
+
+
+
+// maps pack into memory
+// returns true on success, false if file missing or not a valid pack
+char openSpritePack( const char *inFileName );
+
+void closeSpritePack();
+
+
+// 0 if pack not open
+int getNumSpritePackEntries();
+
+SpritePackEntry *getSpritePackEntry( int inIndex );
+
+
+// point into mapped pack, valid until closeSpritePack
+unsigned char *getSpritePackPixels( SpritePackEntry *inEntry );
+
+unsigned char *getSpritePackHitMap( SpritePackEntry *inEntry );
+
+
+char getSpritePackHit( SpritePackEntry *inEntry, int inX, int inY );
+
+
+
+// writing a pack
+// goes to a temp file first, and replaces inFileName in finishSpritePack,
+// so a pack that is currently open is never overwritten in place
+
+// returns true if file opened for writing
+char startSpritePack( const char *inFileName );
+
+
+// sprites must be added in increasing ID order
+// sprites with NULL image are skipped
+void addToSpritePack( DecodedSprite *inSprite );
+
+
+// returns number of sprites written, or -1 on failure
+int finishSpritePack();
+
+
+#endif
@@ -0,0 +1,258 @@
+// compares server's batched heat simulation (heatSim) against the old
+// one-player-at-a-time loop from server.cpp, on random scenes like the
+// ones drawn in thermalSim:  walls and floors of various r-values, with
+// fires and other heat sources, around a player at the center
+//
+// Results must match exactly, bit for bit.
+//
+// Usage:
+// heatSimBenchmark [num_players] [rounds]
+
+
+#include "../../server/heatSim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "minorGems/util/random/CustomRandomSource.h"
+#include "minorGems/system/Time.h"
+
+
+
+// old implementation, kept here as a reference
+// (copied from per-player loop in server.cpp)
+static void old_simulateHeat( float *rGrid, float *heatOutputGrid,
+                              float *heatMap ) {
+
+    for( int i=0; i<HEAT_MAP_D * HEAT_MAP_D; i++ ) {
+        heatMap[i] = 0;
+        }
+
+    int numCycles = 8;
+
+    int numNeighbors = 8;
+    int ndx[8] = { 0, 1,  0, -1,  1,  1, -1, -1 };
+    int ndy[8] = { 1, 0, -1,  0,  1, -1,  1, -1 };
+
+    // found equation here:
+    // http://demonstrations.wolfram.com/
+    //        ACellularAutomatonBasedHeatEquation/
+    // diags have way less contact area
+    double nWeights[8] = { 4, 4, 4, 4, 1, 1, 1, 1 };
+
+    double totalNWeight = 20;
+
+    for( int c=0; c<numCycles; c++ ) {
+
+        float tempHeatGrid[ HEAT_MAP_D * HEAT_MAP_D ];
+        memcpy( tempHeatGrid, heatMap,
+                HEAT_MAP_D * HEAT_MAP_D * sizeof( float ) );
+
+        for( int y=1; y<HEAT_MAP_D-1; y++ ) {
+            for( int x=1; x<HEAT_MAP_D-1; x++ ) {
+                int j = y * HEAT_MAP_D + x;
+
+                float heatDelta = 0;
+
+                float centerLeak = 1 - rGrid[j];
+
+                float centerOldHeat = tempHeatGrid[j];
+
+                for( int n=0; n<numNeighbors; n++ ) {
+
+                    int nx = x + ndx[n];
+                    int ny = y + ndy[n];
+
+                    int nj = ny * HEAT_MAP_D + nx;
+
+                    float nLeak = 1 - rGrid[ nj ];
+
+                    heatDelta += nWeights[n] * centerLeak * nLeak *
+                        ( tempHeatGrid[ nj ] - centerOldHeat );
+                    }
+
+                heatMap[j] =
+                    tempHeatGrid[j] + heatDelta / totalNWeight;
+
+                heatMap[j] += heatOutputGrid[j];
+                }
+            }
+        }
+    }
+
+
+
+CustomRandomSource randSource( 34957197 );
+
+
+// r-values are set in tenths in thermalSim
+static float randomR() {
+    return randSource.getRandomBoundedInt( 0, 10 ) / 10.0f;
+    }
+
+
+
+static void makeScene( float *outRGrid, float *outHeatOutputGrid ) {
+    for( int j=0; j<HEAT_MAP_CELLS; j++ ) {
+        // biome heat
+        outHeatOutputGrid[j] = randSource.getRandomBoundedInt( -1, 1 ) * 0.1f;
+        outRGrid[j] = 0;
+        }
+
+    if( randSource.getRandomBoolean() ) {
+        // walled room around player
+        int x0 = randSource.getRandomBoundedInt( 0, 3 );
+        int y0 = randSource.getRandomBoundedInt( 0, 3 );
+        int x1 = randSource.getRandomBoundedInt( 6, HEAT_MAP_D - 1 );
+        int y1 = randSource.getRandomBoundedInt( 6, HEAT_MAP_D - 1 );
+
+        float wallR = randomR();
+        float floorR = randomR() / 2;
+
+        for( int y=y0; y<=y1; y++ ) {
+            for( int x=x0; x<=x1; x++ ) {
+                int j = y * HEAT_MAP_D + x;
+
+                if( x == x0 || x == x1 || y == y0 || y == y1 ) {
+                    outRGrid[j] = wallR;
+                    }
+                else {
+                    outRGrid[j] = floorR;
+                    }
+                }
+            }
+        }
+
+    // scattered loose objects and heat sources
+    int numObjects = randSource.getRandomBoundedInt( 0, 10 );
+
+    for( int i=0; i<numObjects; i++ ) {
+        int j = randSource.getRandomBoundedInt( 0, HEAT_MAP_CELLS - 1 );
+
+        if( randSource.getRandomBoolean() ) {
+            outRGrid[j] = randomR();
+            }
+        else {
+            // fire
+            outHeatOutputGrid[j] += randSource.getRandomBoundedInt( 1, 10 );
+            }
+        }
+
+    // player at center, with clothing
+    int p = ( HEAT_MAP_D / 2 ) * HEAT_MAP_D + ( HEAT_MAP_D / 2 );
+
+    outRGrid[p] += randSource.getRandomBoundedDouble( 0, 1 );
+    if( outRGrid[p] > 1 ) {
+        outRGrid[p] = 1;
+        }
+    outHeatOutputGrid[p] += 1;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numPlayers = 200;
+    int rounds = 100;
+
+    if( inNumArgs > 1 ) {
+        sscanf( inArgs[1], "%d", &numPlayers );
+        }
+    if( inNumArgs > 2 ) {
+        sscanf( inArgs[2], "%d", &rounds );
+        }
+
+    printf( "%d players, %d rounds\n", numPlayers, rounds );
+
+
+    float *rGrids = new float[ numPlayers * HEAT_MAP_CELLS ];
+    float *heatOutputGrids = new float[ numPlayers * HEAT_MAP_CELLS ];
+
+    float *oldHeatMaps = new float[ numPlayers * HEAT_MAP_CELLS ];
+    float *newHeatMaps = new float[ numPlayers * HEAT_MAP_CELLS ];
+
+    for( int i=0; i<numPlayers; i++ ) {
+        makeScene( &( rGrids[ i * HEAT_MAP_CELLS ] ),
+                   &( heatOutputGrids[ i * HEAT_MAP_CELLS ] ) );
+        }
+
+
+    double startTime = Time::getCurrentTime();
+
+    for( int r=0; r<rounds; r++ ) {
+        for( int i=0; i<numPlayers; i++ ) {
+            old_simulateHeat( &( rGrids[ i * HEAT_MAP_CELLS ] ),
+                              &( heatOutputGrids[ i * HEAT_MAP_CELLS ] ),
+                              &( oldHeatMaps[ i * HEAT_MAP_CELLS ] ) );
+            }
+        }
+
+    double oldTime = Time::getCurrentTime() - startTime;
+
+
+    HeatBatch batch;
+
+    startTime = Time::getCurrentTime();
+
+    for( int r=0; r<rounds; r++ ) {
+        for( int b=0; b<numPlayers; b += HEAT_BATCH_SIZE ) {
+            clearHeatBatch( &batch );
+
+            int batchEnd = b + HEAT_BATCH_SIZE;
+            if( batchEnd > numPlayers ) {
+                batchEnd = numPlayers;
+                }
+
+            for( int i=b; i<batchEnd; i++ ) {
+                addToHeatBatch( &batch,
+                                &( rGrids[ i * HEAT_MAP_CELLS ] ),
+                                &( heatOutputGrids[ i * HEAT_MAP_CELLS ] ) );
+                }
+
+            simulateHeatBatch( &batch );
+
+            for( int i=b; i<batchEnd; i++ ) {
+                getHeatBatchResult( &batch, i - b,
+                                    &( newHeatMaps[ i * HEAT_MAP_CELLS ] ) );
+                }
+            }
+        }
+
+    double newTime = Time::getCurrentTime() - startTime;
+
+
+    int numMismatches = 0;
+
+    for( int i=0; i<numPlayers * HEAT_MAP_CELLS; i++ ) {
+        if( memcmp( &( oldHeatMaps[i] ), &( newHeatMaps[i] ),
+                    sizeof( float ) ) != 0 ) {
+            if( numMismatches < 10 ) {
+                printf( "Mismatch for player %d cell %d:  %.9g vs %.9g\n",
+                        i / HEAT_MAP_CELLS, i % HEAT_MAP_CELLS,
+                        oldHeatMaps[i], newHeatMaps[i] );
+                }
+            numMismatches++;
+            }
+        }
+
+    int numSims = numPlayers * rounds;
+
+    printf( "Old:      %.3f sec (%.2f us per player)\n",
+            oldTime, oldTime * 1000000 / numSims );
+    printf( "Batched:  %.3f sec (%.2f us per player)\n",
+            newTime, newTime * 1000000 / numSims );
+
+    printf( "%d mismatched cells\n", numMismatches );
+
+
+    delete [] rGrids;
+    delete [] heatOutputGrids;
+    delete [] oldHeatMaps;
+    delete [] newHeatMaps;
+
+    if( numMismatches > 0 ) {
+        return 1;
+        }
+    return 0;
+    }
@@ -39,6 +39,7 @@ rm ~/checkout/OneLife/server/lookTime.db
 rm ~/checkout/OneLife/server/floor.db 
 rm ~/checkout/OneLife/server/floorTime.db
 rm ~/checkout/OneLife/server/eve.db
+rm ~/checkout/OneLife/server/mapRegion.db
 
 # don't delete playerStats.db
 
@@ -1,59 +1,95 @@
-#include "minorGems/util/SimpleVector.h"
+#ifndef HASH_TABLE_H_INCLUDED
+#define HASH_TABLE_H_INCLUDED
 
+#include <stdint.h>
+#include <string.h>
 
 
-template <class Type> 
+
+// Hash table keyed by four ints
+//
+// Open addressing with Robin Hood linear probing:  entries live in one
+// flat array, each with its packed key right next to its value, so a
+// lookup usually touches a single cache line.  Entries that have
+// probed farther from their home slot take precedence over closer
+// ones, which keeps probe sequences short even at high load, and
+// removal shifts following entries back instead of leaving tombstones.
+//
+// Table doubles in size as it fills, so the size passed to the
+// constructor is only a starting point.
+template <class Type>
 class HashTable {
-    
+
     public:
-        
+
         // note that inDefaultValue MUST be provided
         // for any Type that cannot have a value of NULL (example: a struct)
         HashTable( int inSize,
                    Type inDefaultValue = (Type)NULL );
-        
+
         ~HashTable();
-        
+
         Type lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                      char *outFound );
 
         // pointer to entry
+        // only valid until next insert or remove
         Type *lookupPointer( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                              char *outFound );
-        
+
         void insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                      Type inItem );
 
         void remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
-        
+
 
         int getNumElements() {
             return mNumElements;
             }
-        
+
         // flush all entries from table
+        // (keeps memory allocated for reuse)
         void clear();
-        
+
     private:
+
+        typedef struct HashSlot {
+                int keys[4];
+
+                // distance from home slot, or -1 if slot empty
+                int probeDistance;
+
+                Type value;
+            } HashSlot;
+
+
+        // always a power of 2
         int mSize;
-        
+        int mMask;
+
         int mNumElements;
-        
+
+        // grow when mNumElements reaches this
+        int mMaxElements;
+
         Type mDefaultValue;
 
-        SimpleVector<Type> *mTable;
-        
-        SimpleVector<int> *mKeysA;
-        SimpleVector<int> *mKeysB;
-        SimpleVector<int> *mKeysC;
-        SimpleVector<int> *mKeysD;
-        
-        int computeHash( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
-        
-        char lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
-                        int *outHashKey, 
-                        int *outBin );
-        
+        HashSlot *mSlots;
+
+
+        void allocateSlots( int inSize );
+
+        void grow();
+
+        unsigned int computeHash( int inKeyA, int inKeyB, int inKeyC,
+                                  int inKeyD );
+
+        // index of slot holding key, or -1
+        int findSlot( int inKeyA, int inKeyB, int inKeyC, int inKeyD );
+
+        // key must not already be present, and table must have room
+        void insertNew( int *inKeys, Type inItem );
+
     };
 
 
@@ -62,181 +98,259 @@ class HashTable {
 // same file as the declaration
 
 
-template <class Type> 
+// fill limit, 7/8
+#define HASH_TABLE_LOAD_NUMERATOR 7
+#define HASH_TABLE_LOAD_DENOMINATOR 8
+
+
+
+template <class Type>
 HashTable<Type>::HashTable( int inSize, Type inDefaultValue )
-        : mSize( inSize ),
-          mNumElements( 0 ),
+        : mNumElements( 0 ),
           mDefaultValue( inDefaultValue ),
-          mTable( new SimpleVector<Type>[ inSize ] ),
-          mKeysA( new SimpleVector<int>[ inSize ] ),
-          mKeysB( new SimpleVector<int>[ inSize ] ),
-          mKeysC( new SimpleVector<int>[ inSize ] ),
-          mKeysD( new SimpleVector<int>[ inSize ] ) {
-    
-        
+          mSlots( NULL ) {
+
+    int size = 16;
+
+    while( size < inSize ) {
+        size *= 2;
+        }
+
+    allocateSlots( size );
     }
 
 
 
 
-        
-template <class Type> 
+
+template <class Type>
 HashTable<Type>::~HashTable() {
-    delete [] mTable;
-    delete [] mKeysA;
-    delete [] mKeysB;
-    delete [] mKeysC;
-    delete [] mKeysD;
+    delete [] mSlots;
     }
 
 
 
-template <class Type> 
-inline int HashTable<Type>::computeHash( int inKeyA, int inKeyB, int inKeyC,
-                                         int inKeyD ) {
-    
-    int hashKey = ( inKeyA * 734727 + inKeyB * 263471 + inKeyC * 2753 +
-                    inKeyD * 948731 ) % mSize;
-    if( hashKey < 0 ) {
-        hashKey += mSize;
+template <class Type>
+void HashTable<Type>::allocateSlots( int inSize ) {
+    mSize = inSize;
+    mMask = inSize - 1;
+    mMaxElements =
+        ( inSize / HASH_TABLE_LOAD_DENOMINATOR ) * HASH_TABLE_LOAD_NUMERATOR;
+
+    mSlots = new HashSlot[ inSize ];
+
+    for( int i=0; i<inSize; i++ ) {
+        mSlots[i].probeDistance = -1;
         }
-    return hashKey;
     }
 
 
 
-template <class Type> 
-char HashTable<Type>::lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
-                                 int *outHashKey, 
-                                 int *outBin ) {
-
-    int hashKey = computeHash( inKeyA, inKeyB, inKeyC, inKeyD );
-        
-    int numBins = mTable[hashKey].size();
-    
-    *outHashKey = hashKey;
-    
-    
-    for( int i=0; i<numBins; i++ ) {
-        if( mKeysA[hashKey].getElementDirect( i ) == inKeyA &&
-            mKeysB[hashKey].getElementDirect( i ) == inKeyB &&
-            mKeysC[hashKey].getElementDirect( i ) == inKeyC &&
-            mKeysD[hashKey].getElementDirect( i ) == inKeyD ) {
-            
-            *outBin = i;
-            return true;
+template <class Type>
+void HashTable<Type>::grow() {
+    HashSlot *oldSlots = mSlots;
+    int oldSize = mSize;
+
+    allocateSlots( oldSize * 2 );
+
+    // counted again as they are re-inserted
+    mNumElements = 0;
+
+    for( int i=0; i<oldSize; i++ ) {
+        if( oldSlots[i].probeDistance != -1 ) {
+            insertNew( oldSlots[i].keys, oldSlots[i].value );
             }
         }
-    
-    return false;
+
+    delete [] oldSlots;
     }
 
 
-        
-template <class Type> 
-Type HashTable<Type>::lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD, 
+
+template <class Type>
+inline unsigned int HashTable<Type>::computeHash( int inKeyA, int inKeyB,
+                                                  int inKeyC, int inKeyD ) {
+    // keys are often small, nearby coordinates, so mix well before masking
+    uint32_t h = (uint32_t)inKeyA * 0x9E3779B1U;
+    h ^= (uint32_t)inKeyB * 0x85EBCA77U;
+    h ^= (uint32_t)inKeyC * 0xC2B2AE3DU;
+    h ^= (uint32_t)inKeyD * 0x27D4EB2FU;
+
+    // murmur3 finalizer
+    h ^= h >> 16;
+    h *= 0x85EBCA6BU;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35U;
+    h ^= h >> 16;
+
+    return h;
+    }
+
+
+
+template <class Type>
+int HashTable<Type>::findSlot( int inKeyA, int inKeyB, int inKeyC,
+                               int inKeyD ) {
+
+    int i = (int)( computeHash( inKeyA, inKeyB, inKeyC, inKeyD ) & mMask );
+
+    for( int dist = 0; ; dist++ ) {
+        HashSlot *s = &( mSlots[i] );
+
+        if( s->probeDistance < dist ) {
+            // empty, or an entry closer to its home than we are to ours
+            // Robin Hood order means our key can't be farther along
+            return -1;
+            }
+
+        if( s->keys[0] == inKeyA &&
+            s->keys[1] == inKeyB &&
+            s->keys[2] == inKeyC &&
+            s->keys[3] == inKeyD ) {
+            return i;
+            }
+
+        i = ( i + 1 ) & mMask;
+        }
+    }
+
+
+
+template <class Type>
+void HashTable<Type>::insertNew( int *inKeys, Type inItem ) {
+
+    HashSlot carried;
+    memcpy( carried.keys, inKeys, sizeof( carried.keys ) );
+    carried.value = inItem;
+    carried.probeDistance = 0;
+
+    int i = (int)( computeHash( inKeys[0], inKeys[1], inKeys[2], inKeys[3] )
+                   & mMask );
+
+    while( true ) {
+        HashSlot *s = &( mSlots[i] );
+
+        if( s->probeDistance == -1 ) {
+            *s = carried;
+            mNumElements++;
+            return;
+            }
+
+        if( s->probeDistance < carried.probeDistance ) {
+            // take from the rich, carry on with displaced entry
+            HashSlot temp = *s;
+            *s = carried;
+            carried = temp;
+            }
+
+        carried.probeDistance++;
+        i = ( i + 1 ) & mMask;
+        }
+    }
+
+
+
+template <class Type>
+Type HashTable<Type>::lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                               char *outFound ) {
-    
-    int hashKey;
 
-    int bin;
-    
-    *outFound = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+    int i = findSlot( inKeyA, inKeyB, inKeyC, inKeyD );
 
-    if( *outFound ) {
-                
-        return mTable[ hashKey ].getElementDirect( bin );
+    if( i != -1 ) {
+        *outFound = true;
+        return mSlots[i].value;
         }
 
+    *outFound = false;
+
     // else return an undefined item (okay, since outFound is false);
     return mDefaultValue;
     }
 
 
 
-template <class Type> 
+template <class Type>
 Type *HashTable<Type>::lookupPointer( int inKeyA, int inKeyB, int inKeyC,
                                       int inKeyD,
                                       char *outFound ) {
-    
-    int hashKey;
 
-    int bin;
-    
-    *outFound = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
+    int i = findSlot( inKeyA, inKeyB, inKeyC, inKeyD );
 
-    if( *outFound ) {
-                
-        return mTable[ hashKey ].getElement( bin );
+    if( i != -1 ) {
+        *outFound = true;
+        return &( mSlots[i].value );
         }
-    
+
+    *outFound = false;
     return NULL;
     }
 
 
 
-template <class Type> 
-void HashTable<Type>::insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD, 
+template <class Type>
+void HashTable<Type>::insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
                               Type inItem ) {
-    
-    int hashKey;
-
-    int bin;
-    
-    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
 
+    int i = findSlot( inKeyA, inKeyB, inKeyC, inKeyD );
 
-    if( found ) {
+    if( i != -1 ) {
         // replace
-        *( mTable[ hashKey ].getElement( bin ) ) = inItem;
+        mSlots[i].value = inItem;
+        return;
         }
-    else {
-        // add a new bin for it
-        mTable[ hashKey ].push_back( inItem );
-        mKeysA[ hashKey ].push_back( inKeyA );
-        mKeysB[ hashKey ].push_back( inKeyB );
-        mKeysC[ hashKey ].push_back( inKeyC );
-        mKeysD[ hashKey ].push_back( inKeyD );
-        
-        mNumElements++;
+
+    if( mNumElements >= mMaxElements ) {
+        grow();
         }
+
+    int keys[4] = { inKeyA, inKeyB, inKeyC, inKeyD };
+
+    insertNew( keys, inItem );
     }
 
 
 
 template <class Type>
 void HashTable<Type>::remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD ) {
-    int hashKey;
-
-    int bin;
-    
-    char found = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD, &hashKey, &bin );
-
-    if( found ) {
-        // remove
-        mTable[ hashKey ].deleteElement( bin );
-        mKeysA[ hashKey ].deleteElement( bin );
-        mKeysB[ hashKey ].deleteElement( bin );
-        mKeysC[ hashKey ].deleteElement( bin );
-        mKeysD[ hashKey ].deleteElement( bin );
-        
-        mNumElements--;
+
+    int i = findSlot( inKeyA, inKeyB, inKeyC, inKeyD );
+
+    if( i == -1 ) {
+        return;
+        }
+
+    // shift following entries back one slot until we hit an empty slot
+    // or an entry that is already home
+    int next = ( i + 1 ) & mMask;
+
+    while( mSlots[next].probeDistance > 0 ) {
+        mSlots[i] = mSlots[next];
+        mSlots[i].probeDistance--;
+
+        i = next;
+        next = ( next + 1 ) & mMask;
         }
+
+    mSlots[i].probeDistance = -1;
+
+    mNumElements--;
     }
 
 
 
-template <class Type> 
+template <class Type>
 void HashTable<Type>::clear() {
-    
+
+    if( mNumElements == 0 ) {
+        return;
+        }
+
     for( int i=0; i<mSize; i++ ) {
-        mTable[i].deleteAll();
-        mKeysA[i].deleteAll();
-        mKeysB[i].deleteAll();
-        mKeysC[i].deleteAll();
-        mKeysD[i].deleteAll();
+        mSlots[i].probeDistance = -1;
         }
 
     mNumElements = 0;
     }
 
+
+#endif
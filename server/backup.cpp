@@ -1,4 +1,5 @@
 #include "backup.h"
+#include "map.h"
 
 
 
@@ -6,9 +7,13 @@
 #include "minorGems/io/file/File.h"
 #include "minorGems/io/file/Directory.h"
 #include "minorGems/system/Time.h"
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
 
 #include "minorGems/util/log/AppLog.h"
 
+#include <stdint.h>
+
 
 static timeSec_t lastBackupTime = 0;
 static int targetHour = 8;
@@ -65,12 +70,410 @@ void backupDBFile( const char *inFileNamePrefix, char *inTimeFileNamePart,
         }
     }
 
+
+
+// "map.db" becomes "map.db.2019_01_02__08_00_00.inc"
+static char *getIncrementFileName( const char *inDBFileName,
+                                   const char *inTimeFileNamePart ) {
+    return autoSprintf( "%s.%s.inc", inDBFileName, inTimeFileNamePart );
+    }
+
+
+
+typedef struct IncrementWriter {
+        FILE **files;
+        int *counts;
+        char failed;
+    } IncrementWriter;
+
+
+
+static void writeIncrementRecord( int inDBIndex, 
+                                  unsigned char *inKey,
+                                  unsigned char *inValue,
+                                  void *inContext ) {
+    IncrementWriter *w = (IncrementWriter*)inContext;
+    
+    FILE *f = w->files[ inDBIndex ];
+    
+    if( f == NULL ) {
+        return;
+        }
+    
+    int keySize, valueSize;
+    getMapSnapshotRecordSizes( inDBIndex, &keySize, &valueSize );
+    
+    if( fwrite( inKey, keySize, 1, f ) != 1 ||
+        fwrite( inValue, valueSize, 1, f ) != 1 ) {
+        w->failed = true;
+        }
+    
+    w->counts[ inDBIndex ]++;
+    }
+
+
+
+// writes one map snapshot into snapshot folder, off the main thread
+class SnapshotBackupThread : public Thread {
+        
+    public:
+        
+        SnapshotBackupThread( MapSnapshot *inSnapshot, char inFull,
+                              File *inFolder,
+                              const char *inTimeFileNamePart )
+                : mSnapshot( inSnapshot ), mFull( inFull ),
+                  mFolderPath( inFolder->getFullFileName() ),
+                  mTimeFileNamePart( stringDuplicate( inTimeFileNamePart ) ),
+                  mDone( false ), mFailed( false ),
+                  mBytesWritten( 0 ), mSeconds( 0 ) {
+            }
+        
+
+        ~SnapshotBackupThread() {
+            delete [] mFolderPath;
+            delete [] mTimeFileNamePart;
+            }
+        
+
+        char isDone() {
+            mLock.lock();
+            char done = mDone;
+            mLock.unlock();
+            
+            return done;
+            }
+        
+
+        virtual void run() {
+            double startTime = Time::getCurrentTime();
+            
+            if( mFull ) {
+                copyDBFiles();
+                }
+            else {
+                writeIncrements();
+                }
+            
+            mSeconds = Time::getCurrentTime() - startTime;
+            
+            mLock.lock();
+            mDone = true;
+            mLock.unlock();
+            }
+        
+
+        // rest of these can be read by main thread once thread is joined
+        
+        MapSnapshot *mSnapshot;
+        char mFull;
+        
+        char *mFolderPath;
+        char *mTimeFileNamePart;
+        
+        char mDone;
+        char mFailed;
+        
+        double mBytesWritten;
+        double mSeconds;
+        
+
+    protected:
+        
+        MutexLock mLock;
+        
+        
+        // DB files are frozen while we copy them
+        void copyDBFiles() {
+            File folder( NULL, mFolderPath );
+            
+            for( int i=0; i<getNumMapSnapshotDBs(); i++ ) {
+                const char *name = getMapSnapshotDBName( i );
+                
+                File dbFile( NULL, name );
+                
+                if( ! dbFile.exists() ) {
+                    continue;
+                    }
+                
+                File *backFile = folder.getChildFile( name );
+                
+                dbFile.copy( backFile );
+                
+                if( backFile->exists() ) {
+                    mBytesWritten += backFile->getLength();
+                    }
+                else {
+                    mFailed = true;
+                    }
+                delete backFile;
+                }
+            }
+        
+
+        void writeIncrements() {
+            File folder( NULL, mFolderPath );
+            
+            int numDBs = getNumMapSnapshotDBs();
+            
+            IncrementWriter w;
+            w.files = new FILE*[ numDBs ];
+            w.counts = new int[ numDBs ];
+            w.failed = false;
+            
+            for( int i=0; i<numDBs; i++ ) {
+                w.counts[i] = 0;
+                
+                char *fileName = 
+                    getIncrementFileName( getMapSnapshotDBName( i ),
+                                          mTimeFileNamePart );
+                
+                File *incFile = folder.getChildFile( fileName );
+                delete [] fileName;
+                
+                char *path = incFile->getFullFileName();
+                delete incFile;
+                
+                w.files[i] = fopen( path, "wb" );
+                delete [] path;
+                
+                if( w.files[i] == NULL ) {
+                    w.failed = true;
+                    continue;
+                    }
+                
+                // count patched in below
+                uint32_t header[3] = { 0, 0, 0 };
+                
+                int keySize, valueSize;
+                getMapSnapshotRecordSizes( i, &keySize, &valueSize );
+                
+                header[0] = keySize;
+                header[1] = valueSize;
+                
+                if( fwrite( BACKUP_INCREMENT_MAGIC, 4, 1, w.files[i] ) != 1 ||
+                    fwrite( header, sizeof( header ), 1, w.files[i] ) != 1 ) {
+                    w.failed = true;
+                    }
+                }
+            
+            forEachMapSnapshotChange( mSnapshot, writeIncrementRecord, &w );
+            
+            for( int i=0; i<numDBs; i++ ) {
+                if( w.files[i] == NULL ) {
+                    continue;
+                    }
+                
+                uint32_t count = w.counts[i];
+                
+                if( fseek( w.files[i], 4 + 2 * sizeof( uint32_t ), 
+                           SEEK_SET ) != 0 ||
+                    fwrite( &count, sizeof( count ), 1, w.files[i] ) != 1 ) {
+                    w.failed = true;
+                    }
+                
+                fseek( w.files[i], 0, SEEK_END );
+                mBytesWritten += ftell( w.files[i] );
+                
+                if( fclose( w.files[i] ) != 0 ) {
+                    w.failed = true;
+                    }
+                }
+            
+            delete [] w.files;
+            delete [] w.counts;
+            
+            mFailed = w.failed;
+            }
+        
+    };
+
+
+
+// folder that current chain of map snapshots goes in
+static File *snapshotFolder = NULL;
+static int numIncrementsInChain = 0;
+
+static char waitingForFullSnapshot = false;
+
+static SnapshotBackupThread *snapshotThread = NULL;
+
+
+
+static void startSnapshotThread( MapSnapshot *inSnapshot, char inFull,
+                                 const char *inTimeFileNamePart ) {
+    snapshotThread = new SnapshotBackupThread( inSnapshot, inFull,
+                                               snapshotFolder,
+                                               inTimeFileNamePart );
+    snapshotThread->start();
+    }
+
+
+
+static void finishSnapshotThread() {
+    snapshotThread->join();
+    
+    SnapshotBackupThread *t = snapshotThread;
+    snapshotThread = NULL;
+    
+    if( t->mFailed ) {
+        AppLog::errorF( "Failed to save %s map snapshot in %s",
+                        t->mFull ? "full" : "incremental", t->mFolderPath );
+        
+        // rest of chain would be useless
+        if( snapshotFolder != NULL ) {
+            delete snapshotFolder;
+            snapshotFolder = NULL;
+            }
+        }
+    else {
+        AppLog::infoF( "Saved %s map snapshot in %s:  %d changed records, "
+                       "%.1f MiB written in %.3f sec on backup thread",
+                       t->mFull ? "full" : "incremental", t->mFolderPath,
+                       getMapSnapshotNumChanges( t->mSnapshot ),
+                       t->mBytesWritten / ( 1024 * 1024 ),
+                       t->mSeconds );
+        }
+    
+    // unfreezes map DB files, if full
+    releaseMapSnapshot( t->mSnapshot );
+    
+    delete t;
+    }
+
+
+
+static void stepSnapshotBackup() {
+    if( waitingForFullSnapshot ) {
+        MapSnapshot *s = getFullMapSnapshot();
+        
+        if( s != NULL ) {
+            waitingForFullSnapshot = false;
+            startSnapshotThread( s, true, "" );
+            }
+        }
+    
+    if( snapshotThread != NULL && snapshotThread->isDone() ) {
+        finishSnapshotThread();
+        }
+    }
+
+
+
+// cut is O(1) here, and files are written by backup thread
+// returns false on failure
+static char saveMapSnapshot( const char *inTimeFileNamePart,
+                             File *inBackupFolder ) {
+    
+    int incrementsPerFull = 
+        SettingsManager::getIntSetting( "backupIncrementsPerFull", 6 );
+    
+    MapSnapshot *s = NULL;
+    
+    if( snapshotFolder != NULL && numIncrementsInChain < incrementsPerFull ) {
+        // NULL if map was reloaded since last one
+        s = cutMapSnapshot();
+        }
+    
+    if( s != NULL ) {
+        numIncrementsInChain++;
+        startSnapshotThread( s, false, inTimeFileNamePart );
+        return true;
+        }
+    
+    
+    // start a new chain
+    if( snapshotFolder != NULL ) {
+        delete snapshotFolder;
+        snapshotFolder = NULL;
+        }
+    numIncrementsInChain = 0;
+    
+    char *folderName = autoSprintf( "snapshot_%s", inTimeFileNamePart );
+    
+    File *folder = inBackupFolder->getChildFile( folderName );
+    delete [] folderName;
+    
+    if( ! folder->exists() ) {
+        Directory::makeDirectory( folder );
+        }
+    
+    if( ! folder->isDirectory() ) {
+        delete folder;
+        return false;
+        }
+    
+    snapshotFolder = folder;
+    
+    // cut happens at next map WAL checkpoint
+    requestFullMapSnapshot();
+    waitingForFullSnapshot = true;
+    
+    return true;
+    }
+
+
+
+// true if inFile is folder of current snapshot chain
+static char isSnapshotFolder( File *inFile ) {
+    if( snapshotFolder == NULL ) {
+        return false;
+        }
+    
+    char *name = inFile->getFileName();
+    char *snapshotName = snapshotFolder->getFileName();
+    
+    char same = ( strcmp( name, snapshotName ) == 0 );
+    
+    delete [] name;
+    delete [] snapshotName;
+    
+    return same;
+    }
+
+
+
+// removes folder contents too
+static char removeBackupFile( File *inFile ) {
+    if( inFile->isDirectory() ) {
+        int numChildren;
+        File **childFiles = inFile->getChildFiles( &numChildren );
+        
+        for( int i=0; i<numChildren; i++ ) {
+            childFiles[i]->remove();
+            delete childFiles[i];
+            }
+        delete [] childFiles;
+        }
+    
+    return inFile->remove();
+    }
+
+
+
+void freeBackup() {
+    if( snapshotThread != NULL ) {
+        AppLog::info( "Waiting for map snapshot backup to finish" );
+        finishSnapshotThread();
+        }
+    
+    waitingForFullSnapshot = false;
+    
+    // map snapshots after map is loaded again can't build on this chain
+    if( snapshotFolder != NULL ) {
+        delete snapshotFolder;
+        snapshotFolder = NULL;
+        }
+    numIncrementsInChain = 0;
+    }
+
     
 
 
 // makes a new backup if needed
 // also handles deleting old backups
 void checkBackup() {
+    stepSnapshotBackup();
+    
     timeSec_t curTime = Time::timeSec();
     
     if( curTime - lastBackupTime > 12 * 3600 
@@ -95,6 +498,11 @@ void checkBackup() {
 
             if( SettingsManager::getIntSetting( "saveBackups", 0 ) ) {
                 
+                if( snapshotThread != NULL || waitingForFullSnapshot ) {
+                    // last map snapshot still going, try again later
+                    return;
+                    }
+                
                 AppLog::info( 
                     "Saving a backup of map.db, mapTime.db, and biome.db "
                     "floor.db, floorTime.db, playerStats.db, and eve.db ..." );
@@ -120,27 +528,44 @@ void checkBackup() {
                 
                 if( backupFolder.isDirectory() ) {
                     
-                    backupDBFile( "lookTime", timeFileNamePart, &backupFolder );
-
-                    backupDBFile( "map", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "mapTime", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "biome", timeFileNamePart, &backupFolder );
+                    if( canSnapshotMap() ) {
+                        backupsSaved = 
+                            saveMapSnapshot( timeFileNamePart, 
+                                             &backupFolder );
+                        
+                        AppLog::info( "Map DB snapshot will be written on "
+                                      "backup thread" );
+                        }
+                    else {
+                        // whole files, copied right here
+                        backupDBFile( "lookTime", timeFileNamePart, 
+                                      &backupFolder );
+                        
+                        backupDBFile( "map", timeFileNamePart, 
+                                      &backupFolder );
+                        
+                        backupDBFile( "mapTime", timeFileNamePart, 
+                                      &backupFolder );
+                        
+                        backupDBFile( "biome", timeFileNamePart, 
+                                      &backupFolder );
+                        
+                        backupDBFile( "floor", timeFileNamePart, 
+                                      &backupFolder );
+                        
+                        backupDBFile( "floorTime", timeFileNamePart, 
+                                      &backupFolder );
+                        backupsSaved = true;
+                        }
                     
+                    // these are small
                     backupDBFile( "eve", timeFileNamePart, &backupFolder );
                     
-                    backupDBFile( "floor", timeFileNamePart, &backupFolder );
-                    
-                    backupDBFile( "floorTime", timeFileNamePart, 
-                                  &backupFolder );
-                    
                     backupDBFile( "playerStats", 
                                   timeFileNamePart, &backupFolder );
 
 
                     AppLog::info( "...Done saving backups" );
-                    backupsSaved = true;
 
                     
                     int keepDays = 
@@ -162,9 +587,12 @@ void checkBackup() {
                     for( int i=0; i<numChildren; i++ ) {
                         if( curTime - 
                             childFiles[i]->getModificationTime()
-                            > keepSeconds ) {
+                            > keepSeconds &&
+                            ! isSnapshotFolder( childFiles[i] ) ) {
                             
-                            char removed = childFiles[i]->remove();
+                            // snapshot folder's time is that of its
+                            // newest increment
+                            char removed = removeBackupFile( childFiles[i] );
 
                             char *fileName = childFiles[i]->getFileName();
                             
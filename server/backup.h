@@ -6,3 +6,19 @@ void initBackup();
 // makes a new backup if needed
 // also handles deleting old backups
 void checkBackup();
+
+
+// waits for any map snapshot still being written
+// must be called before freeMap
+void freeBackup();
+
+
+
+// With the map write-ahead log on, per-cell map DBs are backed up as
+// snapshots, each chain in its own backups/snapshot_<time> folder:
+// a full copy of each DB file (map.db, etc.), then increments named
+// like map.db.<time>.inc, applied in name order by restoreBackup.
+//
+// Increment file:  magic, then key size, value size, and number of records
+// as 32-bit ints, then key and value of each record
+#define BACKUP_INCREMENT_MAGIC "Sinc"
@@ -0,0 +1,375 @@
+#include "blockingMap.h"
+
+#include "map.h"
+
+#include "../gameSource/objectBank.h"
+
+
+#include <math.h>
+#include <string.h>
+
+
+
+#define BLOCKING_REGION_CELLS ( BLOCKING_REGION_D * BLOCKING_REGION_D )
+
+#define BLOCKING_REGION_BYTES ( BLOCKING_REGION_CELLS / 8 )
+
+
+// 4096 regions is 1024x1024 cells, about 450 KB of RAM
+#define BLOCKING_CACHE_SIZE 4096
+
+
+typedef struct BlockingRegion {
+        int regionX, regionY;
+        char valid;
+
+        // earliest decay ETA seen while filling cells, 0 if none
+        timeSec_t nextDecayETA;
+
+        // bit set if cell has been filled in and is not stale
+        unsigned char knownBits[ BLOCKING_REGION_BYTES ];
+
+        unsigned char blockingBits[ BLOCKING_REGION_BYTES ];
+        unsigned char occupiedBits[ BLOCKING_REGION_BYTES ];
+    } BlockingRegion;
+
+
+static BlockingRegion blockingCache[ BLOCKING_CACHE_SIZE ];
+
+
+// bumped on every cell change, so that a cell filled in while getMapObject
+// is applying decays (which can change nearby cells) is not trusted
+static unsigned int changeCount = 0;
+
+
+static BlockingMapStats stats = { 0, 0, 0 };
+
+
+
+#define CACHE_PRIME_A 776509273
+#define CACHE_PRIME_B 904124281
+
+static int computeBlockingCacheHash( int inRegionX, int inRegionY ) {
+
+    int hashKey = ( inRegionX * CACHE_PRIME_A +
+                    inRegionY * CACHE_PRIME_B ) % BLOCKING_CACHE_SIZE;
+    if( hashKey < 0 ) {
+        hashKey += BLOCKING_CACHE_SIZE;
+        }
+    return hashKey;
+    }
+
+
+
+// floor division, so that negative coordinates map to the right region
+static int cellToRegion( int inV ) {
+    if( inV >= 0 ) {
+        return inV / BLOCKING_REGION_D;
+        }
+    return ( inV - BLOCKING_REGION_D + 1 ) / BLOCKING_REGION_D;
+    }
+
+
+
+static int cellIndexInRegion( BlockingRegion *inRegion, int inX, int inY ) {
+    int localX = inX - inRegion->regionX * BLOCKING_REGION_D;
+    int localY = inY - inRegion->regionY * BLOCKING_REGION_D;
+
+    return localY * BLOCKING_REGION_D + localX;
+    }
+
+
+
+static char getBit( unsigned char *inBits, int inIndex ) {
+    return ( inBits[ inIndex >> 3 ] >> ( inIndex & 7 ) ) & 1;
+    }
+
+
+
+static void setBit( unsigned char *inBits, int inIndex, char inValue ) {
+    unsigned char mask = (unsigned char)( 1 << ( inIndex & 7 ) );
+
+    if( inValue ) {
+        inBits[ inIndex >> 3 ] |= mask;
+        }
+    else {
+        inBits[ inIndex >> 3 ] &= (unsigned char)~mask;
+        }
+    }
+
+
+
+static void forgetRegionCells( BlockingRegion *inRegion ) {
+    memset( inRegion->knownBits, 0, BLOCKING_REGION_BYTES );
+    inRegion->nextDecayETA = 0;
+    }
+
+
+
+void initBlockingMap() {
+    for( int i=0; i<BLOCKING_CACHE_SIZE; i++ ) {
+        blockingCache[i].valid = false;
+        }
+    changeCount = 0;
+    }
+
+
+
+void freeBlockingMap() {
+    initBlockingMap();
+    }
+
+
+
+// NULL if region containing cell is not in cache
+static BlockingRegion *findBlockingRegion( int inX, int inY ) {
+    int regionX = cellToRegion( inX );
+    int regionY = cellToRegion( inY );
+
+    BlockingRegion *r =
+        &( blockingCache[ computeBlockingCacheHash( regionX, regionY ) ] );
+
+    if( r->valid && r->regionX == regionX && r->regionY == regionY ) {
+        return r;
+        }
+    return NULL;
+    }
+
+
+
+void blockingMapCellChanged( int inX, int inY ) {
+    changeCount++;
+
+    // wide objects can block cells to the left and right of them
+    int maxR = getMaxWideRadius();
+
+    for( int x = inX - maxR; x <= inX + maxR; x++ ) {
+        BlockingRegion *r = findBlockingRegion( x, inY );
+
+        if( r != NULL ) {
+            setBit( r->knownBits, cellIndexInRegion( r, x, inY ), false );
+            }
+        }
+    }
+
+
+
+static BlockingRegion *getBlockingRegion( int inX, int inY,
+                                          timeSec_t inCurTime ) {
+    int regionX = cellToRegion( inX );
+    int regionY = cellToRegion( inY );
+
+    BlockingRegion *r =
+        &( blockingCache[ computeBlockingCacheHash( regionX, regionY ) ] );
+
+    if( ! r->valid || r->regionX != regionX || r->regionY != regionY ) {
+        // evict, no write-back needed
+        r->valid = true;
+        r->regionX = regionX;
+        r->regionY = regionY;
+        forgetRegionCells( r );
+        }
+    else if( r->nextDecayETA != 0 && r->nextDecayETA <= inCurTime ) {
+        // a decay has come due somewhere in region
+        // let getMapObject apply it as cells are filled in again
+        forgetRegionCells( r );
+        stats.regionRefreshes++;
+        }
+
+    return r;
+    }
+
+
+
+static void noteDecayETA( BlockingRegion *inRegion, int inX, int inY ) {
+    timeSec_t eta = getEtaDecay( inX, inY );
+
+    if( eta != 0 &&
+        ( inRegion->nextDecayETA == 0 || eta < inRegion->nextDecayETA ) ) {
+        inRegion->nextDecayETA = eta;
+        }
+    }
+
+
+
+// returns cell index in region
+static int fillCell( BlockingRegion *inRegion, int inX, int inY ) {
+
+    int index = cellIndexInRegion( inRegion, inX, inY );
+
+    if( getBit( inRegion->knownBits, index ) ) {
+        stats.cellHits++;
+        return index;
+        }
+
+    stats.cellMisses++;
+
+    unsigned int startChangeCount = changeCount;
+
+    // ETAs of all cells we look at go into region's next ETA, because
+    // any of their decays could change whether this cell is blocked
+    // (ETAs of neighbors in other regions make this conservative, which
+    // is fine)
+    int target = getMapObject( inX, inY );
+    noteDecayETA( inRegion, inX, inY );
+
+    char occupied = ( target != 0 );
+    char blocking = false;
+
+    if( target > 0 && getObject( target )->blocksWalking ) {
+        blocking = true;
+        }
+
+    if( ! blocking ) {
+        // not directly blocked
+        // need to check for wide objects to left and right
+        int maxR = getMaxWideRadius();
+
+        for( int dx = -maxR; dx <= maxR && ! blocking; dx++ ) {
+
+            if( dx != 0 ) {
+
+                int nX = inX + dx;
+
+                int nID = getMapObject( nX, inY );
+                noteDecayETA( inRegion, nX, inY );
+
+                if( nID > 0 ) {
+                    ObjectRecord *nO = getObject( nID );
+
+                    if( nO->wide ) {
+
+                        int dist;
+                        int minDist;
+
+                        if( dx < 0 ) {
+                            dist = -dx;
+                            minDist = nO->rightBlockingRadius;
+                            }
+                        else {
+                            dist = dx;
+                            minDist = nO->leftBlockingRadius;
+                            }
+
+                        if( dist <= minDist ) {
+                            blocking = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+    setBit( inRegion->blockingBits, index, blocking );
+    setBit( inRegion->occupiedBits, index, occupied );
+
+    // if a decay applied above changed a cell near this one,
+    // our answer is good for now, but don't trust it later
+    setBit( inRegion->knownBits, index,
+            changeCount == startChangeCount );
+
+    return index;
+    }
+
+
+
+static char isBlocking( int inX, int inY, timeSec_t inCurTime ) {
+    BlockingRegion *r = getBlockingRegion( inX, inY, inCurTime );
+
+    return getBit( r->blockingBits, fillCell( r, inX, inY ) );
+    }
+
+
+
+char isMapSpotBlocking( int inX, int inY ) {
+    return isBlocking( inX, inY, getMapTimeSec() );
+    }
+
+
+
+char isMapSpotEmptyOfObjects( int inX, int inY ) {
+    BlockingRegion *r = getBlockingRegion( inX, inY, getMapTimeSec() );
+
+    return ! getBit( r->occupiedBits, fillCell( r, inX, inY ) );
+    }
+
+
+
+char directLineBlocked( GridPos inSource, GridPos inDest ) {
+    // line algorithm from here
+    // https://en.wikipedia.org/wiki/Bresenham's_line_algorithm
+
+    timeSec_t curTime = getMapTimeSec();
+
+    double deltaX = inDest.x - inSource.x;
+
+    double deltaY = inDest.y - inSource.y;
+
+
+    int xStep = 1;
+    if( deltaX < 0 ) {
+        xStep = -1;
+        }
+
+    int yStep = 1;
+    if( deltaY < 0 ) {
+        yStep = -1;
+        }
+
+
+    if( deltaX == 0 ) {
+        // vertical line
+
+        // just walk through y
+        for( int y=inSource.y; y != inDest.y; y += yStep ) {
+            if( isBlocking( inSource.x, y, curTime ) ) {
+                return true;
+                }
+            }
+        }
+    else {
+        double deltaErr = fabs( deltaY / (double)deltaX );
+
+        double error = deltaErr - 0.5;
+
+        int y = inSource.y;
+        for( int x=inSource.x; x != inDest.x; x += xStep ) {
+            if( isBlocking( x, y, curTime ) ) {
+                return true;
+                }
+            error += deltaErr;
+
+            if( error >= 0.5 ) {
+                y += yStep;
+                error -= 1.0;
+                }
+            }
+        }
+
+    return false;
+    }
+
+
+
+int getFirstBlockedPathStep( GridPos *inPath, int inPathLength ) {
+    timeSec_t curTime = getMapTimeSec();
+
+    for( int i=0; i<inPathLength; i++ ) {
+        if( isBlocking( inPath[i].x, inPath[i].y, curTime ) ) {
+            return i;
+            }
+        }
+    return -1;
+    }
+
+
+
+BlockingMapStats getBlockingMapStats() {
+    BlockingMapStats s = stats;
+
+    stats.cellHits = 0;
+    stats.cellMisses = 0;
+    stats.regionRefreshes = 0;
+
+    return s;
+    }
@@ -0,0 +1,70 @@
+#ifndef BLOCKING_MAP_H_INCLUDED
+#define BLOCKING_MAP_H_INCLUDED
+
+
+#include "../gameSource/GridPos.h"
+
+
+// Compact bitmaps of which map cells block walking and which cells have
+// an object in them, one pair of bitmaps per BLOCKING_REGION_D x
+// BLOCKING_REGION_D block of cells, cached in RAM.
+//
+// Movement validation, line-of-sight checks, and drop spot searches
+// read these bits instead of going through getMapObject for every cell
+// they touch.
+//
+// Cells are filled in lazily from getMapObject the first time they are
+// checked, and map.cpp marks cells stale whenever an object or its decay
+// time changes.  A region is refreshed when the earliest decay among its
+// cells comes due, so decays that have not been applied to the map yet
+// are still seen.
+
+
+// cells per region edge
+#define BLOCKING_REGION_D 16
+
+
+
+// called by initMap and freeMap
+void initBlockingMap();
+
+void freeBlockingMap();
+
+
+
+// called by map.cpp whenever the object or decay time at a cell changes
+void blockingMapCellChanged( int inX, int inY );
+
+
+
+// true if object in cell blocks walking, or if a wide blocking object
+// in a nearby cell covers this cell
+char isMapSpotBlocking( int inX, int inY );
+
+
+// true if there is no object in cell (ignores players)
+char isMapSpotEmptyOfObjects( int inX, int inY );
+
+
+// doesn't check whether dest itself is blocked
+char directLineBlocked( GridPos inSource, GridPos inDest );
+
+
+// returns index of first blocked step in path, or -1 if none blocked
+int getFirstBlockedPathStep( GridPos *inPath, int inPathLength );
+
+
+
+// stats for logging
+typedef struct BlockingMapStats {
+        int cellHits;
+        int cellMisses;
+        int regionRefreshes;
+    } BlockingMapStats;
+
+
+// resets stats after returning them
+BlockingMapStats getBlockingMapStats();
+
+
+#endif
@@ -0,0 +1,163 @@
+#include "changePosGrid.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+
+
+// grid cells per bucket edge
+#define BUCKET_D 16
+
+// lists shorter than this are just scanned
+#define MIN_GRID_POSITIONS 32
+
+
+
+// floor division, so that negative coordinates land in the right bucket
+static int toBucket( int inV ) {
+    if( inV >= 0 ) {
+        return inV / BUCKET_D;
+        }
+    return ( inV - BUCKET_D + 1 ) / BUCKET_D;
+    }
+
+
+
+static int compareInts( const void *inA, const void *inB ) {
+    return *( (int*)inA ) - *( (int*)inB );
+    }
+
+
+
+ChangePosGrid::ChangePosGrid( SimpleVector<ChangePosition> *inPositions )
+        : mPositions( inPositions ),
+          mUseGrid( inPositions->size() >= MIN_GRID_POSITIONS ),
+          mNumChecksSaved( 0 ),
+          mBucketIndex( 256, -1 ) {
+    
+    if( ! mUseGrid ) {
+        return;
+        }
+    
+    int numPos = mPositions->size();
+
+    for( int i=0; i<numPos; i++ ) {
+        ChangePosition *p = mPositions->getElement( i );
+        
+        if( p->global ) {
+            mGlobalIndices.push_back( i );
+            continue;
+            }
+        
+        int bX = toBucket( p->x );
+        int bY = toBucket( p->y );
+        
+        char found;
+        int b = mBucketIndex.lookup( bX, bY, 0, 0, &found );
+        
+        if( ! found ) {
+            b = mBuckets.size();
+            
+            mBuckets.push_back( new SimpleVector<int>() );
+            mBucketX.push_back( bX );
+            mBucketY.push_back( bY );
+            
+            mBucketIndex.insert( bX, bY, 0, 0, b );
+            }
+        
+        mBuckets.getElementDirect( b )->push_back( i );
+        }
+    }
+
+
+
+ChangePosGrid::~ChangePosGrid() {
+    for( int b=0; b<mBuckets.size(); b++ ) {
+        delete mBuckets.getElementDirect( b );
+        }
+    }
+
+
+
+void ChangePosGrid::addBucketContents( int inBucketIndex,
+                                       SimpleVector<int> *outIndices ) {
+    SimpleVector<int> *bucket = mBuckets.getElementDirect( inBucketIndex );
+    
+    for( int i=0; i<bucket->size(); i++ ) {
+        outIndices->push_back( bucket->getElementDirect( i ) );
+        }
+    }
+
+
+
+void ChangePosGrid::getNearby( int inX, int inY, double inRadius,
+                               SimpleVector<int> *outIndices ) {
+    
+    int numPos = mPositions->size();
+    
+    if( ! mUseGrid ) {
+        for( int i=0; i<numPos; i++ ) {
+            outIndices->push_back( i );
+            }
+        return;
+        }
+
+    int startSize = outIndices->size();
+    
+    for( int i=0; i<mGlobalIndices.size(); i++ ) {
+        outIndices->push_back( mGlobalIndices.getElementDirect( i ) );
+        }
+    
+    int r = (int)ceil( inRadius );
+    
+    int minBX = toBucket( inX - r );
+    int maxBX = toBucket( inX + r );
+    int minBY = toBucket( inY - r );
+    int maxBY = toBucket( inY + r );
+    
+    int numQueryBuckets = ( maxBX - minBX + 1 ) * ( maxBY - minBY + 1 );
+    
+    if( mBuckets.size() <= numQueryBuckets ) {
+        // fewer occupied buckets than buckets in range
+        // cheaper to walk occupied ones
+        for( int b=0; b<mBuckets.size(); b++ ) {
+            int bX = mBucketX.getElementDirect( b );
+            int bY = mBucketY.getElementDirect( b );
+            
+            if( bX >= minBX && bX <= maxBX &&
+                bY >= minBY && bY <= maxBY ) {
+                addBucketContents( b, outIndices );
+                }
+            }
+        }
+    else {
+        for( int bY=minBY; bY<=maxBY; bY++ ) {
+            for( int bX=minBX; bX<=maxBX; bX++ ) {
+                char found;
+                int b = mBucketIndex.lookup( bX, bY, 0, 0, &found );
+                
+                if( found ) {
+                    addBucketContents( b, outIndices );
+                    }
+                }
+            }
+        }
+    
+    int numAdded = outIndices->size() - startSize;
+    
+    // restore original list order, which callers depend on
+    // (later updates about the same player override earlier ones)
+    if( numAdded > 1 ) {
+        int *all = outIndices->getElementArray();
+        int *added = &( all[ startSize ] );
+        
+        qsort( added, numAdded, sizeof( int ), compareInts );
+        
+        for( int i=0; i<numAdded; i++ ) {
+            *( outIndices->getElement( startSize + i ) ) = added[i];
+            }
+        delete [] all;
+        }
+    
+    mNumChecksSaved += numPos - numAdded;
+    }
@@ -0,0 +1,71 @@
+#ifndef CHANGE_POS_GRID_H_INCLUDED
+#define CHANGE_POS_GRID_H_INCLUDED
+
+
+#include "map.h"
+#include "HashTable.h"
+
+#include "minorGems/util/SimpleVector.h"
+
+
+
+// Buckets a tick's list of change positions by coarse grid cell, so that
+// each player only has to check the changes that happened near them,
+// instead of every change in the world.
+//
+// Global changes are returned for every query.
+//
+// For short lists, bucketing costs more than it saves, and queries
+// just return the whole list.
+class ChangePosGrid {
+    
+    public:
+        
+        // inPositions must not change while grid is in use
+        ChangePosGrid( SimpleVector<ChangePosition> *inPositions );
+        
+        ~ChangePosGrid();
+        
+
+        // fills outIndices with indices into position list of all
+        // changes that might be within inRadius of inX,inY, 
+        // in ascending order
+        //
+        // Some returned changes may be farther than inRadius, so caller
+        // still needs to check distance.
+        void getNearby( int inX, int inY, double inRadius,
+                        SimpleVector<int> *outIndices );
+        
+
+        // how many per-change distance checks have been skipped by
+        // queries so far
+        int getNumChecksSaved() {
+            return mNumChecksSaved;
+            }
+        
+
+    private:
+        
+        SimpleVector<ChangePosition> *mPositions;
+        
+        char mUseGrid;
+
+        int mNumChecksSaved;
+        
+        // maps bucket x,y to index in mBuckets
+        HashTable<int> mBucketIndex;
+        
+        SimpleVector<int> mBucketX;
+        SimpleVector<int> mBucketY;
+        SimpleVector< SimpleVector<int>* > mBuckets;
+
+        SimpleVector<int> mGlobalIndices;
+        
+        void addBucketContents( int inBucketIndex, 
+                                SimpleVector<int> *outIndices );
+        
+    };
+
+
+
+#endif
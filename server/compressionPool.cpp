@@ -0,0 +1,301 @@
+#include "compressionPool.h"
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/system/Time.h"
+
+#include "minorGems/formats/encodingUtils.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/log/AppLog.h"
+
+
+
+// protects pending, finished, stopSignal, and workerSeconds
+static MutexLock queueLock;
+static BinarySemaphore workAddedSemaphore;
+
+static SimpleVector<CompressionJob*> pendingJobs;
+static SimpleVector<CompressionJob*> finishedJobs;
+
+static char stopSignal = false;
+
+static double workerSeconds = 0;
+
+
+// main thread only
+static int numOutstanding = 0;
+
+static CompressionPoolStats stats = { 0, 0, 0, 0, 0, 0 };
+
+
+
+static void compressJob( CompressionJob *inJob ) {
+    inJob->compressedData = zipCompress( inJob->rawData, inJob->rawLength,
+                                         &( inJob->compressedLength ) );
+
+    delete [] inJob->rawData;
+    inJob->rawData = NULL;
+    }
+
+
+
+static void deleteJob( CompressionJob *inJob ) {
+    if( inJob->rawData != NULL ) {
+        delete [] inJob->rawData;
+        }
+    if( inJob->compressedData != NULL ) {
+        delete [] inJob->compressedData;
+        }
+    delete inJob;
+    }
+
+
+
+class CompressionThread : public Thread {
+
+        virtual void run() {
+
+            while( true ) {
+
+                CompressionJob *job = NULL;
+                char moreWork = false;
+                char stop;
+
+                queueLock.lock();
+
+                stop = stopSignal;
+
+                if( ! stop && pendingJobs.size() > 0 ) {
+                    job = pendingJobs.getElementDirect( 0 );
+                    pendingJobs.deleteElement( 0 );
+
+                    moreWork = ( pendingJobs.size() > 0 );
+                    }
+
+                queueLock.unlock();
+
+
+                if( stop ) {
+                    // pass signal on to next waiting thread
+                    workAddedSemaphore.signal();
+                    break;
+                    }
+
+                if( moreWork ) {
+                    // semaphore is binary, so only one thread woke
+                    // wake another to help
+                    workAddedSemaphore.signal();
+                    }
+
+                if( job != NULL ) {
+                    double startTime = Time::getCurrentTime();
+
+                    compressJob( job );
+
+                    double elapsed = Time::getCurrentTime() - startTime;
+
+                    queueLock.lock();
+                    finishedJobs.push_back( job );
+                    workerSeconds += elapsed;
+                    queueLock.unlock();
+                    }
+                else {
+                    workAddedSemaphore.wait();
+                    }
+                }
+            }
+
+    };
+
+
+
+static SimpleVector<CompressionThread*> threads;
+
+
+
+void initCompressionPool( int inNumThreads ) {
+    stopSignal = false;
+
+    for( int i=0; i<inNumThreads; i++ ) {
+        CompressionThread *t = new CompressionThread();
+        t->start();
+        threads.push_back( t );
+        }
+
+    if( inNumThreads > 0 ) {
+        AppLog::infoF( "Started %d message compression threads",
+                       inNumThreads );
+        }
+    }
+
+
+
+// jobs not done yet still referenced at shutdown are finished inline,
+// so that releasing them later still works
+static void freeJobs( SimpleVector<CompressionJob*> *inJobs ) {
+    for( int i=0; i<inJobs->size(); i++ ) {
+        CompressionJob *job = inJobs->getElementDirect( i );
+
+        if( job->numReferences == 0 ) {
+            deleteJob( job );
+            }
+        else {
+            if( job->compressedData == NULL ) {
+                compressJob( job );
+                }
+            job->done = true;
+            }
+        }
+    inJobs->deleteAll();
+    }
+
+
+
+void freeCompressionPool() {
+    if( threads.size() > 0 ) {
+        queueLock.lock();
+        stopSignal = true;
+        queueLock.unlock();
+
+        workAddedSemaphore.signal();
+
+        for( int i=0; i<threads.size(); i++ ) {
+            CompressionThread *t = threads.getElementDirect( i );
+            t->join();
+            delete t;
+            }
+        threads.deleteAll();
+        }
+
+    // threads all stopped, no lock needed
+    freeJobs( &pendingJobs );
+    freeJobs( &finishedJobs );
+
+    numOutstanding = 0;
+    }
+
+
+
+CompressionJob *startCompression( unsigned char *inRawData,
+                                  int inRawLength ) {
+
+    CompressionJob *job = new CompressionJob;
+
+    job->rawData = inRawData;
+    job->rawLength = inRawLength;
+    job->compressedData = NULL;
+    job->compressedLength = 0;
+    job->done = false;
+    job->numReferences = 1;
+
+    stats.jobsStarted++;
+    stats.bytesIn += inRawLength;
+
+    if( threads.size() == 0 ) {
+        double startTime = Time::getCurrentTime();
+
+        compressJob( job );
+        job->done = true;
+
+        stats.inlineSeconds += Time::getCurrentTime() - startTime;
+        stats.bytesOut += job->compressedLength;
+
+        return job;
+        }
+
+
+    queueLock.lock();
+
+    pendingJobs.push_back( job );
+
+    if( pendingJobs.size() > stats.maxQueueDepth ) {
+        stats.maxQueueDepth = pendingJobs.size();
+        }
+
+    queueLock.unlock();
+
+    workAddedSemaphore.signal();
+
+    numOutstanding++;
+
+    return job;
+    }
+
+
+
+void addCompressionJobReference( CompressionJob *inJob ) {
+    inJob->numReferences++;
+    }
+
+
+
+void releaseCompressionJob( CompressionJob *inJob ) {
+    inJob->numReferences--;
+
+    if( inJob->numReferences == 0 && inJob->done ) {
+        deleteJob( inJob );
+        }
+    // else step deletes it once it's done
+    }
+
+
+
+void stepCompressionPool() {
+    if( numOutstanding == 0 ) {
+        return;
+        }
+
+    SimpleVector<CompressionJob*> jobs;
+
+    queueLock.lock();
+
+    for( int i=0; i<finishedJobs.size(); i++ ) {
+        jobs.push_back( finishedJobs.getElementDirect( i ) );
+        }
+    finishedJobs.deleteAll();
+
+    queueLock.unlock();
+
+
+    for( int i=0; i<jobs.size(); i++ ) {
+        CompressionJob *job = jobs.getElementDirect( i );
+
+        job->done = true;
+        numOutstanding--;
+
+        stats.bytesOut += job->compressedLength;
+
+        if( job->numReferences == 0 ) {
+            // nobody wanted it after all
+            deleteJob( job );
+            }
+        }
+    }
+
+
+
+int getNumCompressionJobsOutstanding() {
+    return numOutstanding;
+    }
+
+
+
+CompressionPoolStats getCompressionPoolStats() {
+    queueLock.lock();
+    stats.workerSeconds = workerSeconds;
+    workerSeconds = 0;
+    queueLock.unlock();
+
+    CompressionPoolStats s = stats;
+
+    stats.jobsStarted = 0;
+    stats.bytesIn = 0;
+    stats.bytesOut = 0;
+    stats.workerSeconds = 0;
+    stats.inlineSeconds = 0;
+    stats.maxQueueDepth = 0;
+
+    return s;
+    }
@@ -0,0 +1,91 @@
+#ifndef COMPRESSION_POOL_H_INCLUDED
+#define COMPRESSION_POOL_H_INCLUDED
+
+
+// Pool of worker threads that zip outgoing message payloads, so that
+// compressing big PU, MX, and map chunk messages doesn't stall the
+// main loop.
+//
+// The main thread hands off a raw payload and gets back a job right
+// away.  Jobs are only marked done in stepCompressionPool, on the main
+// thread, so everything else here (and everything about a job) is main
+// thread only, and needs no locks.
+//
+// Jobs are reference counted, because one compressed payload is often
+// sent to many players.
+//
+// With 0 threads, payloads are compressed right away in
+// startCompression, and jobs are always done.
+
+
+typedef struct CompressionJob {
+        unsigned char *rawData;
+        int rawLength;
+
+        // NULL until done
+        unsigned char *compressedData;
+        int compressedLength;
+
+        char done;
+
+        int numReferences;
+    } CompressionJob;
+
+
+
+void initCompressionPool( int inNumThreads );
+
+
+// stops and joins worker threads, and destroys all remaining jobs
+void freeCompressionPool();
+
+
+
+// starts zipping inRawData, which is destroyed by the job
+// (and must be allocated with new [])
+//
+// Job starts out with one reference, owned by caller.
+CompressionJob *startCompression( unsigned char *inRawData,
+                                  int inRawLength );
+
+
+void addCompressionJobReference( CompressionJob *inJob );
+
+
+// job destroyed when last reference released
+// (or, if still compressing, as soon as it's done)
+void releaseCompressionJob( CompressionJob *inJob );
+
+
+
+// marks jobs finished by workers as done
+void stepCompressionPool();
+
+
+// number of jobs started but not marked done yet
+int getNumCompressionJobsOutstanding();
+
+
+
+// stats for logging
+typedef struct CompressionPoolStats {
+        int jobsStarted;
+        double bytesIn;
+        double bytesOut;
+
+        // time spent compressing on worker threads
+        double workerSeconds;
+
+        // time spent compressing inline, on main thread
+        double inlineSeconds;
+
+        // most jobs waiting for a worker at once
+        int maxQueueDepth;
+    } CompressionPoolStats;
+
+
+// resets stats after returning them
+CompressionPoolStats getCompressionPoolStats();
+
+
+#endif
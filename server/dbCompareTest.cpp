@@ -0,0 +1,344 @@
+// compares KISSDB, STACKDB and MMAPDB on the same work loads
+//
+// keys are 16-byte x,y,slot,subCont quads, like map.db
+//
+// Usage:
+// dbCompareTest [grid_size]
+
+#include "kissdb.h"
+#include "stackdb.h"
+#include "mmapdb.h"
+#include "dbCommon.h"
+#include "minorGems/system/Time.h"
+
+#include <stdlib.h>
+
+#include "minorGems/util/random/CustomRandomSource.h"
+
+
+
+// four ints to a 16-byte key
+void intQuadToKey( int inX, int inY, int inSlot, int inB,
+                   unsigned char *outKey ) {
+    for( int i=0; i<4; i++ ) {
+        int offset = i * 8;
+        outKey[i] = ( inX >> offset ) & 0xFF;
+        outKey[i+4] = ( inY >> offset ) & 0xFF;
+        outKey[i+8] = ( inSlot >> offset ) & 0xFF;
+        outKey[i+12] = ( inB >> offset ) & 0xFF;
+        }
+    }
+
+
+
+// wrappers so that all three DBs can be driven by the same test code
+
+class KissOps {
+    public:
+        typedef KISSDB DBType;
+        typedef KISSDB_Iterator IteratorType;
+
+        static int open( KISSDB *inDB, const char *inPath,
+                         unsigned int inTableSize,
+                         unsigned int inKeySize, unsigned int inValueSize ) {
+            return KISSDB_open( inDB, inPath, KISSDB_OPEN_MODE_RWREPLACE,
+                                inTableSize, inKeySize, inValueSize );
+            }
+        static void close( KISSDB *inDB ) {
+            KISSDB_close( inDB );
+            }
+        static int get( KISSDB *inDB, const void *inKey, void *outValue ) {
+            return KISSDB_get( inDB, inKey, outValue );
+            }
+        static int put( KISSDB *inDB, const void *inKey, const void *inV ) {
+            return KISSDB_put( inDB, inKey, inV );
+            }
+        // no distinction between insert and replace in KISS
+        static int putNew( KISSDB *inDB, const void *inKey, const void *inV ) {
+            return KISSDB_put( inDB, inKey, inV );
+            }
+        static void iteratorInit( KISSDB *inDB, KISSDB_Iterator *inI ) {
+            KISSDB_Iterator_init( inDB, inI );
+            }
+        static int iteratorNext( KISSDB_Iterator *inI,
+                                 void *outKey, void *outValue ) {
+            return KISSDB_Iterator_next( inI, outKey, outValue );
+            }
+    };
+
+
+
+class StackOps {
+    public:
+        typedef STACKDB DBType;
+        typedef STACKDB_Iterator IteratorType;
+
+        static int open( STACKDB *inDB, const char *inPath,
+                         unsigned int inTableSize,
+                         unsigned int inKeySize, unsigned int inValueSize ) {
+            return STACKDB_open( inDB, inPath, 0,
+                                 inTableSize, inKeySize, inValueSize );
+            }
+        static void close( STACKDB *inDB ) {
+            STACKDB_close( inDB );
+            }
+        static int get( STACKDB *inDB, const void *inKey, void *outValue ) {
+            return STACKDB_get( inDB, inKey, outValue );
+            }
+        static int put( STACKDB *inDB, const void *inKey, const void *inV ) {
+            return STACKDB_put( inDB, inKey, inV );
+            }
+        static int putNew( STACKDB *inDB, const void *inKey,
+                           const void *inV ) {
+            return STACKDB_put_new( inDB, inKey, inV );
+            }
+        static void iteratorInit( STACKDB *inDB, STACKDB_Iterator *inI ) {
+            STACKDB_Iterator_init( inDB, inI );
+            }
+        static int iteratorNext( STACKDB_Iterator *inI,
+                                 void *outKey, void *outValue ) {
+            return STACKDB_Iterator_next( inI, outKey, outValue );
+            }
+    };
+
+
+
+class MmapOps {
+    public:
+        typedef MMAPDB DBType;
+        typedef MMAPDB_Iterator IteratorType;
+
+        static int open( MMAPDB *inDB, const char *inPath,
+                         unsigned int inTableSize,
+                         unsigned int inKeySize, unsigned int inValueSize ) {
+            return MMAPDB_open( inDB, inPath, 0,
+                                inTableSize, inKeySize, inValueSize );
+            }
+        static void close( MMAPDB *inDB ) {
+            MMAPDB_close( inDB );
+            }
+        static int get( MMAPDB *inDB, const void *inKey, void *outValue ) {
+            return MMAPDB_get( inDB, inKey, outValue );
+            }
+        static int put( MMAPDB *inDB, const void *inKey, const void *inV ) {
+            return MMAPDB_put( inDB, inKey, inV );
+            }
+        static int putNew( MMAPDB *inDB, const void *inKey,
+                           const void *inV ) {
+            return MMAPDB_put_new( inDB, inKey, inV );
+            }
+        static void iteratorInit( MMAPDB *inDB, MMAPDB_Iterator *inI ) {
+            MMAPDB_Iterator_init( inDB, inI );
+            }
+        static int iteratorNext( MMAPDB_Iterator *inI,
+                                 void *outKey, void *outValue ) {
+            return MMAPDB_Iterator_next( inI, outKey, outValue );
+            }
+    };
+
+
+
+// size of region fetched around a random center in clustered test
+// matches map chunk sent to client
+#define CLUSTER_W 32
+#define CLUSTER_H 30
+
+
+
+template <class Ops>
+void runTests( const char *inName, const char *inFileName, int inNum ) {
+
+    printf( "\n\n===== %s =====\n", inName );
+
+    remove( inFileName );
+
+    typename Ops::DBType db;
+
+    int tableSize = 80000;
+
+    double startTime = Time::getCurrentTime();
+
+    int error = Ops::open( &db, inFileName, tableSize,
+                           16, // four ints,  x, y, slot, subCont
+                           4 // one int
+                           );
+
+    if( error ) {
+        printf( "Failed to open %s\n", inFileName );
+        return;
+        }
+
+    printf( "Opening DB (table size %d) took %f sec\n",
+            tableSize, Time::getCurrentTime() - startTime );
+
+
+    unsigned char key[16];
+    unsigned char value[4];
+
+
+    startTime = Time::getCurrentTime();
+
+    int insertCount = 0;
+    for( int x=0; x<inNum; x++ ) {
+        for( int y=0; y<inNum; y++ ) {
+            insertCount++;
+
+            intToValue( x + y, value );
+            intQuadToKey( x, y, 0, 0, key );
+
+            Ops::putNew( &db, key, value );
+            }
+        }
+    printf( "Inserted %d, took %f sec\n", insertCount,
+            Time::getCurrentTime() - startTime );
+
+
+
+    int lookupCount = 3000;
+    int numRuns = 100;
+    int numLooks = 0;
+    int numHits = 0;
+    unsigned int checksum = 0;
+
+    startTime = Time::getCurrentTime();
+
+    for( int r=0; r<numRuns; r++ ) {
+        CustomRandomSource runSource( 44493 );
+
+        for( int i=0; i<lookupCount; i++ ) {
+            int x = runSource.getRandomBoundedInt( 0, inNum - 1 );
+            int y = runSource.getRandomBoundedInt( 0, inNum - 1 );
+            intQuadToKey( x, y, 0, 0, key );
+            int result = Ops::get( &db, key, value );
+            numLooks ++;
+            if( result == 0 ) {
+                checksum += valueToInt( value );
+                numHits++;
+                }
+            }
+        }
+
+    printf( "Random lookup (%d/%d hits), took %f sec, checksum %u\n",
+            numHits, numLooks, Time::getCurrentTime() - startTime,
+            checksum );
+
+
+
+    // spatially-clustered stream:
+    // whole chunks around random centers, like player views
+    numLooks = 0;
+    numHits = 0;
+    checksum = 0;
+
+    int numChunks = 200;
+
+    startTime = Time::getCurrentTime();
+
+    CustomRandomSource chunkSource( 9387 );
+
+    for( int c=0; c<numChunks; c++ ) {
+        int cX = chunkSource.getRandomBoundedInt( 0, inNum - 1 );
+        int cY = chunkSource.getRandomBoundedInt( 0, inNum - 1 );
+
+        for( int y=cY - CLUSTER_H / 2; y < cY + CLUSTER_H / 2; y++ ) {
+            for( int x=cX - CLUSTER_W / 2; x < cX + CLUSTER_W / 2; x++ ) {
+                // base object and contained count, like getChunkMessage
+                for( int s=0; s<3; s += 2 ) {
+                    intQuadToKey( x, y, s, 0, key );
+                    int result = Ops::get( &db, key, value );
+                    numLooks ++;
+                    if( result == 0 ) {
+                        checksum += valueToInt( value );
+                        numHits++;
+                        }
+                    }
+                }
+            }
+        }
+
+    printf( "Clustered lookup of %d chunks (%d/%d hits), took %f sec, "
+            "checksum %u\n",
+            numChunks, numHits, numLooks,
+            Time::getCurrentTime() - startTime, checksum );
+
+
+
+    numLooks = 0;
+    numHits = 0;
+
+    startTime = Time::getCurrentTime();
+
+    for( int r=0; r<numRuns; r++ ) {
+        CustomRandomSource runSource( 0 );
+
+        for( int i=0; i<lookupCount; i++ ) {
+            // these don't exist
+            int x = runSource.getRandomBoundedInt( inNum + 10, inNum * 2 );
+            int y = runSource.getRandomBoundedInt( 0, inNum - 1 );
+            intQuadToKey( x, y, 0, 0, key );
+            int result = Ops::get( &db, key, value );
+            numLooks ++;
+            if( result == 0 ) {
+                numHits++;
+                }
+            }
+        }
+
+    printf( "Random miss lookup (%d/%d hits), took %f sec\n",
+            numHits, numLooks, Time::getCurrentTime() - startTime );
+
+
+
+    startTime = Time::getCurrentTime();
+
+    CustomRandomSource putSource( 2783 );
+
+    for( int i=0; i<lookupCount * numRuns; i++ ) {
+        int x = putSource.getRandomBoundedInt( 0, inNum * 2 );
+        int y = putSource.getRandomBoundedInt( 0, inNum - 1 );
+        intQuadToKey( x, y, 0, 0, key );
+        intToValue( x + y, value );
+        Ops::put( &db, key, value );
+        }
+
+    printf( "Random replace/insert of %d, took %f sec\n",
+            lookupCount * numRuns, Time::getCurrentTime() - startTime );
+
+
+
+    startTime = Time::getCurrentTime();
+
+    typename Ops::IteratorType dbi;
+
+    Ops::iteratorInit( &db, &dbi );
+
+    int count = 0;
+    checksum = 0;
+    while( Ops::iteratorNext( &dbi, key, value ) > 0 ) {
+        count++;
+        checksum += valueToInt( value );
+        }
+    printf( "Iterated %d, checksum %u, took %f sec\n",
+            count, checksum, Time::getCurrentTime() - startTime );
+
+    Ops::close( &db );
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int num = 500;
+
+    if( inNumArgs > 1 ) {
+        sscanf( inArgs[1], "%d", &num );
+        }
+
+    printf( "Testing with %dx%d grid of keys\n", num, num );
+
+    runTests<KissOps>( "KISSDB", "testKiss.db", num );
+    runTests<StackOps>( "STACKDB", "testStack.db", num );
+    runTests<MmapOps>( "MMAPDB", "testMmap.db", num );
+
+    return 0;
+    }
@@ -5,14 +5,18 @@
 
 #include "kissdb.h"
 #include "stackdb.h"
+#include "mmapdb.h"
 
 
 void usage() {
     printf( "Usage:\n" );
-    printf( "dbConvert kiss_db_file new_table_size\n\n" );
+    printf( "dbConvert kiss_db_file new_table_size [stack|mmap]\n\n" );
     
+    printf( "Converts to stackdb by default\n\n" );
+
     printf( "Example:\n" );
-    printf( "dbConvert map.db 80000\n\n" );
+    printf( "dbConvert map.db 80000\n" );
+    printf( "dbConvert map.db 80000 mmap\n\n" );
     
     exit( 1 );
     }
@@ -21,9 +25,20 @@ void usage() {
 
 int main( int inNumArgs, char **inArgs ) {
     
-    if( inNumArgs != 3 ) {
+    if( inNumArgs != 3 && inNumArgs != 4 ) {
         usage();
         }
+
+    char useMmap = false;
+    
+    if( inNumArgs == 4 ) {
+        if( strcmp( inArgs[3], "mmap" ) == 0 ) {
+            useMmap = true;
+            }
+        else if( strcmp( inArgs[3], "stack" ) != 0 ) {
+            usage();
+            }
+        }
     int newTableSize = 0;
     
     sscanf( inArgs[2], "%d", &newTableSize );
@@ -60,15 +75,28 @@ int main( int inNumArgs, char **inArgs ) {
     
 
     STACKDB dbNew;
-
-    error = STACKDB_open( &dbNew,
-                          tempFileName,
-                          0,
-                          newTableSize,
-                          keySize,
-                          valueSize );
+    MMAPDB dbNewMmap;
+    
+    if( useMmap ) {
+        error = MMAPDB_open( &dbNewMmap,
+                             tempFileName,
+                             0,
+                             newTableSize,
+                             keySize,
+                             valueSize );
+        }
+    else {
+        error = STACKDB_open( &dbNew,
+                              tempFileName,
+                              0,
+                              newTableSize,
+                              keySize,
+                              valueSize );
+        }
+    
     if( error ) {
-        printf( "dbConvert: Failed to open temp stackdb file %s\n", 
+        printf( "dbConvert: Failed to open temp %s file %s\n", 
+                useMmap ? "mmapdb" : "stackdb",
                 tempFileName );
         KISSDB_close( &db );
         exit( 1 );
@@ -83,14 +111,25 @@ int main( int inNumArgs, char **inArgs ) {
     KISSDB_Iterator_init( &db, &dbi );
     
     while( KISSDB_Iterator_next( &dbi, keyBuff, valueBuff ) > 0 ) {
-        STACKDB_put_new( &dbNew, keyBuff, valueBuff );
+        if( useMmap ) {
+            MMAPDB_put_new( &dbNewMmap, keyBuff, valueBuff );
+            }
+        else {
+            STACKDB_put_new( &dbNew, keyBuff, valueBuff );
+            }
         }
 
     delete [] keyBuff;
     delete [] valueBuff;
     
     KISSDB_close( &db );
-    STACKDB_close( &dbNew );
+    
+    if( useMmap ) {
+        MMAPDB_close( &dbNewMmap );
+        }
+    else {
+        STACKDB_close( &dbNew );
+        }
         
     if( rename ( tempFileName, oldFileName ) != 0 ) {
         printf( "dbConvert: Failed to move temp file %s to "
@@ -0,0 +1,400 @@
+#include "decayTimingWheel.h"
+
+#include <math.h>
+
+
+
+#define WHEEL_BITS 6
+#define WHEEL_SIZE 64
+#define WHEEL_MASK 63
+
+#define OVERFLOW_BUCKET ( 3 * WHEEL_SIZE )
+
+
+
+DecayTimingWheel::DecayTimingWheel()
+        : mFreeHead( -1 ),
+          mCurrentTick( (int64_t)floor( Time::timeSec() ) ),
+          mHandles( 1024, -1 ),
+          mNumLive( 0 ),
+          mNumExpired( 0 ),
+          mNumCancelled( 0 ) {
+
+    for( int b=0; b<=OVERFLOW_BUCKET; b++ ) {
+        mBucketHeads[b] = -1;
+        }
+    for( int l=0; l<3; l++ ) {
+        mLevelMasks[l] = 0;
+        }
+    }
+
+
+
+DecayTimingWheel::~DecayTimingWheel() {
+    }
+
+
+
+void DecayTimingWheel::clear() {
+    mNodes.deleteAll();
+    mFreeHead = -1;
+
+    for( int b=0; b<=OVERFLOW_BUCKET; b++ ) {
+        mBucketHeads[b] = -1;
+        }
+    for( int l=0; l<3; l++ ) {
+        mLevelMasks[l] = 0;
+        }
+
+    mCurrentTick = (int64_t)floor( Time::timeSec() );
+    mHandles.clear();
+
+    mNumLive = 0;
+    mNumExpired = 0;
+    mNumCancelled = 0;
+    }
+
+
+
+void DecayTimingWheel::place( int inNodeIndex ) {
+    WheelNode *n = mNodes.getElement( inNodeIndex );
+
+    int64_t tick = n->tick;
+
+    if( tick < mCurrentTick ) {
+        // already due
+        tick = mCurrentTick;
+        }
+
+    int bucket;
+
+    if( ( tick >> WHEEL_BITS ) == ( mCurrentTick >> WHEEL_BITS ) ) {
+        bucket = (int)( tick & WHEEL_MASK );
+        }
+    else if( ( tick >> ( 2 * WHEEL_BITS ) ) ==
+             ( mCurrentTick >> ( 2 * WHEEL_BITS ) ) ) {
+        bucket = WHEEL_SIZE + (int)( ( tick >> WHEEL_BITS ) & WHEEL_MASK );
+        }
+    else if( ( tick >> ( 3 * WHEEL_BITS ) ) ==
+             ( mCurrentTick >> ( 3 * WHEEL_BITS ) ) ) {
+        bucket = 2 * WHEEL_SIZE +
+            (int)( ( tick >> ( 2 * WHEEL_BITS ) ) & WHEEL_MASK );
+        }
+    else {
+        bucket = OVERFLOW_BUCKET;
+        }
+
+    n->bucket = bucket;
+    n->prev = -1;
+    n->next = mBucketHeads[ bucket ];
+
+    if( n->next != -1 ) {
+        mNodes.getElement( n->next )->prev = inNodeIndex;
+        }
+    mBucketHeads[ bucket ] = inNodeIndex;
+
+    if( bucket != OVERFLOW_BUCKET ) {
+        mLevelMasks[ bucket / WHEEL_SIZE ] |=
+            ( (uint64_t)1 << ( bucket & WHEEL_MASK ) );
+        }
+    }
+
+
+
+void DecayTimingWheel::unlink( int inNodeIndex ) {
+    WheelNode *n = mNodes.getElement( inNodeIndex );
+
+    if( n->prev != -1 ) {
+        mNodes.getElement( n->prev )->next = n->next;
+        }
+    else {
+        mBucketHeads[ n->bucket ] = n->next;
+
+        if( n->next == -1 && n->bucket != OVERFLOW_BUCKET ) {
+            // bucket now empty
+            mLevelMasks[ n->bucket / WHEEL_SIZE ] &=
+                ~( (uint64_t)1 << ( n->bucket & WHEEL_MASK ) );
+            }
+        }
+
+    if( n->next != -1 ) {
+        mNodes.getElement( n->next )->prev = n->prev;
+        }
+
+    n->prev = -1;
+    n->next = -1;
+    }
+
+
+
+void DecayTimingWheel::freeNode( int inNodeIndex ) {
+    WheelNode *n = mNodes.getElement( inNodeIndex );
+
+    mHandles.remove( n->record.x, n->record.y, n->record.slot,
+                     n->record.subCont );
+
+    n->bucket = -1;
+    n->next = mFreeHead;
+    mFreeHead = inNodeIndex;
+
+    mNumLive--;
+    }
+
+
+
+void DecayTimingWheel::schedule( LiveDecayRecord inRecord ) {
+    char found;
+    int nodeIndex = mHandles.lookup( inRecord.x, inRecord.y, inRecord.slot,
+                                     inRecord.subCont, &found );
+
+    if( found ) {
+        // replacing, move existing node
+        unlink( nodeIndex );
+        mNumCancelled++;
+        }
+    else {
+        if( mFreeHead != -1 ) {
+            nodeIndex = mFreeHead;
+            mFreeHead = mNodes.getElement( nodeIndex )->next;
+            }
+        else {
+            WheelNode blank = { inRecord, 0, -1, -1, -1 };
+            mNodes.push_back( blank );
+            nodeIndex = mNodes.size() - 1;
+            }
+
+        mHandles.insert( inRecord.x, inRecord.y, inRecord.slot,
+                         inRecord.subCont, nodeIndex );
+        mNumLive++;
+        }
+
+    WheelNode *n = mNodes.getElement( nodeIndex );
+
+    n->record = inRecord;
+    n->tick = (int64_t)ceil( inRecord.etaTimeSeconds );
+
+    place( nodeIndex );
+    }
+
+
+
+timeSec_t DecayTimingWheel::lookup( int inX, int inY, int inSlot,
+                                    int inSubCont,
+                                    char *outFound ) {
+    int nodeIndex = mHandles.lookup( inX, inY, inSlot, inSubCont, outFound );
+
+    if( ! *outFound ) {
+        return 0;
+        }
+    return mNodes.getElement( nodeIndex )->record.etaTimeSeconds;
+    }
+
+
+
+void DecayTimingWheel::cancel( int inX, int inY, int inSlot, int inSubCont ) {
+    char found;
+    int nodeIndex = mHandles.lookup( inX, inY, inSlot, inSubCont, &found );
+
+    if( found ) {
+        unlink( nodeIndex );
+        freeNode( nodeIndex );
+        mNumCancelled++;
+        }
+    }
+
+
+
+void DecayTimingWheel::pourBucket( int inBucket ) {
+    int nodeIndex = mBucketHeads[ inBucket ];
+
+    mBucketHeads[ inBucket ] = -1;
+
+    if( inBucket != OVERFLOW_BUCKET ) {
+        mLevelMasks[ inBucket / WHEEL_SIZE ] &=
+            ~( (uint64_t)1 << ( inBucket & WHEEL_MASK ) );
+        }
+
+    while( nodeIndex != -1 ) {
+        int next = mNodes.getElement( nodeIndex )->next;
+
+        place( nodeIndex );
+
+        nodeIndex = next;
+        }
+    }
+
+
+
+void DecayTimingWheel::cascade( int64_t inTick ) {
+    // higher levels first, so that what they pour into level 1
+    // is poured on down into level 0
+    if( ( inTick & ( ( 1 << ( 2 * WHEEL_BITS ) ) - 1 ) ) == 0 ) {
+
+        if( ( inTick & ( ( 1 << ( 3 * WHEEL_BITS ) ) - 1 ) ) == 0 ) {
+            pourBucket( OVERFLOW_BUCKET );
+            }
+
+        pourBucket( 2 * WHEEL_SIZE +
+                    (int)( ( inTick >> ( 2 * WHEEL_BITS ) ) & WHEEL_MASK ) );
+        }
+
+    pourBucket( WHEEL_SIZE + (int)( ( inTick >> WHEEL_BITS ) & WHEEL_MASK ) );
+    }
+
+
+
+char DecayTimingWheel::getNextUpperBucketStart( int64_t *outTick ) {
+    // everything in a level is later than everything in levels below it
+
+    if( mLevelMasks[1] != 0 ) {
+        int index = __builtin_ctzll( mLevelMasks[1] );
+
+        *outTick =
+            ( ( mCurrentTick >> ( 2 * WHEEL_BITS ) ) << ( 2 * WHEEL_BITS ) ) |
+            ( (int64_t)index << WHEEL_BITS );
+        return true;
+        }
+
+    if( mLevelMasks[2] != 0 ) {
+        int index = __builtin_ctzll( mLevelMasks[2] );
+
+        *outTick =
+            ( ( mCurrentTick >> ( 3 * WHEEL_BITS ) ) << ( 3 * WHEEL_BITS ) ) |
+            ( (int64_t)index << ( 2 * WHEEL_BITS ) );
+        return true;
+        }
+
+    if( mBucketHeads[ OVERFLOW_BUCKET ] != -1 ) {
+        // far future, rare, so just scan for earliest
+        int64_t minTick = 0;
+        
+        int nodeIndex = mBucketHeads[ OVERFLOW_BUCKET ];
+        
+        while( nodeIndex != -1 ) {
+            WheelNode *n = mNodes.getElement( nodeIndex );
+            
+            if( nodeIndex == mBucketHeads[ OVERFLOW_BUCKET ] ||
+                n->tick < minTick ) {
+                minTick = n->tick;
+                }
+            nodeIndex = n->next;
+            }
+        
+        // start of its level-2 cycle
+        *outTick = 
+            ( minTick >> ( 3 * WHEEL_BITS ) ) << ( 3 * WHEEL_BITS );
+        return true;
+        }
+
+    return false;
+    }
+
+
+
+char DecayTimingWheel::popExpired( timeSec_t inCurTime,
+                                   LiveDecayRecord *outRecord ) {
+
+    int64_t curTick = (int64_t)floor( inCurTime );
+
+    if( mNumLive == 0 ) {
+        // nothing to pour down, skip right to now
+        if( curTick > mCurrentTick ) {
+            mCurrentTick = curTick;
+            }
+        return false;
+        }
+
+    while( true ) {
+        int index = (int)( mCurrentTick & WHEEL_MASK );
+
+        int nodeIndex = mBucketHeads[ index ];
+
+        if( nodeIndex != -1 ) {
+            // ticks are rounded-up ETAs, so all in this bucket are due
+            unlink( nodeIndex );
+
+            *outRecord = mNodes.getElement( nodeIndex )->record;
+
+            freeNode( nodeIndex );
+            mNumExpired++;
+            return true;
+            }
+
+        if( mCurrentTick >= curTick ) {
+            return false;
+            }
+
+
+        // skip ahead to next non-empty level 0 bucket in this window
+        uint64_t laterMask =
+            mLevelMasks[0] & ( ~(uint64_t)0 << index );
+
+        if( laterMask != 0 ) {
+            int64_t nextTick =
+                ( mCurrentTick & ~(int64_t)WHEEL_MASK ) |
+                __builtin_ctzll( laterMask );
+
+            if( nextTick > curTick ) {
+                mCurrentTick = curTick;
+                return false;
+                }
+            mCurrentTick = nextTick;
+            continue;
+            }
+
+
+        // level 0 empty for rest of window
+        // skip ahead to next non-empty bucket above level 0
+        // (empty buckets in between have nothing to pour down)
+        int64_t nextTick;
+
+        if( ! getNextUpperBucketStart( &nextTick ) ||
+            nextTick > curTick ) {
+
+            mCurrentTick = curTick;
+            return false;
+            }
+
+        mCurrentTick = nextTick;
+        cascade( nextTick );
+        }
+    }
+
+
+
+char DecayTimingWheel::getNextETA( timeSec_t *outETA ) {
+    if( mNumLive == 0 ) {
+        return false;
+        }
+
+    if( mLevelMasks[0] != 0 ) {
+        *outETA = (timeSec_t)( ( mCurrentTick & ~(int64_t)WHEEL_MASK ) |
+                               __builtin_ctzll( mLevelMasks[0] ) );
+        return true;
+        }
+
+    int64_t nextTick;
+
+    if( getNextUpperBucketStart( &nextTick ) ) {
+        *outETA = (timeSec_t)nextTick;
+        return true;
+        }
+
+    return false;
+    }
+
+
+
+int DecayTimingWheel::getAndResetNumExpired() {
+    int n = mNumExpired;
+    mNumExpired = 0;
+    return n;
+    }
+
+
+
+int DecayTimingWheel::getAndResetNumCancelled() {
+    int n = mNumCancelled;
+    mNumCancelled = 0;
+    return n;
+    }
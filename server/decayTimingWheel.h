@@ -0,0 +1,151 @@
+#ifndef DECAY_TIMING_WHEEL_H_INCLUDED
+#define DECAY_TIMING_WHEEL_H_INCLUDED
+
+
+#include "HashTable.h"
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include <stdint.h>
+
+
+
+typedef struct LiveDecayRecord {
+        int x, y;
+
+        // 0 means main object decay
+        // 1 - NUM_CONT_SLOT means contained object decay
+        int slot;
+
+        timeSec_t etaTimeSeconds;
+
+        // 0 means main object
+        // >0 indexs sub containers of object
+        int subCont;
+
+    } LiveDecayRecord;
+
+
+
+// Hierarchical timing wheel of live decay records, at most one record
+// per x, y, slot, subCont.
+//
+// Level 0 has one bucket per second for the current 64-second window,
+// level 1 one bucket per 64 seconds, level 2 one per 4096 seconds, and
+// anything farther out waits in an overflow list.  Buckets of a level
+// are poured down into lower levels as time reaches them.
+//
+// Scheduling, rescheduling, and cancelling are O(1) through a handle
+// table that maps each key to its record, so stale duplicates never
+// pile up the way they do with lazy deletion.
+//
+// ETAs are rounded up to whole seconds, so a record never comes out
+// before its ETA.
+class DecayTimingWheel {
+
+    public:
+
+        DecayTimingWheel();
+
+        ~DecayTimingWheel();
+
+
+        // adds a record, replacing any record with the same key
+        void schedule( LiveDecayRecord inRecord );
+
+
+        // ETA of record with this key
+        timeSec_t lookup( int inX, int inY, int inSlot, int inSubCont,
+                          char *outFound );
+
+
+        void cancel( int inX, int inY, int inSlot, int inSubCont );
+
+
+        // removes one record with ETA at or before inCurTime
+        // returns false if there are none
+        char popExpired( timeSec_t inCurTime, LiveDecayRecord *outRecord );
+
+
+        // lower bound on earliest ETA of all records, exact (rounded up)
+        // if it's in current 64-second window
+        // returns false if empty
+        char getNextETA( timeSec_t *outETA );
+
+
+        int getNumLive() {
+            return mNumLive;
+            }
+
+        // counts since last call, reset after returning
+        int getAndResetNumExpired();
+        int getAndResetNumCancelled();
+
+
+        void clear();
+
+
+    private:
+
+        typedef struct WheelNode {
+                LiveDecayRecord record;
+
+                // ETA rounded up
+                int64_t tick;
+
+                // index of bucket that node is in, or -1 if free
+                int bucket;
+
+                // neighbors in bucket, or next free node
+                int prev, next;
+            } WheelNode;
+
+
+        SimpleVector<WheelNode> mNodes;
+
+        int mFreeHead;
+
+
+        // three levels of 64 buckets, then overflow bucket
+        int mBucketHeads[ 3 * 64 + 1 ];
+
+        // bit set for each non-empty bucket in a level
+        uint64_t mLevelMasks[3];
+
+
+        // all ticks up to this one have been poured down into level 0
+        int64_t mCurrentTick;
+
+
+        // maps key to node index
+        HashTable<int> mHandles;
+
+
+        int mNumLive;
+        int mNumExpired;
+        int mNumCancelled;
+
+
+        void place( int inNodeIndex );
+
+        void unlink( int inNodeIndex );
+
+        void freeNode( int inNodeIndex );
+
+        // re-places all nodes in bucket
+        void pourBucket( int inBucket );
+
+        // pour down buckets that start at tick inTick
+        // inTick must be a multiple of 64
+        void cascade( int64_t inTick );
+
+        // earliest start of a non-empty bucket above level 0
+        // returns false if none
+        char getNextUpperBucketStart( int64_t *outTick );
+
+    };
+
+
+
+#endif
@@ -0,0 +1,488 @@
+// compares HashTable against the old fixed-size chained implementation
+// on key patterns like those map.cpp generates, checking that both give
+// the same results along the way
+//
+// Patterns:
+//
+//   lookTimes:  liveDecayRecordLastLookTimeHashTable
+//               x,y,slot,subCont keys for cells with live decay, clustered
+//               around player camps, looked up over whole view rectangles
+//               (mostly misses) as players look around, and removed as
+//               decays expire
+//
+//   movements:  liveMovementEtaTimes
+//               x,y,0,0 keys, short-lived, high churn
+//
+//   gridIndex:  ChangePosGrid's bucket index
+//               a few hundred coarse x,y,0,0 keys, cleared every tick
+//
+// Usage:
+// hashTableBenchmark [num_camps] [steps]
+
+
+#include "HashTable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/system/Time.h"
+
+
+
+// old implementation, kept here as a reference
+// (five SimpleVectors per bucket, bucket count fixed at construction)
+
+template <class Type>
+class old_HashTable {
+
+    public:
+
+        old_HashTable( int inSize, Type inDefaultValue = (Type)NULL )
+                : mSize( inSize ),
+                  mNumElements( 0 ),
+                  mDefaultValue( inDefaultValue ),
+                  mTable( new SimpleVector<Type>[ inSize ] ),
+                  mKeysA( new SimpleVector<int>[ inSize ] ),
+                  mKeysB( new SimpleVector<int>[ inSize ] ),
+                  mKeysC( new SimpleVector<int>[ inSize ] ),
+                  mKeysD( new SimpleVector<int>[ inSize ] ) {
+            }
+
+        ~old_HashTable() {
+            delete [] mTable;
+            delete [] mKeysA;
+            delete [] mKeysB;
+            delete [] mKeysC;
+            delete [] mKeysD;
+            }
+
+        Type lookup( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                     char *outFound ) {
+            int hashKey, bin;
+            *outFound = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD,
+                                   &hashKey, &bin );
+            if( *outFound ) {
+                return mTable[ hashKey ].getElementDirect( bin );
+                }
+            return mDefaultValue;
+            }
+
+        Type *lookupPointer( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                             char *outFound ) {
+            int hashKey, bin;
+            *outFound = lookupBin( inKeyA, inKeyB, inKeyC, inKeyD,
+                                   &hashKey, &bin );
+            if( *outFound ) {
+                return mTable[ hashKey ].getElement( bin );
+                }
+            return NULL;
+            }
+
+        void insert( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                     Type inItem ) {
+            int hashKey, bin;
+            if( lookupBin( inKeyA, inKeyB, inKeyC, inKeyD,
+                           &hashKey, &bin ) ) {
+                *( mTable[ hashKey ].getElement( bin ) ) = inItem;
+                }
+            else {
+                mTable[ hashKey ].push_back( inItem );
+                mKeysA[ hashKey ].push_back( inKeyA );
+                mKeysB[ hashKey ].push_back( inKeyB );
+                mKeysC[ hashKey ].push_back( inKeyC );
+                mKeysD[ hashKey ].push_back( inKeyD );
+                mNumElements++;
+                }
+            }
+
+        void remove( int inKeyA, int inKeyB, int inKeyC, int inKeyD ) {
+            int hashKey, bin;
+            if( lookupBin( inKeyA, inKeyB, inKeyC, inKeyD,
+                           &hashKey, &bin ) ) {
+                mTable[ hashKey ].deleteElement( bin );
+                mKeysA[ hashKey ].deleteElement( bin );
+                mKeysB[ hashKey ].deleteElement( bin );
+                mKeysC[ hashKey ].deleteElement( bin );
+                mKeysD[ hashKey ].deleteElement( bin );
+                mNumElements--;
+                }
+            }
+
+        int getNumElements() {
+            return mNumElements;
+            }
+
+        void clear() {
+            for( int i=0; i<mSize; i++ ) {
+                mTable[i].deleteAll();
+                mKeysA[i].deleteAll();
+                mKeysB[i].deleteAll();
+                mKeysC[i].deleteAll();
+                mKeysD[i].deleteAll();
+                }
+            mNumElements = 0;
+            }
+
+    private:
+        int mSize;
+        int mNumElements;
+        Type mDefaultValue;
+
+        SimpleVector<Type> *mTable;
+
+        SimpleVector<int> *mKeysA;
+        SimpleVector<int> *mKeysB;
+        SimpleVector<int> *mKeysC;
+        SimpleVector<int> *mKeysD;
+
+        int computeHash( int inKeyA, int inKeyB, int inKeyC, int inKeyD ) {
+            int hashKey = ( inKeyA * 734727 + inKeyB * 263471 +
+                            inKeyC * 2753 + inKeyD * 948731 ) % mSize;
+            if( hashKey < 0 ) {
+                hashKey += mSize;
+                }
+            return hashKey;
+            }
+
+        char lookupBin( int inKeyA, int inKeyB, int inKeyC, int inKeyD,
+                        int *outHashKey, int *outBin ) {
+            int hashKey = computeHash( inKeyA, inKeyB, inKeyC, inKeyD );
+            int numBins = mTable[hashKey].size();
+            *outHashKey = hashKey;
+
+            for( int i=0; i<numBins; i++ ) {
+                if( mKeysA[hashKey].getElementDirect( i ) == inKeyA &&
+                    mKeysB[hashKey].getElementDirect( i ) == inKeyB &&
+                    mKeysC[hashKey].getElementDirect( i ) == inKeyC &&
+                    mKeysD[hashKey].getElementDirect( i ) == inKeyD ) {
+                    *outBin = i;
+                    return true;
+                    }
+                }
+            return false;
+            }
+    };
+
+
+
+
+// xorshift, so that both tables see exactly the same op stream
+static unsigned int randState = 1;
+
+static unsigned int nextRand() {
+    randState ^= randState << 13;
+    randState ^= randState >> 17;
+    randState ^= randState << 5;
+    return randState;
+    }
+
+static int randRange( int inLow, int inHigh ) {
+    return inLow + (int)( nextRand() % (unsigned int)( inHigh - inLow + 1 ) );
+    }
+
+
+
+typedef struct HashOp {
+        // 0 insert, 1 lookup, 2 lookupPointer and write, 3 remove, 4 clear
+        int type;
+        int keys[4];
+        double value;
+    } HashOp;
+
+
+
+static void addOp( SimpleVector<HashOp> *inOps, int inType,
+                   int inA, int inB, int inC, int inD, double inValue = 0 ) {
+    HashOp op = { inType, { inA, inB, inC, inD }, inValue };
+    inOps->push_back( op );
+    }
+
+
+
+// player view, like getChunkBody
+#define VIEW_RADIUS_X 16
+#define VIEW_RADIUS_Y 14
+
+
+
+static void makeLookTimeOps( int inNumCamps, int inSteps,
+                             SimpleVector<HashOp> *outOps ) {
+
+    SimpleVector<int> campX, campY;
+
+    for( int c=0; c<inNumCamps; c++ ) {
+        campX.push_back( randRange( -5000, 5000 ) );
+        campY.push_back( randRange( -5000, 5000 ) );
+        }
+
+    // keys currently in table, so that removes hit
+    SimpleVector<int> liveKeys;
+
+    for( int s=0; s<inSteps; s++ ) {
+        int c = randRange( 0, inNumCamps - 1 );
+
+        int cx = campX.getElementDirect( c );
+        int cy = campY.getElementDirect( c );
+
+        // new live decays near camp
+        // mostly ground objects, some container slots and sub-slots
+        for( int i=0; i<20; i++ ) {
+            int x = cx + randRange( -40, 40 );
+            int y = cy + randRange( -40, 40 );
+
+            int slot = 0;
+            int subCont = 0;
+
+            int r = randRange( 0, 9 );
+            if( r >= 7 ) {
+                slot = randRange( 1, 6 );
+                }
+            if( r == 9 ) {
+                subCont = randRange( 1, 3 );
+                }
+
+            addOp( outOps, 0, x, y, slot, subCont, s );
+
+            liveKeys.push_back( x );
+            liveKeys.push_back( y );
+            liveKeys.push_back( slot );
+            liveKeys.push_back( subCont );
+            }
+
+        // a player looks over their view, like lookAtRegion
+        int px = cx + randRange( -20, 20 );
+        int py = cy + randRange( -20, 20 );
+
+        for( int y = py - VIEW_RADIUS_Y; y <= py + VIEW_RADIUS_Y; y++ ) {
+            for( int x = px - VIEW_RADIUS_X; x <= px + VIEW_RADIUS_X; x++ ) {
+                addOp( outOps, 2, x, y, 0, 0, s );
+                }
+            }
+
+        // decays expire, like stepMap
+        int numLive = liveKeys.size() / 4;
+
+        for( int i=0; i<18 && numLive > 0; i++ ) {
+            int k = randRange( 0, numLive - 1 );
+
+            int *keys = liveKeys.getElement( k * 4 );
+
+            addOp( outOps, 1, keys[0], keys[1], keys[2], keys[3] );
+            addOp( outOps, 3, keys[0], keys[1], keys[2], keys[3] );
+
+            // swap last into its place
+            int *last = liveKeys.getElement( ( numLive - 1 ) * 4 );
+            for( int j=0; j<4; j++ ) {
+                keys[j] = last[j];
+                }
+            for( int j=0; j<4; j++ ) {
+                liveKeys.deleteElement( liveKeys.size() - 1 );
+                }
+            numLive--;
+            }
+        }
+    }
+
+
+
+static void makeMovementOps( int inNumCamps, int inSteps,
+                             SimpleVector<HashOp> *outOps ) {
+
+    SimpleVector<int> liveKeys;
+
+    for( int s=0; s<inSteps; s++ ) {
+        int cx = randRange( -5000, 5000 );
+        int cy = randRange( -5000, 5000 );
+
+        for( int i=0; i<inNumCamps / 10 + 1; i++ ) {
+            int x = cx + randRange( -10, 10 );
+            int y = cy + randRange( -10, 10 );
+
+            addOp( outOps, 0, x, y, 0, 0, s );
+            liveKeys.push_back( x );
+            liveKeys.push_back( y );
+            }
+
+        // getEtaMove-style checks during getChunkBody
+        for( int i=0; i<200; i++ ) {
+            addOp( outOps, 1, cx + randRange( -16, 16 ),
+                   cy + randRange( -14, 14 ), 0, 0 );
+            }
+
+        // movements finish
+        while( liveKeys.size() / 2 > inNumCamps ) {
+            int k = randRange( 0, liveKeys.size() / 2 - 1 );
+
+            addOp( outOps, 3,
+                   liveKeys.getElementDirect( k * 2 ),
+                   liveKeys.getElementDirect( k * 2 + 1 ), 0, 0 );
+
+            int n = liveKeys.size();
+            *( liveKeys.getElement( k * 2 ) ) =
+                liveKeys.getElementDirect( n - 2 );
+            *( liveKeys.getElement( k * 2 + 1 ) ) =
+                liveKeys.getElementDirect( n - 1 );
+            liveKeys.deleteElement( n - 1 );
+            liveKeys.deleteElement( n - 2 );
+            }
+        }
+    }
+
+
+
+static void makeGridIndexOps( int inNumCamps, int inSteps,
+                              SimpleVector<HashOp> *outOps ) {
+
+    for( int s=0; s<inSteps; s++ ) {
+
+        // changes this tick, bucketed into 32-cell grid squares
+        for( int i=0; i<inNumCamps * 4; i++ ) {
+            int bX = randRange( -5000, 5000 ) / 32;
+            int bY = randRange( -5000, 5000 ) / 32;
+
+            addOp( outOps, 1, bX, bY, 0, 0 );
+            addOp( outOps, 0, bX, bY, 0, 0, i );
+            }
+
+        // players query around them
+        for( int i=0; i<inNumCamps * 2; i++ ) {
+            int bX = randRange( -5000, 5000 ) / 32;
+            int bY = randRange( -5000, 5000 ) / 32;
+
+            for( int dy=-1; dy<=1; dy++ ) {
+                for( int dx=-1; dx<=1; dx++ ) {
+                    addOp( outOps, 1, bX + dx, bY + dy, 0, 0 );
+                    }
+                }
+            }
+
+        addOp( outOps, 4, 0, 0, 0, 0 );
+        }
+    }
+
+
+
+// returns checksum of results, so that work can't be optimized away
+template <class TableType>
+static double runOps( TableType *inTable, SimpleVector<HashOp> *inOps ) {
+    double sum = 0;
+    int numFound = 0;
+
+    int numOps = inOps->size();
+    HashOp *ops = inOps->getElementArray();
+
+    for( int i=0; i<numOps; i++ ) {
+        HashOp *op = &( ops[i] );
+        char found;
+
+        switch( op->type ) {
+            case 0:
+                inTable->insert( op->keys[0], op->keys[1], op->keys[2],
+                                 op->keys[3], op->value );
+                break;
+            case 1:
+                sum += inTable->lookup( op->keys[0], op->keys[1],
+                                        op->keys[2], op->keys[3], &found );
+                numFound += found;
+                break;
+            case 2: {
+                double *p = inTable->lookupPointer( op->keys[0], op->keys[1],
+                                                    op->keys[2], op->keys[3],
+                                                    &found );
+                if( p != NULL ) {
+                    *p = op->value;
+                    numFound++;
+                    }
+                break;
+                }
+            case 3:
+                inTable->remove( op->keys[0], op->keys[1], op->keys[2],
+                                 op->keys[3] );
+                break;
+            case 4:
+                inTable->clear();
+                break;
+            }
+        }
+
+    delete [] ops;
+
+    return sum + numFound + inTable->getNumElements();
+    }
+
+
+
+static char runPattern( const char *inName, SimpleVector<HashOp> *inOps,
+                        int inSize ) {
+
+    old_HashTable<double> oldTable( inSize, 0 );
+    HashTable<double> newTable( inSize, 0 );
+
+    double startTime = Time::getCurrentTime();
+    double oldSum = runOps( &oldTable, inOps );
+    double oldTime = Time::getCurrentTime() - startTime;
+
+    startTime = Time::getCurrentTime();
+    double newSum = runOps( &newTable, inOps );
+    double newTime = Time::getCurrentTime() - startTime;
+
+    printf( "%-10s %9d ops, %7d left:  old %8.3f s, new %8.3f s "
+            "(%.1fx)\n",
+            inName, inOps->size(), newTable.getNumElements(),
+            oldTime, newTime, oldTime / newTime );
+
+    if( oldSum != newSum ||
+        oldTable.getNumElements() != newTable.getNumElements() ) {
+        printf( "  MISMATCH:  old checksum %f, new checksum %f\n",
+                oldSum, newSum );
+        return false;
+        }
+    return true;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    int numCamps = 40;
+    int steps = 20000;
+
+    if( inNumArgs > 1 ) {
+        numCamps = atoi( inArgs[1] );
+        }
+    if( inNumArgs > 2 ) {
+        steps = atoi( inArgs[2] );
+        }
+
+    if( numCamps < 1 ) {
+        numCamps = 1;
+        }
+
+
+    char allMatch = true;
+
+    SimpleVector<HashOp> ops;
+
+    // sizes are the ones map.cpp and ChangePosGrid construct with
+    makeLookTimeOps( numCamps, steps, &ops );
+    allMatch &= runPattern( "lookTimes", &ops, 1024 );
+    ops.deleteAll();
+
+    makeMovementOps( numCamps, steps, &ops );
+    allMatch &= runPattern( "movements", &ops, 1024 );
+    ops.deleteAll();
+
+    makeGridIndexOps( numCamps, steps / 10, &ops );
+    allMatch &= runPattern( "gridIndex", &ops, 256 );
+    ops.deleteAll();
+
+
+    if( ! allMatch ) {
+        printf( "FAILED:  results differ\n" );
+        return 1;
+        }
+
+    printf( "Results match\n" );
+    return 0;
+    }
@@ -0,0 +1,123 @@
+#include "heatSim.h"
+
+#include <string.h>
+
+
+
+void clearHeatBatch( HeatBatch *outBatch ) {
+    // unused lanes still get simulated, on zeros
+    memset( outBatch, 0, sizeof( HeatBatch ) );
+    }
+
+
+
+int addToHeatBatch( HeatBatch *inBatch, 
+                    float *inRGrid, float *inHeatOutputGrid ) {
+    if( inBatch->numPlayers >= HEAT_BATCH_SIZE ) {
+        return -1;
+        }
+    
+    int lane = inBatch->numPlayers;
+    
+    for( int j=0; j<HEAT_MAP_CELLS; j++ ) {
+        inBatch->rValue[j][lane] = inRGrid[j];
+        inBatch->heatOutput[j][lane] = inHeatOutputGrid[j];
+        }
+    
+    inBatch->numPlayers++;
+    
+    return lane;
+    }
+
+
+
+void simulateHeatBatch( HeatBatch *inBatch ) {
+    
+    const int numNeighbors = 8;
+    const int ndx[8] = { 0, 1,  0, -1,  1,  1, -1, -1 };
+    const int ndy[8] = { 1, 0, -1,  0,  1, -1,  1, -1 };
+    
+    // found equation here:
+    // http://demonstrations.wolfram.com/
+    //        ACellularAutomatonBasedHeatEquation/
+    // diags have way less contact area
+    //
+    // kept as doubles, like the per-player version that results must
+    // match
+    const double nWeights[8] = { 4, 4, 4, 4, 1, 1, 1, 1 };
+    
+    const double totalNWeight = 20;
+    
+
+    // neighbor weight times both leaks is the same every cycle
+    // (product of weight and two floats is exact as a double, so
+    // precomputing it changes nothing)
+    double coef[ HEAT_MAP_CELLS ][ 8 ][ HEAT_BATCH_SIZE ];
+    
+    for( int y=1; y<HEAT_MAP_D-1; y++ ) {
+        for( int x=1; x<HEAT_MAP_D-1; x++ ) {
+            int j = y * HEAT_MAP_D + x;
+            
+            for( int n=0; n<numNeighbors; n++ ) {
+                int nj = ( y + ndy[n] ) * HEAT_MAP_D + ( x + ndx[n] );
+                
+                for( int p=0; p<HEAT_BATCH_SIZE; p++ ) {
+                    float centerLeak = 1 - inBatch->rValue[j][p];
+                    float nLeak = 1 - inBatch->rValue[nj][p];
+                    
+                    coef[j][n][p] = nWeights[n] * centerLeak * nLeak;
+                    }
+                }
+            }
+        }
+    
+    for( int j=0; j<HEAT_MAP_CELLS; j++ ) {
+        for( int p=0; p<HEAT_BATCH_SIZE; p++ ) {
+            inBatch->heat[j][p] = 0;
+            }
+        }
+    
+    
+    for( int c=0; c<HEAT_SIM_CYCLES; c++ ) {
+        
+        float oldHeat[ HEAT_MAP_CELLS ][ HEAT_BATCH_SIZE ];
+        memcpy( oldHeat, inBatch->heat, sizeof( oldHeat ) );
+        
+        for( int y=1; y<HEAT_MAP_D-1; y++ ) {
+            for( int x=1; x<HEAT_MAP_D-1; x++ ) {
+                int j = y * HEAT_MAP_D + x;
+                
+                float heatDelta[ HEAT_BATCH_SIZE ];
+                
+                for( int p=0; p<HEAT_BATCH_SIZE; p++ ) {
+                    heatDelta[p] = 0;
+                    }
+                
+                for( int n=0; n<numNeighbors; n++ ) {
+                    int nj = ( y + ndy[n] ) * HEAT_MAP_D + ( x + ndx[n] );
+                    
+                    for( int p=0; p<HEAT_BATCH_SIZE; p++ ) {
+                        heatDelta[p] += 
+                            coef[j][n][p] *
+                            ( oldHeat[nj][p] - oldHeat[j][p] );
+                        }
+                    }
+                
+                for( int p=0; p<HEAT_BATCH_SIZE; p++ ) {
+                    inBatch->heat[j][p] = 
+                        oldHeat[j][p] + heatDelta[p] / totalNWeight;
+                    
+                    inBatch->heat[j][p] += inBatch->heatOutput[j][p];
+                    }
+                }
+            }
+        }
+    }
+
+
+
+void getHeatBatchResult( HeatBatch *inBatch, int inLane, float *outHeatMap ) {
+    for( int j=0; j<HEAT_MAP_CELLS; j++ ) {
+        outHeatMap[j] = inBatch->heat[j][ inLane ];
+        }
+    }
@@ -0,0 +1,56 @@
+#ifndef HEAT_SIM_H_INCLUDED
+#define HEAT_SIM_H_INCLUDED
+
+
+// Player heat simulation:  a few cycles of a cellular automaton heat
+// equation over the map cells around a player, starting from no heat.
+//
+// Players are simulated in batches, stored struct-of-arrays:  each
+// cell holds that cell's values for every player in the batch side by
+// side, so the stencil steps through all players in lockstep, and the
+// inner loop over players is a fixed-length run of contiguous floats
+// that the compiler turns into SIMD.
+//
+// Results match simulating each player on its own exactly, bit for bit
+// (see heatSimBenchmark in gameSource/thermalSim).
+
+
+#define HEAT_MAP_D 10
+
+#define HEAT_MAP_CELLS ( HEAT_MAP_D * HEAT_MAP_D )
+
+#define HEAT_BATCH_SIZE 8
+
+#define HEAT_SIM_CYCLES 8
+
+
+typedef struct HeatBatch {
+        int numPlayers;
+        
+        // inputs
+        float rValue[ HEAT_MAP_CELLS ][ HEAT_BATCH_SIZE ];
+        float heatOutput[ HEAT_MAP_CELLS ][ HEAT_BATCH_SIZE ];
+        
+        // result
+        float heat[ HEAT_MAP_CELLS ][ HEAT_BATCH_SIZE ];
+    } HeatBatch;
+
+
+
+void clearHeatBatch( HeatBatch *outBatch );
+
+
+// inRGrid and inHeatOutputGrid are HEAT_MAP_D x HEAT_MAP_D, row major
+// returns player's lane in batch, or -1 if batch full
+int addToHeatBatch( HeatBatch *inBatch, 
+                    float *inRGrid, float *inHeatOutputGrid );
+
+
+void simulateHeatBatch( HeatBatch *inBatch );
+
+
+// outHeatMap is HEAT_MAP_D x HEAT_MAP_D, row major
+void getHeatBatchResult( HeatBatch *inBatch, int inLane, float *outHeatMap );
+
+
+#endif
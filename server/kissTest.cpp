@@ -2,6 +2,7 @@
 
 #include "kissdb.h"
 #include "stackdb.h"
+#include "mmapdb.h"
 #include "dbCommon.h"
 #include "minorGems/system/Time.h"
 
@@ -37,6 +38,19 @@
 #define DB_Iterator_next  STACKDB_Iterator_next
 /**/
 
+/*
+#define DB MMAPDB
+#define DB_open MMAPDB_open
+#define DB_close MMAPDB_close
+#define DB_get MMAPDB_get
+#define DB_put MMAPDB_put
+// mmap db skips chain search on insert
+#define DB_put_new MMAPDB_put_new
+#define DB_Iterator  MMAPDB_Iterator
+#define DB_Iterator_init  MMAPDB_Iterator_init
+#define DB_Iterator_next  MMAPDB_Iterator_next
+*/
+
 CustomRandomSource randSource( 0 );
 
 
@@ -29,8 +29,11 @@
 #include <stdint.h>
 
 #ifdef _WIN32
+#include <io.h>
 #define fseeko fseeko64
 #define ftello ftello64
+#else
+#include <unistd.h>
 #endif
 
 #define KISSDB_HEADER_SIZE ((sizeof(uint64_t) * 3) + 4)
@@ -161,6 +164,17 @@ void KISSDB_close(KISSDB *db)
 	memset(db,0,sizeof(KISSDB));
 }
 
+int KISSDB_sync(KISSDB *db)
+{
+	if (fflush(db->f))
+		return -1;
+#ifdef _WIN32
+	return _commit(_fileno(db->f));
+#else
+	return fsync(fileno(db->f));
+#endif
+}
+
 int KISSDB_get(KISSDB *db,const void *key,void *vbuf)
 {
 	uint8_t tmp[4096];
@@ -112,6 +112,14 @@ extern int KISSDB_open(
  */
 extern void KISSDB_close(KISSDB *db);
 
+/**
+ * Flush all writes through to disk
+ *
+ * @param db Database struct
+ * @return 0 on success, nonzero on error
+ */
+extern int KISSDB_sync(KISSDB *db);
+
 /**
  * Get an entry
  *
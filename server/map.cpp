@@ -1,6 +1,10 @@
 #include "map.h"
 #include "HashTable.h"
 #include "monument.h"
+#include "regionStore.h"
+#include "blockingMap.h"
+#include "mapPregen.h"
+#include "decayTimingWheel.h"
 
 // cell pixel dimension on client
 #define CELL_D 128
@@ -15,11 +19,15 @@
 #include "minorGems/util/log/AppLog.h"
 
 #include "minorGems/system/Time.h"
+#include "minorGems/system/Thread.h"
 
 #include "minorGems/formats/encodingUtils.h"
 
 #include "kissdb.h"
 #include "stackdb.h"
+#include "mmapdb.h"
+
+#include "writeAheadLog.h"
 
 
 /*
@@ -33,6 +41,12 @@
 #define DB_Iterator  KISSDB_Iterator
 #define DB_Iterator_init  KISSDB_Iterator_init
 #define DB_Iterator_next  KISSDB_Iterator_next
+// records never move, iteration can pause anywhere
+#define DB_Iterator_betweenBins( i )  true
+// KISSDB flushes after every write
+#define DB_sync KISSDB_sync
+// gets never write
+#define DB_setReadOnlyGets( db, r )
 */
 
 /**/
@@ -46,8 +60,31 @@
 #define DB_Iterator  STACKDB_Iterator
 #define DB_Iterator_init  STACKDB_Iterator_init
 #define DB_Iterator_next  STACKDB_Iterator_next
+// gets move records to top of their bin, so iteration can only pause
+// between bins if other calls are made in the mean time
+#define DB_Iterator_betweenBins( i )  ( (i)->nextRecordLoc == 0 )
+#define DB_sync STACKDB_sync
+#define DB_setReadOnlyGets STACKDB_setReadOnlyGets
 /**/
 
+/*
+#define DB MMAPDB
+#define DB_open MMAPDB_open
+#define DB_close MMAPDB_close
+#define DB_get MMAPDB_get
+#define DB_put MMAPDB_put
+// mmap DB skips chain search on insert
+#define DB_put_new MMAPDB_put_new
+#define DB_Iterator  MMAPDB_Iterator
+#define DB_Iterator_init  MMAPDB_Iterator_init
+#define DB_Iterator_next  MMAPDB_Iterator_next
+// records never move, iteration can pause anywhere
+#define DB_Iterator_betweenBins( i )  true
+#define DB_sync MMAPDB_sync
+// gets never write
+#define DB_setReadOnlyGets( db, r )
+*/
+
 
 
 
@@ -96,6 +133,12 @@ timeSec_t fastTime() {
 //#define MAP_TIMESEC fastTime()
 
 
+
+timeSec_t getMapTimeSec() {
+    return MAP_TIMESEC;
+    }
+
+
 extern GridPos getClosestPlayerPos( int inX, int inY );
 
 
@@ -246,40 +289,19 @@ static int maxSecondsForActiveDecayTracking = 900;
 static int maxSecondsNoLookDecayTracking = 10;
 
 
-typedef struct LiveDecayRecord {
-        int x, y;
-        
-        // 0 means main object decay
-        // 1 - NUM_CONT_SLOT means contained object decay
-        int slot;
-        
-        timeSec_t etaTimeSeconds;
-
-        // 0 means main object
-        // >0 indexs sub containers of object
-        int subCont;
-
-    } LiveDecayRecord;
-
-
-
-#include "minorGems/util/MinPriorityQueue.h"
-
-static MinPriorityQueue<LiveDecayRecord> liveDecayQueue;
+// at most one record per cell or slot, holding its current ETA
+static DecayTimingWheel liveDecayWheel;
 
 
-// for quick lookup of existing records in liveDecayQueue
-// store the eta time here
-// before storing a new record in the queue, we can check this hash
-// table to see whether it already exists
-static HashTable<timeSec_t> liveDecayRecordPresentHashTable( 1024 );
-
 // times in seconds that a tracked live decay map cell or slot
 // was last looked at
 static HashTable<timeSec_t> liveDecayRecordLastLookTimeHashTable( 1024 );
 
 
 
+#include "minorGems/util/MinPriorityQueue.h"
+
+
 // track currently in-process movements so that we can be queried
 // about whether arrival has happened or not
 typedef struct MovementRecord {
@@ -405,6 +427,13 @@ timeSec_t dbLookTimeGet( int inX, int inY );
 void dbLookTimePut( int inX, int inY, timeSec_t inTime );
 
 
+// DB_get and DB_put for per-cell DBs, aware of online compaction
+static int cellDBGet( DB *inDB, unsigned char *inKey, 
+                      unsigned char *outValue );
+static int cellDBPut( DB *inDB, unsigned char *inKey, 
+                      unsigned char *inValue );
+
+
 
 
 // returns -1 if not found
@@ -417,7 +446,7 @@ static int biomeDBGet( int inX, int inY,
     // look for changes to default in database
     intPairToKey( inX, inY, key );
     
-    int result = DB_get( &biomeDB, key, value );
+    int result = cellDBGet( &biomeDB, key, value );
     
     if( result == 0 ) {
         // found
@@ -454,7 +483,7 @@ static void biomeDBPut( int inX, int inY, int inValue, int inSecondPlace,
             
     
     anyBiomesInDB = true;
-    DB_put( &biomeDB, key, value );
+    cellDBPut( &biomeDB, key, value );
 
     dbLookTimePut( inX, inY, MAP_TIMESEC );
     }
@@ -564,14 +593,14 @@ static BiomeCacheRecord biomeCache[ BIOME_CACHE_SIZE ];
 #define CACHE_PRIME_C 528383237
 #define CACHE_PRIME_D 148497157
 
+// BIOME_CACHE_SIZE must be a power of 2
 static int computeBiomeCacheHash( int inKeyA, int inKeyB ) {
     
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B ) % BIOME_CACHE_SIZE;
-    if( hashKey < 0 ) {
-        hashKey += BIOME_CACHE_SIZE;
-        }
-    return hashKey;
+    // unsigned, so overflow wraps instead of being undefined
+    unsigned int hashKey = (unsigned int)inKeyA * CACHE_PRIME_A + 
+                           (unsigned int)inKeyB * CACHE_PRIME_B;
+    
+    return hashKey & ( BIOME_CACHE_SIZE - 1 );
     }
 
 
@@ -621,6 +650,37 @@ static void biomePutCached( int inX, int inY, int inBiome, int inSecondPlace,
 
 
 
+// folds fractal value of biome index inI into running top-two picks
+static void stepBiomePick( int inI, double inRandVal,
+                           int *ioPickedBiome, double *ioMaxValue,
+                           int *ioSecondPlace, double *ioSecondPlaceGap ) {
+    
+    if( inRandVal > *ioMaxValue ) {
+        // a new first place
+        
+        // old first moves into second
+        *ioSecondPlace = *ioPickedBiome;
+        *ioSecondPlaceGap = inRandVal - *ioMaxValue;
+        
+
+        *ioMaxValue = inRandVal;
+        *ioPickedBiome = inI;
+        }
+    else if( inRandVal > *ioMaxValue - *ioSecondPlaceGap ) {
+        // a better second place
+        *ioSecondPlace = inI;
+        *ioSecondPlaceGap = *ioMaxValue - inRandVal;
+        }
+    }
+
+
+
+static double getBiomeFractalScale() {
+    return 0.83332 + 0.08333 * numBiomes;
+    }
+
+
+
 static int computeMapBiomeIndex( int inX, int inY, 
                                  int *outSecondPlaceIndex = NULL,
                                  double *outSecondPlaceGap = NULL ) {
@@ -660,24 +720,10 @@ static int computeMapBiomeIndex( int inX, int inY,
         double randVal = getXYFractal(  inX,
                                         inY,
                                         0.55, 
-                                        0.83332 + 0.08333 * numBiomes );
+                                        getBiomeFractalScale() );
         
-        if( randVal > maxValue ) {
-            // a new first place
-            
-            // old first moves into second
-            secondPlace = pickedBiome;
-            secondPlaceGap = randVal - maxValue;
-            
-
-            maxValue = randVal;
-            pickedBiome = i;
-            }
-        else if( randVal > maxValue - secondPlaceGap ) {
-            // a better second place
-            secondPlace = i;
-            secondPlaceGap = maxValue - randVal;
-            }
+        stepBiomePick( i, randVal, &pickedBiome, &maxValue,
+                       &secondPlace, &secondPlaceGap );
         }
     
     biomePutCached( inX, inY, pickedBiome, secondPlace, secondPlaceGap );
@@ -867,177 +913,407 @@ static void mapCacheInsert( int inX, int inY, int inID ) {
 static int getBaseMapCallCount = 0;
 
 
-static int getBaseMap( int inX, int inY ) {
-    
-    if( inX > xLimit || inX < -xLimit ||
-        inY > yLimit || inY < -yLimit ) {
-    
-        return edgeObjectID;
-        }
-    
-    int cachedID = mapCacheLookup( inX, inY );
-    
-    if( cachedID != -1 ) {
-        return cachedID;
-        }
-    
-    getBaseMapCallCount ++;
 
-    setXYRandomSeed( 5379 );
-    
-    // first step:  save rest of work if density tells us that
-    // nothing is here anyway
-    double density = getXYFractal( inX, inY, 0.1, 0.25 );
-    
+static double correctBaseMapDensity( double inRawDensity ) {
     // correction
-    density = sigmoid( density, 0.1 );
+    double density = sigmoid( inRawDensity, 0.1 );
     
     // scale
     density *= .4;
     // good for zoom in to map for teaser
     //density = .70;
+
+    return density;
+    }
+
+
+// true if density alone says there's no natural object here
+static char isBaseMapEmptyByDensity( int inX, int inY ) {
+    setXYRandomSeed( 5379 );
+    
+    // first step:  save rest of work if density tells us that
+    // nothing is here anyway
+    double density = correctBaseMapDensity( 
+        getXYFractal( inX, inY, 0.1, 0.25 ) );
     
     setXYRandomSeed( 9877 );
     
-    if( getXYRandom( inX, inY ) < density ) {
-
-
+    return ! ( getXYRandom( inX, inY ) < density );
+    }
 
 
-        // next step, pick top two biomes
-        int secondPlace;
-        double secondPlaceGap;
-        
-        int pickedBiome = getMapBiomeIndex( inX, inY, &secondPlace,
-                                            &secondPlaceGap );
-        
-        if( pickedBiome == -1 ) {
-            mapCacheInsert( inX, inY, 0 );
-            return 0;
-            }
-        
-        lastCheckedBiome = biomes[pickedBiome];
-        
 
+// picks natural object for a spot that passed density test, given its
+// top two biomes
+//
+// Only reads natural object tables, so safe to call from any thread
+// while map is loaded.
+static int pickNaturalObject( int inX, int inY, 
+                              int inPickedBiome, int inSecondPlace,
+                              double inSecondPlaceGap ) {
+    
+    int pickedBiome = inPickedBiome;
+    
+    // randomly let objects from second place biome peek through
         
-        // randomly let objects from second place biome peek through
-        
-        // if gap is 0, this should happen 50 percent of the time
+    // if gap is 0, this should happen 50 percent of the time
 
-        // if gap is 1.0, it should never happen
+    // if gap is 1.0, it should never happen
 
-        // larger values make second place less likely
-        double secondPlaceReduction = 10.0;
+    // larger values make second place less likely
+    double secondPlaceReduction = 10.0;
 
-        //printf( "Second place gap = %f, random(%d,%d)=%f\n", secondPlaceGap,
-        //        inX, inY, getXYRandom( 2087 + inX, 793 + inY ) );
+    //printf( "Second place gap = %f, random(%d,%d)=%f\n", secondPlaceGap,
+    //        inX, inY, getXYRandom( 2087 + inX, 793 + inY ) );
         
-        setXYRandomSeed( 348763 );
+    setXYRandomSeed( 348763 );
         
-        if( getXYRandom( inX, inY ) > 
-            .5 + secondPlaceReduction * secondPlaceGap ) {
+    if( getXYRandom( inX, inY ) > 
+        .5 + secondPlaceReduction * inSecondPlaceGap ) {
         
-            // note that lastCheckedBiome is NOT changed, so ground
-            // shows the true, first-place biome, but object placement
-            // follows the second place biome
-            pickedBiome = secondPlace;
-            }
+        // note that lastCheckedBiome is NOT changed, so ground
+        // shows the true, first-place biome, but object placement
+        // follows the second place biome
+        pickedBiome = inSecondPlace;
+        }
         
 
-        int numObjects = naturalMapIDs[pickedBiome].size();
+    int numObjects = naturalMapIDs[pickedBiome].size();
 
-        if( numObjects == 0  ) {
-            mapCacheInsert( inX, inY, 0 );
-            return 0;
-            }
+    if( numObjects == 0  ) {
+        return 0;
+        }
 
     
   
-        // something present here
+    // something present here
 
         
-        // special object in this region is 10x more common than it 
-        // would be otherwise
+    // special object in this region is 10x more common than it 
+    // would be otherwise
 
 
-        int specialObjectIndex = -1;
-        double maxValue = -DBL_MAX;
+    int specialObjectIndex = -1;
+    double maxValue = -DBL_MAX;
         
 
-        for( int i=0; i<numObjects; i++ ) {
+    for( int i=0; i<numObjects; i++ ) {
             
-            setXYRandomSeed( 793 * i + 123 );
+        setXYRandomSeed( 793 * i + 123 );
         
-            double randVal = getXYFractal(  inX, 
-                                            inY, 
-                                            0.3, 
-                                            0.15 + 0.016666 * numObjects );
+        double randVal = getXYFractal(  inX, 
+                                        inY, 
+                                        0.3, 
+                                        0.15 + 0.016666 * numObjects );
 
-            if( randVal > maxValue ) {
-                maxValue = randVal;
-                specialObjectIndex = i;
-                }
+        if( randVal > maxValue ) {
+            maxValue = randVal;
+            specialObjectIndex = i;
             }
+        }
+
+
 
+    float oldSpecialChance = 
+        naturalMapChances[pickedBiome].getElementDirect( 
+            specialObjectIndex );
+        
+    float newSpecialChance = oldSpecialChance * 10;
+    
+    // boost special chance in our local copy of weights only,
+    // so tables are never written while other threads read them
+    float boostedTotalWeight = totalChanceWeight[pickedBiome];
+    
+    boostedTotalWeight -= oldSpecialChance;
+    boostedTotalWeight += newSpecialChance;
+        
 
+    // pick one of our natural objects at random
 
-        float oldSpecialChance = 
-            naturalMapChances[pickedBiome].getElementDirect( 
-                specialObjectIndex );
+    // pick value between 0 and total weight
+        
+    setXYRandomSeed( 4593873 );
+        
+    double randValue = boostedTotalWeight * getXYRandom( inX, inY );
+
+    // walk through objects, summing weights, until one crosses threshold
+    int i = 0;
+    float weightSum = 0;        
+        
+    while( weightSum < randValue && i < numObjects ) {
+        if( i == specialObjectIndex ) {
+            weightSum += newSpecialChance;
+            }
+        else {
+            weightSum += naturalMapChances[pickedBiome].getElementDirect( i );
+            }
+        i++;
+        }
         
-        float newSpecialChance = oldSpecialChance * 10;
+    i--;
         
-        *( naturalMapChances[pickedBiome].getElement( specialObjectIndex ) )
-            = newSpecialChance;
+    if( i >= 0 ) {
+        return naturalMapIDs[pickedBiome].getElementDirect( i );
+        }
+    else {
+        return 0;
+        }
+    }
+
+
+
+static int getBaseMap( int inX, int inY ) {
+    
+    if( inX > xLimit || inX < -xLimit ||
+        inY > yLimit || inY < -yLimit ) {
+    
+        return edgeObjectID;
+        }
+    
+    int cachedID = mapCacheLookup( inX, inY );
+    
+    if( cachedID != -1 ) {
+        return cachedID;
+        }
+    
+    getBaseMapCallCount ++;
+
+    if( isBaseMapEmptyByDensity( inX, inY ) ) {
+        mapCacheInsert( inX, inY, 0 );
+        return 0;
+        }
+    
+
+    // next step, pick top two biomes
+    int secondPlace;
+    double secondPlaceGap;
         
-        float oldTotalChanceWeight = totalChanceWeight[pickedBiome];
+    int pickedBiome = getMapBiomeIndex( inX, inY, &secondPlace,
+                                        &secondPlaceGap );
         
-        totalChanceWeight[pickedBiome] -= oldSpecialChance;
-        totalChanceWeight[pickedBiome] += newSpecialChance;
+    if( pickedBiome == -1 ) {
+        mapCacheInsert( inX, inY, 0 );
+        return 0;
+        }
         
+    lastCheckedBiome = biomes[pickedBiome];
+    
+    int returnID = pickNaturalObject( inX, inY, pickedBiome,
+                                      secondPlace, secondPlaceGap );
+    
+    mapCacheInsert( inX, inY, returnID );
+    return returnID;
+    }
 
-        // pick one of our natural objects at random
 
-        // pick value between 0 and total weight
+
+
+// cells per batch in row functions below
+#define BASE_MAP_ROW_BATCH 64
+
+
+
+// top two biomes for a row of cells, inNumCells <= BASE_MAP_ROW_BATCH
+// same results as computeMapBiomeIndex, but touches no cache
+static void computeBiomeRow( int inXStart, int inY, int inNumCells,
+                             int *outPickedBiome, int *outSecondPlace,
+                             double *outSecondPlaceGap ) {
+    
+    double values[ BASE_MAP_ROW_BATCH ];
+    double maxValue[ BASE_MAP_ROW_BATCH ];
         
-        setXYRandomSeed( 4593873 );
+    for( int i=0; i<inNumCells; i++ ) {
+        outPickedBiome[i] = -1;
+        maxValue[i] = -DBL_MAX;
+        outSecondPlace[i] = -1;
+        outSecondPlaceGap[i] = 0;
+        }
         
-        double randValue = 
-            totalChanceWeight[pickedBiome] * getXYRandom( inX, inY );
+    for( int b=0; b<numBiomes; b++ ) {
+        getXYFractalRow( biomes[b] * 263 + 723, 
+                         inXStart, inY, inNumCells,
+                         0.55, getBiomeFractalScale(), values );
+            
+        for( int i=0; i<inNumCells; i++ ) {
+            stepBiomePick( b, values[i], &( outPickedBiome[i] ), 
+                           &( maxValue[i] ),
+                           &( outSecondPlace[i] ), 
+                           &( outSecondPlaceGap[i] ) );
+            }
+        }
+    }
 
-        // walk through objects, summing weights, until one crosses threshold
-        int i = 0;
-        float weightSum = 0;        
+
+
+// isBaseMapEmptyByDensity for a row of cells, 
+// inNumCells <= BASE_MAP_ROW_BATCH
+static void computeDensityEmptyRow( int inXStart, int inY, int inNumCells,
+                                    char *outEmpty ) {
+    double densityValues[ BASE_MAP_ROW_BATCH ];
+    double randValues[ BASE_MAP_ROW_BATCH ];
+    
+    getXYFractalRow( 5379, inXStart, inY, inNumCells, 0.1, 0.25, 
+                     densityValues );
+    getXYRandomRow( 9877, inXStart, inY, inNumCells, randValues );
+    
+    for( int i=0; i<inNumCells; i++ ) {
+        outEmpty[i] = 
+            ! ( randValues[i] < correctBaseMapDensity( densityValues[i] ) );
+        }
+    }
+
+
+
+// computes biomes and base map density for a row of cells at once, with
+// the row versions of the noise functions, and puts the results into the
+// biome cache and base map cache
+//
+// Most cells are empty because of density alone, so only the few
+// that have a natural object still go through full getBaseMap.
+static void prefillBaseMapRowBatch( int inXStart, int inY, int inNumCells ) {
+    
+    // biomes
+    char anyBiomeMisses = false;
+    
+    for( int i=0; i<inNumCells; i++ ) {
+        int secondPlace;
+        double secondPlaceGap;
         
-        while( weightSum < randValue && i < numObjects ) {
-            weightSum += naturalMapChances[pickedBiome].getElementDirect( i );
-            i++;
+        if( biomeGetCached( inXStart + i, inY, 
+                            &secondPlace, &secondPlaceGap ) == -2 ) {
+            anyBiomeMisses = true;
+            break;
             }
+        }
+    
+    if( anyBiomeMisses ) {
+        int pickedBiome[ BASE_MAP_ROW_BATCH ];
+        int secondPlace[ BASE_MAP_ROW_BATCH ];
+        double secondPlaceGap[ BASE_MAP_ROW_BATCH ];
         
-        i--;
+        computeBiomeRow( inXStart, inY, inNumCells, 
+                         pickedBiome, secondPlace, secondPlaceGap );
         
+        for( int i=0; i<inNumCells; i++ ) {
+            biomePutCached( inXStart + i, inY, pickedBiome[i],
+                            secondPlace[i], secondPlaceGap[i] );
+            }
+        }
+    
 
-        // restore chance of special object
-        *( naturalMapChances[pickedBiome].getElement( specialObjectIndex ) )
-            = oldSpecialChance;
-
-        totalChanceWeight[pickedBiome] = oldTotalChanceWeight;
+    // density
+    if( inY > yLimit || inY < -yLimit ) {
+        // whole row is edge
+        return;
+        }
 
-        if( i >= 0 ) {
-            int returnID = naturalMapIDs[pickedBiome].getElementDirect( i );
-            mapCacheInsert( inX, inY, returnID );
-            return returnID;
+    char anyMapMisses = false;
+    
+    for( int i=0; i<inNumCells; i++ ) {
+        if( mapCacheLookup( inXStart + i, inY ) == -1 ) {
+            anyMapMisses = true;
+            break;
             }
-        else {
-            mapCacheInsert( inX, inY, 0 );
-            return 0;
+        }
+    
+    if( ! anyMapMisses ) {
+        return;
+        }
+    
+    char empty[ BASE_MAP_ROW_BATCH ];
+    
+    computeDensityEmptyRow( inXStart, inY, inNumCells, empty );
+    
+    for( int i=0; i<inNumCells; i++ ) {
+        int x = inXStart + i;
+        
+        if( x > xLimit || x < -xLimit ) {
+            continue;
+            }
+        
+        if( empty[i] ) {
+            mapCacheInsert( x, inY, 0 );
             }
         }
-    else {
-        mapCacheInsert( inX, inY, 0 );
-        return 0;
+    }
+
+
+
+static void prefillBaseMapRow( int inXStart, int inY, int inNumCells ) {
+    for( int b=0; b<inNumCells; b += BASE_MAP_ROW_BATCH ) {
+        int num = inNumCells - b;
+        if( num > BASE_MAP_ROW_BATCH ) {
+            num = BASE_MAP_ROW_BATCH;
+            }
+        prefillBaseMapRowBatch( inXStart + b, inY, num );
         }
+    }
+
+
+
+
+// generates a block on a pregen worker thread
+// touches no caches or DBs
+static void generateBaseMapBlock( PregenBlock *ioBlock ) {
     
+    for( int r=0; r<PREGEN_BLOCK_D; r++ ) {
+        int y = ioBlock->startY + r;
+        
+        int rowStart = r * PREGEN_BLOCK_D;
+        
+        int *pickedBiome = &( ioBlock->pickedBiome[ rowStart ] );
+        int *secondPlace = &( ioBlock->secondPlace[ rowStart ] );
+        double *secondPlaceGap = &( ioBlock->secondPlaceGap[ rowStart ] );
+        
+        computeBiomeRow( ioBlock->startX, y, PREGEN_BLOCK_D,
+                         pickedBiome, secondPlace, secondPlaceGap );
+        
+        char empty[ PREGEN_BLOCK_D ];
+        
+        computeDensityEmptyRow( ioBlock->startX, y, PREGEN_BLOCK_D, empty );
+        
+        for( int i=0; i<PREGEN_BLOCK_D; i++ ) {
+            int x = ioBlock->startX + i;
+            
+            int *id = &( ioBlock->baseMapID[ rowStart + i ] );
+            
+            if( x > xLimit || x < -xLimit ||
+                y > yLimit || y < -yLimit ) {
+                // edge, never cached
+                *id = -1;
+                }
+            else if( empty[i] || pickedBiome[i] == -1 ) {
+                *id = 0;
+                }
+            else {
+                *id = pickNaturalObject( x, y, pickedBiome[i],
+                                         secondPlace[i], 
+                                         secondPlaceGap[i] );
+                }
+            }
+        }
+    }
+
+
+
+// back on main thread, put generated block into caches
+static void consumeBaseMapBlock( PregenBlock *inBlock ) {
+    for( int r=0; r<PREGEN_BLOCK_D; r++ ) {
+        int y = inBlock->startY + r;
+        
+        for( int i=0; i<PREGEN_BLOCK_D; i++ ) {
+            int x = inBlock->startX + i;
+            int c = r * PREGEN_BLOCK_D + i;
+            
+            biomePutCached( x, y, inBlock->pickedBiome[c],
+                            inBlock->secondPlace[c], 
+                            inBlock->secondPlaceGap[c] );
+            
+            if( inBlock->baseMapID[c] != -1 ) {
+                mapCacheInsert( x, y, inBlock->baseMapID[c] );
+                }
+            }
+        }
     }
 
 
@@ -1107,6 +1383,8 @@ void outputMapImage() {
 
     for( int y = 0; y<h; y++ ) {
         
+        prefillBaseMapRow( 0, y, w );
+
         for( int x = 0; x<w; x++ ) {
 
             /*
@@ -1204,19 +1482,23 @@ void outputBiomeFractals() {
         for( int b=0; b<numBiomes; b++ ) {
             int biome = biomes[ b ];
             
-            setXYRandomSeed( biome * 263 + 723 );
-
             int r = 100 * scale;
             
             Image outIm( r * 2, r * 2, 4 );
             
+            double *rowValues = new double[ r * 2 ];
+            
             for( int y=-r; y<r; y++ ) {
+                
+                getXYFractalRow( biome * 263 + 723,
+                                 -r, y, r * 2,
+                                 0.55, 
+                                 scale,
+                                 rowValues );
+                
                 for( int x=-r; x<r; x++ ) {
                     
-                    double v = getXYFractal(  x, 
-                                              y, 
-                                              0.55, 
-                                              scale );
+                    double v = rowValues[ x + r ];
                     Color c( v, v, v, 1 );
 
                     int imX = x + r;
@@ -1226,6 +1508,8 @@ void outputBiomeFractals() {
                     }
                 }
             
+            delete [] rowValues;
+            
             char *name = autoSprintf( "fractal_b%d_s%d.tga",
                                       biome, scale );
             
@@ -1324,11 +1608,20 @@ void printBiomeSamples() {
 
     int range = 2000;
 
-    for( int i=0; i<numSamples; i++ ) {
-        int x = sampleRandSource.getRandomBoundedInt( -range, range );
+    // sample short rows at random spots, so that rows of
+    // cells can be computed at once
+    int rowLength = 100;
+    
+    for( int i=0; i<numSamples; i += rowLength ) {
+        int x = sampleRandSource.getRandomBoundedInt( -range, 
+                                                      range - rowLength );
         int y = sampleRandSource.getRandomBoundedInt( -range, range );
         
-        biomeSamples[ computeMapBiomeIndex( x, y ) ] ++;
+        prefillBaseMapRow( x, y, rowLength );
+        
+        for( int j=0; j<rowLength; j++ ) {
+            biomeSamples[ computeMapBiomeIndex( x + j, y ) ] ++;
+            }
         }
     
     for( int i=0; i<numBiomes; i++ ) {
@@ -1361,17 +1654,17 @@ static DBCacheRecord dbCache[ DB_CACHE_SIZE ];
 #define CACHE_PRIME_C 528383237
 #define CACHE_PRIME_D 148497157
 
+// DB_CACHE_SIZE must be a power of 2
 static int computeDBCacheHash( int inKeyA, int inKeyB, 
                                int inKeyC, int inKeyD ) {
     
-    int hashKey = ( inKeyA * CACHE_PRIME_A + 
-                    inKeyB * CACHE_PRIME_B + 
-                    inKeyC * CACHE_PRIME_C +
-                    inKeyD * CACHE_PRIME_D ) % DB_CACHE_SIZE;
-    if( hashKey < 0 ) {
-        hashKey += DB_CACHE_SIZE;
-        }
-    return hashKey;
+    // unsigned, so overflow wraps instead of being undefined
+    unsigned int hashKey = (unsigned int)inKeyA * CACHE_PRIME_A + 
+                           (unsigned int)inKeyB * CACHE_PRIME_B + 
+                           (unsigned int)inKeyC * CACHE_PRIME_C +
+                           (unsigned int)inKeyD * CACHE_PRIME_D;
+    
+    return hashKey & ( DB_CACHE_SIZE - 1 );
     }
 
 
@@ -1416,125 +1709,421 @@ static void dbPutCached( int inX, int inY, int inSlot, int inSubCont,
 
 char lookTimeDBEmpty = false;
 
+// set if any per-cell DB was missing or had cells cleaned out of it
+// on open, meaning region records built from old contents can't be trusted
+static char regionStoreStale = false;
+
 // if lookTimeDBEmpty, then we init all map cell look times to NOW
 int cellsLookedAtToInit = 0;
 
 
 
-// version of open call that checks whether look time exists in lookTimeDB
-// for each record in opened DB, and clears any entries that are not
-// rebuilding file storage for DB in the process
-// lookTimeDB MUST be open before calling this
-//
-// If lookTimeDBEmpty, this call just opens the target DB normally without
-// shrinking it.
-//
-// Can handle max key and value size of 16 and 12 bytes
-// Assumes that first 8 bytes of key are xy as 32-bit ints
-int DB_open_timeShrunk(
-	DB *db,
-	const char *path,
-	int mode,
-	unsigned long hash_table_size,
-	unsigned long key_size,
-	unsigned long value_size) {
+// set of map cells
+// Open addressing, linear probing, keys are packed xy.
+typedef struct CellSet {
+        uint64_t *keys;
+        int capacity;
+        int numCells;
+        
+        // key of cell -1,-1 is our empty slot marker, so it's 
+        // tracked separately
+        char emptyKeyPresent;
+    } CellSet;
+
+#define CELL_SET_EMPTY_KEY 0xFFFFFFFFFFFFFFFFULL
+
 
-    File dbFile( NULL, path );
+static uint64_t packCellKey( int inX, int inY ) {
+    return ( (uint64_t)(uint32_t)inX << 32 ) | (uint32_t)inY;
+    }
+
+
+static uint64_t mixCellKey( uint64_t inKey ) {
+    // murmur3 finalizer
+    uint64_t h = inKey;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
     
-    if( ! dbFile.exists() || lookTimeDBEmpty ) {
+    return h;
+    }
 
-        if( lookTimeDBEmpty ) {
-            AppLog::infoF( "No lookTimes present, not cleaning %s", path );
+
+static void insertCellSetKey( CellSet *inSet, uint64_t inKey ) {
+    int i = (int)( mixCellKey( inKey ) & (uint64_t)( inSet->capacity - 1 ) );
+    
+    while( inSet->keys[i] != CELL_SET_EMPTY_KEY ) {
+        if( inSet->keys[i] == inKey ) {
+            return;
             }
-        
-        int error = DB_open( db, 
-                                 path, 
-                                 mode,
-                                 hash_table_size,
-                                 key_size,
-                                 value_size );
+        i = ( i + 1 ) & ( inSet->capacity - 1 );
+        }
+    inSet->keys[i] = inKey;
+    inSet->numCells++;
+    }
 
-        if( ! error ) {
-            // add look time for cells in this DB to present
-            // essentially resetting all look times to NOW
-            
-            DB_Iterator dbi;
+
+static void setCellSetCapacity( CellSet *inSet, int inCapacity ) {
+    uint64_t *oldKeys = inSet->keys;
+    int oldCapacity = inSet->capacity;
     
+    inSet->keys = new uint64_t[ inCapacity ];
+    inSet->capacity = inCapacity;
+    inSet->numCells = 0;
     
-            DB_Iterator_init( db, &dbi );
+    for( int i=0; i<inCapacity; i++ ) {
+        inSet->keys[i] = CELL_SET_EMPTY_KEY;
+        }
     
-            // key and value size that are big enough to handle all of our DB
-            unsigned char key[16];
+    if( oldKeys != NULL ) {
+        for( int i=0; i<oldCapacity; i++ ) {
+            if( oldKeys[i] != CELL_SET_EMPTY_KEY ) {
+                insertCellSetKey( inSet, oldKeys[i] );
+                }
+            }
+        delete [] oldKeys;
+        }
+    }
+
+
+static void addCell( CellSet *inSet, int inX, int inY ) {
+    uint64_t key = packCellKey( inX, inY );
     
-            unsigned char value[12];
+    if( key == CELL_SET_EMPTY_KEY ) {
+        inSet->emptyKeyPresent = true;
+        return;
+        }
     
-            while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
-                int x = valueToInt( key );
-                int y = valueToInt( &( key[4] ) );
+    if( inSet->keys == NULL ) {
+        setCellSetCapacity( inSet, 1024 );
+        }
+    else if( inSet->numCells * 2 >= inSet->capacity ) {
+        setCellSetCapacity( inSet, inSet->capacity * 2 );
+        }
+    
+    insertCellSetKey( inSet, key );
+    }
+
+
+static char isCellInSet( CellSet *inSet, int inX, int inY ) {
+    uint64_t key = packCellKey( inX, inY );
+    
+    if( key == CELL_SET_EMPTY_KEY ) {
+        return inSet->emptyKeyPresent;
+        }
+    
+    if( inSet->keys == NULL ) {
+        return false;
+        }
+    
+    int i = (int)( mixCellKey( key ) & (uint64_t)( inSet->capacity - 1 ) );
+    
+    while( inSet->keys[i] != CELL_SET_EMPTY_KEY ) {
+        if( inSet->keys[i] == key ) {
+            return true;
+            }
+        i = ( i + 1 ) & ( inSet->capacity - 1 );
+        }
+    return false;
+    }
+
+
+static void freeCellSet( CellSet *inSet ) {
+    if( inSet->keys != NULL ) {
+        delete [] inSet->keys;
+        inSet->keys = NULL;
+        }
+    inSet->capacity = 0;
+    inSet->numCells = 0;
+    inSet->emptyKeyPresent = false;
+    }
+
+
+
+// optimization:
+// cells that have a look time, loaded from lookTime.db in the same pass
+// that cleans it, so that shrinking the other DBs doesn't need a
+// lookTimeDB lookup per record
+//
+// Only read while those DBs are shrunk in parallel, so no locks needed.
+static CellSet liveCells = { NULL, 0, 0, false };
+
+
+static void addLiveCell( int inX, int inY ) {
+    addCell( &liveCells, inX, inY );
+    }
+
+
+static char isLiveCell( int inX, int inY ) {
+    return isCellInSet( &liveCells, inX, inY );
+    }
+
+
+static void freeLiveCells() {
+    freeCellSet( &liveCells );
+    }
+
+
+
+// what cleanMap needs to know about map.db, gathered while
+// map.db is shrunk, so that it doesn't need its own pass
+typedef struct CleanMapScan {
+        // x,y coordinates in map that need clearing
+        SimpleVector<int> xToClear;
+        SimpleVector<int> yToClear;
+
+        // container slots that need checking
+        SimpleVector<int> xContToCheck;
+        SimpleVector<int> yContToCheck;
+
+        int totalSetCount;
+        int numClearedCount;
+        int totalNumContained;
+    } CleanMapScan;
 
-                cellsLookedAtToInit++;
+
+char getIsCategory( int inID );
+
+
+// checks one map.db record
+// only reads object bank, so safe to call from shrink threads
+static void scanRecordForCleanMap( unsigned char *inKey, 
+                                   unsigned char *inValue,
+                                   CleanMapScan *ioScan ) {
+    
+    int s = valueToInt( &( inKey[8] ) );
+    int b = valueToInt( &( inKey[12] ) );
+    
+    if( s == 0 ) {
+        int id = valueToInt( inValue );
+        
+        if( id > 0 ) {
+            ioScan->totalSetCount++;
+            
+            ObjectRecord *o = getObject( id );
+            
+            if( o == NULL || getIsCategory( id ) ) {
+                // id doesn't exist anymore
                 
-                dbLookTimePut( x, y, MAP_TIMESEC );
+                // OR it's a non-pattern category
+                // those should never exist in map
+                // may be left over from a non-clean shutdown
+                
+                ioScan->numClearedCount++;
+                
+                ioScan->xToClear.push_back( valueToInt( inKey ) );
+                ioScan->yToClear.push_back( valueToInt( &( inKey[4] ) ) );
+                }
+            }
+        }
+    if( s == 2 && b == 0 ) {
+        int numSlots = valueToInt( inValue );
+        if( numSlots > 0 ) {
+            ioScan->totalNumContained += numSlots;
+            
+            ioScan->xContToCheck.push_back( valueToInt( inKey ) );
+            ioScan->yContToCheck.push_back( valueToInt( &( inKey[4] ) ) );
+            }
+        }
+    }
+
+
+
+// one per-cell DB to open at startup, dropping cells that have
+// no look time
+typedef struct ShrinkJob {
+        DB *db;
+        const char *path;
+        unsigned long hashTableSize;
+        unsigned long keySize;
+        unsigned long valueSize;
+        
+        // if not NULL, kept records are fed to scanRecordForCleanMap
+        CleanMapScan *cleanScan;
+        
+        // results
+        int error;
+        // shrunk copy couldn't replace old file, which is still in use
+        char renameFailed;
+        // file wasn't there, or some of its cells were dropped
+        char regionStale;
+        int total;
+        int stale;
+        double seconds;
+    } ShrinkJob;
+
+
+
+static void setupShrinkJob( ShrinkJob *outJob,
+                            DB *inDB,
+                            const char *inPath,
+                            unsigned long inHashTableSize,
+                            unsigned long inKeySize,
+                            unsigned long inValueSize,
+                            CleanMapScan *inCleanScan = NULL ) {
+    outJob->db = inDB;
+    outJob->path = inPath;
+    outJob->hashTableSize = inHashTableSize;
+    outJob->keySize = inKeySize;
+    outJob->valueSize = inValueSize;
+    outJob->cleanScan = inCleanScan;
+
+    outJob->error = 0;
+    outJob->renameFailed = false;
+    outJob->regionStale = false;
+    outJob->total = 0;
+    outJob->stale = 0;
+    outJob->seconds = 0;
+    }
+
+
+
+// opens DB and adds look times of NOW for all of its cells
+// this is what we do instead of shrinking if lookTimeDBEmpty
+// must run on main thread, because it writes to lookTimeDB
+static void openAndInitLookTimes( ShrinkJob *ioJob ) {
+    File dbFile( NULL, ioJob->path );
+    
+    if( ! dbFile.exists() ) {
+        ioJob->regionStale = true;
+        }
+    else {
+        AppLog::infoF( "No lookTimes present, not cleaning %s", 
+                       ioJob->path );
+        }
+    
+    ioJob->error = DB_open( ioJob->db, 
+                            ioJob->path, 
+                            KISSDB_OPEN_MODE_RWCREAT,
+                            ioJob->hashTableSize,
+                            ioJob->keySize,
+                            ioJob->valueSize );
+    
+    if( ! ioJob->error ) {
+        // add look time for cells in this DB to present
+        // essentially resetting all look times to NOW
+        
+        DB_Iterator dbi;
+        
+        DB_Iterator_init( ioJob->db, &dbi );
+        
+        // key and value size that are big enough to handle all of our DB
+        unsigned char key[16];
+        
+        unsigned char value[12];
+        
+        while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+            int x = valueToInt( key );
+            int y = valueToInt( &( key[4] ) );
+            
+            cellsLookedAtToInit++;
+            
+            dbLookTimePut( x, y, MAP_TIMESEC );
+            
+            if( ioJob->cleanScan != NULL ) {
+                scanRecordForCleanMap( key, value, ioJob->cleanScan );
                 }
             }
-        return error;
         }
+    }
+
+
+
+// opens DB, first rebuilding its file with only cells that are
+// in live cell set
+//
+// Touches nothing but its own DB files, the live cell set, and
+// (through cleanScan) the object bank, so jobs for different DBs can
+// run on separate threads.  Doesn't log, results are in ioJob.
+//
+// Can handle max key and value size of 16 and 12 bytes
+// Assumes that first 8 bytes of key are xy as 32-bit ints
+static void runShrinkJob( ShrinkJob *ioJob ) {
+    
+    double startTime = Time::getCurrentTime();
+    
+    ioJob->error = 0;
+    ioJob->regionStale = false;
+    ioJob->total = 0;
+    ioJob->stale = 0;
     
-    char *dbTempName = autoSprintf( "%s.temp", path );
+    File dbFile( NULL, ioJob->path );
+    
+    char *dbTempName = autoSprintf( "%s.temp", ioJob->path );
     File dbTempFile( NULL, dbTempName );
     
     if( dbTempFile.exists() ) {
         dbTempFile.remove();
         }
     
-    if( dbTempFile.exists() ) {
-        AppLog::errorF( "Failed to remove temp DB file %s", dbTempName );
-
+    if( ! dbFile.exists() || dbTempFile.exists() ) {
+        // nothing to shrink
+        // or can't remove old temp file, so open as is
+        
+        if( ! dbFile.exists() ) {
+            ioJob->regionStale = true;
+            }
+        
         delete [] dbTempName;
-
-        return DB_open( db, 
-                            path, 
-                            mode,
-                            hash_table_size,
-                            key_size,
-                            value_size );
+        
+        ioJob->error = DB_open( ioJob->db, 
+                                ioJob->path, 
+                                KISSDB_OPEN_MODE_RWCREAT,
+                                ioJob->hashTableSize,
+                                ioJob->keySize,
+                                ioJob->valueSize );
+        
+        if( ! ioJob->error && ioJob->cleanScan != NULL ) {
+            DB_Iterator dbi;
+            DB_Iterator_init( ioJob->db, &dbi );
+            
+            unsigned char key[16];
+            unsigned char value[12];
+            
+            while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+                scanRecordForCleanMap( key, value, ioJob->cleanScan );
+                }
+            }
+        
+        ioJob->seconds = Time::getCurrentTime() - startTime;
+        return;
         }
     
     DB oldDB;
     
     int error = DB_open( &oldDB, 
-                             path, 
-                             mode,
-                             hash_table_size,
-                             key_size,
-                             value_size );
+                         ioJob->path, 
+                         KISSDB_OPEN_MODE_RWCREAT,
+                         ioJob->hashTableSize,
+                         ioJob->keySize,
+                         ioJob->valueSize );
     if( error ) {
-        AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
-                        path );
         delete [] dbTempName;
-
-        return error;
+        
+        ioJob->error = error;
+        ioJob->seconds = Time::getCurrentTime() - startTime;
+        return;
         }
 
     DB tempDB;
     
     error = DB_open( &tempDB, 
-                         dbTempName, 
-                         mode,
-                         hash_table_size,
-                         key_size,
-                         value_size );
+                     dbTempName, 
+                     KISSDB_OPEN_MODE_RWCREAT,
+                     ioJob->hashTableSize,
+                     ioJob->keySize,
+                     ioJob->valueSize );
     if( error ) {
-        AppLog::errorF( "Failed to open DB file %s in DB_open_timeShrunk",
-                        dbTempName );
         delete [] dbTempName;
         DB_close( &oldDB );
-        return error;
+        
+        ioJob->error = error;
+        ioJob->seconds = Time::getCurrentTime() - startTime;
+        return;
         }
 
-
-    
-
     
     DB_Iterator dbi;
     
@@ -1546,48 +2135,139 @@ int DB_open_timeShrunk(
     
     unsigned char value[12];
     
-    int total = 0;
-    int stale = 0;
-
     while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
-        total++;
+        ioJob->total++;
 
         int x = valueToInt( key );
         int y = valueToInt( &( key[4] ) );
 
-        if( dbLookTimeGet( x, y ) > 0 ) {
+        if( isLiveCell( x, y ) ) {
             // keep
             // insert it in temp
             DB_put_new( &tempDB, key, value );
+            
+            if( ioJob->cleanScan != NULL ) {
+                scanRecordForCleanMap( key, value, ioJob->cleanScan );
+                }
             }
         else {
             // stale
             // ignore
-            stale++;
+            ioJob->stale++;
             }
         }
     
-    AppLog::infoF( "Cleaned %d / %d stale map cells from %s", stale, total,
-                   path );
-
-    printf( "\n" );
+    if( ioJob->stale > 0 ) {
+        ioJob->regionStale = true;
+        }
     
+    // on disk before it replaces old file, so a crash can't leave a
+    // truncated copy in its place
+    DB_sync( &tempDB );
     
     DB_close( &tempDB );
     DB_close( &oldDB );
-
-    dbTempFile.copy( &dbFile );
-    dbTempFile.remove();
+    
+    // replace old file with new one, without copying its bytes
+    if( rename( dbTempName, ioJob->path ) != 0 ) {
+        // logged on main thread
+        ioJob->renameFailed = true;
+        }
 
     delete [] dbTempName;
 
     // now open new, shrunk file
-    return DB_open( db, 
-                        path, 
-                        mode,
-                        hash_table_size,
-                        key_size,
-                        value_size );
+    ioJob->error = DB_open( ioJob->db, 
+                            ioJob->path, 
+                            KISSDB_OPEN_MODE_RWCREAT,
+                            ioJob->hashTableSize,
+                            ioJob->keySize,
+                            ioJob->valueSize );
+    
+    ioJob->seconds = Time::getCurrentTime() - startTime;
+    }
+
+
+
+class ShrinkThread : public Thread {
+    public:
+        
+        ShrinkThread( ShrinkJob *inJob )
+                : mJob( inJob ) {
+            }
+        
+        virtual void run() {
+            runShrinkJob( mJob );
+            }
+        
+    private:
+        ShrinkJob *mJob;
+    };
+
+
+
+// runs all jobs, each on its own thread if inParallel
+// lookTimeDB and live cell set MUST be ready before calling this
+static void runShrinkJobs( ShrinkJob *inJobs, int inNumJobs, 
+                           char inParallel ) {
+    
+    if( lookTimeDBEmpty ) {
+        // nothing to shrink against
+        for( int i=0; i<inNumJobs; i++ ) {
+            double startTime = Time::getCurrentTime();
+            
+            openAndInitLookTimes( &( inJobs[i] ) );
+            
+            inJobs[i].seconds = Time::getCurrentTime() - startTime;
+            }
+        }
+    else if( inParallel ) {
+        SimpleVector<ShrinkThread*> threads;
+        
+        for( int i=0; i<inNumJobs; i++ ) {
+            ShrinkThread *t = new ShrinkThread( &( inJobs[i] ) );
+            t->start();
+            threads.push_back( t );
+            }
+        
+        for( int i=0; i<threads.size(); i++ ) {
+            ShrinkThread *t = threads.getElementDirect( i );
+            t->join();
+            delete t;
+            }
+        }
+    else {
+        for( int i=0; i<inNumJobs; i++ ) {
+            runShrinkJob( &( inJobs[i] ) );
+            }
+        }
+    
+    
+    for( int i=0; i<inNumJobs; i++ ) {
+        ShrinkJob *j = &( inJobs[i] );
+        
+        if( j->regionStale ) {
+            regionStoreStale = true;
+            }
+        
+        if( j->renameFailed ) {
+            // old file still in place, with stale cells in it
+            AppLog::errorF( "Failed to replace %s with shrunk copy",
+                            j->path );
+            }
+        
+        if( ! lookTimeDBEmpty ) {
+            if( j->error ) {
+                AppLog::errorF( "Failed to open DB file %s when shrinking",
+                                j->path );
+                }
+            else {
+                AppLog::infoF( "Cleaned %d / %d stale map cells from %s "
+                               "in %.3f sec", 
+                               j->stale, j->total, j->path, j->seconds );
+                }
+            }
+        }
     }
 
 
@@ -1625,76 +2305,44 @@ char getIsCategory( int inID ) {
 
 
 // returns num set after
-int cleanMap() {
+// inScan can be gathered from map.db when it is opened, or NULL to
+// scan map.db here
+int cleanMap( CleanMapScan *inScan = NULL ) {
     AppLog::info( "\nCleaning map of objects that have been removed..." );
 
-    DB_Iterator dbi;
-    
+    CleanMapScan ownScan;
     
-    DB_Iterator_init( &db, &dbi );
-    
-    unsigned char key[16];
-    
-    unsigned char value[4];
-
+    if( inScan == NULL ) {
+        ownScan.totalSetCount = 0;
+        ownScan.numClearedCount = 0;
+        ownScan.totalNumContained = 0;
+        
+        DB_Iterator dbi;
+        
+        DB_Iterator_init( &db, &dbi );
+        
+        unsigned char key[16];
+        
+        unsigned char value[4];
+        
+        while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
+            scanRecordForCleanMap( key, value, &ownScan );
+            }
+        
+        inScan = &ownScan;
+        }
 
-    // keep list of x,y coordinates in map that need clearing
-    SimpleVector<int> xToClear;
-    SimpleVector<int> yToClear;
+    SimpleVector<int> &xToClear = inScan->xToClear;
+    SimpleVector<int> &yToClear = inScan->yToClear;
 
-    // container slots that need clearing
-    SimpleVector<int> xContToCheck;
-    SimpleVector<int> yContToCheck;
+    SimpleVector<int> &xContToCheck = inScan->xContToCheck;
+    SimpleVector<int> &yContToCheck = inScan->yContToCheck;
     
-    
-    int totalSetCount = 0;
-    int numClearedCount = 0;
-    int totalNumContained = 0;
+    int totalSetCount = inScan->totalSetCount;
+    int numClearedCount = inScan->numClearedCount;
+    int totalNumContained = inScan->totalNumContained;
     int numContainedCleared = 0;
     
-    while( DB_Iterator_next( &dbi, key, value ) > 0 ) {
-        
-        int s = valueToInt( &( key[8] ) );
-        int b = valueToInt( &( key[12] ) );
-       
-        if( s == 0 ) {
-            int id = valueToInt( value );
-            
-            if( id > 0 ) {
-                totalSetCount++;
-                
-                ObjectRecord *o = getObject( id );
-                
-                if( o == NULL || getIsCategory( id ) ) {
-                    // id doesn't exist anymore
-                    
-                    // OR it's a non-pattern category
-                    // those should never exist in map
-                    // may be left over from a non-clean shutdown
-                    
-                    numClearedCount++;
-                    
-                    int x = valueToInt( key );
-                    int y = valueToInt( &( key[4] ) );
-                    
-                    xToClear.push_back( x );
-                    yToClear.push_back( y );
-                    }
-                }
-            }
-        if( s == 2 && b == 0 ) {
-            int numSlots = valueToInt( value );
-            if( numSlots > 0 ) {
-                totalNumContained += numSlots;
-                
-                int x = valueToInt( key );
-                int y = valueToInt( &( key[4] ) );
-                xContToCheck.push_back( x );
-                yContToCheck.push_back( y );
-                }
-            }
-        }
-    
 
     for( int i=0; i<xToClear.size(); i++ ) {
         int x = xToClear.getElementDirect( i );
@@ -1929,9 +2577,31 @@ static void loadIntoMapFromFile( FILE *inFile,
 
 
 
+static void loadRegionCellFromDBs( int inX, int inY, RegionCell *outCell );
+
+static void initMapCompaction( int inStaleSeconds );
+static void abortMapCompaction();
+
+static void replayMapWAL();
+static void initMapWAL();
+static void freeMapWAL();
+static void freeMapSnapshots();
+
+static void initChunkCache();
+static void freeChunkCache();
+
+static int chunkCacheHits = 0;
+static int chunkCacheMisses = 0;
+
+
 void initMap() {
+    // before anything reads DB files
+    replayMapWAL();
+    
     initDBCache();
     initBiomeCache();
+    initChunkCache();
+    initBlockingMap();
 
     mapCacheClear();
     
@@ -2064,6 +2734,8 @@ void initMap() {
 
 
     
+    double phaseStartTime = Time::getCurrentTime();
+
     const char *lookTimeDBName = "lookTime.db";
     
     char lookTimeDBExists = false;
@@ -2100,22 +2772,25 @@ void initMap() {
     int staleSec = SettingsManager::getIntSetting( "mapCellForgottenSeconds", 
                                                    0 );
     
-    if( lookTimeDBExists && staleSec > 0 ) {
-        AppLog::info( "\nCleaning stale look times from map..." );
-
-
+    if( lookTimeDBExists ) {
+        // one pass both cleans look times and loads live cell set
+        char cleanStale = ( staleSec > 0 );
+        
         static DB lookTimeDB_temp;
         
         const char *lookTimeDBName_temp = "lookTime_temp.db";
 
-        File tempDBFile( NULL, lookTimeDBName_temp );
+        if( cleanStale ) {
+            AppLog::info( "\nCleaning stale look times from map..." );
+
+            File tempDBFile( NULL, lookTimeDBName_temp );
         
-        if( tempDBFile.exists() ) {
-            tempDBFile.remove();
-            }
+            if( tempDBFile.exists() ) {
+                tempDBFile.remove();
+                }
         
 
-        error = DB_open( &lookTimeDB_temp, 
+            error = DB_open( &lookTimeDB_temp, 
                              lookTimeDBName_temp, 
                              KISSDB_OPEN_MODE_RWCREAT,
                              80000,
@@ -2125,9 +2800,13 @@ void initMap() {
                              // "double" on the server platform uses
                              );
     
-        if( error ) {
-            AppLog::errorF( "Error %d opening look time temp KissDB", error );
-            return;
+            if( error ) {
+                AppLog::errorF( "Error %d opening look time temp KissDB", 
+                                error );
+                DB_close( &lookTimeDB_old );
+                freeLiveCells();
+                return;
+                }
             }
         
         DB_Iterator dbi;
@@ -2149,31 +2828,48 @@ void initMap() {
 
             timeSec_t t = valueToTime( value );
             
-            if( curTime - t >= staleSec ) {
+            if( cleanStale && curTime - t >= staleSec ) {
                 // stale cell
                 // ignore
                 stale++;
                 }
             else {
                 // non-stale
-                // insert it in temp
-                DB_put_new( &lookTimeDB_temp, key, value );
+                if( cleanStale ) {
+                    // insert it in temp
+                    DB_put_new( &lookTimeDB_temp, key, value );
+                    }
+                
+                if( t > 0 ) {
+                    addLiveCell( valueToInt( key ), 
+                                 valueToInt( &( key[4] ) ) );
+                    }
                 }
             }
         
-        AppLog::infoF( "Cleaned %d / %d stale look times", stale, total );
+        DB_close( &lookTimeDB_old );
 
-        printf( "\n" );
+        if( cleanStale ) {
+            AppLog::infoF( "Cleaned %d / %d stale look times", stale, total );
 
-        if( total == 0 ) {
-            lookTimeDBEmpty = true;
-            }
+            printf( "\n" );
 
-        DB_close( &lookTimeDB_temp );
-        DB_close( &lookTimeDB_old );
+            if( total == 0 ) {
+                lookTimeDBEmpty = true;
+                }
+
+            // on disk before it replaces old file
+            DB_sync( &lookTimeDB_temp );
+            
+            DB_close( &lookTimeDB_temp );
 
-        tempDBFile.copy( &lookTimeDBFile );
-        tempDBFile.remove();
+            // replace old file with new one, without copying its bytes
+            if( rename( lookTimeDBName_temp, lookTimeDBName ) != 0 ) {
+                // old file still in place, with stale look times in it
+                AppLog::errorF( "Failed to replace %s with cleaned copy",
+                                lookTimeDBName );
+                }
+            }
         }
     else {
         DB_close( &lookTimeDB_old );
@@ -2193,115 +2889,172 @@ void initMap() {
     
     if( error ) {
         AppLog::errorF( "Error %d opening look time KissDB", error );
+        freeLiveCells();
         return;
         }
 
+    double lookTimeSeconds = Time::getCurrentTime() - phaseStartTime;
+    phaseStartTime = Time::getCurrentTime();
     
 
 
+    // per-cell DBs each live in their own files, so they can be
+    // shrunk side by side
+    // map.db's pass also gathers what cleanMap needs
+    CleanMapScan mapScan;
+    mapScan.totalSetCount = 0;
+    mapScan.numClearedCount = 0;
+    mapScan.totalNumContained = 0;
+
+    ShrinkJob shrinkJobs[5];
+    
+
     // note that the various decay ETA slots in map.db 
     // are define but unused, because we store times separately
     // in mapTime.db
-    error = DB_open_timeShrunk( &db, 
-                         "map.db", 
-                         KISSDB_OPEN_MODE_RWCREAT,
-                         80000,
-                         16, // four 32-bit ints, xysb
-                             // s is the slot number 
-                             // s=0 for base object
-                             // s=1 decay ETA seconds (wall clock time)
-                             // s=2 for count of contained objects
-                             // s=3 first contained object
-                             // s=4 second contained object
-                             // s=... remaining contained objects
-                             // Then decay ETA for each slot, in order,
-                             //   after that.
-                             // s = -1
-                             //  is a special flag slot set to 0 if NONE
-                             //  of the contained items have ETA decay
-                             //  or 1 if some of the contained items might 
-                             //  have ETA decay.
-                             //  (this saves us from having to check each
-                             //   one)
-                             // If a contained object id is negative,
-                             // that indicates that it sub-contains
-                             // other objects in its corresponding b slot
-                             //
-                             // b is for indexing sub-container slots
-                             // b=0 is the main object 
-                             // b=1 is the first sub-slot, etc.
-                         4 // one int, object ID at x,y in slot (s-3)
-                           // OR contained count if s=2
-                         );
-    
-    if( error ) {
-        AppLog::errorF( "Error %d opening map KissDB", error );
-        return;
-        }
+    setupShrinkJob( &( shrinkJobs[0] ),
+                    &db, 
+                    "map.db", 
+                    80000,
+                    16, // four 32-bit ints, xysb
+                        // s is the slot number 
+                        // s=0 for base object
+                        // s=1 decay ETA seconds (wall clock time)
+                        // s=2 for count of contained objects
+                        // s=3 first contained object
+                        // s=4 second contained object
+                        // s=... remaining contained objects
+                        // Then decay ETA for each slot, in order,
+                        //   after that.
+                        // s = -1
+                        //  is a special flag slot set to 0 if NONE
+                        //  of the contained items have ETA decay
+                        //  or 1 if some of the contained items might 
+                        //  have ETA decay.
+                        //  (this saves us from having to check each
+                        //   one)
+                        // If a contained object id is negative,
+                        // that indicates that it sub-contains
+                        // other objects in its corresponding b slot
+                        //
+                        // b is for indexing sub-container slots
+                        // b=0 is the main object 
+                        // b=1 is the first sub-slot, etc.
+                    4, // one int, object ID at x,y in slot (s-3)
+                       // OR contained count if s=2
+                    &mapScan );
     
-    dbOpen = true;
-
 
 
     // this DB uses the same slot numbers as the map.db
     // however, only times are stored here, because they require 8 bytes
     // so, slot 0 and 2 are never used, for example
-    error = DB_open_timeShrunk( &timeDB, 
-                         "mapTime.db", 
-                         KISSDB_OPEN_MODE_RWCREAT,
-                         80000,
-                         16, // four 32-bit ints, xysb
-                         // s is the slot number 
-                         // s=0 for base object
-                         // s=1 decay ETA seconds (wall clock time)
-                         // s=2 for count of contained objects
-                         // s=3 first contained object
-                         // s=4 second contained object
-                         // s=... remaining contained objects
-                         // Then decay ETA for each slot, in order,
-                         //   after that.
-                             // If a contained object id is negative,
-                             // that indicates that it sub-contains
-                             // other objects in its corresponding b slot
-                             //
-                             // b is for indexing sub-container slots
-                             // b=0 is the main object 
-                             // b=1 is the first sub-slot, etc.
-                         8 // one 64-bit double, representing an ETA time
-                           // in whatever binary format and byte order
-                           // "double" on the server platform uses
-                         );
-    
-    if( error ) {
-        AppLog::errorF( "Error %d opening map time KissDB", error );
+    setupShrinkJob( &( shrinkJobs[1] ),
+                    &timeDB, 
+                    "mapTime.db", 
+                    80000,
+                    16, // four 32-bit ints, xysb
+                        // s is the slot number 
+                        // s=0 for base object
+                        // s=1 decay ETA seconds (wall clock time)
+                        // s=2 for count of contained objects
+                        // s=3 first contained object
+                        // s=4 second contained object
+                        // s=... remaining contained objects
+                        // Then decay ETA for each slot, in order,
+                        //   after that.
+                        // If a contained object id is negative,
+                        // that indicates that it sub-contains
+                        // other objects in its corresponding b slot
+                        //
+                        // b is for indexing sub-container slots
+                        // b=0 is the main object 
+                        // b=1 is the first sub-slot, etc.
+                    8 // one 64-bit double, representing an ETA time
+                      // in whatever binary format and byte order
+                      // "double" on the server platform uses
+                    );
+    
+
+
+    setupShrinkJob( &( shrinkJobs[2] ),
+                    &biomeDB, 
+                    "biome.db", 
+                    80000,
+                    8, // two 32-bit ints, xy
+                    12 // three ints,  
+                    // 1: biome number at x,y 
+                    // 2: second place biome number at x,y 
+                    // 3: second place biome gap as int (float gap
+                    //    multiplied by 1,000,000)
+                    );
+    
+
+    setupShrinkJob( &( shrinkJobs[3] ),
+                    &floorDB, 
+                    "floor.db", 
+                    80000,
+                    8, // two 32-bit ints, xy
+                    4 // one int, the floor object ID at x,y 
+                    );
+    
+
+    setupShrinkJob( &( shrinkJobs[4] ),
+                    &floorTimeDB, 
+                    "floorTime.db", 
+                    80000,
+                    8, // two 32-bit ints, xy
+                    8 // one 64-bit double, representing an ETA time
+                      // in whatever binary format and byte order
+                      // "double" on the server platform uses
+                    );
+    
+    
+    char parallelShrink = 
+        SettingsManager::getIntSetting( "parallelStartupShrink", 1 );
+
+    runShrinkJobs( shrinkJobs, 5, parallelShrink );
+    
+    // not needed anymore, and it can be big
+    freeLiveCells();
+    
+    
+    // flag each one that opened, so freeMap closes it, even if
+    // another one failed
+    dbOpen = ! shrinkJobs[0].error;
+    timeDBOpen = ! shrinkJobs[1].error;
+    biomeDBOpen = ! shrinkJobs[2].error;
+    floorDBOpen = ! shrinkJobs[3].error;
+    floorTimeDBOpen = ! shrinkJobs[4].error;
+    
+    if( ! dbOpen ) {
+        AppLog::errorF( "Error %d opening map KissDB", 
+                        shrinkJobs[0].error );
         return;
         }
-    
-    timeDBOpen = true;
-
-
-
-
-
-
-    error = DB_open_timeShrunk( &biomeDB, 
-                         "biome.db", 
-                         KISSDB_OPEN_MODE_RWCREAT,
-                         80000,
-                         8, // two 32-bit ints, xy
-                         12 // three ints,  
-                         // 1: biome number at x,y 
-                         // 2: second place biome number at x,y 
-                         // 3: second place biome gap as int (float gap
-                         //    multiplied by 1,000,000)
-                         );
-    
-    if( error ) {
-        AppLog::errorF( "Error %d opening biome KissDB", error );
+    if( ! timeDBOpen ) {
+        AppLog::errorF( "Error %d opening map time KissDB", 
+                        shrinkJobs[1].error );
+        return;
+        }
+    if( ! biomeDBOpen ) {
+        AppLog::errorF( "Error %d opening biome KissDB", 
+                        shrinkJobs[2].error );
+        return;
+        }
+    if( ! floorDBOpen ) {
+        AppLog::errorF( "Error %d opening floor KissDB", 
+                        shrinkJobs[3].error );
+        return;
+        }
+    if( ! floorTimeDBOpen ) {
+        AppLog::errorF( "Error %d opening floor time KissDB", 
+                        shrinkJobs[4].error );
         return;
         }
-    
-    biomeDBOpen = true;
+
+    double shrinkSeconds = Time::getCurrentTime() - phaseStartTime;
+    phaseStartTime = Time::getCurrentTime();
 
 
 
@@ -2320,45 +3073,6 @@ void initMap() {
     
 
 
-    error = DB_open_timeShrunk( &floorDB, 
-                         "floor.db", 
-                         KISSDB_OPEN_MODE_RWCREAT,
-                         80000,
-                         8, // two 32-bit ints, xy
-                         4 // one int, the floor object ID at x,y 
-                         );
-    
-    if( error ) {
-        AppLog::errorF( "Error %d opening floor KissDB", error );
-        return;
-        }
-    
-    floorDBOpen = true;
-
-
-
-    error = DB_open_timeShrunk( &floorTimeDB, 
-                         "floorTime.db", 
-                         KISSDB_OPEN_MODE_RWCREAT,
-                         80000,
-                         8, // two 32-bit ints, xy
-                         8 // one 64-bit double, representing an ETA time
-                           // in whatever binary format and byte order
-                           // "double" on the server platform uses
-                         );
-    
-    if( error ) {
-        AppLog::errorF( "Error %d opening floor time KissDB", error );
-        return;
-        }
-    
-    floorTimeDBOpen = true;
-
-
-
-
-
-
     error = DB_open( &eveDB, 
                          "eve.db", 
                          KISSDB_OPEN_MODE_RWCREAT,
@@ -2379,6 +3093,11 @@ void initMap() {
     eveDBOpen = true;
 
 
+    initRegionStore( loadRegionCellFromDBs, regionStoreStale );
+
+    double regionStoreSeconds = Time::getCurrentTime() - phaseStartTime;
+
+
     if( lookTimeDBEmpty && cellsLookedAtToInit > 0 ) {
         printf( "Since lookTime db was empty, we initialized look times "
                 "for %d cells to now.\n\n", cellsLookedAtToInit );
@@ -2457,7 +3176,18 @@ void initMap() {
     delete [] allObjects;
 
 
-    int totalSetCount = cleanMap();
+    phaseStartTime = Time::getCurrentTime();
+    
+    int totalSetCount = cleanMap( &mapScan );
+    
+    double cleanMapSeconds = Time::getCurrentTime() - phaseStartTime;
+    
+    AppLog::infoF( "Map startup phases:  %.3f sec look times, "
+                   "%.3f sec opening and shrinking DBs (%s), "
+                   "%.3f sec region store, %.3f sec cleaning map",
+                   lookTimeSeconds, shrinkSeconds,
+                   parallelShrink ? "in parallel" : "one at a time",
+                   regionStoreSeconds, cleanMapSeconds );
     
     
     if( totalSetCount == 0 ) {
@@ -2505,8 +3235,24 @@ void initMap() {
 
 
 
+
+
+    // workers only know procedural biomes, so they can't help if
+    // any biomes are overridden in biome DB
+    int numPregenThreads = 0;
+    
+    if( ! anyBiomesInDB ) {
+        numPregenThreads = 
+            SettingsManager::getIntSetting( "mapPregenThreads", 2 );
+        }
+    
+    initMapPregen( numPregenThreads, 
+                   generateBaseMapBlock, consumeBaseMapBlock );
     
+
+    initMapCompaction( staleSec );
     
+    initMapWAL();
     
 
     
@@ -2533,8 +3279,43 @@ void freeAndNullString( char **inStringPointer ) {
 
 
 void freeMap() {
+    // stop workers before tables they read are freed
+    freeMapPregen();
+
+    // temp copies are useless now, and region store must not be
+    // left hiding forgotten cells
+    abortMapCompaction();
+    
+    freeMapSnapshots();
+    
+    // DB files must have everything before we close them
+    freeMapWAL();
+
     printf( "%d calls to getBaseMap\n", getBaseMapCallCount );
 
+    MapPregenStats pregenStats = getMapPregenStats();
+    
+    printf( "Map pregen:  %d blocks requested, %d generated, "
+            "%d requests dropped\n",
+            pregenStats.blocksRequested, pregenStats.blocksConsumed,
+            pregenStats.requestsDropped );
+
+    RegionStoreStats regionStats = getRegionStoreStats();
+    
+    printf( "Region store:  %d cache hits, %d misses, %d regions built "
+            "from cells, %d region writes\n",
+            regionStats.cacheHits, regionStats.cacheMisses,
+            regionStats.regionsBuiltFromCells, regionStats.regionsWritten );
+
+    printf( "Map chunk cache:  %d hits, %d misses\n",
+            chunkCacheHits, chunkCacheMisses );
+
+    BlockingMapStats blockingStats = getBlockingMapStats();
+    
+    printf( "Blocking map:  %d cell hits, %d misses, %d region refreshes\n",
+            blockingStats.cellHits, blockingStats.cellMisses,
+            blockingStats.regionRefreshes );
+
     
     if( lookTimeDBOpen ) {
         DB_close( &lookTimeDB );
@@ -2688,6 +3469,8 @@ void freeMap() {
         AppLog::info( "Now running normal map clean..." );
         cleanMap();
 
+        // write back all region changes, now that map is final
+        freeRegionStore();
         
         DB_close( &db );
         }
@@ -2726,14 +3509,16 @@ void freeMap() {
     
     allNaturalMapIDs.deleteAll();
 
-    liveDecayQueue.clear();
-    liveDecayRecordPresentHashTable.clear();
+    liveDecayWheel.clear();
     liveDecayRecordLastLookTimeHashTable.clear();
     liveMovementEtaTimes.clear();
 
     liveMovements.clear();
     
     mapChangePosSinceLastStep.deleteAll();
+    
+    freeChunkCache();
+    freeBlockingMap();
     }
 
 
@@ -2758,17 +3543,73 @@ void wipeMapFiles() {
     deleteFileByName( "map.db" );
     deleteFileByName( "mapTime.db" );
     deleteFileByName( "playerStats.db" );
+    deleteFileByName( "mapWAL.log" );
+    deleteFileByName( "mapWAL.log.old" );
+    
+    wipeRegionStoreFiles();
+    }
+
+
+
+
+
+
+
+// the per-cell fields for main objects that are grouped into region
+// records by regionStore
+static char isRegionSlot( int inSlot, int inSubCont ) {
+    return inSubCont == 0 &&
+        ( inSlot == 0 || inSlot == NUM_CONT_SLOT || inSlot == NO_DECAY_SLOT );
     }
 
 
+static int *getRegionSlotField( RegionCell *inCell, int inSlot ) {
+    if( inSlot == 0 ) {
+        return &( inCell->object );
+        }
+    else if( inSlot == NUM_CONT_SLOT ) {
+        return &( inCell->numContained );
+        }
+    else {
+        return &( inCell->noDecay );
+        }
+    }
+
 
 
+// returns -1 if not found
+// reads map.db directly, bypassing all caches, with no look time side-effect
+static int dbGetRaw( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+    unsigned char key[16];
+    unsigned char value[4];
+
+    intQuadToKey( inX, inY, inSlot, inSubCont, key );
+    
+    int result = cellDBGet( &db, key, value );
+    
+    if( result == 0 ) {
+        // found
+        return valueToInt( value );
+        }
+    else {
+        return -1;
+        }
+    }
 
 
 
 // returns -1 if not found
 static int dbGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
     
+    if( isRegionSlot( inSlot, inSubCont ) && isRegionStoreOpen() ) {
+        int val = *getRegionSlotField( lookupRegionCell( inX, inY ), inSlot );
+        
+        if( val > 0 ) {
+            dbLookTimePut( inX, inY, MAP_TIMESEC );
+            }
+        return val;
+        }
+    
     int cachedVal = dbGetCached( inX, inY, inSlot, inSubCont );
     if( cachedVal != -2 ) {
         
@@ -2780,25 +3621,7 @@ static int dbGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
         }
     
 
-    unsigned char key[16];
-    unsigned char value[4];
-
-    // look for changes to default in database
-    intQuadToKey( inX, inY, inSlot, inSubCont, key );
-    
-    int result = DB_get( &db, key, value );
-    
-    
-    
-    int returnVal;
-    
-    if( result == 0 ) {
-        // found
-        returnVal = valueToInt( value );
-        }
-    else {
-        returnVal = -1;
-        }
+    int returnVal = dbGetRaw( inX, inY, inSlot, inSubCont );
 
     dbPutCached( inX, inY, inSlot, inSubCont, returnVal );
 
@@ -2813,14 +3636,15 @@ static int dbGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
 
 
 // returns 0 if not found
-static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+static timeSec_t dbTimeGetRaw( int inX, int inY, int inSlot, 
+                               int inSubCont = 0 ) {
     unsigned char key[16];
     unsigned char value[8];
 
     // look for changes to default in database
     intQuadToKey( inX, inY, inSlot, inSubCont, key );
     
-    int result = DB_get( &timeDB, key, value );
+    int result = cellDBGet( &timeDB, key, value );
     
     if( result == 0 ) {
         // found
@@ -2833,24 +3657,30 @@ static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
 
 
 
-static int dbFloorGet( int inX, int inY ) {
+// returns 0 if not found
+static timeSec_t dbTimeGet( int inX, int inY, int inSlot, int inSubCont = 0 ) {
+    if( inSlot == DECAY_SLOT && inSubCont == 0 && isRegionStoreOpen() ) {
+        return lookupRegionCell( inX, inY )->objectEta;
+        }
+    return dbTimeGetRaw( inX, inY, inSlot, inSubCont );
+    }
+
+
+
+// returns -1 if not found
+// no look time side-effect
+static int dbFloorGetRaw( int inX, int inY ) {
     unsigned char key[9];
     unsigned char value[4];
 
     // look for changes to default in database
     intPairToKey( inX, inY, key );
     
-    int result = DB_get( &floorDB, key, value );
+    int result = cellDBGet( &floorDB, key, value );
     
     if( result == 0 ) {
         // found
-        int returnVal = valueToInt( value );
-        
-        if( returnVal > 0 ) {
-            dbLookTimePut( inX, inY, MAP_TIMESEC );
-            }
-        
-        return returnVal;
+        return valueToInt( value );
         }
     else {
         return -1;
@@ -2859,14 +3689,33 @@ static int dbFloorGet( int inX, int inY ) {
 
 
 
+static int dbFloorGet( int inX, int inY ) {
+    int returnVal;
+    
+    if( isRegionStoreOpen() ) {
+        returnVal = lookupRegionCell( inX, inY )->floor;
+        }
+    else {
+        returnVal = dbFloorGetRaw( inX, inY );
+        }
+    
+    if( returnVal > 0 ) {
+        dbLookTimePut( inX, inY, MAP_TIMESEC );
+        }
+    
+    return returnVal;
+    }
+
+
+
 // returns 0 if not found
-static timeSec_t dbFloorTimeGet( int inX, int inY ) {
+static timeSec_t dbFloorTimeGetRaw( int inX, int inY ) {
     unsigned char key[8];
     unsigned char value[8];
 
     intPairToKey( inX, inY, key );
     
-    int result = DB_get( &floorTimeDB, key, value );
+    int result = cellDBGet( &floorTimeDB, key, value );
     
     if( result == 0 ) {
         // found
@@ -2879,6 +3728,16 @@ static timeSec_t dbFloorTimeGet( int inX, int inY ) {
 
 
 
+// returns 0 if not found
+static timeSec_t dbFloorTimeGet( int inX, int inY ) {
+    if( isRegionStoreOpen() ) {
+        return lookupRegionCell( inX, inY )->floorEta;
+        }
+    return dbFloorTimeGetRaw( inX, inY );
+    }
+
+
+
 // returns 0 if not found
 timeSec_t dbLookTimeGet( int inX, int inY ) {
     unsigned char key[8];
@@ -2886,7 +3745,7 @@ timeSec_t dbLookTimeGet( int inX, int inY ) {
 
     intPairToKey( inX, inY, key );
     
-    int result = DB_get( &lookTimeDB, key, value );
+    int result = cellDBGet( &lookTimeDB, key, value );
     
     if( result == 0 ) {
         // found
@@ -2953,108 +3812,1550 @@ static void dbPut( int inX, int inY, int inSlot, int inValue,
         }
     
     
-
-    unsigned char key[16];
-    unsigned char value[4];
+
+    unsigned char key[16];
+    unsigned char value[4];
+    
+
+    intQuadToKey( inX, inY, inSlot, inSubCont, key );
+    intToValue( inValue, value );
+            
+    
+    cellDBPut( &db, key, value );
+
+    if( isRegionSlot( inSlot, inSubCont ) && isRegionStoreOpen() ) {
+        *getRegionSlotField( lookupRegionCell( inX, inY ), inSlot ) = inValue;
+        markRegionCellDirty( inX, inY );
+        }
+    else {
+        dbPutCached( inX, inY, inSlot, inSubCont, inValue );
+        }
+
+    if( inSlot == 0 && inSubCont == 0 ) {
+        blockingMapCellChanged( inX, inY );
+        }
+    
+    dbLookTimePut( inX, inY, MAP_TIMESEC );
+    }
+
+
+
+
+
+static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
+                       int inSubCont = 0 ) {
+    // ETA decay changes don't get reported as map changes    
+    
+    unsigned char key[16];
+    unsigned char value[8];
+    
+
+    intQuadToKey( inX, inY, inSlot, inSubCont, key );
+    timeToValue( inTime, value );
+            
+    
+    cellDBPut( &timeDB, key, value );
+
+    if( inSlot == DECAY_SLOT && inSubCont == 0 && isRegionStoreOpen() ) {
+        lookupRegionCell( inX, inY )->objectEta = inTime;
+        markRegionCellDirty( inX, inY );
+        }
+
+    if( inSlot == DECAY_SLOT && inSubCont == 0 ) {
+        // an earlier ETA might come due before region's cached next ETA
+        blockingMapCellChanged( inX, inY );
+        }
+    }
+
+
+
+
+static void dbFloorPut( int inX, int inY, int inValue ) {
+    
+    char found = false;
+    for( int i=0; i<mapChangePosSinceLastStep.size(); i++ ) {
+        
+        ChangePosition *p = mapChangePosSinceLastStep.getElement( i );
+        
+        if( p->x == inX && p->y == inY ) {
+            found = true;
+            
+            // update it
+            p->responsiblePlayerID = currentResponsiblePlayer;
+            break;
+            }
+        }
+        
+    if( ! found ) {
+        ChangePosition p = { inX, inY, false, currentResponsiblePlayer,
+                             0, 0, 0.0 };
+        mapChangePosSinceLastStep.push_back( p );
+        }
+    
+    
+    unsigned char key[8];
+    unsigned char value[4];
+    
+
+    intPairToKey( inX, inY, key );
+    intToValue( inValue, value );
+            
+    
+    cellDBPut( &floorDB, key, value );
+
+    if( isRegionStoreOpen() ) {
+        lookupRegionCell( inX, inY )->floor = inValue;
+        markRegionCellDirty( inX, inY );
+        }
+    
+    dbLookTimePut( inX, inY, MAP_TIMESEC );
+    }
+
+
+
+static void dbFloorTimePut( int inX, int inY, timeSec_t inTime ) {
+    // ETA decay changes don't get reported as map changes    
+    
+    unsigned char key[8];
+    unsigned char value[8];
+    
+
+    intPairToKey( inX, inY, key );
+    timeToValue( inTime, value );
+            
+    
+    cellDBPut( &floorTimeDB, key, value );
+
+    if( isRegionStoreOpen() ) {
+        lookupRegionCell( inX, inY )->floorEta = inTime;
+        markRegionCellDirty( inX, inY );
+        }
+    }
+
+
+
+// look times only matter at the scale of mapCellForgottenSeconds,
+// so skip rewriting one that was set this recently
+#define LOOK_TIME_RESOLUTION_SECONDS 60
+
+
+void dbLookTimePut( int inX, int inY, timeSec_t inTime ) {
+    if( !lookTimeDBOpen ) return;
+    
+    if( isRegionStoreOpen() ) {
+        RegionCell *c = lookupRegionCell( inX, inY );
+        
+        if( inTime >= c->lookTime && 
+            inTime - c->lookTime < LOOK_TIME_RESOLUTION_SECONDS ) {
+            return;
+            }
+        c->lookTime = inTime;
+        markRegionCellDirty( inX, inY );
+        }
+    
+    unsigned char key[8];
+    unsigned char value[8];
+    
+
+    intPairToKey( inX, inY, key );
+    timeToValue( inTime, value );
+            
+    
+    cellDBPut( &lookTimeDB, key, value );
+    }
+
+
+
+// fills region cell from per-cell DBs, for regions never stored before
+static void loadRegionCellFromDBs( int inX, int inY, RegionCell *outCell ) {
+    outCell->object = dbGetRaw( inX, inY, 0 );
+    outCell->numContained = dbGetRaw( inX, inY, NUM_CONT_SLOT );
+    outCell->noDecay = dbGetRaw( inX, inY, NO_DECAY_SLOT );
+    outCell->floor = dbFloorGetRaw( inX, inY );
+    outCell->objectEta = dbTimeGetRaw( inX, inY, DECAY_SLOT );
+    outCell->floorEta = dbFloorTimeGetRaw( inX, inY );
+    outCell->lookTime = dbLookTimeGet( inX, inY );
+    }
+
+
+
+// Per-cell DBs, for code that treats them all the same way
+
+
+// same as in initMap
+// (only used when creating files, existing DBs keep their own)
+#define CELL_DB_HASH_TABLE_SIZE 80000
+
+
+typedef struct CellDB {
+        DB *db;
+        char *dbOpenFlag;
+        const char *path;
+        unsigned long keySize;
+        unsigned long valueSize;
+    } CellDB;
+
+
+// lookTime.db MUST be first
+#define NUM_CELL_DBS 6
+
+static CellDB cellDBs[ NUM_CELL_DBS ];
+
+
+
+static void setupCellDB( int inIndex, DB *inDB, char *inDBOpenFlag,
+                         const char *inPath,
+                         unsigned long inKeySize,
+                         unsigned long inValueSize ) {
+    CellDB *c = &( cellDBs[ inIndex ] );
+    
+    c->db = inDB;
+    c->dbOpenFlag = inDBOpenFlag;
+    c->path = inPath;
+    c->keySize = inKeySize;
+    c->valueSize = inValueSize;
+    }
+
+
+
+static void initCellDBs() {
+    // key and value sizes as in initMap
+    setupCellDB( 0, &lookTimeDB, &lookTimeDBOpen, "lookTime.db", 8, 8 );
+    setupCellDB( 1, &db, &dbOpen, "map.db", 16, 4 );
+    setupCellDB( 2, &timeDB, &timeDBOpen, "mapTime.db", 16, 8 );
+    setupCellDB( 3, &biomeDB, &biomeDBOpen, "biome.db", 8, 12 );
+    setupCellDB( 4, &floorDB, &floorDBOpen, "floor.db", 8, 4 );
+    setupCellDB( 5, &floorTimeDB, &floorTimeDBOpen, "floorTime.db", 8, 8 );
+    }
+
+
+
+static int getCellDBIndex( DB *inDB ) {
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        if( cellDBs[i].db == inDB ) {
+            return i;
+            }
+        }
+    return -1;
+    }
+
+
+
+// latest value written for each of a set of per-cell DB keys
+// Open addressing, linear probing.
+typedef struct CellDBWrite {
+        char used;
+        unsigned char dbIndex;
+        unsigned char key[16];
+        unsigned char value[12];
+    } CellDBWrite;
+
+
+typedef struct CellDBWriteTable {
+        CellDBWrite *slots;
+        int capacity;
+        int numWrites;
+        
+        // changes whenever table is rebuilt, moving writes to 
+        // different slots
+        int generation;
+    } CellDBWriteTable;
+
+
+
+static int findCellDBWriteSlot( CellDBWrite *inSlots, 
+                                int inCapacity,
+                                int inDBIndex, 
+                                const unsigned char *inKey ) {
+    int keySize = cellDBs[ inDBIndex ].keySize;
+    
+    // keys are 8 or 16 bytes
+    uint64_t a, b = 0;
+    memcpy( &a, inKey, 8 );
+    if( keySize > 8 ) {
+        memcpy( &b, &( inKey[8] ), 8 );
+        }
+    
+    uint64_t h = mixCellKey( a ^ mixCellKey( b + inDBIndex ) );
+    
+    int i = (int)( h & (uint64_t)( inCapacity - 1 ) );
+    
+    while( inSlots[i].used ) {
+        if( inSlots[i].dbIndex == inDBIndex &&
+            memcmp( inSlots[i].key, inKey, keySize ) == 0 ) {
+            break;
+            }
+        i = ( i + 1 ) & ( inCapacity - 1 );
+        }
+    return i;
+    }
+
+
+
+static void setCellDBWriteTableCapacity( CellDBWriteTable *inTable,
+                                         int inCapacity ) {
+    CellDBWrite *oldSlots = inTable->slots;
+    int oldCapacity = inTable->capacity;
+    
+    inTable->slots = new CellDBWrite[ inCapacity ];
+    inTable->capacity = inCapacity;
+    
+    for( int i=0; i<inCapacity; i++ ) {
+        inTable->slots[i].used = false;
+        }
+    
+    if( oldSlots != NULL ) {
+        for( int i=0; i<oldCapacity; i++ ) {
+            CellDBWrite *w = &( oldSlots[i] );
+            
+            if( w->used ) {
+                int slot = findCellDBWriteSlot( inTable->slots,
+                                                inCapacity,
+                                                w->dbIndex, w->key );
+                inTable->slots[ slot ] = *w;
+                }
+            }
+        delete [] oldSlots;
+        }
+    
+    inTable->generation++;
+    }
+
+
+
+static void recordCellDBWrite( CellDBWriteTable *inTable,
+                               int inDBIndex, 
+                               const unsigned char *inKey,
+                               const unsigned char *inValue ) {
+    if( inTable->slots == NULL ) {
+        setCellDBWriteTableCapacity( inTable, 1024 );
+        }
+    else if( inTable->numWrites * 2 >= inTable->capacity ) {
+        setCellDBWriteTableCapacity( inTable, inTable->capacity * 2 );
+        }
+    
+    int slot = findCellDBWriteSlot( inTable->slots, inTable->capacity,
+                                    inDBIndex, inKey );
+    
+    CellDBWrite *w = &( inTable->slots[ slot ] );
+    
+    if( ! w->used ) {
+        w->used = true;
+        w->dbIndex = inDBIndex;
+        memcpy( w->key, inKey, cellDBs[ inDBIndex ].keySize );
+        inTable->numWrites++;
+        }
+    memcpy( w->value, inValue, cellDBs[ inDBIndex ].valueSize );
+    }
+
+
+
+// returns true if found
+static char getCellDBWrite( CellDBWriteTable *inTable,
+                            int inDBIndex, 
+                            const unsigned char *inKey,
+                            unsigned char *outValue ) {
+    if( inTable->numWrites == 0 ) {
+        return false;
+        }
+    
+    int slot = findCellDBWriteSlot( inTable->slots, inTable->capacity,
+                                    inDBIndex, inKey );
+    
+    CellDBWrite *w = &( inTable->slots[ slot ] );
+    
+    if( ! w->used ) {
+        return false;
+        }
+    memcpy( outValue, w->value, cellDBs[ inDBIndex ].valueSize );
+    return true;
+    }
+
+
+
+// records all writes from inSource in ioDest, replacing any there
+static void copyCellDBWrites( CellDBWriteTable *inSource,
+                              CellDBWriteTable *ioDest ) {
+    for( int i=0; i<inSource->capacity; i++ ) {
+        CellDBWrite *w = &( inSource->slots[i] );
+        
+        if( w->used ) {
+            recordCellDBWrite( ioDest, w->dbIndex, w->key, w->value );
+            }
+        }
+    }
+
+
+
+static void freeCellDBWriteTable( CellDBWriteTable *inTable ) {
+    if( inTable->slots != NULL ) {
+        delete [] inTable->slots;
+        inTable->slots = NULL;
+        }
+    inTable->capacity = 0;
+    inTable->numWrites = 0;
+    inTable->generation++;
+    }
+
+
+
+static void syncCellDBs() {
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        if( *( cellDBs[i].dbOpenFlag ) ) {
+            DB_sync( cellDBs[i].db );
+            }
+        }
+    }
+
+
+
+
+// Snapshots of per-cell DBs, for backups
+//
+// A full snapshot is cut as a WAL checkpoint starts.  Once that 
+// checkpoint is written, the DB files hold exactly what the map held at 
+// the cut, and they are frozen (no checkpoints, no compaction, and gets 
+// that don't write) until the snapshot is released, so another thread
+// can copy them while the server keeps running out of the RAM tables.
+//
+// From the first cut on, every write is also recorded in the changes
+// table.  An incremental snapshot just takes that table over, so it
+// holds the latest value of every record changed since the snapshot 
+// before it.
+
+struct MapSnapshot {
+        char full;
+        
+        // empty for full snapshot
+        CellDBWriteTable changes;
+    };
+
+
+static CellDBWriteTable snapshotChanges = { NULL, 0, 0, 0 };
+
+// true once a full snapshot has been cut since map was loaded
+static char snapshotChangesTracked = false;
+
+// waiting for next checkpoint to start
+static char fullSnapshotRequested = false;
+
+// waiting for checkpoint to finish
+static char fullSnapshotCheckpointing = false;
+
+static char mapFilesFrozen = false;
+
+// frozen, but not handed out yet
+static MapSnapshot *readyFullSnapshot = NULL;
+
+
+
+static void setMapFilesFrozen( char inFrozen ) {
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        if( *( cellDBs[i].dbOpenFlag ) ) {
+            DB_setReadOnlyGets( cellDBs[i].db, inFrozen );
+            }
+        }
+    mapFilesFrozen = inFrozen;
+    }
+
+
+
+// called as checkpoint starts, once everything written so far has
+// moved to checkpoint table
+static void cutFullMapSnapshot() {
+    // full snapshot covers these
+    freeCellDBWriteTable( &snapshotChanges );
+    
+    snapshotChangesTracked = true;
+    
+    fullSnapshotRequested = false;
+    fullSnapshotCheckpointing = true;
+    }
+
+
+
+// called once that checkpoint is written and synced
+static void freezeFullMapSnapshot() {
+    fullSnapshotCheckpointing = false;
+    
+    setMapFilesFrozen( true );
+    
+    readyFullSnapshot = new MapSnapshot;
+    readyFullSnapshot->full = true;
+    readyFullSnapshot->changes.slots = NULL;
+    readyFullSnapshot->changes.capacity = 0;
+    readyFullSnapshot->changes.numWrites = 0;
+    readyFullSnapshot->changes.generation = 0;
+    }
+
+
+
+// Write-ahead log for per-cell DBs
+//
+// With the log on, writes to per-cell DBs don't go to their files right
+// away.  They are appended to the log, and kept in RAM in the dirty
+// table, which reads check first.  Everything written between stepMaps
+// goes out as one group commit at the end of stepMap, so after a crash,
+// replay at startup brings all DBs back to the end of the same step,
+// with no container counts disagreeing with their slots across map.db,
+// mapTime.db and floor.db.
+//
+// Every mapWALCheckpointSeconds, the log is rotated, and the dirty table
+// becomes the checkpoint table, which is written into the DB files a
+// bit at a time in later stepMaps.  Once those files are synced, the
+// old log segment is dropped.  A key written many times between
+// checkpoints only hits its DB file once.
+
+static const char *mapWALName = "mapWAL.log";
+
+static char useMapWAL = false;
+
+// log can't be written, so dirty table is only copy of recent writes
+// until we can fall back to writing DB files directly
+static char mapWALFailed = false;
+
+static int mapWALCheckpointSeconds = 60;
+
+static double lastCheckpointStartTime = 0;
+
+
+static CellDBWriteTable walDirtyWrites = { NULL, 0, 0, 0 };
+
+// being written into DB files
+static CellDBWriteTable walCheckpointWrites = { NULL, 0, 0, 0 };
+static int nextCheckpointSlot = 0;
+static double checkpointWorkSeconds = 0;
+
+
+
+// record tag is DB index, data is key then value
+static void replayMapWALRecord( unsigned char inTag, 
+                                unsigned char *inData, int inLength ) {
+    if( inTag >= NUM_CELL_DBS ) {
+        return;
+        }
+    
+    CellDB *c = &( cellDBs[ inTag ] );
+    
+    if( ! *( c->dbOpenFlag ) ||
+        inLength != (int)( c->keySize + c->valueSize ) ) {
+        return;
+        }
+    
+    DB_put( c->db, inData, &( inData[ c->keySize ] ) );
+    }
+
+
+
+// brings DB files up to date with any log left by a crash
+// must be called in initMap before DB files are read
+static void replayMapWAL() {
+    initCellDBs();
+    
+    char *oldName = autoSprintf( "%s.old", mapWALName );
+    
+    File walFile( NULL, mapWALName );
+    File oldWALFile( NULL, oldName );
+    
+    delete [] oldName;
+    
+    if( ( ! walFile.exists() || walFile.getLength() == 0 ) &&
+        ! oldWALFile.exists() ) {
+        return;
+        }
+    
+    AppLog::info( "Replaying map write-ahead log" );
+    
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        CellDB *c = &( cellDBs[i] );
+        
+        File dbFile( NULL, c->path );
+        
+        if( ! dbFile.exists() ) {
+            // map was wiped, records for it are useless
+            continue;
+            }
+        
+        int error = DB_open( c->db, 
+                             c->path, 
+                             KISSDB_OPEN_MODE_RWCREAT,
+                             CELL_DB_HASH_TABLE_SIZE,
+                             c->keySize,
+                             c->valueSize );
+        if( error ) {
+            AppLog::errorF( "Error %d opening %s for log replay", 
+                            error, c->path );
+            continue;
+            }
+        *( c->dbOpenFlag ) = true;
+        }
+    
+    replayWriteAheadLog( mapWALName, replayMapWALRecord );
+    
+    syncCellDBs();
+    
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        CellDB *c = &( cellDBs[i] );
+        
+        if( *( c->dbOpenFlag ) ) {
+            DB_close( c->db );
+            *( c->dbOpenFlag ) = false;
+            }
+        }
+    }
+
+
+
+// called at end of initMap
+static void initMapWAL() {
+    useMapWAL = SettingsManager::getIntSetting( "useMapWriteAheadLog", 1 );
+    
+    if( ! useMapWAL ) {
+        // anything in old log was replayed already
+        char *oldName = autoSprintf( "%s.old", mapWALName );
+        remove( mapWALName );
+        remove( oldName );
+        delete [] oldName;
+        return;
+        }
+    
+    mapWALCheckpointSeconds = 
+        SettingsManager::getIntSetting( "mapWALCheckpointSeconds", 60 );
+    
+    int syncMS = 
+        SettingsManager::getIntSetting( "mapWALSyncMilliseconds", 100 );
+    
+    // startup writes went straight to files
+    syncCellDBs();
+    
+    if( ! openWriteAheadLog( mapWALName, syncMS ) ) {
+        useMapWAL = false;
+        return;
+        }
+    
+    mapWALFailed = false;
+    
+    lastCheckpointStartTime = Time::getCurrentTime();
+    }
+
+
+
+static void startMapWALCheckpoint() {
+    // records for everything in dirty table are in old segment now
+    if( ! walRotate() ) {
+        mapWALFailed = true;
+        }
+    
+    walCheckpointWrites = walDirtyWrites;
+    
+    walDirtyWrites.slots = NULL;
+    walDirtyWrites.capacity = 0;
+    walDirtyWrites.numWrites = 0;
+    
+    nextCheckpointSlot = 0;
+    checkpointWorkSeconds = 0;
+    
+    lastCheckpointStartTime = Time::getCurrentTime();
+    }
+
+
+
+// writes checkpoint table into DB files until inEndTime
+// (always writing at least a few)
+static void stepMapWALCheckpoint( double inEndTime ) {
+    
+    double startTime = Time::getCurrentTime();
+    
+    int numWritten = 0;
+    
+    while( nextCheckpointSlot < walCheckpointWrites.capacity ) {
+        
+        if( numWritten % 64 == 63 &&
+            Time::getCurrentTime() >= inEndTime ) {
+            break;
+            }
+        
+        CellDBWrite *w = &( walCheckpointWrites.slots[ nextCheckpointSlot ] );
+        
+        if( w->used ) {
+            DB_put( cellDBs[ w->dbIndex ].db, w->key, w->value );
+            numWritten++;
+            }
+        nextCheckpointSlot++;
+        }
+    
+    
+    if( nextCheckpointSlot >= walCheckpointWrites.capacity ) {
+        // all written
+        syncCellDBs();
+        
+        if( fullSnapshotCheckpointing ) {
+            freezeFullMapSnapshot();
+            }
+        
+        walDropOldSegment();
+        
+        checkpointWorkSeconds += Time::getCurrentTime() - startTime;
+        
+        WALStats walStats = getWALStats();
+        
+        AppLog::infoF( 
+            "Map WAL checkpoint:  %d records written to DB files in "
+            "%.3f sec of work.  Since last:  %d records in %d groups "
+            "(%.1f KiB, at most %d records in one), "
+            "%d syncs taking %.3f sec",
+            walCheckpointWrites.numWrites, checkpointWorkSeconds,
+            walStats.recordsCommitted, walStats.groupsCommitted,
+            walStats.bytesWritten / 1024, walStats.maxRecordsInGroup,
+            walStats.syncs, walStats.syncSeconds );
+        
+        freeCellDBWriteTable( &walCheckpointWrites );
+        }
+    else {
+        checkpointWorkSeconds += Time::getCurrentTime() - startTime;
+        }
+    }
+
+
+
+static void freeMapWAL();
+
+
+// commits this step's writes, and works on checkpoint until inEndTime
+static void stepMapWAL( double inEndTime ) {
+    if( ! useMapWAL ) {
+        return;
+        }
+    
+    if( ! walCommit() ) {
+        mapWALFailed = true;
+        }
+    
+    if( mapWALFailed ) {
+        if( ! mapFilesFrozen && ! fullSnapshotCheckpointing ) {
+            AppLog::error( "Map write-ahead log failed, turning it off and "
+                           "writing DB files directly" );
+            
+            fullSnapshotRequested = false;
+            
+            // applies everything in RAM tables
+            freeMapWAL();
+            return;
+            }
+        
+        // DB files can't be touched yet, but a checkpoint that's
+        // already underway will freeze them when done
+        if( walHasOldSegment() ) {
+            stepMapWALCheckpoint( inEndTime );
+            }
+        return;
+        }
+    
+    if( ! walHasOldSegment() && ! mapFilesFrozen ) {
+        
+        if( fullSnapshotRequested && ! isMapCompactionRunning() ) {
+            startMapWALCheckpoint();
+            cutFullMapSnapshot();
+            }
+        else if( walDirtyWrites.numWrites > 0 &&
+                 Time::getCurrentTime() - lastCheckpointStartTime >= 
+                 mapWALCheckpointSeconds ) {
+            
+            startMapWALCheckpoint();
+            }
+        }
+    
+    if( walHasOldSegment() ) {
+        stepMapWALCheckpoint( inEndTime );
+        }
+    }
+
+
+
+// writes everything into DB files and closes log
+static void freeMapWAL() {
+    if( ! useMapWAL ) {
+        return;
+        }
+    
+    walCommit();
+    
+    // finish any checkpoint in progress, then one more for the rest
+    for( int i=0; i<2; i++ ) {
+        if( ! walHasOldSegment() ) {
+            startMapWALCheckpoint();
+            }
+        stepMapWALCheckpoint( Time::getCurrentTime() + 3600 );
+        }
+    
+    closeWriteAheadLog();
+    
+    // nothing left in either segment, even if log failed mid-rotate
+    char *oldName = autoSprintf( "%s.old", mapWALName );
+    remove( mapWALName );
+    remove( oldName );
+    delete [] oldName;
+    
+    freeCellDBWriteTable( &walDirtyWrites );
+    freeCellDBWriteTable( &walCheckpointWrites );
+    
+    useMapWAL = false;
+    mapWALFailed = false;
+    }
+
+
+
+
+// Online compaction of per-cell DBs
+//
+// Shrinking at startup is otherwise the only thing that forgets stale
+// cells, so the DB files (and their hash chains) of a long-running
+// server would grow without bound.
+//
+// Every mapCompactionIntervalSeconds, each per-cell DB is copied into a
+// temp file, a few bins at a time at the end of stepMap.  lookTime.db
+// goes first, and cells with look times older than
+// mapCellForgottenSeconds are forgotten as it reaches them.  Their
+// records are left out of the copies of the other DBs.
+//
+// Forgotten cells are hidden from the rest of the map code right away:
+// reads of them only see writes made since compaction started.  All
+// such writes are also kept in RAM, and replayed into each copy once
+// its iterator is done, so the live DBs, as seen through cellDBGet,
+// always match what their copies will hold.
+//
+// Once all copies are caught up, they replace the old files in one step.
+
+
+// time that compaction can use in each stepMap, counting time that
+// rest of stepMap has already used
+#define COMPACTION_STEP_SECONDS 0.002
+
+// records copied (or writes replayed) between time checks
+#define COMPACTION_BATCH_SIZE 64
+
+
+typedef struct CompactionDB {
+        CellDB *cell;
+        
+        DB tempDB;
+        char tempOpen;
+        
+        DB_Iterator dbi;
+        char iteratorDone;
+        
+        // next slot of write table to replay into tempDB
+        // starts over if table is rebuilt
+        int nextReplaySlot;
+        int replayGeneration;
+        char replayDone;
+        
+        // stats
+        long sizeBefore;
+        int numRecords;
+        int numEvicted;
+        int numChains;
+        int numChainsAfter;
+        int maxChain;
+        int maxChainAfter;
+        int curChain;
+        int curChainKept;
+    } CompactionDB;
+
+
+// one for each of cellDBs
+static CompactionDB compactionDBs[ NUM_CELL_DBS ];
+
+static int mapCompactionIntervalSeconds = 3600;
+static int compactionStaleSeconds = 0;
+
+static char compactionRunning = false;
+static int compactionCurrentDB = 0;
+
+// look times are compared to this
+static timeSec_t compactionMapTime = 0;
+
+static double compactionStartTime = 0;
+static double compactionWorkSeconds = 0;
+static double lastCompactionEndTime = 0;
+
+// cells forgotten so far
+static CellSet compactionEvicted = { NULL, 0, 0, false };
+
+static int numForgottenThisStep = 0;
+
+// forgotten in lookTime.db bin being copied, refreshed once bin is done
+static SimpleVector<int> forgottenInBinX;
+static SimpleVector<int> forgottenInBinY;
+
+
+
+// writes made to per-cell DBs while compaction is running
+static CellDBWriteTable compactionWrites = { NULL, 0, 0, 0 };
+
+
+
+static void initMapCompaction( int inStaleSeconds ) {
+    compactionStaleSeconds = inStaleSeconds;
+    
+    mapCompactionIntervalSeconds = 
+        SettingsManager::getIntSetting( "mapCompactionIntervalSeconds", 
+                                        3600 );
+    
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        compactionDBs[i].cell = &( cellDBs[i] );
+        compactionDBs[i].tempOpen = false;
+        compactionDBs[i].iteratorDone = false;
+        }
+    
+    // startup just shrank everything
+    lastCompactionEndTime = Time::getCurrentTime();
+    }
+
+
+
+char isMapCompactionRunning() {
+    return compactionRunning;
+    }
+
+
+
+static long getFileLength( const char *inPath ) {
+    File f( NULL, inPath );
+    
+    if( ! f.exists() ) {
+        return 0;
+        }
+    return f.getLength();
+    }
+
+
+
+// region record and caches for a cell whose per-cell records have changed
+// out from under them
+static void refreshCompactedCell( int inX, int inY ) {
+    if( isRegionStoreOpen() ) {
+        RegionCell *c = lookupRegionCell( inX, inY );
+        
+        loadRegionCellFromDBs( inX, inY, c );
+        markRegionCellDirty( inX, inY );
+        }
+    
+    blockingMapCellChanged( inX, inY );
+    }
+
+
+
+static void forgetCompactedCell( int inX, int inY ) {
+    addCell( &compactionEvicted, inX, inY );
+    
+    numForgottenThisStep++;
+    
+    // refreshing reads lookTime.db, which would move records around
+    // under our iterator in the middle of a bin
+    forgottenInBinX.push_back( inX );
+    forgottenInBinY.push_back( inY );
+    }
+
+
+
+static void refreshForgottenInBin() {
+    for( int i=0; i<forgottenInBinX.size(); i++ ) {
+        refreshCompactedCell( forgottenInBinX.getElementDirect( i ),
+                              forgottenInBinY.getElementDirect( i ) );
+        }
+    forgottenInBinX.deleteAll();
+    forgottenInBinY.deleteAll();
+    }
+
+
+
+static void closeCompactionTemps() {
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        CompactionDB *c = &( compactionDBs[i] );
+        
+        if( c->tempOpen ) {
+            DB_close( &( c->tempDB ) );
+            c->tempOpen = false;
+            
+            char *tempName = autoSprintf( "%s.temp", c->cell->path );
+            
+            File tempFile( NULL, tempName );
+            tempFile.remove();
+            
+            delete [] tempName;
+            }
+        c->iteratorDone = false;
+        }
+    }
+
+
+
+// forgotten cells come back, with whatever was written to them since
+static void abortMapCompaction() {
+    if( ! compactionRunning ) {
+        return;
+        }
+    
+    AppLog::info( "Map compaction aborted" );
+    
+    closeCompactionTemps();
+    
+    forgottenInBinX.deleteAll();
+    forgottenInBinY.deleteAll();
+    
+    compactionRunning = false;
+    
+    freeCellDBWriteTable( &compactionWrites );
+    
+    for( int i=0; i<compactionEvicted.capacity; i++ ) {
+        uint64_t key = compactionEvicted.keys[i];
+        
+        if( key != CELL_SET_EMPTY_KEY ) {
+            refreshCompactedCell( (int)( key >> 32 ), (int)( key ) );
+            }
+        }
+    if( compactionEvicted.emptyKeyPresent ) {
+        refreshCompactedCell( -1, -1 );
+        }
+    
+    freeCellSet( &compactionEvicted );
+    
+    initDBCache();
+    freeChunkCache();
+    
+    lastCompactionEndTime = Time::getCurrentTime();
+    }
+
+
+
+static void startMapCompaction() {
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        if( ! *( cellDBs[i].dbOpenFlag ) ) {
+            // nothing to compact
+            lastCompactionEndTime = Time::getCurrentTime();
+            return;
+            }
+        }
+    
+    AppLog::info( "Starting map compaction" );
+    
+    compactionRunning = true;
+    compactionCurrentDB = 0;
+    
+    // writes not in DB files yet, so copies won't get them from there
+    copyCellDBWrites( &walCheckpointWrites, &compactionWrites );
+    copyCellDBWrites( &walDirtyWrites, &compactionWrites );
+    
+    compactionMapTime = MAP_TIMESEC;
+    compactionStartTime = Time::getCurrentTime();
+    compactionWorkSeconds = 0;
+    }
+
+
+
+// returns false on error
+static char openCompactionTemp( CompactionDB *inC ) {
+    char *tempName = autoSprintf( "%s.temp", inC->cell->path );
+    
+    File tempFile( NULL, tempName );
+    
+    if( tempFile.exists() ) {
+        tempFile.remove();
+        }
+    
+    int error = DB_open( &( inC->tempDB ), 
+                         tempName, 
+                         KISSDB_OPEN_MODE_RWCREAT,
+                         CELL_DB_HASH_TABLE_SIZE,
+                         inC->cell->keySize,
+                         inC->cell->valueSize );
+    delete [] tempName;
+    
+    if( error ) {
+        AppLog::errorF( "Error %d opening compaction temp file for %s",
+                        error, inC->cell->path );
+        return false;
+        }
+    
+    inC->tempOpen = true;
+    
+    DB_Iterator_init( inC->cell->db, &( inC->dbi ) );
+    inC->iteratorDone = false;
+    
+    inC->nextReplaySlot = 0;
+    inC->replayGeneration = compactionWrites.generation;
+    inC->replayDone = false;
+    
+    inC->sizeBefore = getFileLength( inC->cell->path );
+    inC->numRecords = 0;
+    inC->numEvicted = 0;
+    inC->numChains = 0;
+    inC->numChainsAfter = 0;
+    inC->maxChain = 0;
+    inC->maxChainAfter = 0;
+    inC->curChain = 0;
+    inC->curChainKept = 0;
+    
+    return true;
+    }
+
+
+
+// copies at least inNumRecords, stopping at end of a bin
+// returns false on error
+static char copyCompactionRecords( CompactionDB *inC, int inNumRecords ) {
+    
+    char isLookTime = ( inC->cell->db == &lookTimeDB );
+    
+    // key and value size that are big enough to handle all of our DB
+    unsigned char key[16];
+    unsigned char value[12];
+    
+    int numCopied = 0;
+    
+    while( numCopied < inNumRecords || 
+           ! DB_Iterator_betweenBins( &( inC->dbi ) ) ) {
+        
+        int result = DB_Iterator_next( &( inC->dbi ), key, value );
+        
+        if( result < 0 ) {
+            AppLog::errorF( "Error reading %s for compaction", inC->cell->path );
+            return false;
+            }
+        if( result == 0 ) {
+            inC->iteratorDone = true;
+            return true;
+            }
+        
+        numCopied++;
+        inC->numRecords++;
+        inC->curChain++;
+        
+        int x = valueToInt( key );
+        int y = valueToInt( &( key[4] ) );
+        
+        char keep;
+        
+        if( isLookTime ) {
+            // file may be behind
+            getCellDBWrite( &compactionWrites, 0, key, value );
+            
+            timeSec_t t = valueToTime( value );
+            
+            keep = ( compactionMapTime - t < compactionStaleSeconds );
+            
+            if( ! keep ) {
+                forgetCompactedCell( x, y );
+                }
+            }
+        else {
+            keep = ! isCellInSet( &compactionEvicted, x, y );
+            }
+        
+        if( keep ) {
+            // iterator sees each key once, and writes aren't replayed
+            // until it's done, so this is always new in temp
+            DB_put_new( &( inC->tempDB ), key, value );
+            inC->curChainKept++;
+            }
+        else {
+            inC->numEvicted++;
+            }
+        
+        if( DB_Iterator_betweenBins( &( inC->dbi ) ) ) {
+            // end of one chain
+            inC->numChains++;
+            
+            if( inC->curChainKept > 0 ) {
+                inC->numChainsAfter++;
+                }
+            
+            if( inC->curChain > inC->maxChain ) {
+                inC->maxChain = inC->curChain;
+                }
+            if( inC->curChainKept > inC->maxChainAfter ) {
+                inC->maxChainAfter = inC->curChainKept;
+                }
+            inC->curChain = 0;
+            inC->curChainKept = 0;
+            
+            refreshForgottenInBin();
+            }
+        }
+    
+    return true;
+    }
+
+
+
+static void replayCompactionWrites( CompactionDB *inC, int inNumWrites ) {
+    if( inC->replayGeneration != compactionWrites.generation ) {
+        // table rebuilt, slots moved
+        // replaying again is harmless
+        inC->nextReplaySlot = 0;
+        inC->replayGeneration = compactionWrites.generation;
+        }
+    
+    int dbIndex = inC - compactionDBs;
+    
+    int numReplayed = 0;
+    
+    while( numReplayed < inNumWrites && 
+           inC->nextReplaySlot < compactionWrites.capacity ) {
+        
+        CellDBWrite *w = &( compactionWrites.slots[ inC->nextReplaySlot ] );
+        
+        if( w->used && w->dbIndex == dbIndex ) {
+            DB_put( &( inC->tempDB ), w->key, w->value );
+            numReplayed++;
+            }
+        inC->nextReplaySlot++;
+        }
+    
+    if( inC->nextReplaySlot >= compactionWrites.capacity ) {
+        inC->replayDone = true;
+        }
+    }
+
+
+
+static void finishMapCompaction() {
+    
+    // every copy is caught up, and will get no more writes until
+    // we're done here, so swap them in
+    
+    compactionRunning = false;
+    
+    for( int i=0; i<NUM_CELL_DBS; i++ ) {
+        CompactionDB *c = &( compactionDBs[i] );
+        
+        // write-ahead log may not have everything in it anymore
+        DB_sync( &( c->tempDB ) );
+        
+        DB_close( &( c->tempDB ) );
+        c->tempOpen = false;
+        c->iteratorDone = false;
+        
+        DB_close( c->cell->db );
+        
+        char *tempName = autoSprintf( "%s.temp", c->cell->path );
+        
+        if( rename( tempName, c->cell->path ) != 0 ) {
+            // old file still in place, with forgotten cells in it
+            AppLog::errorF( "Failed to replace %s with compacted copy",
+                            c->cell->path );
+            }
+        delete [] tempName;
+        
+        int error = DB_open( c->cell->db, 
+                             c->cell->path, 
+                             KISSDB_OPEN_MODE_RWCREAT,
+                             CELL_DB_HASH_TABLE_SIZE,
+                             c->cell->keySize,
+                             c->cell->valueSize );
+        if( error ) {
+            AppLog::errorF( "Error %d reopening %s after compaction",
+                            error, c->cell->path );
+            *( c->cell->dbOpenFlag ) = false;
+            continue;
+            }
+        
+        AppLog::infoF( 
+            "Compacted %s:  %d / %d records evicted, "
+            "%.1f MiB -> %.1f MiB, "
+            "chain length %.2f ave, %d max -> %.2f ave, %d max",
+            c->cell->path, c->numEvicted, c->numRecords,
+            c->sizeBefore / 1048576.0, 
+            getFileLength( c->cell->path ) / 1048576.0,
+            c->numChains > 0 ? 
+              (double)c->numRecords / c->numChains : 0.0,
+            c->maxChain,
+            c->numChainsAfter > 0 ? 
+              (double)( c->numRecords - c->numEvicted ) / c->numChainsAfter 
+              : 0.0,
+            c->maxChainAfter );
+        }
+    
+    double hoursSinceLast = 
+        ( compactionStartTime - lastCompactionEndTime ) / 3600.0;
+    
+    AppLog::infoF( 
+        "Map compaction done in %.1f sec (%.3f sec of work), "
+        "%d cells forgotten (%.1f per hour since last compaction), "
+        "%d writes tracked",
+        Time::getCurrentTime() - compactionStartTime,
+        compactionWorkSeconds,
+        compactionEvicted.numCells,
+        hoursSinceLast > 0 ? compactionEvicted.numCells / hoursSinceLast : 0.0,
+        compactionWrites.numWrites );
+    
+    // nothing to hide anymore, files match what we've been showing
+    freeCellDBWriteTable( &compactionWrites );
+    freeCellSet( &compactionEvicted );
+    
+    lastCompactionEndTime = Time::getCurrentTime();
+    }
+
+
+
+// returns false on error
+static char stepCompactionDB() {
+    CompactionDB *c = &( compactionDBs[ compactionCurrentDB ] );
+    
+    if( ! c->tempOpen ) {
+        return openCompactionTemp( c );
+        }
+    
+    if( ! c->iteratorDone ) {
+        return copyCompactionRecords( c, COMPACTION_BATCH_SIZE );
+        }
+    
+    if( ! c->replayDone ) {
+        replayCompactionWrites( c, COMPACTION_BATCH_SIZE );
+        return true;
+        }
+    
+    compactionCurrentDB++;
+    
+    if( compactionCurrentDB == NUM_CELL_DBS ) {
+        finishMapCompaction();
+        }
+    return true;
+    }
+
+
+
+// uses what's left of this step's time, but always makes some progress
+static void stepMapCompaction( double inStepStartTime ) {
+    if( ! compactionRunning ) {
+        if( mapFilesFrozen || 
+            fullSnapshotRequested || fullSnapshotCheckpointing ) {
+            // snapshot needs files left alone
+            return;
+            }
+        
+        if( mapCompactionIntervalSeconds <= 0 || 
+            compactionStaleSeconds <= 0 ||
+            Time::getCurrentTime() - lastCompactionEndTime < 
+            mapCompactionIntervalSeconds ) {
+            return;
+            }
+        
+        startMapCompaction();
+        
+        if( ! compactionRunning ) {
+            return;
+            }
+        }
+    
+    double startTime = Time::getCurrentTime();
+    double endTime = inStepStartTime + COMPACTION_STEP_SECONDS;
+    
+    numForgottenThisStep = 0;
+    
+    do {
+        if( ! stepCompactionDB() ) {
+            abortMapCompaction();
+            break;
+            }
+        }
+    while( compactionRunning && Time::getCurrentTime() < endTime );
+    
+    
+    if( numForgottenThisStep > 0 ) {
+        // cached values for them are from before they were forgotten
+        initDBCache();
+        freeChunkCache();
+        }
+    
+    compactionWorkSeconds += Time::getCurrentTime() - startTime;
+    }
+
+
+
+static int cellDBGet( DB *inDB, unsigned char *inKey, 
+                      unsigned char *outValue ) {
+    int i = getCellDBIndex( inDB );
+    
+    if( compactionRunning &&
+        isCellInSet( &compactionEvicted, 
+                     valueToInt( inKey ), valueToInt( &( inKey[4] ) ) ) ) {
+        // forgotten
+        // only writes since then count
+        if( getCellDBWrite( &compactionWrites, i, inKey, outValue ) ) {
+            return 0;
+            }
+        return 1;
+        }
+    
+    if( useMapWAL ) {
+        // newest first
+        if( getCellDBWrite( &walDirtyWrites, i, inKey, outValue ) ||
+            getCellDBWrite( &walCheckpointWrites, i, inKey, outValue ) ) {
+            return 0;
+            }
+        }
+    
+    return DB_get( inDB, inKey, outValue );
+    }
+
+
+
+static int cellDBPut( DB *inDB, unsigned char *inKey, 
+                      unsigned char *inValue ) {
+    int i = getCellDBIndex( inDB );
+    
+    if( snapshotChangesTracked ) {
+        recordCellDBWrite( &snapshotChanges, i, inKey, inValue );
+        }
+    
+    if( compactionRunning ) {
+        recordCellDBWrite( &compactionWrites, i, inKey, inValue );
+        
+        CompactionDB *c = &( compactionDBs[i] );
+        
+        if( c->iteratorDone ) {
+            // copy won't see this otherwise
+            DB_put( &( c->tempDB ), inKey, inValue );
+            }
+        }
+    
+    if( useMapWAL ) {
+        // DB file gets it at next checkpoint
+        unsigned char record[28];
+        
+        int keySize = cellDBs[i].keySize;
+        int valueSize = cellDBs[i].valueSize;
+        
+        memcpy( record, inKey, keySize );
+        memcpy( &( record[ keySize ] ), inValue, valueSize );
+        
+        walAppend( i, record, keySize + valueSize );
+        
+        recordCellDBWrite( &walDirtyWrites, i, inKey, inValue );
+        return 0;
+        }
+    
+    return DB_put( inDB, inKey, inValue );
+    }
+
+
+
+char canSnapshotMap() {
+    return useMapWAL;
+    }
+
+
+
+void requestFullMapSnapshot() {
+    if( ! useMapWAL || 
+        mapFilesFrozen || fullSnapshotCheckpointing || 
+        readyFullSnapshot != NULL ) {
+        return;
+        }
+    fullSnapshotRequested = true;
+    }
+
+
+
+MapSnapshot *getFullMapSnapshot() {
+    MapSnapshot *s = readyFullSnapshot;
+    readyFullSnapshot = NULL;
+    
+    return s;
+    }
+
+
+
+MapSnapshot *cutMapSnapshot() {
+    if( ! snapshotChangesTracked ) {
+        return NULL;
+        }
+    
+    MapSnapshot *s = new MapSnapshot;
+    s->full = false;
+    s->changes = snapshotChanges;
+    
+    snapshotChanges.slots = NULL;
+    snapshotChanges.capacity = 0;
+    snapshotChanges.numWrites = 0;
     
+    return s;
+    }
 
-    intQuadToKey( inX, inY, inSlot, inSubCont, key );
-    intToValue( inValue, value );
-            
-    
-    DB_put( &db, key, value );
 
-    dbPutCached( inX, inY, inSlot, inSubCont, inValue );
-    dbLookTimePut( inX, inY, MAP_TIMESEC );
+
+int getNumMapSnapshotDBs() {
+    return NUM_CELL_DBS;
     }
 
 
 
+const char *getMapSnapshotDBName( int inDBIndex ) {
+    return cellDBs[ inDBIndex ].path;
+    }
 
 
-static void dbTimePut( int inX, int inY, int inSlot, timeSec_t inTime,
-                       int inSubCont = 0 ) {
-    // ETA decay changes don't get reported as map changes    
-    
-    unsigned char key[16];
-    unsigned char value[8];
-    
 
-    intQuadToKey( inX, inY, inSlot, inSubCont, key );
-    timeToValue( inTime, value );
-            
-    
-    DB_put( &timeDB, key, value );
+void getMapSnapshotRecordSizes( int inDBIndex, 
+                                int *outKeySize, int *outValueSize ) {
+    *outKeySize = cellDBs[ inDBIndex ].keySize;
+    *outValueSize = cellDBs[ inDBIndex ].valueSize;
     }
 
 
 
+int getMapSnapshotNumChanges( MapSnapshot *inSnapshot ) {
+    return inSnapshot->changes.numWrites;
+    }
+
 
-static void dbFloorPut( int inX, int inY, int inValue ) {
+
+void forEachMapSnapshotChange( MapSnapshot *inSnapshot,
+                               MapSnapshotRecordHandler inHandler,
+                               void *inContext ) {
+    CellDBWriteTable *t = &( inSnapshot->changes );
     
-    char found = false;
-    for( int i=0; i<mapChangePosSinceLastStep.size(); i++ ) {
-        
-        ChangePosition *p = mapChangePosSinceLastStep.getElement( i );
+    for( int i=0; i<t->capacity; i++ ) {
+        CellDBWrite *w = &( t->slots[i] );
         
-        if( p->x == inX && p->y == inY ) {
-            found = true;
-            
-            // update it
-            p->responsiblePlayerID = currentResponsiblePlayer;
-            break;
+        if( w->used ) {
+            inHandler( w->dbIndex, w->key, w->value, inContext );
             }
         }
-        
-    if( ! found ) {
-        ChangePosition p = { inX, inY, false, currentResponsiblePlayer,
-                             0, 0, 0.0 };
-        mapChangePosSinceLastStep.push_back( p );
-        }
-    
-    
-    unsigned char key[8];
-    unsigned char value[4];
-    
-
-    intPairToKey( inX, inY, key );
-    intToValue( inValue, value );
-            
-    
-    DB_put( &floorDB, key, value );
-    dbLookTimePut( inX, inY, MAP_TIMESEC );
     }
 
 
 
-static void dbFloorTimePut( int inX, int inY, timeSec_t inTime ) {
-    // ETA decay changes don't get reported as map changes    
-    
-    unsigned char key[8];
-    unsigned char value[8];
-    
-
-    intPairToKey( inX, inY, key );
-    timeToValue( inTime, value );
-            
+void releaseMapSnapshot( MapSnapshot *inSnapshot ) {
+    if( inSnapshot->full && mapFilesFrozen ) {
+        setMapFilesFrozen( false );
+        }
     
-    DB_put( &floorTimeDB, key, value );
+    freeCellDBWriteTable( &( inSnapshot->changes ) );
+    delete inSnapshot;
     }
 
 
 
-void dbLookTimePut( int inX, int inY, timeSec_t inTime ) {
-    if( !lookTimeDBOpen ) return;
+// next snapshot after map is loaded again must be full
+static void freeMapSnapshots() {
+    if( mapFilesFrozen ) {
+        AppLog::error( "Full map snapshot not released before freeMap" );
+        setMapFilesFrozen( false );
+        }
     
-    unsigned char key[8];
-    unsigned char value[8];
+    if( readyFullSnapshot != NULL ) {
+        delete readyFullSnapshot;
+        readyFullSnapshot = NULL;
+        }
     
-
-    intPairToKey( inX, inY, key );
-    timeToValue( inTime, value );
-            
+    freeCellDBWriteTable( &snapshotChanges );
     
-    DB_put( &lookTimeDB, key, value );
+    snapshotChangesTracked = false;
+    fullSnapshotRequested = false;
+    fullSnapshotCheckpointing = false;
     }
 
 
@@ -3071,24 +5372,18 @@ static void trackETA( int inX, int inY, int inSlot, timeSec_t inETA,
     if( timeLeft < maxSecondsForActiveDecayTracking ) {
         // track it live
             
-        // duplicates okay
-        // we'll deal with them when they ripen
-        // (we check the true ETA stored in map before acting
-        //   on one stored in this queue)
+        // replaces any record with an old ETA for this cell or slot
+        // (we still check the true ETA stored in map before acting
+        //   on one stored in wheel)
         LiveDecayRecord r = { inX, inY, inSlot, inETA, inSubCont };
             
         char exists;
         timeSec_t existingETA =
-            liveDecayRecordPresentHashTable.lookup( inX, inY, inSlot,
-                                                    inSubCont,
-                                                    &exists );
+            liveDecayWheel.lookup( inX, inY, inSlot, inSubCont, &exists );
 
         if( !exists || existingETA != inETA ) {
             
-            liveDecayQueue.insert( r, inETA );
-            
-            liveDecayRecordPresentHashTable.insert( inX, inY, inSlot, 
-                                                    inSubCont, inETA );
+            liveDecayWheel.schedule( r );
 
             char exists;
             
@@ -4216,12 +6511,203 @@ int getMapBiome( int inX, int inY ) {
 
 
 
-// returns properly formatted chunk message for chunk centered
-// around x,y
-unsigned char *getChunkMessage( int inStartX, int inStartY, 
-                                int inWidth, int inHeight,
-                                GridPos inRelativeToPos,
-                                int *outMessageLength ) {
+// optimization:
+// cache zipped chunk bodies, so that players standing in the same spot
+// (babies born next to mother, players reconnecting, map pull requests)
+// reuse the same bytes instead of re-reading and re-zipping every cell
+//
+// Record holds job zipping body, which may still be running on a
+// compression worker when record is hit.
+//
+// Body depends only on absolute rectangle and format (header holds the
+// player-relative coordinates), so rectangle is the key.
+// Each step, mapChangePosSinceLastStep is boiled down to the set of
+// 16x16 regions that changed, and an entry is dropped if its rectangle
+// touches any of them.  Entries are also dropped after a few seconds, so
+// that cells in view still get re-read (which keeps their look times and
+// live decay tracking fresh).
+
+#define CHUNK_CACHE_SIZE 256
+
+#define CHUNK_CACHE_REGION_D 16
+
+#define CHUNK_CACHE_MAX_AGE_SECONDS 5
+
+typedef struct ChunkCacheRecord {
+        int x, y, w, h;
+        int format;
+        
+        timeSec_t cacheTime;
+        
+        // zipping body, or done
+        // NULL if slot empty
+        CompressionJob *job;
+    } ChunkCacheRecord;
+
+
+static ChunkCacheRecord chunkCache[ CHUNK_CACHE_SIZE ];
+
+// regions with changes in current step, reused between steps
+static SimpleVector<GridPos> changedChunkRegions;
+
+
+static int computeChunkCacheHash( int inX, int inY, int inW, int inH,
+                                  int inFormat ) {
+    
+    // unsigned, so overflow wraps
+    unsigned int hashKey = 
+        (unsigned int)inX * CACHE_PRIME_A + 
+        (unsigned int)inY * CACHE_PRIME_B + 
+        (unsigned int)( inW * 31 + inH ) * CACHE_PRIME_C +
+        (unsigned int)inFormat * CACHE_PRIME_D;
+    
+    return hashKey % CHUNK_CACHE_SIZE;
+    }
+
+
+
+// rounds toward negative infinity
+static int getChunkCacheRegion( int inV ) {
+    if( inV >= 0 ) {
+        return inV / CHUNK_CACHE_REGION_D;
+        }
+    return - ( ( - inV - 1 ) / CHUNK_CACHE_REGION_D ) - 1;
+    }
+
+
+
+static void clearChunkCacheRecord( ChunkCacheRecord *inRecord ) {
+    if( inRecord->job != NULL ) {
+        releaseCompressionJob( inRecord->job );
+        inRecord->job = NULL;
+        }
+    }
+
+
+
+static void initChunkCache() {
+    for( int i=0; i<CHUNK_CACHE_SIZE; i++ ) {
+        chunkCache[i].job = NULL;
+        }
+    }
+
+
+
+static void freeChunkCache() {
+    for( int i=0; i<CHUNK_CACHE_SIZE; i++ ) {
+        clearChunkCacheRecord( &( chunkCache[i] ) );
+        }
+    changedChunkRegions.deleteAll();
+    }
+
+
+
+static char isInChunkRecord( ChunkCacheRecord *inRecord, int inX, int inY ) {
+    return 
+        inX >= inRecord->x && inX < inRecord->x + inRecord->w &&
+        inY >= inRecord->y && inY < inRecord->y + inRecord->h;
+    }
+
+
+
+// drops cached chunks that overlap regions with changes
+static void invalidateChunkCache( SimpleVector<ChangePosition> *inChanges ) {
+    int numChanges = inChanges->size();
+    
+    if( numChanges == 0 ) {
+        return;
+        }
+    
+    changedChunkRegions.deleteAll();
+    
+    for( int c=0; c<numChanges; c++ ) {
+        ChangePosition *p = inChanges->getElement( c );
+        
+        GridPos region = { getChunkCacheRegion( p->x ),
+                           getChunkCacheRegion( p->y ) };
+        
+        // many changes in a step land in the same few regions
+        char found = false;
+        for( int j=0; j<changedChunkRegions.size(); j++ ) {
+            GridPos *other = changedChunkRegions.getElement( j );
+            
+            if( other->x == region.x && other->y == region.y ) {
+                found = true;
+                break;
+                }
+            }
+        if( ! found ) {
+            changedChunkRegions.push_back( region );
+            }
+        }
+    
+    int numRegions = changedChunkRegions.size();
+    
+    for( int i=0; i<CHUNK_CACHE_SIZE; i++ ) {
+        ChunkCacheRecord *r = &( chunkCache[i] );
+        
+        if( r->job == NULL ) {
+            continue;
+            }
+        
+        int startX = getChunkCacheRegion( r->x );
+        int startY = getChunkCacheRegion( r->y );
+        int endX = getChunkCacheRegion( r->x + r->w - 1 );
+        int endY = getChunkCacheRegion( r->y + r->h - 1 );
+        
+        for( int j=0; j<numRegions; j++ ) {
+            GridPos *region = changedChunkRegions.getElement( j );
+            
+            if( region->x >= startX && region->x <= endX &&
+                region->y >= startY && region->y <= endY ) {
+                clearChunkCacheRecord( r );
+                break;
+                }
+            }
+        }
+    }
+
+
+
+// returns cached record, or NULL on miss
+static ChunkCacheRecord *getCachedChunk( int inX, int inY, int inW, int inH,
+                                         int inFormat ) {
+    ChunkCacheRecord *r = 
+        &( chunkCache[ 
+               computeChunkCacheHash( inX, inY, inW, inH, inFormat ) ] );
+    
+    if( r->job == NULL ||
+        r->x != inX || r->y != inY || r->w != inW || r->h != inH ||
+        r->format != inFormat ) {
+        return NULL;
+        }
+    
+    if( MAP_TIMESEC - r->cacheTime > CHUNK_CACHE_MAX_AGE_SECONDS ) {
+        clearChunkCacheRecord( r );
+        return NULL;
+        }
+
+    // changes made since last step haven't been applied to cache yet
+    for( int i=0; i<mapChangePosSinceLastStep.size(); i++ ) {
+        ChangePosition *p = mapChangePosSinceLastStep.getElement( i );
+        
+        if( isInChunkRecord( r, p->x, p->y ) ) {
+            clearChunkCacheRecord( r );
+            return NULL;
+            }
+        }
+    
+    return r;
+    }
+
+
+
+// reads cells in rectangle, and returns unzipped chunk body
+// in requested format
+static unsigned char *getChunkBody( int inStartX, int inStartY, 
+                                    int inWidth, int inHeight,
+                                    int inFormat,
+                                    int *outRawSize ) {
     
     int chunkCells = inWidth * inHeight;
     
@@ -4245,6 +6731,7 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
     for( int y=inStartY; y<endY; y++ ) {
         int chunkY = y - inStartY;
         
+        prefillBaseMapRow( inStartX, y, inWidth );
 
         for( int x=inStartX; x<endX; x++ ) {
             int chunkX = x - inStartX;
@@ -4309,50 +6796,124 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
 
 
 
+
     SimpleVector<unsigned char> chunkDataBuffer;
 
-    for( int i=0; i<chunkCells; i++ ) {
+    if( inFormat == MAP_CHUNK_FORMAT_BINARY ) {
         
-        if( i > 0 ) {
-            chunkDataBuffer.appendArray( (unsigned char*)" ", 1 );
+        startBinaryChunk( &chunkDataBuffer );
+        
+        int i = 0;
+        
+        while( i < chunkCells ) {
+            
+            if( chunkFloors[i] == 0 && chunk[i] == 0 &&
+                containedStacks[i] == NULL ) {
+                
+                // empty, see how far the empty run with this biome goes
+                int runEnd = i + 1;
+                
+                while( runEnd < chunkCells &&
+                       chunkBiomes[runEnd] == chunkBiomes[i] &&
+                       chunkFloors[runEnd] == 0 && chunk[runEnd] == 0 &&
+                       containedStacks[runEnd] == NULL ) {
+                    runEnd++;
+                    }
+                
+                appendChunkEmptyRun( &chunkDataBuffer, runEnd - i,
+                                     chunkBiomes[i] );
+                i = runEnd;
+                continue;
+                }
+            
+            int numContained = 0;
+
+            if( containedStacks[i] != NULL ) {
+                numContained = containedStackSizes[i];
+                
+                for( int c=0; c<numContained; c++ ) {
+                    containedStacks[i][c] = 
+                        hideIDForClient( containedStacks[i][c] );
+                    
+                    if( subContainedStacks[i][c] != NULL ) {
+                        for( int s=0; s<subContainedStackSizes[i][c]; s++ ) {
+                            subContainedStacks[i][c][s] =
+                                hideIDForClient( 
+                                    subContainedStacks[i][c][s] );
+                            }
+                        }
+                    }
+                }
+            
+            appendChunkCell( &chunkDataBuffer,
+                             chunkBiomes[i],
+                             hideIDForClient( chunkFloors[i] ),
+                             hideIDForClient( chunk[i] ),
+                             numContained,
+                             containedStacks[i],
+                             subContainedStackSizes[i],
+                             subContainedStacks[i] );
+            i++;
             }
+        }
+    else {
+        for( int i=0; i<chunkCells; i++ ) {
+        
+            if( i > 0 ) {
+                chunkDataBuffer.appendArray( (unsigned char*)" ", 1 );
+                }
         
 
-        char *cell = autoSprintf( "%d:%d:%d", chunkBiomes[i],
-                                  hideIDForClient( chunkFloors[i] ), 
-                                  hideIDForClient( chunk[i] ) );
+            char *cell = autoSprintf( "%d:%d:%d", chunkBiomes[i],
+                                      hideIDForClient( chunkFloors[i] ), 
+                                      hideIDForClient( chunk[i] ) );
         
-        chunkDataBuffer.appendArray( (unsigned char*)cell, strlen(cell) );
-        delete [] cell;
+            chunkDataBuffer.appendArray( (unsigned char*)cell, 
+                                         strlen( cell ) );
+            delete [] cell;
 
-        if( containedStacks[i] != NULL ) {
-            for( int c=0; c<containedStackSizes[i]; c++ ) {
-                char *containedString = 
-                    autoSprintf( ",%d", 
-                                 hideIDForClient( containedStacks[i][c] ) );
+            if( containedStacks[i] != NULL ) {
+                for( int c=0; c<containedStackSizes[i]; c++ ) {
+                    char *containedString = 
+                        autoSprintf( ",%d", 
+                                     hideIDForClient( 
+                                         containedStacks[i][c] ) );
         
-                chunkDataBuffer.appendArray( (unsigned char*)containedString, 
-                                             strlen( containedString ) );
-                delete [] containedString;
+                    chunkDataBuffer.appendArray( 
+                        (unsigned char*)containedString, 
+                        strlen( containedString ) );
+                    delete [] containedString;
 
-                if( subContainedStacks[i][c] != NULL ) {
+                    if( subContainedStacks[i][c] != NULL ) {
                     
-                    for( int s=0; s<subContainedStackSizes[i][c]; s++ ) {
+                        for( int s=0; s<subContainedStackSizes[i][c]; s++ ) {
                         
-                        char *subContainedString = 
-                            autoSprintf( ":%d", 
-                                         hideIDForClient( 
-                                             subContainedStacks[i][c][s] ) );
-        
-                        chunkDataBuffer.appendArray( 
-                            (unsigned char*)subContainedString, 
-                            strlen( subContainedString ) );
-                        delete [] subContainedString;
+                            char *subContainedString = 
+                                autoSprintf( ":%d", 
+                                             hideIDForClient( 
+                                                 subContainedStacks
+                                                 [i][c][s] ) );
+        
+                            chunkDataBuffer.appendArray( 
+                                (unsigned char*)subContainedString, 
+                                strlen( subContainedString ) );
+                            delete [] subContainedString;
+                            }
                         }
-                    delete [] subContainedStacks[i][c];
                     }
                 }
+            }
+        }
+    
 
+    for( int i=0; i<chunkCells; i++ ) {
+        if( containedStacks[i] != NULL ) {
+            for( int c=0; c<containedStackSizes[i]; c++ ) {
+                if( subContainedStacks[i][c] != NULL ) {
+                    delete [] subContainedStacks[i][c];
+                    }
+                }
+            
             delete [] subContainedStackSizes[i];
             delete [] subContainedStacks[i];
 
@@ -4372,36 +6933,61 @@ unsigned char *getChunkMessage( int inStartX, int inStartY,
     
     
 
-    unsigned char *chunkData = chunkDataBuffer.getElementArray();
+    *outRawSize = chunkDataBuffer.size();
     
-    int compressedSize;
-    unsigned char *compressedChunkData =
-        zipCompress( chunkData, chunkDataBuffer.size(),
-                     &compressedSize );
+    return chunkDataBuffer.getElementArray();
+    }
 
 
 
-    char *header = autoSprintf( "MC\n%d %d %d %d\n%d %d\n#", 
-                                inWidth, inHeight,
-                                inStartX - inRelativeToPos.x, 
-                                inStartY - inRelativeToPos.y, 
-                                chunkDataBuffer.size(),
-                                compressedSize );
-    
-    SimpleVector<unsigned char> buffer;
-    buffer.appendArray( (unsigned char*)header, strlen( header ) );
-    delete [] header;
 
+// returns start of chunk message header for chunk centered
+// around x,y, and job zipping its body
+char *getChunkMessageStart( int inStartX, int inStartY, 
+                            int inWidth, int inHeight,
+                            GridPos inRelativeToPos,
+                            CompressionJob **outJob,
+                            int inFormat ) {
+
+    ChunkCacheRecord *cached = 
+        getCachedChunk( inStartX, inStartY, inWidth, inHeight, inFormat );
     
-    buffer.appendArray( compressedChunkData, compressedSize );
-    
-    delete [] chunkData;
-    delete [] compressedChunkData;
-    
+    if( cached != NULL ) {
+        chunkCacheHits++;
+        }
+    else {
+        chunkCacheMisses++;
+        
+        cached = 
+            &( chunkCache[ 
+                   computeChunkCacheHash( inStartX, inStartY, 
+                                          inWidth, inHeight, inFormat ) ] );
+        
+        clearChunkCacheRecord( cached );
 
+        int rawSize;
+        unsigned char *rawData =
+            getChunkBody( inStartX, inStartY, inWidth, inHeight, inFormat,
+                          &rawSize );
+        
+        // hits on this record can share job while it's still running
+        cached->job = startCompression( rawData, rawSize );
+        
+        cached->x = inStartX;
+        cached->y = inStartY;
+        cached->w = inWidth;
+        cached->h = inHeight;
+        cached->format = inFormat;
+        cached->cacheTime = MAP_TIMESEC;
+        }
     
-    *outMessageLength = buffer.size();
-    return buffer.getElementArray();
+    addCompressionJobReference( cached->job );
+    *outJob = cached->job;
+
+    return autoSprintf( "MC\n%d %d %d %d\n", 
+                        inWidth, inHeight,
+                        inStartX - inRelativeToPos.x, 
+                        inStartY - inRelativeToPos.y );
     }
 
 
@@ -5084,13 +7670,13 @@ timeSec_t getFloorEtaDecay( int inX, int inY ) {
 
 
 int getNextDecayDelta() {
-    if( liveDecayQueue.size() == 0 ) {
+    timeSec_t minTime;
+    
+    if( ! liveDecayWheel.getNextETA( &minTime ) ) {
         return -1;
         }
     
     timeSec_t curTime = MAP_TIMESEC;
-
-    timeSec_t minTime = liveDecayQueue.checkMinPriority();
     
     
     if( minTime <= curTime ) {
@@ -5103,50 +7689,55 @@ int getNextDecayDelta() {
 
 
 
+static double lastDecayStatsLogTime = 0;
+
+#define DECAY_STATS_LOG_INTERVAL_SECONDS 60
+
+static int maxDecaysExpiredInOneStep = 0;
+
+
+
 void stepMap( SimpleVector<MapChangeRecord> *inMapChanges, 
               SimpleVector<ChangePosition> *inChangePosList ) {
     
+    double stepStartTime = Time::getCurrentTime();
+    
+    // base map generated ahead of players by workers
+    stepMapPregen();
+
     timeSec_t curTime = MAP_TIMESEC;
 
-    while( liveDecayQueue.size() > 0 && 
-           liveDecayQueue.checkMinPriority() <= curTime ) {
+    int numExpiredThisStep = 0;
+    
+    LiveDecayRecord r;
+    
+    while( liveDecayWheel.popExpired( curTime, &r ) ) {
         
         // another expired
-
-        LiveDecayRecord r = liveDecayQueue.removeMin();        
-
+        // wheel has removed it
+        numExpiredThisStep++;
+        
         char storedFound;
-        timeSec_t storedETA =
-            liveDecayRecordPresentHashTable.lookup( r.x, r.y, r.slot,
-                                                    r.subCont,
-                                                    &storedFound );
         
-        if( storedFound && storedETA == r.etaTimeSeconds ) {
-            
-            liveDecayRecordPresentHashTable.remove( r.x, r.y, r.slot,
-                                                    r.subCont );
-
-                    
-            timeSec_t lastLookTime =
-                liveDecayRecordLastLookTimeHashTable.lookup( r.x, r.y, r.slot,
-                                                             r.subCont,
-                                                             &storedFound );
+        timeSec_t lastLookTime =
+            liveDecayRecordLastLookTimeHashTable.lookup( r.x, r.y, r.slot,
+                                                         r.subCont,
+                                                         &storedFound );
 
-            if( storedFound ) {
+        if( storedFound ) {
 
-                if( MAP_TIMESEC - lastLookTime > 
-                    maxSecondsNoLookDecayTracking ) {
+            if( MAP_TIMESEC - lastLookTime > 
+                maxSecondsNoLookDecayTracking ) {
                     
-                    // this cell or slot hasn't been looked at in too long
-                    // don't even apply this decay now
-                    liveDecayRecordLastLookTimeHashTable.remove( 
-                        r.x, r.y, r.slot, r.subCont );
-                    continue;
-                    }
-                // else keep lastlook time around in case
-                // this cell will decay further and we're still tracking it
-                // (but maybe delete it if cell is no longer tracked, below)
+                // this cell or slot hasn't been looked at in too long
+                // don't even apply this decay now
+                liveDecayRecordLastLookTimeHashTable.remove( 
+                    r.x, r.y, r.slot, r.subCont );
+                continue;
                 }
+            // else keep lastlook time around in case
+            // this cell will decay further and we're still tracking it
+            // (but maybe delete it if cell is no longer tracked, below)
             }
 
         if( r.slot == 0 ) {
@@ -5170,8 +7761,7 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
         
         
         char stillExists;
-        liveDecayRecordPresentHashTable.lookup( r.x, r.y, r.slot, r.subCont,
-                                                &stillExists );
+        liveDecayWheel.lookup( r.x, r.y, r.slot, r.subCont, &stillExists );
         
         if( !stillExists ) {
             // cell or slot no longer tracked
@@ -5181,6 +7771,25 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
             }
         }
     
+    if( numExpiredThisStep > maxDecaysExpiredInOneStep ) {
+        maxDecaysExpiredInOneStep = numExpiredThisStep;
+        }
+    
+    if( Time::getCurrentTime() - lastDecayStatsLogTime > 
+        DECAY_STATS_LOG_INTERVAL_SECONDS ) {
+        
+        AppLog::infoF( "Live decay:  %d tracked, %d expired, %d cancelled "
+                       "in last %d seconds (at most %d in one step)",
+                       liveDecayWheel.getNumLive(),
+                       liveDecayWheel.getAndResetNumExpired(),
+                       liveDecayWheel.getAndResetNumCancelled(),
+                       DECAY_STATS_LOG_INTERVAL_SECONDS,
+                       maxDecaysExpiredInOneStep );
+        
+        maxDecaysExpiredInOneStep = 0;
+        lastDecayStatsLogTime = Time::getCurrentTime();
+        }
+    
 
     while( liveMovements.size() > 0 && 
            liveMovements.checkMinPriority() <= curTime ) {
@@ -5204,7 +7813,20 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
         }
 
     
+    invalidateChunkCache( &mapChangePosSinceLastStep );
+
     mapChangePosSinceLastStep.deleteAll();
+
+    
+    // commit before compaction, which may swap in files holding
+    // everything written so far
+    stepMapWAL( stepStartTime + COMPACTION_STEP_SECONDS );
+    
+    stepMapCompaction( stepStartTime );
+    
+
+    // region records changed this step are written back together
+    flushRegionStore();
     }
 
 
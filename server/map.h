@@ -6,6 +6,8 @@
 #include "minorGems/system/Time.h"
 
 #include "../gameSource/GridPos.h"
+#include "../commonSource/mapChunkFormat.h"
+#include "compressionPool.h"
 
 
 
@@ -61,14 +63,23 @@ void mapEveDeath( char *inEmail, double inAge );
 
 
 
-// returns properly formatted chunk message for chunk in rectangle shape
+// gets chunk message for chunk in rectangle shape
 // with bottom-left corner at x,y
 // coordinates in message will be relative to inRelativeToPos
 // note that inStartX,Y are absolute world coordinates
-unsigned char *getChunkMessage( int inStartX, int inStartY, 
-                                int inWidth, int inHeight,
-                                GridPos inRelativeToPos,
-                                int *outMessageLength );
+//
+// Body is zipped by compression pool.  Returns start of message
+// header, up to sizes, to pass to OutboundBuffer::queueCompressed along
+// with body's job, returned in outJob.
+//
+// Caller destroys returned string, and releases reference to job.
+//
+// inFormat is one of the MAP_CHUNK_FORMAT_ values in mapChunkFormat.h
+char *getChunkMessageStart( int inStartX, int inStartY, 
+                            int inWidth, int inHeight,
+                            GridPos inRelativeToPos,
+                            CompressionJob **outJob,
+                            int inFormat = MAP_CHUNK_FORMAT_TEXT );
 
 
 // sets the player responsible for subsequent map changes
@@ -94,6 +105,11 @@ void setEtaDecay( int inX, int inY, timeSec_t inAbsoluteTimeInSeconds );
 timeSec_t getEtaDecay( int inX, int inY );
 
 
+// clock that decay ETAs are measured against
+// (may be frozen or sped up for testing)
+timeSec_t getMapTimeSec();
+
+
 // for all these calls, inSubCont indexes the main container (when 0)
 // or sub-containers (when > 0).
 // So, if inSubCont=3 and inSlot=2, we get information about the 2nd
@@ -203,6 +219,71 @@ void stepMap( SimpleVector<MapChangeRecord> *inMapChanges,
                SimpleVector<ChangePosition> *inChangePosList );
 
 
+// true while stale cells are being compacted out of map DBs, a bit
+// at a time in each stepMap
+char isMapCompactionRunning();
+
+
+
+// Snapshots of per-cell map DBs, for incremental backups
+//
+// Only possible with the map write-ahead log on, because the DB files
+// must be left alone while a full snapshot is copied.
+//
+// Full snapshot:  DB files are frozen at a consistent point until the
+// snapshot is released, and can be copied by any thread in the mean time.
+//
+// Incremental snapshot:  latest value of each record changed since the
+// snapshot before, cut in O(1).  Held in RAM until released.
+
+typedef struct MapSnapshot MapSnapshot;
+
+
+char canSnapshotMap();
+
+
+// full snapshot is cut as next WAL checkpoint starts, and ready once
+// that checkpoint is written
+void requestFullMapSnapshot();
+
+// NULL until ready
+// returns each snapshot only once
+MapSnapshot *getFullMapSnapshot();
+
+
+// NULL if there's been no full snapshot since map was loaded
+MapSnapshot *cutMapSnapshot();
+
+
+// these are safe to call from any thread while snapshot is held
+
+int getNumMapSnapshotDBs();
+
+// file name, like "map.db"
+const char *getMapSnapshotDBName( int inDBIndex );
+
+void getMapSnapshotRecordSizes( int inDBIndex, 
+                                int *outKeySize, int *outValueSize );
+
+// 0 for full snapshot
+int getMapSnapshotNumChanges( MapSnapshot *inSnapshot );
+
+
+typedef void (*MapSnapshotRecordHandler)( int inDBIndex, 
+                                          unsigned char *inKey,
+                                          unsigned char *inValue,
+                                          void *inContext );
+
+void forEachMapSnapshotChange( MapSnapshot *inSnapshot,
+                               MapSnapshotRecordHandler inHandler,
+                               void *inContext );
+
+
+// main thread only
+// unfreezes DB files after full snapshot
+void releaseMapSnapshot( MapSnapshot *inSnapshot );
+
+
 
 void restretchDecays( int inNumDecays, timeSec_t *inDecayEtas,
                       int inOldContainerID, int inNewContainerID );
@@ -0,0 +1,309 @@
+#include "mapPregen.h"
+
+#include "minorGems/system/Thread.h"
+#include "minorGems/system/MutexLock.h"
+#include "minorGems/system/BinarySemaphore.h"
+#include "minorGems/system/Time.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/log/AppLog.h"
+
+
+
+// drop requests beyond this many queued blocks
+#define MAX_PENDING_BLOCKS 512
+
+
+// don't request same block again for this long
+// (by then, it may have been evicted from caches)
+#define REQUEST_MEMORY_SECONDS 30
+
+
+#define REQUEST_TABLE_SIZE 4096
+
+
+
+static PregenBlockGenerator generator = NULL;
+static PregenBlockConsumer consumer = NULL;
+
+
+// protects pending, finished, and stopSignal
+static MutexLock queueLock;
+static BinarySemaphore workAddedSemaphore;
+
+static SimpleVector<PregenBlock*> pendingBlocks;
+static SimpleVector<PregenBlock*> finishedBlocks;
+
+static char stopSignal = false;
+
+
+
+// main thread only
+typedef struct RequestRecord {
+        int startX, startY;
+        double requestTime;
+    } RequestRecord;
+
+static RequestRecord requestTable[ REQUEST_TABLE_SIZE ];
+
+
+static MapPregenStats stats = { 0, 0, 0 };
+
+
+
+class PregenThread : public Thread {
+
+        virtual void run() {
+
+            while( true ) {
+
+                PregenBlock *block = NULL;
+                char moreWork = false;
+                char stop;
+
+                queueLock.lock();
+
+                stop = stopSignal;
+
+                if( ! stop && pendingBlocks.size() > 0 ) {
+                    block = pendingBlocks.getElementDirect( 0 );
+                    pendingBlocks.deleteElement( 0 );
+
+                    moreWork = ( pendingBlocks.size() > 0 );
+                    }
+
+                queueLock.unlock();
+
+
+                if( stop ) {
+                    // pass signal on to next waiting thread
+                    workAddedSemaphore.signal();
+                    break;
+                    }
+
+                if( moreWork ) {
+                    // semaphore is binary, so only one thread woke
+                    // wake another to help
+                    workAddedSemaphore.signal();
+                    }
+
+                if( block != NULL ) {
+                    generator( block );
+
+                    queueLock.lock();
+                    finishedBlocks.push_back( block );
+                    queueLock.unlock();
+                    }
+                else {
+                    workAddedSemaphore.wait();
+                    }
+                }
+            }
+
+    };
+
+
+
+static SimpleVector<PregenThread*> threads;
+
+
+
+static int computeRequestHash( int inStartX, int inStartY ) {
+    int hashKey = ( inStartX / PREGEN_BLOCK_D * 776509273 +
+                    inStartY / PREGEN_BLOCK_D * 904124281 )
+        % REQUEST_TABLE_SIZE;
+    if( hashKey < 0 ) {
+        hashKey += REQUEST_TABLE_SIZE;
+        }
+    return hashKey;
+    }
+
+
+
+// floor division, so that negative coordinates map to the right block
+static int cellToBlockStart( int inV ) {
+    int block;
+
+    if( inV >= 0 ) {
+        block = inV / PREGEN_BLOCK_D;
+        }
+    else {
+        block = ( inV - PREGEN_BLOCK_D + 1 ) / PREGEN_BLOCK_D;
+        }
+    return block * PREGEN_BLOCK_D;
+    }
+
+
+
+static void clearRequestTable() {
+    for( int i=0; i<REQUEST_TABLE_SIZE; i++ ) {
+        requestTable[i].requestTime = 0;
+        }
+    }
+
+
+
+void initMapPregen( int inNumThreads,
+                    PregenBlockGenerator inGenerator,
+                    PregenBlockConsumer inConsumer ) {
+    generator = inGenerator;
+    consumer = inConsumer;
+
+    clearRequestTable();
+
+    stopSignal = false;
+
+    for( int i=0; i<inNumThreads; i++ ) {
+        PregenThread *t = new PregenThread();
+        t->start();
+        threads.push_back( t );
+        }
+
+    if( inNumThreads > 0 ) {
+        AppLog::infoF( "Started %d map pregeneration threads",
+                       inNumThreads );
+        }
+    }
+
+
+
+void freeMapPregen() {
+    if( threads.size() > 0 ) {
+        queueLock.lock();
+        stopSignal = true;
+        queueLock.unlock();
+
+        workAddedSemaphore.signal();
+
+        for( int i=0; i<threads.size(); i++ ) {
+            PregenThread *t = threads.getElementDirect( i );
+            t->join();
+            delete t;
+            }
+        threads.deleteAll();
+        }
+
+    // threads all stopped, no lock needed
+    for( int i=0; i<pendingBlocks.size(); i++ ) {
+        delete pendingBlocks.getElementDirect( i );
+        }
+    pendingBlocks.deleteAll();
+
+    for( int i=0; i<finishedBlocks.size(); i++ ) {
+        delete finishedBlocks.getElementDirect( i );
+        }
+    finishedBlocks.deleteAll();
+    }
+
+
+
+void requestMapPregen( int inXStart, int inYStart,
+                       int inWidth, int inHeight ) {
+    if( threads.size() == 0 ) {
+        return;
+        }
+
+    double curTime = Time::getCurrentTime();
+
+    int endX = inXStart + inWidth - 1;
+    int endY = inYStart + inHeight - 1;
+
+    SimpleVector<PregenBlock*> newBlocks;
+
+    for( int y = cellToBlockStart( inYStart ); y <= endY;
+         y += PREGEN_BLOCK_D ) {
+
+        for( int x = cellToBlockStart( inXStart ); x <= endX;
+             x += PREGEN_BLOCK_D ) {
+
+            RequestRecord *r = &( requestTable[ computeRequestHash( x, y ) ] );
+
+            if( r->requestTime != 0 &&
+                r->startX == x && r->startY == y &&
+                curTime - r->requestTime < REQUEST_MEMORY_SECONDS ) {
+                // requested recently
+                continue;
+                }
+
+            r->startX = x;
+            r->startY = y;
+            r->requestTime = curTime;
+
+            PregenBlock *block = new PregenBlock;
+            block->startX = x;
+            block->startY = y;
+
+            newBlocks.push_back( block );
+            }
+        }
+
+    if( newBlocks.size() == 0 ) {
+        return;
+        }
+
+
+    queueLock.lock();
+
+    for( int i=0; i<newBlocks.size(); i++ ) {
+        PregenBlock *block = newBlocks.getElementDirect( i );
+
+        if( pendingBlocks.size() < MAX_PENDING_BLOCKS ) {
+            pendingBlocks.push_back( block );
+            stats.blocksRequested++;
+            }
+        else {
+            // forget that we requested it, so it can be requested
+            // again later
+            requestTable[ computeRequestHash( block->startX,
+                                              block->startY ) ].requestTime
+                = 0;
+            delete block;
+            stats.requestsDropped++;
+            }
+        }
+
+    queueLock.unlock();
+
+    workAddedSemaphore.signal();
+    }
+
+
+
+void stepMapPregen() {
+    if( threads.size() == 0 ) {
+        return;
+        }
+
+    SimpleVector<PregenBlock*> blocks;
+
+    queueLock.lock();
+
+    for( int i=0; i<finishedBlocks.size(); i++ ) {
+        blocks.push_back( finishedBlocks.getElementDirect( i ) );
+        }
+    finishedBlocks.deleteAll();
+
+    queueLock.unlock();
+
+
+    for( int i=0; i<blocks.size(); i++ ) {
+        PregenBlock *block = blocks.getElementDirect( i );
+
+        consumer( block );
+        stats.blocksConsumed++;
+
+        delete block;
+        }
+    }
+
+
+
+MapPregenStats getMapPregenStats() {
+    MapPregenStats s = stats;
+
+    stats.blocksRequested = 0;
+    stats.blocksConsumed = 0;
+    stats.requestsDropped = 0;
+
+    return s;
+    }
@@ -0,0 +1,85 @@
+#ifndef MAP_PREGEN_H_INCLUDED
+#define MAP_PREGEN_H_INCLUDED
+
+
+// Pool of worker threads that generate procedural base map and biome
+// data for blocks of cells before they are needed.
+//
+// Workers only run the generator passed to initMapPregen, which must
+// touch nothing but read-only tables and per-thread noise state.
+// Finished blocks are handed back to the main thread in stepMapPregen,
+// which feeds them to the consumer (which fills main-thread caches),
+// so that caches and DBs never need locks.
+
+
+// cells per block edge
+#define PREGEN_BLOCK_D 16
+
+#define PREGEN_BLOCK_CELLS ( PREGEN_BLOCK_D * PREGEN_BLOCK_D )
+
+
+typedef struct PregenBlock {
+        // cell coordinates of block's bottom left corner
+        int startX, startY;
+
+        // row-major, indexed by ( y - startY ) * PREGEN_BLOCK_D +
+        //                        ( x - startX )
+
+        // -1 for cells generator has no base map value for
+        int baseMapID[ PREGEN_BLOCK_CELLS ];
+
+        int pickedBiome[ PREGEN_BLOCK_CELLS ];
+        int secondPlace[ PREGEN_BLOCK_CELLS ];
+        double secondPlaceGap[ PREGEN_BLOCK_CELLS ];
+    } PregenBlock;
+
+
+
+// fills in block with startX and startY already set
+// called on worker threads
+typedef void (*PregenBlockGenerator)( PregenBlock *ioBlock );
+
+
+// takes results of a finished block
+// called on main thread, from stepMapPregen
+typedef void (*PregenBlockConsumer)( PregenBlock *inBlock );
+
+
+
+// inNumThreads can be 0 to disable pregeneration
+void initMapPregen( int inNumThreads,
+                    PregenBlockGenerator inGenerator,
+                    PregenBlockConsumer inConsumer );
+
+
+// stops and joins worker threads, discards unfinished work
+void freeMapPregen();
+
+
+
+// queues generation of all blocks that overlap a rectangle of cells
+//
+// Blocks requested recently are skipped.  Requests are dropped if too
+// much work is already queued (it's only a head start, after all).
+void requestMapPregen( int inXStart, int inYStart,
+                       int inWidth, int inHeight );
+
+
+// hands all finished blocks to consumer
+void stepMapPregen();
+
+
+
+// stats for logging
+typedef struct MapPregenStats {
+        int blocksRequested;
+        int blocksConsumed;
+        int requestsDropped;
+    } MapPregenStats;
+
+
+// resets stats after returning them
+MapPregenStats getMapPregenStats();
+
+
+#endif
@@ -0,0 +1,688 @@
+#define _FILE_OFFSET_BITS 64
+
+#include "mmapdb.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// djb2 hash function
+static uint64_t MMAPDB_hash( const void *inB, unsigned int inLen ) {
+    uint64_t hash = 5381;
+    for( unsigned int i=0; i<inLen; i++ ) {
+        hash = ((hash << 5) + hash) + (uint64_t)(((const uint8_t *)inB)[i]);
+        }
+    return hash;
+    }
+
+
+
+static const char *magicString = "Mdb";
+
+#define MMAPDB_VERSION 1
+
+
+// header occupies one full page, so that the bucket table after it
+// starts page-aligned
+#define MMAPDB_HEADER_SIZE 4096
+
+// byte offsets of 32-bit fields in header
+#define MMAPDB_HEADER_TABLE_SIZE 4
+#define MMAPDB_HEADER_KEY_SIZE 8
+#define MMAPDB_HEADER_VALUE_SIZE 12
+#define MMAPDB_HEADER_BUCKET_SIZE 16
+#define MMAPDB_HEADER_NUM_OVERFLOW 20
+#define MMAPDB_HEADER_OVERFLOW_CAPACITY 24
+
+
+// each bucket starts with two 32-bit ints:
+// number of records in bucket, and index of next overflow bucket
+// (1-based, 0 if none)
+#define MMAPDB_BUCKET_HEADER_SIZE 8
+
+// aim for this many records per bucket, if it fits in a page
+#define MMAPDB_TARGET_RECORDS_PER_BUCKET 8
+
+// overflow area grows by at least this many buckets at a time
+#define MMAPDB_MIN_OVERFLOW_GROWTH 256
+
+
+
+static uint32_t *getHeaderField( MMAPDB *inDB, int inOffset ) {
+    return (uint32_t *)( inDB->map + inOffset );
+    }
+
+
+
+static unsigned int computeBucketSize( unsigned int inRecordSize ) {
+    unsigned int needed =
+        MMAPDB_BUCKET_HEADER_SIZE +
+        MMAPDB_TARGET_RECORDS_PER_BUCKET * inRecordSize;
+
+    unsigned int size = 64;
+
+    while( size < needed && size < MMAPDB_HEADER_SIZE ) {
+        size *= 2;
+        }
+
+    unsigned int minNeeded = MMAPDB_BUCKET_HEADER_SIZE + inRecordSize;
+    
+    if( size < minNeeded ) {
+        // records too big to fit even one in a page
+        // use a whole number of pages, so buckets stay page-aligned
+        size = MMAPDB_HEADER_SIZE * 
+            ( ( minNeeded + MMAPDB_HEADER_SIZE - 1 ) / MMAPDB_HEADER_SIZE );
+        }
+
+    return size;
+    }
+
+
+
+// bucket index counts primary buckets first, then overflow buckets
+static uint8_t *getBucket( MMAPDB *inDB, uint64_t inBucketIndex ) {
+    return inDB->map + MMAPDB_HEADER_SIZE +
+        inBucketIndex * inDB->bucketSize;
+    }
+
+
+
+static uint64_t getTotalBuckets( MMAPDB *inDB ) {
+    return (uint64_t)inDB->hashTableSize +
+        *getHeaderField( inDB, MMAPDB_HEADER_OVERFLOW_CAPACITY );
+    }
+
+
+
+static uint64_t getFileSizeForBuckets( MMAPDB *inDB, uint64_t inNumBuckets ) {
+    return MMAPDB_HEADER_SIZE + inNumBuckets * inDB->bucketSize;
+    }
+
+
+
+// platform file and mapping calls
+
+#ifdef _WIN32
+
+static int openDBFile( MMAPDB *inDB, const char *inPath ) {
+    HANDLE h = CreateFileA( inPath, GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( h == INVALID_HANDLE_VALUE ) {
+        inDB->fileHandle = NULL;
+        return -1;
+        }
+    inDB->fileHandle = h;
+    return 0;
+    }
+
+
+static char isDBFileOpen( MMAPDB *inDB ) {
+    return ( inDB->fileHandle != NULL );
+    }
+
+
+static void closeDBFile( MMAPDB *inDB ) {
+    CloseHandle( (HANDLE)( inDB->fileHandle ) );
+    inDB->fileHandle = NULL;
+    }
+
+
+static int getDBFileSize( MMAPDB *inDB, uint64_t *outSize ) {
+    LARGE_INTEGER size;
+
+    if( ! GetFileSizeEx( (HANDLE)( inDB->fileHandle ), &size ) ) {
+        return -1;
+        }
+    *outSize = size.QuadPart;
+    return 0;
+    }
+
+
+// new space is zero-filled
+static int setDBFileSize( MMAPDB *inDB, uint64_t inSize ) {
+    LARGE_INTEGER pos;
+    pos.QuadPart = inSize;
+
+    if( ! SetFilePointerEx( (HANDLE)( inDB->fileHandle ), pos, NULL,
+                            FILE_BEGIN ) ||
+        ! SetEndOfFile( (HANDLE)( inDB->fileHandle ) ) ) {
+        return -1;
+        }
+    return 0;
+    }
+
+
+// returns NULL on failure
+static uint8_t *mapDBFile( MMAPDB *inDB, uint64_t inSize ) {
+    if( inSize > (uint64_t)(size_t)-1 ) {
+        return NULL;
+        }
+
+    HANDLE mapping = CreateFileMappingA( (HANDLE)( inDB->fileHandle ), NULL,
+                                         PAGE_READWRITE,
+                                         (DWORD)( inSize >> 32 ),
+                                         (DWORD)( inSize & 0xFFFFFFFF ),
+                                         NULL );
+    if( mapping == NULL ) {
+        return NULL;
+        }
+
+    void *m = MapViewOfFile( mapping, FILE_MAP_WRITE, 0, 0, (size_t)inSize );
+
+    // view keeps mapping alive
+    CloseHandle( mapping );
+
+    return (uint8_t *)m;
+    }
+
+
+static void unmapDBFile( uint8_t *inMap, uint64_t inSize ) {
+    UnmapViewOfFile( inMap );
+    }
+
+
+static int syncDBMap( MMAPDB *inDB ) {
+    if( ! FlushViewOfFile( inDB->map, (size_t)( inDB->mapSize ) ) ||
+        ! FlushFileBuffers( (HANDLE)( inDB->fileHandle ) ) ) {
+        return -1;
+        }
+    return 0;
+    }
+
+#else
+
+static int openDBFile( MMAPDB *inDB, const char *inPath ) {
+    inDB->fd = open( inPath, O_RDWR | O_CREAT, 0644 );
+
+    if( inDB->fd == -1 ) {
+        return -1;
+        }
+    return 0;
+    }
+
+
+static char isDBFileOpen( MMAPDB *inDB ) {
+    return ( inDB->fd != -1 );
+    }
+
+
+static void closeDBFile( MMAPDB *inDB ) {
+    close( inDB->fd );
+    inDB->fd = -1;
+    }
+
+
+static int getDBFileSize( MMAPDB *inDB, uint64_t *outSize ) {
+    struct stat fileStat;
+
+    if( fstat( inDB->fd, &fileStat ) != 0 ) {
+        return -1;
+        }
+    *outSize = fileStat.st_size;
+    return 0;
+    }
+
+
+// new space is zero-filled (and sparse on most file systems)
+static int setDBFileSize( MMAPDB *inDB, uint64_t inSize ) {
+    if( ftruncate( inDB->fd, inSize ) != 0 ) {
+        return -1;
+        }
+    return 0;
+    }
+
+
+// returns NULL on failure
+static uint8_t *mapDBFile( MMAPDB *inDB, uint64_t inSize ) {
+    void *m = mmap( NULL, inSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    inDB->fd, 0 );
+
+    if( m == MAP_FAILED ) {
+        return NULL;
+        }
+    return (uint8_t *)m;
+    }
+
+
+static void unmapDBFile( uint8_t *inMap, uint64_t inSize ) {
+    munmap( inMap, inSize );
+    }
+
+
+static int syncDBMap( MMAPDB *inDB ) {
+    return msync( inDB->map, inDB->mapSize, MS_SYNC );
+    }
+
+#endif
+
+
+
+static int mapFile( MMAPDB *inDB, uint64_t inSize ) {
+    uint8_t *m = mapDBFile( inDB, inSize );
+
+    if( m == NULL ) {
+        inDB->map = NULL;
+        inDB->mapSize = 0;
+        return -1;
+        }
+    inDB->map = m;
+    inDB->mapSize = inSize;
+    return 0;
+    }
+
+
+
+// adds more overflow buckets to end of file and remaps it
+// pointers into map are invalid after this call
+// on failure, old map is left in place and still valid
+static int growOverflow( MMAPDB *inDB ) {
+    uint32_t oldCapacity =
+        *getHeaderField( inDB, MMAPDB_HEADER_OVERFLOW_CAPACITY );
+
+    uint32_t growBy = oldCapacity;
+
+    if( growBy < MMAPDB_MIN_OVERFLOW_GROWTH ) {
+        growBy = MMAPDB_MIN_OVERFLOW_GROWTH;
+        }
+
+    uint32_t newCapacity = oldCapacity + growBy;
+
+    uint64_t newSize = getFileSizeForBuckets(
+        inDB, (uint64_t)inDB->hashTableSize + newCapacity );
+
+    if( setDBFileSize( inDB, newSize ) != 0 ) {
+        return -1;
+        }
+
+    // map new size before giving up old map, so a failed mmap
+    // doesn't leave us with nothing mapped
+    uint8_t *m = mapDBFile( inDB, newSize );
+
+    if( m == NULL ) {
+        // extra file space stays unused, because capacity in
+        // header is unchanged
+        return -1;
+        }
+
+    unmapDBFile( inDB->map, inDB->mapSize );
+
+    inDB->map = m;
+    inDB->mapSize = newSize;
+
+    *getHeaderField( inDB, MMAPDB_HEADER_OVERFLOW_CAPACITY ) = newCapacity;
+
+    return 0;
+    }
+
+
+
+static void closeOnError( MMAPDB *inDB ) {
+    if( inDB->map != NULL ) {
+        unmapDBFile( inDB->map, inDB->mapSize );
+        inDB->map = NULL;
+        }
+    if( isDBFileOpen( inDB ) ) {
+        closeDBFile( inDB );
+        }
+    }
+
+
+
+int MMAPDB_open(
+    MMAPDB *inDB,
+    const char *inPath,
+    int inMode,
+    unsigned int inHashTableSize,
+    unsigned int inKeySize,
+    unsigned int inValueSize ) {
+
+    inDB->map = NULL;
+    inDB->mapSize = 0;
+
+    if( openDBFile( inDB, inPath ) != 0 ) {
+        return 1;
+        }
+
+    inDB->hashTableSize = inHashTableSize;
+    inDB->keySize = inKeySize;
+    inDB->valueSize = inValueSize;
+    inDB->recordSize = inKeySize + inValueSize;
+
+    inDB->bucketSize = computeBucketSize( inDB->recordSize );
+    inDB->recordsPerBucket =
+        ( inDB->bucketSize - MMAPDB_BUCKET_HEADER_SIZE ) / inDB->recordSize;
+
+
+
+    uint64_t fileSize;
+
+    if( getDBFileSize( inDB, &fileSize ) != 0 ) {
+        closeOnError( inDB );
+        return 1;
+        }
+
+
+    if( fileSize < MMAPDB_HEADER_SIZE ) {
+        // file that doesn't even contain the header
+
+        // size file for fresh header and empty primary buckets
+        uint64_t size = getFileSizeForBuckets( inDB, inHashTableSize );
+
+        if( setDBFileSize( inDB, size ) != 0 ) {
+            closeOnError( inDB );
+            return 1;
+            }
+
+        if( mapFile( inDB, size ) != 0 ) {
+            closeOnError( inDB );
+            return 1;
+            }
+
+        memcpy( inDB->map, magicString, 3 );
+        inDB->map[3] = MMAPDB_VERSION;
+
+        *getHeaderField( inDB, MMAPDB_HEADER_TABLE_SIZE ) = inHashTableSize;
+        *getHeaderField( inDB, MMAPDB_HEADER_KEY_SIZE ) = inKeySize;
+        *getHeaderField( inDB, MMAPDB_HEADER_VALUE_SIZE ) = inValueSize;
+        *getHeaderField( inDB, MMAPDB_HEADER_BUCKET_SIZE ) =
+            inDB->bucketSize;
+        *getHeaderField( inDB, MMAPDB_HEADER_NUM_OVERFLOW ) = 0;
+        *getHeaderField( inDB, MMAPDB_HEADER_OVERFLOW_CAPACITY ) = 0;
+
+        return 0;
+        }
+
+
+    // read header
+    if( mapFile( inDB, fileSize ) != 0 ) {
+        closeOnError( inDB );
+        return 1;
+        }
+
+    if( memcmp( inDB->map, magicString, 3 ) != 0 ||
+        inDB->map[3] != MMAPDB_VERSION ) {
+        printf( "Mmapdb magic string '%s' version %d not found at start of "
+                "file header\n", magicString, MMAPDB_VERSION );
+        closeOnError( inDB );
+        return 1;
+        }
+
+    uint32_t val32 = *getHeaderField( inDB, MMAPDB_HEADER_TABLE_SIZE );
+
+    if( val32 != inHashTableSize ) {
+        printf( "Requested mmapdb hash table size of %u does not match "
+                "size of %u in file header\n", inHashTableSize, val32 );
+        closeOnError( inDB );
+        return 1;
+        }
+
+    val32 = *getHeaderField( inDB, MMAPDB_HEADER_KEY_SIZE );
+
+    if( val32 != inKeySize ) {
+        printf( "Requested mmapdb key size of %u does not match "
+                "size of %u in file header\n", inKeySize, val32 );
+        closeOnError( inDB );
+        return 1;
+        }
+
+    val32 = *getHeaderField( inDB, MMAPDB_HEADER_VALUE_SIZE );
+
+    if( val32 != inValueSize ) {
+        printf( "Requested mmapdb value size of %u does not match "
+                "size of %u in file header\n", inValueSize, val32 );
+        closeOnError( inDB );
+        return 1;
+        }
+
+    val32 = *getHeaderField( inDB, MMAPDB_HEADER_BUCKET_SIZE );
+
+    if( val32 != inDB->bucketSize ) {
+        printf( "Mmapdb bucket size of %u in file header does not match "
+                "expected size of %u\n", val32, inDB->bucketSize );
+        closeOnError( inDB );
+        return 1;
+        }
+
+    // got here, header matches
+
+    // make sure all buckets exist in file
+    if( fileSize <
+        getFileSizeForBuckets( inDB, getTotalBuckets( inDB ) ) ) {
+        printf( "mmapdb file contains correct header but is missing "
+                "buckets.\n" );
+        closeOnError( inDB );
+        return 1;
+        }
+
+    return 0;
+    }
+
+
+
+
+int MMAPDB_sync( MMAPDB *inDB ) {
+    if( inDB->map == NULL ) {
+        return -1;
+        }
+    return syncDBMap( inDB );
+    }
+
+
+
+void MMAPDB_close( MMAPDB *inDB ) {
+    if( inDB->map != NULL ) {
+        syncDBMap( inDB );
+        unmapDBFile( inDB->map, inDB->mapSize );
+        inDB->map = NULL;
+        inDB->mapSize = 0;
+        }
+    if( isDBFileOpen( inDB ) ) {
+        closeDBFile( inDB );
+        }
+    }
+
+
+
+static uint64_t getPrimaryBucketIndex( MMAPDB *inDB, const void *inKey ) {
+    return MMAPDB_hash( inKey, inDB->keySize ) %
+        (uint64_t)inDB->hashTableSize;
+    }
+
+
+
+// overflow indices are 1-based, 0 means end of chain
+static uint64_t overflowToBucketIndex( MMAPDB *inDB, uint32_t inOverflow ) {
+    return (uint64_t)inDB->hashTableSize + inOverflow - 1;
+    }
+
+
+
+// returns pointer to record with matching key, or NULL if not found
+static uint8_t *findRecord( MMAPDB *inDB, const void *inKey ) {
+
+    uint8_t *bucket = getBucket( inDB, getPrimaryBucketIndex( inDB, inKey ) );
+
+    while( true ) {
+        uint32_t *bucketHeader = (uint32_t *)bucket;
+
+        uint32_t numRecords = bucketHeader[0];
+
+        uint8_t *record = bucket + MMAPDB_BUCKET_HEADER_SIZE;
+
+        for( uint32_t i=0; i<numRecords; i++ ) {
+            if( memcmp( record, inKey, inDB->keySize ) == 0 ) {
+                return record;
+                }
+            record += inDB->recordSize;
+            }
+
+        uint32_t next = bucketHeader[1];
+
+        if( next == 0 ) {
+            return NULL;
+            }
+        bucket = getBucket( inDB, overflowToBucketIndex( inDB, next ) );
+        }
+    }
+
+
+
+int MMAPDB_get( MMAPDB *inDB, const void *inKey, void *outValue ) {
+    if( inDB->map == NULL ) {
+        return -1;
+        }
+
+    uint8_t *record = findRecord( inDB, inKey );
+
+    if( record == NULL ) {
+        return 1;
+        }
+
+    memcpy( outValue, record + inDB->keySize, inDB->valueSize );
+    return 0;
+    }
+
+
+
+// appends new record to the end of the bucket chain for inKey
+static int insertRecord( MMAPDB *inDB,
+                         const void *inKey, const void *inValue ) {
+
+    uint64_t bucketIndex = getPrimaryBucketIndex( inDB, inKey );
+
+    // records only ever appended, so only the last bucket in the
+    // chain can have free space
+    uint32_t next = ( (uint32_t *)getBucket( inDB, bucketIndex ) )[1];
+
+    while( next != 0 ) {
+        bucketIndex = overflowToBucketIndex( inDB, next );
+        next = ( (uint32_t *)getBucket( inDB, bucketIndex ) )[1];
+        }
+
+    uint32_t numRecords = ( (uint32_t *)getBucket( inDB, bucketIndex ) )[0];
+
+    if( numRecords >= inDB->recordsPerBucket ) {
+        // chain full, link in a new overflow bucket
+
+        uint32_t numOverflow =
+            *getHeaderField( inDB, MMAPDB_HEADER_NUM_OVERFLOW );
+
+        if( numOverflow >=
+            *getHeaderField( inDB, MMAPDB_HEADER_OVERFLOW_CAPACITY ) ) {
+
+            if( growOverflow( inDB ) != 0 ) {
+                return -1;
+                }
+            }
+
+        numOverflow++;
+        *getHeaderField( inDB, MMAPDB_HEADER_NUM_OVERFLOW ) = numOverflow;
+
+        ( (uint32_t *)getBucket( inDB, bucketIndex ) )[1] = numOverflow;
+
+        bucketIndex = overflowToBucketIndex( inDB, numOverflow );
+        numRecords = 0;
+        }
+
+    uint8_t *bucket = getBucket( inDB, bucketIndex );
+
+    uint8_t *record = bucket + MMAPDB_BUCKET_HEADER_SIZE +
+        numRecords * inDB->recordSize;
+
+    memcpy( record, inKey, inDB->keySize );
+    memcpy( record + inDB->keySize, inValue, inDB->valueSize );
+
+    // bump count last, so a torn write leaves record invisible
+    ( (uint32_t *)bucket )[0] = numRecords + 1;
+
+    return 0;
+    }
+
+
+
+int MMAPDB_put( MMAPDB *inDB, const void *inKey, const void *inValue ) {
+    if( inDB->map == NULL ) {
+        return -1;
+        }
+
+    uint8_t *record = findRecord( inDB, inKey );
+
+    if( record != NULL ) {
+        // hit
+        // replace value
+        memcpy( record + inDB->keySize, inValue, inDB->valueSize );
+        return 0;
+        }
+
+    return insertRecord( inDB, inKey, inValue );
+    }
+
+
+
+int MMAPDB_put_new( MMAPDB *inDB, const void *inKey, const void *inValue ) {
+    if( inDB->map == NULL ) {
+        return -1;
+        }
+
+    return insertRecord( inDB, inKey, inValue );
+    }
+
+
+
+
+
+void MMAPDB_Iterator_init( MMAPDB *inDB, MMAPDB_Iterator *inDBi ) {
+    inDBi->db = inDB;
+    inDBi->bucket = 0;
+    inDBi->record = 0;
+    }
+
+
+
+int MMAPDB_Iterator_next( MMAPDB_Iterator *inDBi,
+                          void *outKey, void *outValue ) {
+
+    MMAPDB *db = inDBi->db;
+
+    if( db->map == NULL ) {
+        return -1;
+        }
+
+    uint64_t numBuckets =
+        (uint64_t)db->hashTableSize +
+        *getHeaderField( db, MMAPDB_HEADER_NUM_OVERFLOW );
+
+    while( inDBi->bucket < numBuckets ) {
+        uint8_t *bucket = getBucket( db, inDBi->bucket );
+
+        uint32_t numRecords = ( (uint32_t *)bucket )[0];
+
+        if( inDBi->record < numRecords ) {
+            uint8_t *record = bucket + MMAPDB_BUCKET_HEADER_SIZE +
+                inDBi->record * db->recordSize;
+
+            memcpy( outKey, record, db->keySize );
+            memcpy( outValue, record + db->keySize, db->valueSize );
+
+            inDBi->record ++;
+            return 1;
+            }
+
+        inDBi->bucket ++;
+        inDBi->record = 0;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,156 @@
+#include <stdint.h>
+#include <stdio.h>
+
+
+// Memory-mapped hash database, with the same API as KISSDB and STACKDB.
+//
+// The whole file is mapped into memory, so gets and puts are plain memory
+// accesses instead of fseek/fread calls (the OS pages data in and out).
+//
+// File layout:
+//    header page (MMAPDB_HEADER_SIZE bytes)
+//    hashTableSize primary buckets
+//    overflow buckets, appended as needed
+//
+// Each bucket is a power-of-two number of bytes no larger than a page,
+// so that buckets never straddle a page boundary (or a whole number of
+// pages, for records too big to fit in one page).  A bucket holds
+// a record count, the index of the next overflow bucket in its chain,
+// and then a packed array of key/value records.
+//
+// If growing the file fails, the old map is kept, and the put that needed
+// the space returns -1.  Gets and puts on a database that is not open
+// (or failed to open) return -1.
+//
+// Uses mmap, or a file mapping on Windows.
+
+
+typedef struct {
+        unsigned int hashTableSize;
+        unsigned int keySize;
+        unsigned int valueSize;
+
+        // keySize + valueSize
+        unsigned int recordSize;
+
+        // bytes per bucket, including bucket header
+        unsigned int bucketSize;
+        unsigned int recordsPerBucket;
+
+#ifdef _WIN32
+        // file HANDLE, NULL if not open
+        void *fileHandle;
+#else
+        int fd;
+#endif
+
+        uint8_t *map;
+        uint64_t mapSize;
+    } MMAPDB;
+
+
+
+
+/**
+ * Open database
+ *
+ * The three _size parameters must be specified if the database could
+ * be created or re-created. Otherwise an error will occur. If the
+ * database already exists, these parameters must match those in the
+ * file header.
+ *
+ * @param db Database struct
+ * @param path Path to file
+ * @param inMode is ignored, and always opened in RW-create mode
+ *   (left for compatibility with KISSDB api)
+ * @param hash_table_size Number of primary buckets (must be >0)
+ * @param key_size Size of keys in bytes
+ * @param value_size Size of values in bytes
+ * @return 0 on success, nonzero on error
+ */
+int MMAPDB_open(
+    MMAPDB *inDB,
+    const char *inPath,
+    int inMode,
+    unsigned int inHashTableSize,
+    unsigned int inKeySize,
+    unsigned int inValueSize );
+
+/**
+ * Close database
+ *
+ * @param db Database struct
+ */
+void MMAPDB_close( MMAPDB *inDB );
+
+
+/**
+ * Flush all writes through to disk
+ *
+ * @param db Database struct
+ * @return 0 on success, nonzero on error
+ */
+int MMAPDB_sync( MMAPDB *inDB );
+
+/**
+ * Get an entry
+ *
+ * @param db Database struct
+ * @param key Key (key_size bytes)
+ * @param vbuf Value buffer (value_size bytes capacity)
+ * @return -1 on I/O error, 0 on success, 1 on not found
+ */
+int MMAPDB_get( MMAPDB *inDB, const void *inKey, void *outValue );
+
+/**
+ * Put an entry (overwriting it if it already exists)
+ *
+ * In the already-exists case the size of the database file does not
+ * change.
+ *
+ * @param db Database struct
+ * @param key Key (key_size bytes)
+ * @param value Value (value_size bytes)
+ * @return -1 on I/O error, 0 on success
+ */
+int MMAPDB_put( MMAPDB *inDB, const void *inKey, const void *inValue );
+
+
+
+// version of put where caller guarantees that inKey does not exist
+// in database yet
+//
+// Skips the search through the bucket chain for an existing record.
+int MMAPDB_put_new( MMAPDB *inDB, const void *inKey, const void *inValue );
+
+
+/**
+ * Cursor used for iterating over all entries in database
+ */
+typedef struct {
+        MMAPDB *db;
+        unsigned int bucket;
+        unsigned int record;
+} MMAPDB_Iterator;
+
+/**
+ * Initialize an iterator
+ *
+ * @param db Database struct
+ * @param i Iterator to initialize
+ */
+void MMAPDB_Iterator_init( MMAPDB *inDB, MMAPDB_Iterator *inDBi );
+
+/**
+ * Get the next entry
+ *
+ * The order of entries returned by iterator is undefined. It depends on
+ * how keys hash.
+ *
+ * @param Database iterator
+ * @param kbuf Buffer to fill with next key (key_size bytes)
+ * @param vbuf Buffer to fill with next value (value_size bytes)
+ * @return 0 if there are no more entries, negative on error, positive if an kbuf/vbuf have been filled
+ */
+int MMAPDB_Iterator_next( MMAPDB_Iterator *inDBi,
+                          void *outKey, void *outValue );
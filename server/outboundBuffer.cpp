@@ -0,0 +1,404 @@
+#include "outboundBuffer.h"
+
+#include "minorGems/system/Time.h"
+#include "minorGems/util/stringUtils.h"
+
+#include <string.h>
+#include <errno.h>
+
+#ifndef WIN_32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+
+
+#define INITIAL_CAPACITY 4096
+
+// buffers that grew past this for a burst are shrunk again once drained
+#define SHRINK_CAPACITY 65536
+
+
+
+static OutboundStats stats = { 0, 0, 0, 0, 0 };
+
+
+
+#ifndef WIN_32
+
+// socket descriptor, same way SocketUnix gets it
+static int getSocketDescriptor( Socket *inSock ) {
+    int *socketIDptr = (int *)( inSock->mNativeObjectPointer );
+    return socketIDptr[0];
+    }
+
+
+
+// sends pieces with one gathered, non-blocking call
+// returns number of bytes sent (0 if socket buffer full), or -1 on error
+static int sendPieces( Socket *inSock, unsigned char **inPieces, 
+                       int *inLengths, int inNumPieces ) {
+    struct iovec pieces[2];
+    
+    for( int i=0; i<inNumPieces; i++ ) {
+        pieces[i].iov_base = inPieces[i];
+        pieces[i].iov_len = inLengths[i];
+        }
+    
+    struct msghdr header;
+    memset( &header, 0, sizeof( header ) );
+    header.msg_iov = pieces;
+    header.msg_iovlen = inNumPieces;
+
+    // sendmsg rather than writev, because socket itself is blocking
+    // and we need per-call MSG_DONTWAIT, like Socket::send uses
+    int numSent;
+
+    do {
+        numSent = sendmsg( getSocketDescriptor( inSock ), &header,
+                           MSG_DONTWAIT | MSG_NOSIGNAL );
+        } while( numSent == -1 && errno == EINTR );
+
+    if( numSent == -1 ) {
+        if( errno == EAGAIN || errno == EWOULDBLOCK ) {
+            // socket buffer full, try again next flush
+            return 0;
+            }
+        return -1;
+        }
+    
+    return numSent;
+    }
+
+#else
+
+// no gathered send in Socket, so one non-blocking Socket::send per piece
+static int sendPieces( Socket *inSock, unsigned char **inPieces, 
+                       int *inLengths, int inNumPieces ) {
+    int numSent = 0;
+    
+    for( int i=0; i<inNumPieces; i++ ) {
+        int result = inSock->send( inPieces[i], inLengths[i], false, false );
+        
+        if( result == -2 ) {
+            // socket buffer full, try again next flush
+            return numSent;
+            }
+        if( result < 0 ) {
+            return -1;
+            }
+        
+        numSent += result;
+        
+        if( result < inLengths[i] ) {
+            return numSent;
+            }
+        }
+    
+    return numSent;
+    }
+
+#endif
+
+
+
+OutboundBuffer::OutboundBuffer( Socket *inSock,
+                                int inHighWatermark,
+                                int inLowWatermark )
+        : mSock( inSock ),
+          mHighWatermark( inHighWatermark ),
+          mLowWatermark( inLowWatermark ),
+          mData( NULL ),
+          mCapacity( 0 ),
+          mStart( 0 ),
+          mNumQueued( 0 ),
+          mFirstQueuedTime( 0 ),
+          mFailed( false ),
+          mNumHeldBytes( 0 ),
+          mNumRejectedBytes( 0 ) {
+
+    setCapacity( INITIAL_CAPACITY );
+
+#ifndef WIN_32
+    // we do our own coalescing, so don't let TCP hold back what we flush
+    // (Socket::send turned this on for each no-delay send before,
+    //  and still does on Windows, where each flush goes through it)
+    int flag = 1;
+    setsockopt( getSocketDescriptor( mSock ), IPPROTO_TCP, TCP_NODELAY,
+                &flag, sizeof( flag ) );
+#endif
+    }
+
+
+
+OutboundBuffer::~OutboundBuffer() {
+    stats.bytesDropped += getNumDropped();
+
+    delete [] mData;
+
+    for( int i=0; i<mHeld.size(); i++ ) {
+        HeldMessage *h = mHeld.getElement( i );
+
+        delete [] h->data;
+
+        if( h->job != NULL ) {
+            releaseCompressionJob( h->job );
+            }
+        }
+    }
+
+
+
+void OutboundBuffer::setCapacity( int inCapacity ) {
+    unsigned char *newData = new unsigned char[ inCapacity ];
+
+    // unwrap into start of new buffer
+    int firstPart = mNumQueued;
+    if( mStart + firstPart > mCapacity ) {
+        firstPart = mCapacity - mStart;
+        }
+
+    if( firstPart > 0 ) {
+        memcpy( newData, &( mData[ mStart ] ), firstPart );
+        }
+    if( mNumQueued > firstPart ) {
+        memcpy( &( newData[ firstPart ] ), mData, mNumQueued - firstPart );
+        }
+
+    if( mData != NULL ) {
+        delete [] mData;
+        }
+
+    mData = newData;
+    mCapacity = inCapacity;
+    mStart = 0;
+    }
+
+
+
+char OutboundBuffer::queue( unsigned char *inMessage, int inLength ) {
+    if( mFailed ||
+        mNumQueued + mNumHeldBytes + inLength > mHighWatermark ) {
+        mNumRejectedBytes += inLength;
+        return false;
+        }
+
+    if( mHeld.size() > 0 ) {
+        // wait behind earlier message that's still compressing
+        HeldMessage h;
+        h.job = NULL;
+        h.data = new unsigned char[ inLength ];
+        h.length = inLength;
+
+        memcpy( h.data, inMessage, inLength );
+
+        mHeld.push_back( h );
+        mNumHeldBytes += inLength;
+        return true;
+        }
+
+    addToRing( inMessage, inLength );
+
+    return true;
+    }
+
+
+
+char OutboundBuffer::queueCompressed( const char *inHeaderPrefix,
+                                      CompressionJob *inJob ) {
+    if( mFailed ||
+        mNumQueued + mNumHeldBytes + inJob->rawLength > mHighWatermark ) {
+        mNumRejectedBytes += inJob->rawLength;
+        return false;
+        }
+
+    HeldMessage h;
+    h.job = inJob;
+    h.data = (unsigned char*)stringDuplicate( inHeaderPrefix );
+    h.length = strlen( inHeaderPrefix );
+
+    addCompressionJobReference( inJob );
+
+    mHeld.push_back( h );
+    mNumHeldBytes += inJob->rawLength;
+
+    // goes right into ring if job already done and nothing held before it
+    releaseHeld();
+
+    return true;
+    }
+
+
+
+void OutboundBuffer::releaseHeld() {
+    while( mHeld.size() > 0 ) {
+        HeldMessage *h = mHeld.getElement( 0 );
+
+        if( h->job == NULL ) {
+            addToRing( h->data, h->length );
+            mNumHeldBytes -= h->length;
+            }
+        else if( h->job->done ) {
+            CompressionJob *job = h->job;
+
+            char *sizes = autoSprintf( "%d %d\n#", job->rawLength,
+                                       job->compressedLength );
+
+            addToRing( h->data, h->length );
+            addToRing( (unsigned char*)sizes, strlen( sizes ) );
+            addToRing( job->compressedData, job->compressedLength );
+
+            delete [] sizes;
+
+            mNumHeldBytes -= job->rawLength;
+
+            releaseCompressionJob( job );
+            }
+        else {
+            // still compressing, it and everything after wait
+            return;
+            }
+
+        delete [] h->data;
+        mHeld.deleteElement( 0 );
+        }
+    }
+
+
+
+void OutboundBuffer::addToRing( unsigned char *inMessage, int inLength ) {
+    if( mNumQueued + inLength > mCapacity ) {
+        int newCapacity = mCapacity;
+
+        while( newCapacity < mNumQueued + inLength ) {
+            newCapacity *= 2;
+            }
+        setCapacity( newCapacity );
+        }
+
+    if( mNumQueued == 0 ) {
+        mFirstQueuedTime = Time::getCurrentTime();
+        }
+
+    int mask = mCapacity - 1;
+    int end = ( mStart + mNumQueued ) & mask;
+
+    int firstPart = inLength;
+    if( end + firstPart > mCapacity ) {
+        firstPart = mCapacity - end;
+        }
+
+    memcpy( &( mData[ end ] ), inMessage, firstPart );
+
+    if( inLength > firstPart ) {
+        memcpy( mData, &( inMessage[ firstPart ] ), inLength - firstPart );
+        }
+
+    mNumQueued += inLength;
+
+    stats.bytesQueued += inLength;
+    }
+
+
+
+double OutboundBuffer::getTimeUntilFlush( double inCoalesceSeconds ) {
+    if( mNumQueued == 0 || mFailed ) {
+        return -1;
+        }
+
+    if( mNumQueued > mLowWatermark ) {
+        return 0;
+        }
+
+    double timeLeft =
+        mFirstQueuedTime + inCoalesceSeconds - Time::getCurrentTime();
+
+    if( timeLeft < 0 ) {
+        timeLeft = 0;
+        }
+    return timeLeft;
+    }
+
+
+
+int OutboundBuffer::flush( double inCoalesceSeconds ) {
+    if( mFailed ) {
+        return -1;
+        }
+
+    releaseHeld();
+
+    if( getTimeUntilFlush( inCoalesceSeconds ) != 0 ) {
+        // nothing to send, or waiting for more
+        return 0;
+        }
+
+
+    // at most two pieces, if data wraps around end of ring
+    unsigned char *pieces[2];
+    int pieceLengths[2];
+    int numPieces = 1;
+
+    int firstPart = mNumQueued;
+    if( mStart + firstPart > mCapacity ) {
+        firstPart = mCapacity - mStart;
+        }
+
+    pieces[0] = &( mData[ mStart ] );
+    pieceLengths[0] = firstPart;
+
+    if( mNumQueued > firstPart ) {
+        pieces[1] = mData;
+        pieceLengths[1] = mNumQueued - firstPart;
+        numPieces = 2;
+        }
+
+    int numSent = sendPieces( mSock, pieces, pieceLengths, numPieces );
+
+    stats.sendCalls++;
+
+    if( numSent == -1 ) {
+        mFailed = true;
+        return -1;
+        }
+
+    mStart = ( mStart + numSent ) & ( mCapacity - 1 );
+    mNumQueued -= numSent;
+
+    stats.bytesSent += numSent;
+
+    if( mNumQueued == 0 ) {
+        mStart = 0;
+
+        if( mCapacity > SHRINK_CAPACITY ) {
+            setCapacity( INITIAL_CAPACITY );
+            }
+        }
+    else {
+        // rest waits for next flush, which is due right away
+        mFirstQueuedTime = 0;
+        }
+
+    if( mNumQueued > stats.maxBacklog ) {
+        stats.maxBacklog = mNumQueued;
+        }
+
+    return numSent;
+    }
+
+
+
+OutboundStats getOutboundStats() {
+    OutboundStats s = stats;
+
+    stats.bytesQueued = 0;
+    stats.bytesSent = 0;
+    stats.sendCalls = 0;
+    stats.maxBacklog = 0;
+    stats.bytesDropped = 0;
+
+    return s;
+    }
@@ -0,0 +1,167 @@
+#ifndef OUTBOUND_BUFFER_H_INCLUDED
+#define OUTBOUND_BUFFER_H_INCLUDED
+
+
+#include "minorGems/network/Socket.h"
+#include "minorGems/util/SimpleVector.h"
+
+#include "compressionPool.h"
+
+
+
+// Per-connection ring buffer of outbound bytes.
+//
+// Messages are queued during a server step and flushed together with
+// one gathered, non-blocking send, instead of one send call per message.
+// Whatever the socket won't take right away stays queued for the next
+// flush, so a client on a briefly congested link isn't dropped for a
+// single short write.  Only a backlog past the high watermark counts as
+// a failure.
+//
+// A message whose payload is still being compressed is held, along with
+// everything queued after it, until the payload is done, so messages
+// always go out in the order they were queued.
+class OutboundBuffer {
+
+    public:
+
+        // Buffer is flushed to inSock, which it does not own.
+        //
+        // inHighWatermark is the most bytes that can be waiting.
+        //
+        // Backlogs above inLowWatermark are flushed right away, even
+        // inside the coalescing window.
+        OutboundBuffer( Socket *inSock,
+                        int inHighWatermark,
+                        int inLowWatermark );
+
+        ~OutboundBuffer();
+
+
+        // copies message to end of buffer
+        // returns false if this would put backlog over high watermark
+        // (message not queued in that case)
+        char queue( unsigned char *inMessage, int inLength );
+
+
+        // queues message made of inHeaderPrefix, then
+        // "rawLength compressedLength\n#", then compressed payload
+        //
+        // Adds a reference to inJob, released once message goes into
+        // buffer.
+        //
+        // returns false if this would put backlog over high watermark
+        // (counting raw length of payload)
+        char queueCompressed( const char *inHeaderPrefix,
+                              CompressionJob *inJob );
+
+
+        // sends as much as the socket will take without blocking
+        //
+        // Waits to coalesce more messages if oldest queued byte is younger
+        // than inCoalesceSeconds and backlog is under low watermark.
+        //
+        // returns number of bytes sent, or -1 on socket error
+        int flush( double inCoalesceSeconds = 0 );
+
+
+        // not counting held messages
+        int getNumQueued() {
+            return mNumQueued;
+            }
+
+
+        int getNumHeld() {
+            return mHeld.size();
+            }
+
+
+        // seconds until a coalesced flush is due, 0 if due now,
+        // or -1 if nothing queued
+        double getTimeUntilFlush( double inCoalesceSeconds );
+
+
+        char hasFailed() {
+            return mFailed;
+            }
+
+
+        // bytes that will never go out if buffer is destroyed now:
+        // everything still queued or held, plus messages that were
+        // refused by queue calls
+        // (counting raw length for compressed payloads)
+        int getNumDropped() {
+            return mNumQueued + mNumHeldBytes + mNumRejectedBytes;
+            }
+
+
+    private:
+
+        Socket *mSock;
+
+        int mHighWatermark;
+        int mLowWatermark;
+
+        // ring of bytes, capacity always a power of 2
+        unsigned char *mData;
+        int mCapacity;
+
+        int mStart;
+        int mNumQueued;
+
+        // when buffer last went from empty to non-empty
+        double mFirstQueuedTime;
+
+        char mFailed;
+
+
+        typedef struct HeldMessage {
+                // NULL for plain message
+                CompressionJob *job;
+
+                // message, or header prefix if job set
+                unsigned char *data;
+                int length;
+            } HeldMessage;
+
+        SimpleVector<HeldMessage> mHeld;
+
+        // counting raw length for compressed payloads
+        int mNumHeldBytes;
+
+        int mNumRejectedBytes;
+
+
+        void setCapacity( int inCapacity );
+
+        // copies into ring, no watermark check
+        void addToRing( unsigned char *inMessage, int inLength );
+
+        // moves held messages into ring, up to first one with
+        // payload still compressing
+        void releaseHeld();
+
+    };
+
+
+
+// totals over all buffers, for logging
+typedef struct OutboundStats {
+        double bytesQueued;
+        double bytesSent;
+        int sendCalls;
+
+        // largest backlog seen after a flush
+        int maxBacklog;
+
+        // unsent when buffers were destroyed
+        double bytesDropped;
+    } OutboundStats;
+
+
+// resets stats after returning them
+OutboundStats getOutboundStats();
+
+
+
+#endif
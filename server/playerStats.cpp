@@ -1,8 +1,38 @@
 #include "playerStats.h"
 
 #include "kissdb.h"
+#include "stackdb.h"
+#include "mmapdb.h"
 #include "dbCommon.h"
 
+
+// pick DB backend at build time
+// playerStats.db has always been a KISSDB file, so keep that as default
+
+/**/
+#define DB KISSDB
+#define DB_open KISSDB_open
+#define DB_close KISSDB_close
+#define DB_get KISSDB_get
+#define DB_put KISSDB_put
+/**/
+
+/*
+#define DB STACKDB
+#define DB_open STACKDB_open
+#define DB_close STACKDB_close
+#define DB_get STACKDB_get
+#define DB_put STACKDB_put
+*/
+
+/*
+#define DB MMAPDB
+#define DB_open MMAPDB_open
+#define DB_close MMAPDB_close
+#define DB_get MMAPDB_get
+#define DB_put MMAPDB_put
+*/
+
 #include "minorGems/util/log/AppLog.h"
 #include "minorGems/util/SettingsManager.h"
 #include "minorGems/util/SimpleVector.h"
@@ -14,7 +44,7 @@
 
 
 
-static KISSDB db;
+static DB db;
 static char dbOpen = false;
 
 static char useStatsServer = false;
@@ -37,7 +67,7 @@ static SimpleVector<StatRecord> records;
 
 
 void initPlayerStats() {
-    int error = KISSDB_open( &db, 
+    int error = DB_open( &db, 
                              "playerStats.db", 
                              KISSDB_OPEN_MODE_RWCREAT,
                              80000,
@@ -70,7 +100,7 @@ void initPlayerStats() {
 
 void freePlayerStats() {
     if( dbOpen ) {
-        KISSDB_close( &db );
+        DB_close( &db );
         dbOpen = false;
         }    
 
@@ -103,7 +133,7 @@ int getPlayerLifeStats( char *inEmail, int *outNumLives,
 
     emailToKey( inEmail, key );
     
-    int result = KISSDB_get( &db, key, value );
+    int result = DB_get( &db, key, value );
     
     if( result == 0 ) {
         // found
@@ -139,7 +169,7 @@ void recordPlayerLifeStats( char *inEmail, int inNumSecondsLived ) {
     intToValue( numSec, &( value[4] ) );
             
     
-    KISSDB_put( &db, key, value );
+    DB_put( &db, key, value );
 
     if( useStatsServer ) {
         
@@ -0,0 +1,219 @@
+#include "readySocketPoll.h"
+
+#include "minorGems/util/log/AppLog.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+
+
+// most events taken per wake
+// any more stay queued in kernel and come back right away on next wait
+#define MAX_EVENTS_PER_WAKE 256
+
+
+
+#ifdef __linux__
+
+
+
+// socket descriptor, same way SocketUnix gets it
+static int getDescriptor( void *inNativeObjectPointer ) {
+    int *socketIDptr = (int *)( inNativeObjectPointer );
+    return socketIDptr[0];
+    }
+
+
+
+ReadySocketPoll::ReadySocketPoll()
+        : mNumWakeups( 0 ),
+          mNumReadyEvents( 0 ) {
+
+    mEpollFD = epoll_create1( EPOLL_CLOEXEC );
+
+    if( mEpollFD == -1 ) {
+        AppLog::errorF( "epoll_create1 failed:  %s", strerror( errno ) );
+        }
+    }
+
+
+
+ReadySocketPoll::~ReadySocketPoll() {
+    for( int i=0; i<mEntries.size(); i++ ) {
+        delete mEntries.getElementDirect( i );
+        }
+
+    if( mEpollFD != -1 ) {
+        close( mEpollFD );
+        }
+    }
+
+
+
+void ReadySocketPoll::addSocketServer( SocketServer *inServer ) {
+    struct epoll_event e;
+    e.events = EPOLLIN | EPOLLET;
+    e.data.ptr = &mServerTag;
+
+    epoll_ctl( mEpollFD, EPOLL_CTL_ADD,
+               getDescriptor( inServer->mNativeObjectPointer ), &e );
+    }
+
+
+
+ReadySocketEntry *ReadySocketPoll::addSocket( Socket *inSock ) {
+    ReadySocketEntry *entry = new ReadySocketEntry;
+    entry->sock = inSock;
+    entry->ready = true;
+
+    struct epoll_event e;
+    e.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    e.data.ptr = entry;
+
+    epoll_ctl( mEpollFD, EPOLL_CTL_ADD,
+               getDescriptor( inSock->mNativeObjectPointer ), &e );
+
+    mEntries.push_back( entry );
+
+    return entry;
+    }
+
+
+
+void ReadySocketPoll::removeSocket( ReadySocketEntry *inEntry ) {
+    // event arg ignored, but must be non-NULL on old kernels
+    struct epoll_event e;
+
+    epoll_ctl( mEpollFD, EPOLL_CTL_DEL,
+               getDescriptor( inEntry->sock->mNativeObjectPointer ), &e );
+
+    mEntries.deleteElementEqualTo( inEntry );
+    delete inEntry;
+    }
+
+
+
+char ReadySocketPoll::wait( int inTimeoutMS ) {
+    struct epoll_event events[ MAX_EVENTS_PER_WAKE ];
+
+    int numEvents = epoll_wait( mEpollFD, events, MAX_EVENTS_PER_WAKE,
+                                inTimeoutMS );
+
+    if( numEvents <= 0 ) {
+        // timeout, or interrupted by a signal
+        return false;
+        }
+
+    mNumWakeups++;
+    mNumReadyEvents += numEvents;
+
+    char serverReady = false;
+
+    for( int i=0; i<numEvents; i++ ) {
+        if( events[i].data.ptr == &mServerTag ) {
+            serverReady = true;
+            }
+        else {
+            ( (ReadySocketEntry*)( events[i].data.ptr ) )->ready = true;
+            }
+        }
+
+    return serverReady;
+    }
+
+
+
+#else
+
+
+
+ReadySocketPoll::ReadySocketPoll()
+        : mNumWakeups( 0 ),
+          mNumReadyEvents( 0 ),
+          mPoll( new SocketPoll() ) {
+    }
+
+
+
+ReadySocketPoll::~ReadySocketPoll() {
+    for( int i=0; i<mEntries.size(); i++ ) {
+        delete mEntries.getElementDirect( i );
+        }
+    delete mPoll;
+    }
+
+
+
+void ReadySocketPoll::addSocketServer( SocketServer *inServer ) {
+    mPoll->addSocketServer( inServer );
+    }
+
+
+
+ReadySocketEntry *ReadySocketPoll::addSocket( Socket *inSock ) {
+    ReadySocketEntry *entry = new ReadySocketEntry;
+    entry->sock = inSock;
+    entry->ready = true;
+
+    mPoll->addSocket( inSock );
+
+    mEntries.push_back( entry );
+
+    return entry;
+    }
+
+
+
+void ReadySocketPoll::removeSocket( ReadySocketEntry *inEntry ) {
+    mPoll->removeSocket( inEntry->sock );
+
+    mEntries.deleteElementEqualTo( inEntry );
+    delete inEntry;
+    }
+
+
+
+char ReadySocketPoll::wait( int inTimeoutMS ) {
+    SocketOrServer *readySock = mPoll->wait( inTimeoutMS );
+
+    if( readySock == NULL ) {
+        return false;
+        }
+
+    mNumWakeups++;
+    mNumReadyEvents++;
+
+    if( ! readySock->isSocket ) {
+        return true;
+        }
+
+    // don't know which others are ready too
+    for( int i=0; i<mEntries.size(); i++ ) {
+        mEntries.getElementDirect( i )->ready = true;
+        }
+    return false;
+    }
+
+
+
+#endif
+
+
+
+int ReadySocketPoll::getAndResetNumWakeups() {
+    int n = mNumWakeups;
+    mNumWakeups = 0;
+    return n;
+    }
+
+
+
+int ReadySocketPoll::getAndResetNumReadyEvents() {
+    int n = mNumReadyEvents;
+    mNumReadyEvents = 0;
+    return n;
+    }
@@ -0,0 +1,87 @@
+#ifndef READY_SOCKET_POLL_H_INCLUDED
+#define READY_SOCKET_POLL_H_INCLUDED
+
+
+#include "minorGems/network/Socket.h"
+#include "minorGems/network/SocketServer.h"
+#include "minorGems/network/SocketPoll.h"
+#include "minorGems/util/SimpleVector.h"
+
+
+
+typedef struct ReadySocketEntry {
+        Socket *sock;
+
+        // set when data (or a hangup) has arrived on sock
+        // caller clears it after reading everything waiting
+        char ready;
+    } ReadySocketEntry;
+
+
+
+// Waits for activity on a server socket and many client sockets, and
+// reports every socket that became ready in one wake, so that the main
+// loop only has to read from those.
+//
+// On Linux, this is edge-triggered epoll:  one epoll_wait per wake, and
+// a socket is only reported again after new data arrives, so callers
+// must read everything waiting each time a socket is ready.
+//
+// Elsewhere, falls back on SocketPoll, and any socket activity marks
+// all sockets as ready.
+class ReadySocketPoll {
+
+    public:
+
+        ReadySocketPoll();
+
+        ~ReadySocketPoll();
+
+
+        void addSocketServer( SocketServer *inServer );
+
+
+        // starts watching a socket
+        // entry starts out ready, in case data arrived before now
+        ReadySocketEntry *addSocket( Socket *inSock );
+
+
+        // stops watching, and destroys entry
+        // must be called before socket is destroyed
+        void removeSocket( ReadySocketEntry *inEntry );
+
+
+        // waits up to inTimeoutMS for activity, marking sockets that
+        // have some as ready
+        //
+        // returns true if server socket has connections waiting to be
+        // accepted (callers must accept all of them)
+        char wait( int inTimeoutMS );
+
+
+        // counts since last call, reset after returning
+        int getAndResetNumWakeups();
+        int getAndResetNumReadyEvents();
+
+
+    private:
+
+        SimpleVector<ReadySocketEntry*> mEntries;
+
+        int mNumWakeups;
+        int mNumReadyEvents;
+
+#ifdef __linux__
+        int mEpollFD;
+
+        // address used to tag server socket's events
+        char mServerTag;
+#else
+        SocketPoll *mPoll;
+#endif
+
+    };
+
+
+
+#endif
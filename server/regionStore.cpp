@@ -0,0 +1,388 @@
+#include "regionStore.h"
+
+#include "kissdb.h"
+#include "stackdb.h"
+#include "mmapdb.h"
+#include "dbCommon.h"
+
+#include "minorGems/util/log/AppLog.h"
+#include "minorGems/io/file/File.h"
+
+#include <string.h>
+
+
+
+/**/
+#define DB STACKDB
+#define DB_open STACKDB_open
+#define DB_close STACKDB_close
+#define DB_get STACKDB_get
+#define DB_put STACKDB_put
+/**/
+
+/*
+#define DB MMAPDB
+#define DB_open MMAPDB_open
+#define DB_close MMAPDB_close
+#define DB_get MMAPDB_get
+#define DB_put MMAPDB_put
+*/
+
+
+
+static const char *regionDBName = "mapRegion.db";
+
+// present only while region DB is known to match per-cell DBs
+// (written on clean shutdown, removed at startup)
+static const char *regionCleanFlagName = "mapRegionClean.txt";
+
+
+static DB regionDB;
+static char regionDBOpen = false;
+
+static RegionCellLoader cellLoader = NULL;
+
+
+// bump this if RegionCell encoding changes
+#define REGION_RECORD_VERSION 1
+
+// four ints and three 64-bit doubles
+#define REGION_CELL_BYTES 40
+
+#define REGION_RECORD_BYTES ( 4 + REGION_CELLS * REGION_CELL_BYTES )
+
+
+
+// optimization:
+// cache whole regions in RAM
+
+// 10 MB of RAM for this.
+#define REGION_CACHE_SIZE 1024
+
+typedef struct RegionCacheRecord {
+        int regionX, regionY;
+        char valid;
+        char dirty;
+        RegionCell cells[ REGION_CELLS ];
+    } RegionCacheRecord;
+
+static RegionCacheRecord regionCache[ REGION_CACHE_SIZE ];
+
+
+static RegionStoreStats stats = { 0, 0, 0, 0 };
+
+
+
+#define CACHE_PRIME_A 776509273
+#define CACHE_PRIME_B 904124281
+
+static int computeRegionCacheHash( int inRegionX, int inRegionY ) {
+
+    int hashKey = ( inRegionX * CACHE_PRIME_A +
+                    inRegionY * CACHE_PRIME_B ) % REGION_CACHE_SIZE;
+    if( hashKey < 0 ) {
+        hashKey += REGION_CACHE_SIZE;
+        }
+    return hashKey;
+    }
+
+
+
+// floor division, so that negative coordinates map to the right region
+static int cellToRegion( int inV ) {
+    if( inV >= 0 ) {
+        return inV / REGION_D;
+        }
+    return ( inV - REGION_D + 1 ) / REGION_D;
+    }
+
+
+
+static int cellIndexInRegion( int inX, int inY ) {
+    int localX = inX - cellToRegion( inX ) * REGION_D;
+    int localY = inY - cellToRegion( inY ) * REGION_D;
+
+    return localY * REGION_D + localX;
+    }
+
+
+
+static void regionToKey( int inRegionX, int inRegionY,
+                         unsigned char *outKey ) {
+    intToValue( inRegionX, &( outKey[0] ) );
+    intToValue( inRegionY, &( outKey[4] ) );
+    }
+
+
+
+static void encodeRegion( RegionCacheRecord *inRecord,
+                          unsigned char *outValue ) {
+    intToValue( REGION_RECORD_VERSION, outValue );
+
+    unsigned char *v = &( outValue[4] );
+
+    for( int i=0; i<REGION_CELLS; i++ ) {
+        RegionCell *c = &( inRecord->cells[i] );
+
+        intToValue( c->object, &( v[0] ) );
+        intToValue( c->numContained, &( v[4] ) );
+        intToValue( c->noDecay, &( v[8] ) );
+        intToValue( c->floor, &( v[12] ) );
+
+        // times stored in whatever binary format "double" on the
+        // server platform uses, same as other time DBs
+        memcpy( &( v[16] ), &( c->objectEta ), 8 );
+        memcpy( &( v[24] ), &( c->floorEta ), 8 );
+        memcpy( &( v[32] ), &( c->lookTime ), 8 );
+
+        v += REGION_CELL_BYTES;
+        }
+    }
+
+
+
+// returns false if record is from a different version
+static char decodeRegion( unsigned char *inValue,
+                          RegionCacheRecord *outRecord ) {
+    if( valueToInt( inValue ) != REGION_RECORD_VERSION ) {
+        return false;
+        }
+
+    unsigned char *v = &( inValue[4] );
+
+    for( int i=0; i<REGION_CELLS; i++ ) {
+        RegionCell *c = &( outRecord->cells[i] );
+
+        c->object = valueToInt( &( v[0] ) );
+        c->numContained = valueToInt( &( v[4] ) );
+        c->noDecay = valueToInt( &( v[8] ) );
+        c->floor = valueToInt( &( v[12] ) );
+
+        memcpy( &( c->objectEta ), &( v[16] ), 8 );
+        memcpy( &( c->floorEta ), &( v[24] ), 8 );
+        memcpy( &( c->lookTime ), &( v[32] ), 8 );
+
+        v += REGION_CELL_BYTES;
+        }
+    return true;
+    }
+
+
+
+static void writeRegion( RegionCacheRecord *inRecord ) {
+    unsigned char key[8];
+    unsigned char value[ REGION_RECORD_BYTES ];
+
+    regionToKey( inRecord->regionX, inRecord->regionY, key );
+    encodeRegion( inRecord, value );
+
+    DB_put( &regionDB, key, value );
+
+    inRecord->dirty = false;
+    stats.regionsWritten++;
+    }
+
+
+
+static void loadRegion( int inRegionX, int inRegionY,
+                        RegionCacheRecord *outRecord ) {
+
+    outRecord->regionX = inRegionX;
+    outRecord->regionY = inRegionY;
+    outRecord->valid = true;
+    outRecord->dirty = false;
+
+    unsigned char key[8];
+    unsigned char value[ REGION_RECORD_BYTES ];
+
+    regionToKey( inRegionX, inRegionY, key );
+
+    int result = DB_get( &regionDB, key, value );
+
+    if( result == 0 && decodeRegion( value, outRecord ) ) {
+        return;
+        }
+
+    // never stored, build it from per-cell DBs
+    int startX = inRegionX * REGION_D;
+    int startY = inRegionY * REGION_D;
+
+    for( int y=0; y<REGION_D; y++ ) {
+        for( int x=0; x<REGION_D; x++ ) {
+            cellLoader( startX + x, startY + y,
+                        &( outRecord->cells[ y * REGION_D + x ] ) );
+            }
+        }
+
+    stats.regionsBuiltFromCells++;
+
+    // save it so we never have to build it again
+    outRecord->dirty = true;
+    }
+
+
+
+static void clearRegionCache() {
+    for( int i=0; i<REGION_CACHE_SIZE; i++ ) {
+        regionCache[i].valid = false;
+        regionCache[i].dirty = false;
+        }
+    }
+
+
+
+char initRegionStore( RegionCellLoader inLoader, char inInvalidate ) {
+    cellLoader = inLoader;
+
+    clearRegionCache();
+
+    File cleanFlagFile( NULL, regionCleanFlagName );
+
+    if( ! cleanFlagFile.exists() ) {
+        // crash or first run, can't trust region records
+        inInvalidate = true;
+        }
+    else {
+        // any crash from here on leaves store untrusted
+        cleanFlagFile.remove();
+        }
+
+    if( inInvalidate ) {
+        File regionDBFile( NULL, regionDBName );
+
+        if( regionDBFile.exists() ) {
+            AppLog::info( "Discarding map region records, "
+                          "will rebuild them as regions are viewed" );
+            regionDBFile.remove();
+            }
+        }
+
+    int error = DB_open( &regionDB,
+                         regionDBName,
+                         KISSDB_OPEN_MODE_RWCREAT,
+                         20000,
+                         8, // two 32-bit ints, region x, region y
+                         REGION_RECORD_BYTES
+                         // one version int, then for each cell:
+                         // four ints, object, numContained, noDecay, floor
+                         // three doubles, objectEta, floorEta, lookTime
+                         );
+
+    if( error ) {
+        AppLog::errorF( "Error %d opening map region DB", error );
+        return false;
+        }
+
+    regionDBOpen = true;
+    return true;
+    }
+
+
+
+void flushRegionStore() {
+    if( ! regionDBOpen ) {
+        return;
+        }
+
+    for( int i=0; i<REGION_CACHE_SIZE; i++ ) {
+        if( regionCache[i].valid && regionCache[i].dirty ) {
+            writeRegion( &( regionCache[i] ) );
+            }
+        }
+    }
+
+
+
+void freeRegionStore() {
+    if( ! regionDBOpen ) {
+        return;
+        }
+
+    flushRegionStore();
+
+    DB_close( &regionDB );
+    regionDBOpen = false;
+
+    clearRegionCache();
+
+    FILE *f = fopen( regionCleanFlagName, "w" );
+    if( f != NULL ) {
+        fprintf( f, "1" );
+        fclose( f );
+        }
+    }
+
+
+
+void wipeRegionStoreFiles() {
+    File regionDBFile( NULL, regionDBName );
+
+    if( regionDBFile.exists() ) {
+        regionDBFile.remove();
+        }
+
+    File cleanFlagFile( NULL, regionCleanFlagName );
+
+    if( cleanFlagFile.exists() ) {
+        cleanFlagFile.remove();
+        }
+    }
+
+
+
+char isRegionStoreOpen() {
+    return regionDBOpen;
+    }
+
+
+
+static RegionCacheRecord *getRegionRecord( int inX, int inY ) {
+    int regionX = cellToRegion( inX );
+    int regionY = cellToRegion( inY );
+
+    RegionCacheRecord *r =
+        &( regionCache[ computeRegionCacheHash( regionX, regionY ) ] );
+
+    if( r->valid && r->regionX == regionX && r->regionY == regionY ) {
+        stats.cacheHits++;
+        return r;
+        }
+
+    stats.cacheMisses++;
+
+    if( r->valid && r->dirty ) {
+        // evicting
+        writeRegion( r );
+        }
+
+    loadRegion( regionX, regionY, r );
+
+    return r;
+    }
+
+
+
+RegionCell *lookupRegionCell( int inX, int inY ) {
+    RegionCacheRecord *r = getRegionRecord( inX, inY );
+
+    return &( r->cells[ cellIndexInRegion( inX, inY ) ] );
+    }
+
+
+
+void markRegionCellDirty( int inX, int inY ) {
+    getRegionRecord( inX, inY )->dirty = true;
+    }
+
+
+
+RegionStoreStats getRegionStoreStats() {
+    RegionStoreStats s = stats;
+
+    stats.cacheHits = 0;
+    stats.cacheMisses = 0;
+    stats.regionsBuiltFromCells = 0;
+    stats.regionsWritten = 0;
+
+    return s;
+    }
@@ -0,0 +1,109 @@
+#ifndef REGION_STORE_H_INCLUDED
+#define REGION_STORE_H_INCLUDED
+
+
+#include "minorGems/system/Time.h"
+
+
+// Groups the per-cell map fields that every map read touches into
+// one record per REGION_D x REGION_D block of cells, stored in mapRegion.db,
+// with a read-through cache of regions in RAM in front of it.
+//
+// Loading a player's view then costs a handful of region reads instead of
+// thousands of scattered per-cell lookups.
+//
+// The per-cell DBs in map.cpp stay the source of truth (they are still
+// iterated at startup and shutdown), so this is a derived store:
+// map.cpp writes through to both, and the whole store is thrown away and
+// rebuilt lazily whenever it might disagree with the per-cell DBs.
+
+
+// cells per region edge
+#define REGION_D 16
+
+#define REGION_CELLS ( REGION_D * REGION_D )
+
+
+// fields of one map cell for main object (sub container 0)
+// int fields are -1, and time fields are 0, if cell has no entry in
+// underlying per-cell DB
+typedef struct RegionCell {
+        // slot 0 in map.db
+        int object;
+
+        // NUM_CONT_SLOT in map.db
+        int numContained;
+
+        // NO_DECAY_SLOT in map.db
+        int noDecay;
+
+        // floor.db
+        int floor;
+
+        // DECAY_SLOT in mapTime.db
+        timeSec_t objectEta;
+
+        // floorTime.db
+        timeSec_t floorEta;
+
+        // lookTime.db
+        timeSec_t lookTime;
+    } RegionCell;
+
+
+
+// fills in a cell from the per-cell DBs, called for each cell of a region
+// that has never been stored in region DB
+typedef void (*RegionCellLoader)( int inX, int inY, RegionCell *outCell );
+
+
+
+// if inInvalidate is true, any existing region records are discarded
+// Also discarded if the server did not shut down cleanly last time.
+//
+// returns true on success
+char initRegionStore( RegionCellLoader inLoader, char inInvalidate );
+
+
+// flushes all dirty regions and closes the store
+void freeRegionStore();
+
+
+// can only be called before initRegionStore or after freeRegionStore
+void wipeRegionStoreFiles();
+
+
+char isRegionStoreOpen();
+
+
+
+// gets cell record, loading its region if needed
+//
+// returned pointer is valid until next call to lookupRegionCell
+// if changing the cell through this pointer, call markRegionCellDirty
+RegionCell *lookupRegionCell( int inX, int inY );
+
+
+// marks region containing cell to be written back on next flush
+void markRegionCellDirty( int inX, int inY );
+
+
+// writes all dirty regions back to region DB
+void flushRegionStore();
+
+
+
+// stats for logging
+typedef struct RegionStoreStats {
+        int cacheHits;
+        int cacheMisses;
+        int regionsBuiltFromCells;
+        int regionsWritten;
+    } RegionStoreStats;
+
+
+// resets stats after returning them
+RegionStoreStats getRegionStoreStats();
+
+
+#endif
@@ -0,0 +1,264 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+
+#include "minorGems/io/file/File.h"
+#include "minorGems/util/stringUtils.h"
+
+#include "stackdb.h"
+#include "backup.h"
+
+
+void usage() {
+    printf( "Usage:\n" );
+    printf( "restoreBackup snapshot_dir out_dir [last_time]\n\n" );
+
+    printf( "Rebuilds per-cell map DBs from full copies in snapshot_dir,\n" );
+    printf( "plus all increments up to last_time (or all of them).\n" );
+    printf( "out_dir must exist.  Only stackdb files are supported.\n\n" );
+
+    printf( "eve.db and playerStats.db are still saved as whole files\n" );
+    printf( "in backups dir, and just need to be copied.\n\n" );
+
+    printf( "Example:\n" );
+    printf( "restoreBackup backups/snapshot_2019_01_02__08_00_00 "
+            "restored\n" );
+    printf( "restoreBackup backups/snapshot_2019_01_02__08_00_00 "
+            "restored 2019_01_05__08_00_00\n\n" );
+
+    exit( 1 );
+    }
+
+
+
+// reads stackdb header of file
+// returns true on success
+char readDBHeader( const char *inPath, uint32_t *outTableSize,
+                   uint32_t *outKeySize, uint32_t *outValueSize ) {
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        return false;
+        }
+
+    char magic[4];
+    uint32_t header[3];
+
+    char ok =
+        fread( magic, 3, 1, f ) == 1 &&
+        fread( header, sizeof( header ), 1, f ) == 1;
+
+    fclose( f );
+
+    magic[3] = '\0';
+
+    if( ! ok || strcmp( magic, "Sdb" ) != 0 ) {
+        return false;
+        }
+
+    *outTableSize = header[0];
+    *outKeySize = header[1];
+    *outValueSize = header[2];
+
+    return true;
+    }
+
+
+
+// returns number of records applied, or -1 on error
+int applyIncrement( File *inIncFile, const char *inDBPath ) {
+    uint32_t tableSize, keySize, valueSize;
+
+    if( ! readDBHeader( inDBPath, &tableSize, &keySize, &valueSize ) ) {
+        printf( "Failed to read header of %s\n", inDBPath );
+        return -1;
+        }
+
+    char *incPath = inIncFile->getFullFileName();
+
+    FILE *f = fopen( incPath, "rb" );
+
+    delete [] incPath;
+
+    if( f == NULL ) {
+        return -1;
+        }
+
+    char magic[5];
+    uint32_t header[3];
+
+    if( fread( magic, 4, 1, f ) != 1 ||
+        fread( header, sizeof( header ), 1, f ) != 1 ) {
+        fclose( f );
+        return -1;
+        }
+    magic[4] = '\0';
+
+    if( strcmp( magic, BACKUP_INCREMENT_MAGIC ) != 0 ||
+        header[0] != keySize || header[1] != valueSize ) {
+        printf( "Increment doesn't match %s\n", inDBPath );
+        fclose( f );
+        return -1;
+        }
+
+    int numRecords = header[2];
+
+    STACKDB db;
+
+    if( STACKDB_open( &db, inDBPath, 0, tableSize, keySize, valueSize ) ) {
+        printf( "Failed to open %s\n", inDBPath );
+        fclose( f );
+        return -1;
+        }
+
+    unsigned char *key = new unsigned char[ keySize ];
+    unsigned char *value = new unsigned char[ valueSize ];
+
+    int numApplied = 0;
+
+    for( int i=0; i<numRecords; i++ ) {
+        if( fread( key, keySize, 1, f ) != 1 ||
+            fread( value, valueSize, 1, f ) != 1 ) {
+            printf( "Increment cut short after %d records\n", i );
+            break;
+            }
+
+        if( STACKDB_put( &db, key, value ) != 0 ) {
+            printf( "Failed to write to %s\n", inDBPath );
+            break;
+            }
+        numApplied++;
+        }
+
+    delete [] key;
+    delete [] value;
+
+    STACKDB_close( &db );
+    fclose( f );
+
+    if( numApplied != numRecords ) {
+        return -1;
+        }
+    return numApplied;
+    }
+
+
+
+int main( int inNumArgs, char **inArgs ) {
+
+    if( inNumArgs != 3 && inNumArgs != 4 ) {
+        usage();
+        }
+
+    const char *lastTime = NULL;
+
+    if( inNumArgs == 4 ) {
+        lastTime = inArgs[3];
+        }
+
+    File snapshotDir( NULL, inArgs[1] );
+    File outDir( NULL, inArgs[2] );
+
+    if( ! snapshotDir.isDirectory() ) {
+        printf( "%s is not a directory\n\n", inArgs[1] );
+        usage();
+        }
+    if( ! outDir.isDirectory() ) {
+        printf( "%s is not a directory\n\n", inArgs[2] );
+        usage();
+        }
+
+    int numFiles;
+    File **files = snapshotDir.getChildFilesSorted( &numFiles );
+
+
+    // full copies first
+    int numFull = 0;
+
+    for( int i=0; i<numFiles; i++ ) {
+        char *name = files[i]->getFileName();
+
+        int nameLength = strlen( name );
+
+        if( nameLength > 3 &&
+            strcmp( &( name[ nameLength - 3 ] ), ".db" ) == 0 ) {
+
+            File *outFile = outDir.getChildFile( name );
+
+            files[i]->copy( outFile );
+
+            printf( "Copied %s\n", name );
+            numFull++;
+
+            delete outFile;
+            }
+        delete [] name;
+        }
+
+    if( numFull == 0 ) {
+        printf( "No full DB copies found in %s\n", inArgs[1] );
+        return 1;
+        }
+
+
+    // then increments, sorted by DB, then time
+    int numIncrements = 0;
+    char failed = false;
+
+    for( int i=0; i<numFiles; i++ ) {
+        char *name = files[i]->getFileName();
+
+        // map.db.2019_01_02__08_00_00.inc
+        char *dbEnd = strstr( name, ".db." );
+        char *timeEnd = strstr( name, ".inc" );
+
+        if( dbEnd != NULL && timeEnd != NULL && timeEnd > dbEnd ) {
+
+            char *timePart = &( dbEnd[4] );
+
+            // cut name into DB file name and time
+            dbEnd[3] = '\0';
+            timeEnd[0] = '\0';
+
+            if( lastTime == NULL || strcmp( timePart, lastTime ) <= 0 ) {
+
+                File *outFile = outDir.getChildFile( name );
+                char *outPath = outFile->getFullFileName();
+                delete outFile;
+
+                int numApplied = applyIncrement( files[i], outPath );
+
+                if( numApplied < 0 ) {
+                    printf( "Failed to apply %s increment from %s\n",
+                            name, timePart );
+                    failed = true;
+                    }
+                else {
+                    printf( "Applied %d records to %s from %s\n",
+                            numApplied, name, timePart );
+                    numIncrements++;
+                    }
+
+                delete [] outPath;
+                }
+            }
+        delete [] name;
+        }
+
+
+    for( int i=0; i<numFiles; i++ ) {
+        delete files[i];
+        }
+    delete [] files;
+
+
+    printf( "Restored %d DBs from full copies plus %d increments\n",
+            numFull, numIncrements );
+
+    if( failed ) {
+        printf( "Some increments failed, restored DBs are not usable\n" );
+        return 1;
+        }
+
+    return 0;
+    }
@@ -0,0 +1,46 @@
+#!/bin/sh
+
+# Runs stressTestClient against a server already running in this folder
+# (on this machine), then prints the server's main loop wake stats
+# (loop wakes, per-wake handling time, CPU per client) logged meanwhile.
+#
+# Stats are logged once a minute, so run for a few minutes at least.
+# Server needs requireTicketServerCheck set to 0.
+#
+# Usage:
+# ./runStressBenchmark.sh num_clients seconds [port]
+
+if [ $# -lt 2 ]
+then
+	echo "Usage:"
+	echo "./runStressBenchmark.sh num_clients seconds [port]"
+	echo ""
+	echo "Example:"
+	echo "./runStressBenchmark.sh 100 300"
+	exit 1
+fi
+
+numClients=$1
+seconds=$2
+port=8005
+
+if [ $# -gt 2 ]
+then
+	port=$3
+fi
+
+
+if [ ! -f stressTestClient ]
+then
+	./makeStressTestClient
+fi
+
+
+startLine=`cat log.txt | wc -l`
+
+timeout $seconds ./stressTestClient localhost $port bench $numClients > /dev/null
+
+
+echo "Wake stats for $numClients clients over $seconds seconds:"
+
+tail -n +$startLine log.txt | grep "Wakes:"
@@ -6,6 +6,10 @@
 #include <assert.h>
 #include <float.h>
 
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
 
 #include "minorGems/util/stringUtils.h"
 #include "minorGems/util/SettingsManager.h"
@@ -46,6 +50,15 @@
 #include "failureLog.h"
 #include "names.h"
 #include "lineageLimit.h"
+#include "changePosGrid.h"
+#include "blockingMap.h"
+#include "mapPregen.h"
+#include "outboundBuffer.h"
+#include "readySocketPoll.h"
+#include "compressionPool.h"
+#include "heatSim.h"
+#include "HashTable.h"
+#include "../gameSource/messageFramer.h"
 
 
 #include "minorGems/util/random/JenkinsRandomSource.h"
@@ -57,8 +70,6 @@ static JenkinsRandomSource randSource;
 #include "../gameSource/GridPos.h"
 
 
-#define HEAT_MAP_D 10
-
 float targetHeat = 10;
 
 
@@ -149,7 +160,10 @@ static const char *allowedSayChars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ.-,'?! ";
 // for incoming socket connections that are still in the login process
 typedef struct FreshConnection {
         Socket *sock;
-        SimpleVector<char> *sockBuffer;
+        MessageFramer *sockBuffer;
+
+        // tells us when sock has data waiting
+        ReadySocketEntry *sockEntry;
 
         unsigned int sequenceNumber;
 
@@ -167,6 +181,9 @@ typedef struct FreshConnection {
         char *email;
         
         int tutorialNumber;
+        
+        // MAP_CHUNK_FORMAT_ that client asked for in LOGIN
+        int mapChunkFormat;
     } FreshConnection;
 
 
@@ -242,6 +259,9 @@ typedef struct LiveObject {
         
         char pathTruncated;
 
+        // MAP_CHUNK_FORMAT_ to use for MC messages to this player
+        int mapChunkFormat;
+
         char firstMapSent;
         int lastSentMapX;
         int lastSentMapY;
@@ -306,7 +326,14 @@ typedef struct LiveObject {
 
 
         Socket *sock;
-        SimpleVector<char> *sockBuffer;
+        MessageFramer *sockBuffer;
+
+        // tells us when sock has data waiting
+        // NULL once we've stopped listening to sock
+        ReadySocketEntry *sockEntry;
+
+        // messages waiting to go out on sock
+        OutboundBuffer *outbound;
 
         char isNew;
         char firstMessageSent;
@@ -470,16 +497,118 @@ static void addDeadlyMapSpot( GridPos inPos ) {
 
 
 
+// index in players of each player ID
+// kept up to date wherever players is changed
+static HashTable<int> playerIndexByID( 1024, -1 );
+
+
+
+static void addPlayerToIndex( int inIndex ) {
+    playerIndexByID.insert( players.getElement( inIndex )->id, 0, 0, 0,
+                            inIndex );
+    }
+
+
+
+// call after players.deleteElement( inIndex )
+static void removePlayerFromIndex( int inID, int inIndex ) {
+    playerIndexByID.remove( inID, 0, 0, 0 );
+    
+    // rest shifted down by one
+    for( int i=inIndex; i<players.size(); i++ ) {
+        addPlayerToIndex( i );
+        }
+    }
+
+
+
+static int getLiveObjectIndex( int inID ) {
+    char found;
+    int i = playerIndexByID.lookup( inID, 0, 0, 0, &found );
+    
+    if( ! found ) {
+        return -1;
+        }
+    return i;
+    }
+
+
+
 static LiveObject *getLiveObject( int inID ) {
-    for( int i=0; i<players.size(); i++ ) {
-        LiveObject *o = players.getElement( i );
-        
-        if( o->id == inID ) {
-            return o;
+    int i = getLiveObjectIndex( inID );
+    
+    if( i == -1 ) {
+        return NULL;
+        }
+    return players.getElement( i );
+    }
+
+
+
+// Possible mothers:  all living women outside the tutorial, grouped by
+// lineage, so that a new player's lineage limit is checked once per
+// line instead of once per woman.
+// Women join at birth and leave at death (age can be forced lower, so
+// being past fertile age doesn't take anyone out).
+typedef struct MotherLineage {
+        int lineageEveID;
+        SimpleVector<int> *motherIDs;
+    } MotherLineage;
+
+static SimpleVector<MotherLineage> motherLineages;
+
+
+
+static int getMotherLineageIndex( int inLineageEveID ) {
+    for( int i=0; i<motherLineages.size(); i++ ) {
+        if( motherLineages.getElementDirect( i ).lineageEveID == 
+            inLineageEveID ) {
+            return i;
             }
         }
+    return -1;
+    }
+
+
+
+static void addToMotherIndex( LiveObject *inPlayer ) {
+    int i = getMotherLineageIndex( inPlayer->lineageEveID );
+    
+    if( i == -1 ) {
+        MotherLineage l = { inPlayer->lineageEveID, new SimpleVector<int>() };
+        motherLineages.push_back( l );
+        i = motherLineages.size() - 1;
+        }
     
-    return NULL;
+    motherLineages.getElementDirect( i ).motherIDs->push_back( inPlayer->id );
+    }
+
+
+
+static void removeFromMotherIndex( LiveObject *inPlayer ) {
+    int i = getMotherLineageIndex( inPlayer->lineageEveID );
+    
+    if( i == -1 ) {
+        return;
+        }
+    
+    SimpleVector<int> *ids = motherLineages.getElementDirect( i ).motherIDs;
+    
+    ids->deleteElementEqualTo( inPlayer->id );
+    
+    if( ids->size() == 0 ) {
+        delete ids;
+        motherLineages.deleteElement( i );
+        }
+    }
+
+
+
+static void freeMotherIndex() {
+    for( int i=0; i<motherLineages.size(); i++ ) {
+        delete motherLineages.getElementDirect( i ).motherIDs;
+        }
+    motherLineages.deleteAll();
     }
 
 
@@ -730,22 +859,6 @@ static double measurePathLength( int inXS, int inYS,
 
 
 
-static int getLiveObjectIndex( int inID ) {
-    for( int i=0; i<players.size(); i++ ) {
-        LiveObject *o = players.getElement( i );
-        
-        if( o->id == inID ) {
-            return i;
-            }
-        }
-
-    return -1;
-    }
-
-
-
-
-
 int nextID = 2;
 
 
@@ -775,6 +888,7 @@ void quitCleanup() {
 
     for( int i=0; i<players.size(); i++ ) {
         LiveObject *nextPlayer = players.getElement(i);
+        delete nextPlayer->outbound;
         delete nextPlayer->sock;
         delete nextPlayer->sockBuffer;
         delete nextPlayer->lineage;
@@ -821,6 +935,9 @@ void quitCleanup() {
         delete nextPlayer->babyIDs;
         }
     players.deleteAll();
+    
+    playerIndexByID.clear();
+    freeMotherIndex();
 
 
     freeLineageLimit();
@@ -837,8 +954,12 @@ void quitCleanup() {
     
     freeTriggers();
 
+    freeBackup();
     freeMap();
 
+    // after map chunk cache and players' buffers let go of their jobs
+    freeCompressionPool();
+
     freeTransBank();
     freeCategoryBank();
     freeObjectBank();
@@ -919,20 +1040,23 @@ int numConnections = 0;
 
 // reads all waiting data from socket and stores it in buffer
 // returns true if socket still good, false on error
-char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
+char readSocketFull( Socket *inSock, MessageFramer *inBuffer ) {
 
-    char buffer[512];
+    // receive right into buffer
+    int space;
+    unsigned char *dest = inBuffer->getWriteSpace( 512, &space );
     
-    int numRead = inSock->receive( (unsigned char*)buffer, 512, 0 );
+    int numRead = inSock->receive( dest, space, 0 );
     
     if( numRead == -1 ) {
         return false;
         }
     
     while( numRead > 0 ) {
-        inBuffer->appendArray( buffer, numRead );
+        inBuffer->commitWrite( numRead );
 
-        numRead = inSock->receive( (unsigned char*)buffer, 512, 0 );
+        dest = inBuffer->getWriteSpace( 512, &space );
+        numRead = inSock->receive( dest, space, 0 );
         }
 
     return true;
@@ -941,40 +1065,20 @@ char readSocketFull( Socket *inSock, SimpleVector<char> *inBuffer ) {
 
 
 // NULL if there's no full message available
-char *getNextClientMessage( SimpleVector<char> *inBuffer ) {
-    // find first terminal character #
+// message is in place in buffer, and only valid until next
+// readSocketFull on that buffer
+char *getNextClientMessage( MessageFramer *inBuffer ) {
 
-    int index = inBuffer->getElementIndex( '#' );
-        
-    if( index == -1 ) {
-        return NULL;
-        }
+    int length;
+    char *message = inBuffer->getNextMessage( &length );
     
-    if( index > 1 && 
-        inBuffer->getElementDirect( 0 ) == 'K' &&
-        inBuffer->getElementDirect( 1 ) == 'A' ) {
-        
+    while( message != NULL &&
+           length > 1 && message[0] == 'K' && message[1] == 'A' ) {
         // a KA (keep alive) message
         // short-cicuit the processing here
-        
-        inBuffer->deleteStartElements( index + 1 );
-        return NULL;
-        }
-    
-        
-
-    char *message = new char[ index + 1 ];
-    
-    // all but terminal character
-    for( int i=0; i<index; i++ ) {
-        message[i] = inBuffer->getElementDirect( i );
+        message = inBuffer->getNextMessage( &length );
         }
     
-    // delete from buffer, including terminal character
-    inBuffer->deleteStartElements( index + 1 );
-    
-    message[ index ] = '\0';
-    
     return message;
     }
 
@@ -1304,6 +1408,287 @@ void forcePlayerAge( const char *inEmail, double inAge ) {
 
 
 
+// heat and r-value that a map cell contributes to heat maps around it
+typedef struct CellHeatInput {
+        float heatOutput;
+        float rValue;
+    } CellHeatInput;
+
+
+// cells looked up during this round of heat map updates
+// players near each other share most of their cells
+static HashTable<int> cellHeatInputIndex( 1024, -1 );
+static SimpleVector<CellHeatInput> cellHeatInputs;
+
+
+
+static void clearCellHeatInputs() {
+    cellHeatInputIndex.clear();
+    cellHeatInputs.deleteAll();
+    }
+
+
+
+static void computeCellHeatInput( int mapX, int mapY, 
+                                  CellHeatInput *outInput ) {
+    outInput->heatOutput = 0;
+    outInput->rValue = 0;
+    
+    outInput->heatOutput +=
+        getBiomeHeatValue( getMapBiome( mapX, mapY ) );
+
+
+    ObjectRecord *o = getObject( getMapObject( mapX, mapY ) );
+    
+    
+    
+
+    if( o != NULL ) {
+        outInput->heatOutput += o->heatValue;
+        if( o->permanent ) {
+            // loose objects sitting on ground don't
+            // contribute to r-value (like dropped clothing)
+            outInput->rValue = o->rValue;
+            }
+
+
+        // skip checking for heat-producing contained items
+        // for now.  Consumes too many server-side resources
+        // can still check for heat produced by stuff in
+        // held container (below).
+        
+        if( false && o->numSlots > 0 ) {
+            // contained can produce heat shielded by container
+            // r value
+            double oRFactor = 1 - o->rValue;
+            
+            int numCont;
+            int *cont = getContained( mapX, mapY, &numCont );
+            
+            if( cont != NULL ) {
+                
+                for( int c=0; c<numCont; c++ ) {
+                    
+                    int cID = cont[c];
+                    char hasSub = false;
+                    if( cID < 0 ) {
+                        hasSub = true;
+                        cID = -cID;
+                        }
+
+                    ObjectRecord *cO = getObject( cID );
+                    outInput->heatOutput += 
+                        cO->heatValue * oRFactor;
+                    
+                    if( hasSub ) {
+                        double cRFactor = 1 - cO->rValue;
+                        
+                        int numSub;
+                        int *sub = getContained( mapX, mapY, 
+                                                 &numSub, 
+                                                 c + 1 );
+                        if( sub != NULL ) {
+                            for( int s=0; s<numSub; s++ ) {
+                                ObjectRecord *sO = 
+                                    getObject( sub[s] );
+                                
+                                outInput->heatOutput += 
+                                    sO->heatValue * 
+                                    cRFactor * 
+                                    oRFactor;
+                                }
+                            delete [] sub;
+                            }
+                        }
+                    }
+                delete [] cont;
+                }
+            }
+        }
+    
+
+    // floor can insulate or produce heat too
+    ObjectRecord *fO = getObject( getMapFloor( mapX, mapY ) );
+    
+    if( fO != NULL ) {
+        outInput->heatOutput += fO->heatValue;
+        outInput->rValue += fO->rValue;
+        }
+    }
+
+
+
+static CellHeatInput getCellHeatInput( int inMapX, int inMapY ) {
+    char found;
+    int i = cellHeatInputIndex.lookup( inMapX, inMapY, 0, 0, &found );
+    
+    if( found ) {
+        return cellHeatInputs.getElementDirect( i );
+        }
+    
+    CellHeatInput input;
+    computeCellHeatInput( inMapX, inMapY, &input );
+    
+    cellHeatInputs.push_back( input );
+    cellHeatInputIndex.insert( inMapX, inMapY, 0, 0, 
+                               cellHeatInputs.size() - 1 );
+    
+    return input;
+    }
+
+
+
+// fills in HEAT_MAP_D x HEAT_MAP_D grids around player
+static void getPlayerHeatInputs( LiveObject *inPlayer,
+                                 float *outRGrid, 
+                                 float *outHeatOutputGrid ) {
+    
+    for( int y=0; y<HEAT_MAP_D; y++ ) {
+        int mapY = inPlayer->ys + y - HEAT_MAP_D / 2;
+        
+        for( int x=0; x<HEAT_MAP_D; x++ ) {
+            
+            int mapX = inPlayer->xs + x - HEAT_MAP_D / 2;
+            
+            int j = y * HEAT_MAP_D + x;
+            
+            CellHeatInput input = getCellHeatInput( mapX, mapY );
+            
+            outHeatOutputGrid[j] = input.heatOutput;
+            outRGrid[j] = input.rValue;
+            }
+        }
+
+    // clothing is additive to R value at center spot
+
+    float headWeight = 0.25;
+    float chestWeight = 0.35;
+    float buttWeight = 0.2;
+    float eachFootWeigth = 0.1;
+    
+    float backWeight = 0.1;
+
+
+    float clothingR = 0;
+    
+    if( inPlayer->clothing.hat != NULL ) {
+        clothingR += headWeight *  inPlayer->clothing.hat->rValue;
+        }
+    if( inPlayer->clothing.tunic != NULL ) {
+        clothingR += chestWeight * inPlayer->clothing.tunic->rValue;
+        }
+    if( inPlayer->clothing.frontShoe != NULL ) {
+        clothingR += 
+            eachFootWeigth * inPlayer->clothing.frontShoe->rValue;
+        }
+    if( inPlayer->clothing.backShoe != NULL ) {
+        clothingR += eachFootWeigth * 
+            inPlayer->clothing.backShoe->rValue;
+        }
+    if( inPlayer->clothing.bottom != NULL ) {
+        clothingR += buttWeight * inPlayer->clothing.bottom->rValue;
+        }
+    if( inPlayer->clothing.backpack != NULL ) {
+        clothingR += backWeight * inPlayer->clothing.backpack->rValue;
+        }
+
+    //printf( "Clothing r = %f\n", clothingR );
+    
+    
+    int playerMapIndex = 
+        ( HEAT_MAP_D / 2 ) * HEAT_MAP_D +
+        ( HEAT_MAP_D / 2 );
+    
+
+    outRGrid[ playerMapIndex ] += clothingR;
+    
+    
+    if( outRGrid[ playerMapIndex ] > 1 ) {
+        
+        outRGrid[ playerMapIndex ] = 1;
+        }
+    
+
+    // body itself produces 1 unit of heat
+    // (r value of clothing can hold this in
+    outHeatOutputGrid[ playerMapIndex ] += 1;
+    
+
+    // what player is holding can contribute heat
+    if( inPlayer->holdingID > 0 ) {
+        ObjectRecord *heldO = getObject( inPlayer->holdingID );
+        
+        outHeatOutputGrid[ playerMapIndex ] += heldO->heatValue;
+        
+        double heldRFactor = 1 - heldO->rValue;
+        
+        // contained can contribute too, but shielded by r-value
+        // of container
+        for( int c=0; c<inPlayer->numContained; c++ ) {
+            
+            int cID = inPlayer->containedIDs[c];
+            char hasSub = false;
+            
+            if( cID < 0 ) {
+                hasSub = true;
+                cID = -cID;
+                }
+
+            ObjectRecord *contO = getObject( cID );
+            
+            outHeatOutputGrid[ playerMapIndex ] += 
+                contO->heatValue * heldRFactor;
+            
+
+            if( hasSub ) {
+                // sub contained too, but shielded by both r-values
+                double contRFactor = 1 - contO->rValue;
+
+                for( int s=0; 
+                     s<inPlayer->subContainedIDs[c].size(); s++ ) {
+                
+                    ObjectRecord *subO =
+                        getObject( inPlayer->subContainedIDs[c].
+                               getElementDirect( s ) );
+                    
+                    outHeatOutputGrid[ playerMapIndex ] += 
+                        subO->heatValue * 
+                        contRFactor * heldRFactor;
+                    }
+                }
+            }
+        }
+    
+    // clothing can contribute heat
+    for( int c=0; c<NUM_CLOTHING_PIECES; c++ ) {
+        
+        ObjectRecord *cO = clothingByIndex( inPlayer->clothing, c );
+    
+        if( cO != NULL ) {
+            outHeatOutputGrid[playerMapIndex ] += cO->heatValue;
+
+            // contained items in clothing can contribute
+            // heat, shielded by clothing r-values
+            double cRFactor = 1 - cO->rValue;
+
+            for( int s=0; 
+                 s < inPlayer->clothingContained[c].size(); s++ ) {
+                
+                ObjectRecord *sO = 
+                    getObject( inPlayer->clothingContained[c].
+                               getElementDirect( s ) );
+                
+                outHeatOutputGrid[ playerMapIndex ] += 
+                    sO->heatValue * cRFactor;
+                }
+            }
+        }
+    }
+
+
+
+
+
 double computeFoodDecrementTimeSeconds( LiveObject *inPlayer ) {
     double value = maxFoodDecrementSeconds * 2 * inPlayer->heat;
     
@@ -1828,22 +2213,108 @@ static int getMaxChunkDimension() {
 
 
 
-// sets lastSentMap in inO if chunk goes through
-// returns result of send, auto-marks error in inO
-int sendMapChunkMessage( LiveObject *inO, 
-                         char inDestOverride = false,
-                         int inDestOverrideX = 0, 
-                         int inDestOverrideY = 0 ) {
+// outbound buffer limits, in bytes, from settings
+static int sendBufferHighWatermark = 2097152;
+static int sendBufferLowWatermark = 65536;
+
+// how long small messages can wait in outbound buffer for more to join them
+static double sendCoalesceSeconds = 0;
+
+
+// marks player with error after a message couldn't be queued
+// (too much already waiting for them, or socket failed)
+static void markQueueFailed( LiveObject *inPlayer ) {
+    if( ! inPlayer->error ) {
+        setDeathReason( inPlayer, "disconnected" );
+        
+        inPlayer->error = true;
+
+        if( inPlayer->outbound->hasFailed() ) {
+            inPlayer->errorCauseString = "Socket write failed";
+            }
+        else {
+            inPlayer->errorCauseString = "Send buffer overflow";
+            }
+        }
+    }
+
+
+
+// queues message made of inHeaderPrefix, then sizes and compressed
+// payload, once inJob is done
+// returns false on failure, and marks error in inPlayer
+static char queueCompressedMessageForPlayer( 
+    LiveObject *inPlayer,
+    CompressionJob *inJob,
+    const char *inHeaderPrefix = "CM\n" ) {
     
+    if( inPlayer->outbound->queueCompressed( inHeaderPrefix, inJob ) ) {
+        return true;
+        }
     
-    int messageLength = 0;
+    markQueueFailed( inPlayer );
+    return false;
+    }
 
-    int xd = inO->xd;
-    int yd = inO->yd;
+
+
+// queues message to be sent at end of this step
+// if inJob set, queues CM message for it instead, and ignores inMessage
+// returns false on failure, and marks error in inPlayer
+static char queueMessageForPlayer( LiveObject *inPlayer, 
+                                   unsigned char *inMessage, int inLength,
+                                   CompressionJob *inJob = NULL ) {
     
-    if( inDestOverride ) {
-        xd = inDestOverrideX;
-        yd = inDestOverrideY;
+    if( inJob != NULL ) {
+        return queueCompressedMessageForPlayer( inPlayer, inJob );
+        }
+    
+    if( inPlayer->outbound->queue( inMessage, inLength ) ) {
+        return true;
+        }
+    
+    markQueueFailed( inPlayer );
+    return false;
+    }
+
+
+
+// queues map chunk message for rectangle, relative to inO's birthPos
+// returns false on failure, and marks error in inO
+static char queueChunkMessageForPlayer( LiveObject *inO,
+                                        int inStartX, int inStartY,
+                                        int inWidth, int inHeight ) {
+    CompressionJob *job;
+    
+    char *headerPrefix = getChunkMessageStart( inStartX, inStartY,
+                                               inWidth, inHeight,
+                                               inO->birthPos,
+                                               &job,
+                                               inO->mapChunkFormat );
+    
+    char result = queueCompressedMessageForPlayer( inO, job, headerPrefix );
+    
+    delete [] headerPrefix;
+    releaseCompressionJob( job );
+    
+    return result;
+    }
+
+
+
+// sets lastSentMap in inO if chunk goes through
+// returns true if all queued, auto-marks error in inO
+char sendMapChunkMessage( LiveObject *inO, 
+                          char inDestOverride = false,
+                          int inDestOverrideX = 0, 
+                          int inDestOverrideY = 0 ) {
+    
+    int xd = inO->xd;
+    int yd = inO->yd;
+    
+    if( inDestOverride ) {
+        xd = inDestOverrideX;
+        yd = inDestOverrideY;
         }
     
     
@@ -1853,7 +2324,7 @@ int sendMapChunkMessage( LiveObject *inO,
     int fullStartX = xd - halfW;
     int fullStartY = yd - halfH;
     
-    int numSent = 0;
+    char allQueued = true;
 
     
 
@@ -1862,19 +2333,11 @@ int sendMapChunkMessage( LiveObject *inO,
         
         inO->firstMapSent = true;
         
-        unsigned char *mapChunkMessage = getChunkMessage( fullStartX,
-                                                          fullStartY,
-                                                          chunkDimensionX,
-                                                          chunkDimensionY,
-                                                          inO->birthPos,
-                                                          &messageLength );
-                
-        numSent += 
-            inO->sock->send( mapChunkMessage, 
-                             messageLength, 
-                             false, false );
-                
-        delete [] mapChunkMessage;
+        allQueued = queueChunkMessageForPlayer( inO, 
+                                                fullStartX,
+                                                fullStartY,
+                                                chunkDimensionX,
+                                                chunkDimensionY );
         }
     else {
         
@@ -1930,58 +2393,152 @@ int sendMapChunkMessage( LiveObject *inO,
         
         // only send if non-zero width and height
         if( horBarW > 0 && horBarH > 0 ) {
-            int len;
-            unsigned char *mapChunkMessage = getChunkMessage( horBarStartX,
-                                                              horBarStartY,
-                                                              horBarW,
-                                                              horBarH,
-                                                              inO->birthPos,
-                                                              &len );
-            messageLength += len;
-            
-            numSent += 
-                inO->sock->send( mapChunkMessage, 
-                                 len, 
-                                 false, false );
-            
-            delete [] mapChunkMessage;
+            if( ! queueChunkMessageForPlayer( inO,
+                                              horBarStartX,
+                                              horBarStartY,
+                                              horBarW,
+                                              horBarH ) ) {
+                allQueued = false;
+                }
             }
         if( vertBarW > 0 && vertBarH > 0 ) {
-            int len;
-            unsigned char *mapChunkMessage = getChunkMessage( vertBarStartX,
-                                                              vertBarStartY,
-                                                              vertBarW,
-                                                              vertBarH,
-                                                              inO->birthPos,
-                                                              &len );
-            messageLength += len;
-            
-            numSent += 
-                inO->sock->send( mapChunkMessage, 
-                                 len, 
-                                 false, false );
-            
-            delete [] mapChunkMessage;
+            if( ! queueChunkMessageForPlayer( inO,
+                                              vertBarStartX,
+                                              vertBarStartY,
+                                              vertBarW,
+                                              vertBarH ) ) {
+                allQueued = false;
+                }
             }
         }
     
     
                 
 
-    if( numSent == messageLength ) {
-        // sent correctly
+    if( allQueued ) {
+        // queued correctly
         inO->lastSentMapX = xd;
         inO->lastSentMapY = yd;
         }
-    else {
-        setDeathReason( inO, "disconnected" );
+    return allQueued;
+    }
+
+
+
+// distance checks skipped thanks to ChangePosGrid, logged periodically
+static int distanceChecksSaved = 0;
+static double lastDistanceChecksLogTime = 0;
+
+static double lastOutboundLogTime = 0;
+static int outboundFlushSteps = 0;
+
+#define OUTBOUND_LOG_INTERVAL_SECONDS 60
+
+
+// main loop wakes, and how long each took to handle, logged periodically
+static int numLoopWakes = 0;
+static double totalWakeHandleTime = 0;
+static double maxWakeHandleTime = 0;
+static double lastWakeTime = 0;
+
+static double lastWakeStatsLogTime = 0;
+static double lastWakeStatsCPUTime = 0;
+
+#define WAKE_STATS_LOG_INTERVAL_SECONDS 60
+
+
+static void noteWakeHandled( double inSeconds ) {
+    numLoopWakes++;
+    totalWakeHandleTime += inSeconds;
+    
+    if( inSeconds > maxWakeHandleTime ) {
+        maxWakeHandleTime = inSeconds;
+        }
+    }
+
+
+
+// user + system CPU seconds used by this process so far
+// (only on Linux, like ReadySocketPoll's epoll path)
+static double getProcessCPUTime() {
+#ifdef __linux__
+    struct rusage usage;
+    
+    if( getrusage( RUSAGE_SELF, &usage ) != 0 ) {
+        return 0;
+        }
+    
+    return 
+        usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+#else
+    // not measured, so CPU stats log as 0
+    return 0;
+#endif
+    }
+
+
+
+static void logWakeStats( ReadySocketPoll *inPoll ) {
+    double curTime = Time::getCurrentTime();
+    
+    double elapsed = curTime - lastWakeStatsLogTime;
+    
+    if( elapsed < WAKE_STATS_LOG_INTERVAL_SECONDS ) {
+        return;
+        }
+    
+    double cpuTime = getProcessCPUTime();
+    
+    if( lastWakeStatsLogTime != 0 ) {
+        
+        int numSocketWakes = inPoll->getAndResetNumWakeups();
+        int numReadyEvents = inPoll->getAndResetNumReadyEvents();
+        
+        double cpuPercent = 
+            100 * ( cpuTime - lastWakeStatsCPUTime ) / elapsed;
         
-        inO->error = true;
-        inO->errorCauseString = "Socket write failed";
+        double cpuPercentPerClient = 0;
+        
+        if( players.size() > 0 ) {
+            cpuPercentPerClient = cpuPercent / players.size();
+            }
+        
+        double averageHandleTime = 0;
+        
+        if( numLoopWakes > 0 ) {
+            averageHandleTime = totalWakeHandleTime / numLoopWakes;
+            }
+        
+        AppLog::infoF( "Wakes:  %d loop wakes (%d on socket activity, "
+                       "%d sockets ready, %.2f per socket wake), "
+                       "%.3f ms avg handling, %.3f ms max, "
+                       "%.2f%% CPU (%.3f%% per each of %d clients), "
+                       "in last %.0f seconds",
+                       numLoopWakes, numSocketWakes, numReadyEvents,
+                       numSocketWakes > 0 ? 
+                           (double)numReadyEvents / numSocketWakes : 0,
+                       1000 * averageHandleTime,
+                       1000 * maxWakeHandleTime,
+                       cpuPercent, cpuPercentPerClient, players.size(),
+                       elapsed );
+        }
+    else {
+        // first time, counts are from startup, discard them
+        inPoll->getAndResetNumWakeups();
+        inPoll->getAndResetNumReadyEvents();
         }
-    return numSent;
+    
+    numLoopWakes = 0;
+    totalWakeHandleTime = 0;
+    maxWakeHandleTime = 0;
+    
+    lastWakeStatsCPUTime = cpuTime;
+    lastWakeStatsLogTime = curTime;
     }
 
+#define DISTANCE_CHECKS_LOG_INTERVAL_SECONDS 60
+
 
 
 double intDist( int inXA, int inYA, int inXB, int inYB ) {
@@ -2077,9 +2634,7 @@ char isMapSpotEmptyOfPlayers( int inX, int inY ) {
 
 // checks both grid of objects and live, non-moving player positions
 char isMapSpotEmpty( int inX, int inY, char inConsiderPlayers = true ) {
-    int target = getMapObject( inX, inY );
-    
-    if( target != 0 ) {
+    if( ! isMapSpotEmptyOfObjects( inX, inY ) ) {
         return false;
         }
     
@@ -2646,63 +3201,6 @@ void handleForcedBabyDrop(
 
 
 
-char isMapSpotBlocking( int inX, int inY ) {
-    
-    int target = getMapObject( inX, inY );
-
-    if( target != 0 ) {
-        ObjectRecord *obj = getObject( target );
-    
-        if( obj->blocksWalking ) {
-            return true;
-            }
-        }
-    
-    // not directly blocked
-    // need to check for wide objects to left and right
-    int maxR = getMaxWideRadius();
-    
-    for( int dx = -maxR; dx <= maxR; dx++ ) {
-        
-        if( dx != 0 ) {
-            
-            int nX = inX + dx;
-        
-            int nID = getMapObject( nX, inY );
-            
-            if( nID != 0 ) {
-                ObjectRecord *nO = getObject( nID );
-                
-                if( nO->wide ) {
-                    
-                    int dist;
-                    int minDist;
-                    
-                    if( dx < 0 ) {
-                        dist = -dx;
-                        minDist = nO->rightBlockingRadius;
-                        }
-                    else {
-                        dist = dx;
-                        minDist = nO->leftBlockingRadius;
-                        }
-                    
-                    if( dist <= minDist ) {
-                        return true;
-                        }
-                    }
-                }
-            }
-        }
-    
-    return false;
-    }
-
-
-
-
-
-
 // returns 0 for NULL
 static int objectRecordToID( ObjectRecord *inRecord ) {
     if( inRecord == NULL ) {
@@ -3084,9 +3582,11 @@ static int tutorialCount = 0;
 
 
 void processLoggedInPlayer( Socket *inSock,
-                            SimpleVector<char> *inSockBuffer,
+                            MessageFramer *inSockBuffer,
+                            ReadySocketEntry *inSockEntry,
                             char *inEmail,
-                            int inTutorialNumber ) {
+                            int inTutorialNumber,
+                            int inMapChunkFormat ) {
     
     // reload these settings every time someone new connects
     // thus, they can be changed without restarting the server
@@ -3162,63 +3662,59 @@ void processLoggedInPlayer( Socket *inSock,
     
     primeLineageTest( numPlayers );
     
-
-    for( int i=0; i<numPlayers; i++ ) {
-        LiveObject *player = players.getElement( i );
+    timeSec_t curBirthTime = Time::timeSec();
+    
+    for( int l=0; l<motherLineages.size(); l++ ) {
+        MotherLineage *line = motherLineages.getElement( l );
         
-        if( player->error ) {
-            continue;
-            }
-
-        if( player->isTutorial ) {
-            continue;
-            }
-
-        if( isFertileAge( player ) ) {
+        // only checked if someone in line could be our mother
+        char lineChecked = false;
+        char linePermitted = false;
+        
+        for( int m=0; m<line->motherIDs->size(); m++ ) {
+            LiveObject *player = 
+                getLiveObject( line->motherIDs->getElementDirect( m ) );
+            
+            if( player == NULL || player->error ) {
+                continue;
+                }
+            
+            if( ! isFertileAge( player ) ) {
+                continue;
+                }
+            
             numOfAge ++;
             
             // make sure this woman isn't on cooldown
             // and that she's not a bad mother
-            char canHaveBaby = true;
-
+            if( curBirthTime < player->birthCoolDown ) {
+                continue;
+                }
             
-            if( Time::timeSec() < player->birthCoolDown ) {    
-                canHaveBaby = false;
+            if( ! lineChecked ) {
+                linePermitted = 
+                    isLinePermitted( newObject.email, line->lineageEveID );
+                lineChecked = true;
                 }
             
-            if( ! isLinePermitted( newObject.email, player->lineageEveID ) ) {
+            if( ! linePermitted ) {
                 // this line forbidden for new player
                 continue;
                 }
             
-
+            
             int numPastBabies = player->babyIDs->size();
             
-            if( canHaveBaby && numPastBabies >= badMotherLimit ) {
+            if( numPastBabies >= badMotherLimit ) {
                 int numDead = 0;
                 
                 for( int b=0; b < numPastBabies; b++ ) {
                     
-                    int bID = 
-                        player->babyIDs->getElementDirect( b );
-
-                    char bAlive = false;
-                    
-                    for( int j=0; j<numPlayers; j++ ) {
-                        LiveObject *otherObj = players.getElement( j );
-                    
-                        if( otherObj->error ) {
-                            continue;
-                            }
-
-                        int id = otherObj->id;
+                    LiveObject *babyO = 
+                        getLiveObject( 
+                            player->babyIDs->getElementDirect( b ) );
                     
-                        if( id == bID ) {
-                            bAlive = true;
-                            break;
-                            }
-                        }
-                    if( ! bAlive ) {
+                    if( babyO == NULL || babyO->error ) {
                         numDead ++;
                         }
                     }
@@ -3226,13 +3722,11 @@ void processLoggedInPlayer( Socket *inSock,
                 if( numDead >= badMotherLimit ) {
                     // this is a bad mother who lets all babies die
                     // don't give them more babies
-                    canHaveBaby = false;
+                    continue;
                     }
                 }
             
-            if( canHaveBaby ) {
-                parentChoices.push_back( player );
-                }
+            parentChoices.push_back( player );
             }
         }
 
@@ -3613,6 +4107,7 @@ void processLoggedInPlayer( Socket *inSock,
     newObject.pathLength = 0;
     newObject.pathToDest = NULL;
     newObject.pathTruncated = 0;
+    newObject.mapChunkFormat = inMapChunkFormat;
     newObject.firstMapSent = false;
     newObject.lastSentMapX = 0;
     newObject.lastSentMapY = 0;
@@ -3651,6 +4146,10 @@ void processLoggedInPlayer( Socket *inSock,
 
     newObject.sock = inSock;
     newObject.sockBuffer = inSockBuffer;
+    newObject.sockEntry = inSockEntry;
+    newObject.outbound = new OutboundBuffer( inSock, 
+                                             sendBufferHighWatermark,
+                                             sendBufferLowWatermark );
     newObject.isNew = true;
     newObject.firstMessageSent = false;
     
@@ -3736,6 +4235,12 @@ void processLoggedInPlayer( Socket *inSock,
     parent = NULL;
     players.push_back( newObject );            
 
+    addPlayerToIndex( players.size() - 1 );
+    
+    if( ! newObject.isTutorial && getFemale( &newObject ) ) {
+        addToMotherIndex( &newObject );
+        }
+
 
     if( ! newObject.isTutorial )        
     logBirth( newObject.id,
@@ -3756,58 +4261,6 @@ void processLoggedInPlayer( Socket *inSock,
 
 
 
-// doesn't check whether dest itself is blocked
-static char directLineBlocked( GridPos inSource, GridPos inDest ) {
-    // line algorithm from here
-    // https://en.wikipedia.org/wiki/Bresenham's_line_algorithm
-    
-    double deltaX = inDest.x - inSource.x;
-    
-    double deltaY = inDest.y - inSource.y;
-    
-
-    int xStep = 1;
-    if( deltaX < 0 ) {
-        xStep = -1;
-        }
-    
-    int yStep = 1;
-    if( deltaY < 0 ) {
-        yStep = -1;
-        }
-    
-
-    if( deltaX == 0 ) {
-        // vertical line
-        
-        // just walk through y
-        for( int y=inSource.y; y != inDest.y; y += yStep ) {
-            if( isMapSpotBlocking( inSource.x, y ) ) {
-                return true;
-                }
-            }
-        }
-    else {
-        double deltaErr = fabs( deltaY / (double)deltaX );
-        
-        double error = deltaErr - 0.5;
-        
-        int y = inSource.y;
-        for( int x=inSource.x; x != inDest.x; x += xStep ) {
-            if( isMapSpotBlocking( x, y ) ) {
-                return true;
-                }
-            error += deltaErr;
-            
-            if( error >= 0.5 ) {
-                y += yStep;
-                error -= 1.0;
-                }
-            }
-        }
-
-    return false;
-    }
 
 
 
@@ -4315,68 +4768,25 @@ static void handleHoldingChange( LiveObject *inPlayer, int inNewHeldID ) {
 
 
 
-static unsigned char *makeCompressedMessage( char *inMessage, int inLength,
-                                             int *outLength ) {
-    
-    int compressedSize;
-    unsigned char *compressedData =
-        zipCompress( (unsigned char*)inMessage, inLength, &compressedSize );
-
-
-
-    char *header = autoSprintf( "CM\n%d %d\n#", 
-                                inLength,
-                                compressedSize );
-    int headerLength = strlen( header );
-    int fullLength = headerLength + compressedSize;
-    
-    unsigned char *fullMessage = new unsigned char[ fullLength ];
-    
-    memcpy( fullMessage, (unsigned char*)header, headerLength );
-    
-    memcpy( &( fullMessage[ headerLength ] ), compressedData, compressedSize );
-
-    delete [] compressedData;
-    
-    *outLength = fullLength;
-    
-    delete [] header;
-    
-    return fullMessage;
-    }
-
-
-
 static int maxUncompressedSize = 256;
 
 
 static void sendMessageToPlayer( LiveObject *inPlayer, 
                                  char *inMessage, int inLength ) {
     
-    unsigned char *message = (unsigned char*)inMessage;
-    int len = inLength;
-    
-    char deleteMessage = false;
-
     if( inLength > maxUncompressedSize ) {
-        message = makeCompressedMessage( inMessage, inLength, &len );
-        deleteMessage = true;
-        }
-
-    int numSent = 
-        inPlayer->sock->send( message, 
-                              len, 
-                              false, false );
+        unsigned char *copy = new unsigned char[ inLength ];
+        memcpy( copy, inMessage, inLength );
         
-    if( numSent != len ) {
-        setDeathReason( inPlayer, "disconnected" );
+        CompressionJob *job = startCompression( copy, inLength );
         
-        inPlayer->error = true;
-        inPlayer->errorCauseString = "Socket write failed";
+        queueCompressedMessageForPlayer( inPlayer, job );
+        
+        releaseCompressionJob( job );
         }
-
-    if( deleteMessage ) {
-        delete [] message;
+    else {
+        queueMessageForPlayer( inPlayer, (unsigned char*)inMessage, 
+                               inLength );
         }
     }
     
@@ -4614,19 +5024,9 @@ void apocalypseStep() {
                 LiveObject *nextPlayer = players.getElement( i );
                 if( !nextPlayer->error ) {
                     
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            (unsigned char*)message, 
-                            messageLength,
-                            false, false );
-                    
-                    if( numSent != messageLength ) {
-                        setDeathReason( nextPlayer, "disconnected" );
-                        
-                        nextPlayer->error = true;
-                        nextPlayer->errorCauseString =
-                            "Socket write failed";
-                        }
+                    queueMessageForPlayer( nextPlayer,
+                                           (unsigned char*)message,
+                                           messageLength );
                     }
                 }
             
@@ -4682,6 +5082,7 @@ void apocalypseStep() {
                 // apocalypse over
 
                 // clear map
+                freeBackup();
                 freeMap();
                 
                 wipeMapFiles();
@@ -4725,28 +5126,225 @@ void monumentStep() {
                 int messageLength = strlen( message );
 
 
-                int numSent = 
-                    nextPlayer->sock->send( 
-                        (unsigned char*)message, 
-                        messageLength,
-                        false, false );
+                queueMessageForPlayer( nextPlayer,
+                                       (unsigned char*)message,
+                                       messageLength );
                 
                 delete [] message;
+                }
+            }
 
-                if( numSent != messageLength ) {
-                    setDeathReason( nextPlayer, "disconnected" );
+        monumentCallPending = false;
+        }
+    }
+
+
+
+
+// how long main loop can sleep waiting for sockets before some timed
+// action (move end, food decrement, decay, outbound flush, etc.) needs
+// to be handled
+static double computePollTimeout( char inSomeClientMessageReceived ) {
+
+    int numLive = players.size();
+    
+    double secPerYear = 1.0 / getAgeRate();
+    
+
+    // check for timeout for shortest player move or food decrement
+    // so that we wake up from listening to socket to handle it
+    double minMoveTime = 999999;
+    
+    double curTime = Time::getCurrentTime();
+
+    for( int i=0; i<numLive; i++ ) {
+        LiveObject *nextPlayer = players.getElement( i );
+        
+        if( nextPlayer->error ) {
+            continue;
+            }
+
+        if( nextPlayer->xd != nextPlayer->xs ||
+            nextPlayer->yd != nextPlayer->ys ) {
+            
+            double moveTimeLeft =
+                nextPlayer->moveTotalSeconds -
+                ( curTime - nextPlayer->moveStartTime );
+            
+            if( moveTimeLeft < 0 ) {
+                moveTimeLeft = 0;
+                }
+            
+            if( moveTimeLeft < minMoveTime ) {
+                minMoveTime = moveTimeLeft;
+                }
+            }
+        
+        // look at food decrement time too
+            
+        double timeLeft =
+            nextPlayer->foodDecrementETASeconds - curTime;
                     
-                    nextPlayer->error = true;
-                    nextPlayer->errorCauseString =
-                        "Socket write failed";
+        if( timeLeft < 0 ) {
+            timeLeft = 0;
+            }
+        if( timeLeft < minMoveTime ) {
+            minMoveTime = timeLeft;
+            }           
+
+        // look at held decay too
+        if( nextPlayer->holdingEtaDecay != 0 ) {
+            
+            timeLeft = nextPlayer->holdingEtaDecay - curTime;
+            
+            if( timeLeft < 0 ) {
+                timeLeft = 0;
+                }
+            if( timeLeft < minMoveTime ) {
+                minMoveTime = timeLeft;
+                }
+            }
+        
+        for( int c=0; c<NUM_CLOTHING_PIECES; c++ ) {
+            if( nextPlayer->clothingEtaDecay[c] != 0 ) {
+                timeLeft = nextPlayer->clothingEtaDecay[c] - curTime;
+                
+                if( timeLeft < 0 ) {
+                    timeLeft = 0;
+                    }
+                if( timeLeft < minMoveTime ) {
+                    minMoveTime = timeLeft;
+                    }
+                }
+            for( int cc=0; cc<nextPlayer->clothingContained[c].size();
+                 cc++ ) {
+                timeSec_t decay =
+                    nextPlayer->clothingContainedEtaDecays[c].
+                    getElementDirect( cc );
+                
+                if( decay != 0 ) {
+                    timeLeft = decay - curTime;
+                    
+                    if( timeLeft < 0 ) {
+                        timeLeft = 0;
+                        }
+                    if( timeLeft < minMoveTime ) {
+                        minMoveTime = timeLeft;
+                        }
                     }
                 }
             }
+        
+        // look at old age death to
+        double ageLeft = forceDeathAge - computeAge( nextPlayer );
+        
+        double ageSecondsLeft = ageLeft * secPerYear;
+        
+        if( ageSecondsLeft < minMoveTime ) {
+            minMoveTime = ageSecondsLeft;
 
-        monumentCallPending = false;
+            if( minMoveTime < 0 ) {
+                minMoveTime = 0;
+                }
+            }
+        
+
+        // as low as it can get, no need to check other players
+        if( minMoveTime == 0 ) {
+            break;
+            }
+        }
+    
+    
+    double pollTimeout = 2;
+    
+    if( minMoveTime < pollTimeout ) {
+        // shorter timeout if we have to wake up for a move
+        
+        // HOWEVER, always keep max timout at 2 sec
+        // so we always wake up periodically to catch quit signals, etc
+
+        pollTimeout = minMoveTime;
+        }
+    
+    if( pollTimeout > 0 ) {
+        int shortestDecay = getNextDecayDelta();
+        
+        if( shortestDecay != -1 ) {
+            
+            if( shortestDecay < pollTimeout ) {
+                pollTimeout = shortestDecay;
+                }
+            }
         }
-    }
 
+    
+    char anyTicketServerRequestsOut = false;
+
+    for( int i=0; i<newConnections.size(); i++ ) {
+        
+        FreshConnection *nextConnection = newConnections.getElement( i );
+
+        if( nextConnection->ticketServerRequest != NULL ) {
+            anyTicketServerRequestsOut = true;
+            break;
+            }
+        }
+    
+    if( anyTicketServerRequestsOut ) {
+        // need to step outstanding ticket server web requests
+        // sleep a tiny amount of time to avoid cpu spin
+        pollTimeout = 0.01;
+        }
+
+
+    if( areTriggersEnabled() ) {
+        // need to handle trigger timing
+        pollTimeout = 0.01;
+        }
+
+    // wake up in time to flush outbound buffers
+    for( int i=0; i<players.size(); i++ ) {
+        LiveObject *nextPlayer = players.getElement( i );
+        
+        double flushTime = 
+            nextPlayer->outbound->getTimeUntilFlush( sendCoalesceSeconds );
+        
+        if( flushTime == 0 ) {
+            // socket was full last time we flushed
+            // sleep a tiny amount of time to avoid cpu spin
+            flushTime = 0.01;
+            }
+        
+        if( flushTime > 0 && flushTime < pollTimeout ) {
+            pollTimeout = flushTime;
+            }
+        }
+    
+    if( getNumCompressionJobsOutstanding() > 0 ) {
+        // messages waiting on compression workers
+        // check back soon
+        if( pollTimeout > 0.001 ) {
+            pollTimeout = 0.001;
+            }
+        }
+    
+    if( isMapCompactionRunning() ) {
+        // compaction only runs during steps
+        // keep them coming
+        if( pollTimeout > 0.01 ) {
+            pollTimeout = 0.01;
+            }
+        }
+    
+    if( inSomeClientMessageReceived ) {
+        // don't wait at all
+        // we need to check for next message right away
+        pollTimeout = 0;
+        }
+
+    return pollTimeout;
+    }
 
 
 
@@ -4851,6 +5449,16 @@ int main() {
     familySpan =
         SettingsManager::getIntSetting( "familySpan", 2 );
     
+    sendBufferHighWatermark =
+        SettingsManager::getIntSetting( "sendBufferHighWatermark", 2097152 );
+    
+    sendBufferLowWatermark =
+        SettingsManager::getIntSetting( "sendBufferLowWatermark", 65536 );
+
+    sendCoalesceSeconds =
+        SettingsManager::getIntSetting( "sendCoalesceMilliseconds", 0 ) 
+        / 1000.0;
+    
     
     readNameGivingPhrases( "babyNamingPhrases", &nameGivingPhrases );
     readNameGivingPhrases( "familyNamingPhrases", &familyNameGivingPhrases );
@@ -4916,6 +5524,11 @@ int main() {
     initTriggers();
 
 
+    // 0 to compress inline, on main thread
+    initCompressionPool( 
+        SettingsManager::getIntSetting( "compressionThreads", 2 ) );
+    
+
     initMap();
     
     
@@ -4923,7 +5536,7 @@ int main() {
         SettingsManager::getIntSetting( "port", 5077 );
     
     
-    SocketPoll sockPoll;
+    ReadySocketPoll sockPoll;
     
     
     
@@ -4958,186 +5571,40 @@ int main() {
         
         int numLive = players.size();
         
-        double secPerYear = 1.0 / getAgeRate();
-        
-
-        // check for timeout for shortest player move or food decrement
-        // so that we wake up from listening to socket to handle it
-        double minMoveTime = 999999;
-        
-        double curTime = Time::getCurrentTime();
 
-        for( int i=0; i<numLive; i++ ) {
-            LiveObject *nextPlayer = players.getElement( i );
-            
+        for( int i=0; i<players.size(); i++ ) {
             // clear at the start of each step
-            nextPlayer->responsiblePlayerID = -1;
-
-            if( nextPlayer->error ) {
-                continue;
-                }
-
-            if( nextPlayer->xd != nextPlayer->xs ||
-                nextPlayer->yd != nextPlayer->ys ) {
-                
-                double moveTimeLeft =
-                    nextPlayer->moveTotalSeconds -
-                    ( curTime - nextPlayer->moveStartTime );
-                
-                if( moveTimeLeft < 0 ) {
-                    moveTimeLeft = 0;
-                    }
-                
-                if( moveTimeLeft < minMoveTime ) {
-                    minMoveTime = moveTimeLeft;
-                    }
-                }
-            
-            // look at food decrement time too
-                
-            double timeLeft =
-                nextPlayer->foodDecrementETASeconds - curTime;
-                        
-            if( timeLeft < 0 ) {
-                timeLeft = 0;
-                }
-            if( timeLeft < minMoveTime ) {
-                minMoveTime = timeLeft;
-                }           
-
-            // look at held decay too
-            if( nextPlayer->holdingEtaDecay != 0 ) {
-                
-                timeLeft = nextPlayer->holdingEtaDecay - curTime;
-                
-                if( timeLeft < 0 ) {
-                    timeLeft = 0;
-                    }
-                if( timeLeft < minMoveTime ) {
-                    minMoveTime = timeLeft;
-                    }
-                }
-            
-            for( int c=0; c<NUM_CLOTHING_PIECES; c++ ) {
-                if( nextPlayer->clothingEtaDecay[c] != 0 ) {
-                    timeLeft = nextPlayer->clothingEtaDecay[c] - curTime;
-                    
-                    if( timeLeft < 0 ) {
-                        timeLeft = 0;
-                        }
-                    if( timeLeft < minMoveTime ) {
-                        minMoveTime = timeLeft;
-                        }
-                    }
-                for( int cc=0; cc<nextPlayer->clothingContained[c].size();
-                     cc++ ) {
-                    timeSec_t decay =
-                        nextPlayer->clothingContainedEtaDecays[c].
-                        getElementDirect( cc );
-                    
-                    if( decay != 0 ) {
-                        timeLeft = decay - curTime;
-                        
-                        if( timeLeft < 0 ) {
-                            timeLeft = 0;
-                            }
-                        if( timeLeft < minMoveTime ) {
-                            minMoveTime = timeLeft;
-                            }
-                        }
-                    }
-                }
-            
-            // look at old age death to
-            double ageLeft = forceDeathAge - computeAge( nextPlayer );
-            
-            double ageSecondsLeft = ageLeft * secPerYear;
-            
-            if( ageSecondsLeft < minMoveTime ) {
-                minMoveTime = ageSecondsLeft;
-
-                if( minMoveTime < 0 ) {
-                    minMoveTime = 0;
-                    }
-                }
-            
-
-            // as low as it can get, no need to check other players
-            if( minMoveTime == 0 ) {
-                break;
-                }
+            players.getElement( i )->responsiblePlayerID = -1;
             }
         
-        
-        SocketOrServer *readySock =  NULL;
-
-        double pollTimeout = 2;
-        
-        if( minMoveTime < pollTimeout ) {
-            // shorter timeout if we have to wake up for a move
-            
-            // HOWEVER, always keep max timout at 2 sec
-            // so we always wake up periodically to catch quit signals, etc
-
-            pollTimeout = minMoveTime;
-            }
-        
-        if( pollTimeout > 0 ) {
-            int shortestDecay = getNextDecayDelta();
-            
-            if( shortestDecay != -1 ) {
-                
-                if( shortestDecay < pollTimeout ) {
-                    pollTimeout = shortestDecay;
-                    }
-                }
-            }
-
-        
-        char anyTicketServerRequestsOut = false;
 
-        for( int i=0; i<newConnections.size(); i++ ) {
-            
-            FreshConnection *nextConnection = newConnections.getElement( i );
-
-            if( nextConnection->ticketServerRequest != NULL ) {
-                anyTicketServerRequestsOut = true;
-                break;
-                }
-            }
+        double pollTimeout = computePollTimeout( someClientMessageReceived );
         
-        if( anyTicketServerRequestsOut ) {
-            // need to step outstanding ticket server web requests
-            // sleep a tiny amount of time to avoid cpu spin
-            pollTimeout = 0.01;
-            }
-
-
-        if( areTriggersEnabled() ) {
-            // need to handle trigger timing
-            pollTimeout = 0.01;
-            }
-
-        if( someClientMessageReceived ) {
-            // don't wait at all
-            // we need to check for next message right away
-            pollTimeout = 0;
-            }
 
         // we thus use zero CPU as long as no messages or new connections
         // come in, and only wake up when some timed action needs to be
         // handled
         
-        readySock = sockPoll.wait( (int)( pollTimeout * 1000 ) );
+        if( lastWakeTime != 0 ) {
+            noteWakeHandled( Time::getCurrentTime() - lastWakeTime );
+            }
         
+        char serverReady = sockPoll.wait( (int)( pollTimeout * 1000 ) );
         
+        lastWakeTime = Time::getCurrentTime();
         
+        logWakeStats( &sockPoll );
         
-        if( readySock != NULL && !readySock->isSocket ) {
+        
+        while( serverReady ) {
             // server ready
+            // we only hear about it once, so take all that are waiting
             Socket *sock = server.acceptConnection( 0 );
 
-            if( sock != NULL ) {
+            if( sock == NULL ) {
+                serverReady = false;
+                }
+            else {
                 AppLog::info( "Got connection" );                
 
                 FreshConnection newConnection;
@@ -5152,6 +5619,7 @@ int main() {
                 newConnection.sequenceNumber = nextSequenceNumber;
                 
                 newConnection.tutorialNumber = 0;
+                newConnection.mapChunkFormat = MAP_CHUNK_FORMAT_TEXT;
 
                 nextSequenceNumber ++;
                 
@@ -5193,13 +5661,16 @@ int main() {
                     newConnection.shutdownMode = true;
                     }         
                 else {
+                    // last line is highest map chunk format we can send
                     message = autoSprintf( "SN\n"
                                            "%d/%d\n"
                                            "%lu\n"
-                                           "%lu\n#",
+                                           "%lu\n"
+                                           "%d\n#",
                                            currentPlayers, maxPlayers,
                                            newConnection.sequenceNumber,
-                                           versionNumber );
+                                           versionNumber,
+                                           MAP_CHUNK_FORMAT_LATEST );
                     newConnection.shutdownMode = false;
                     }
 
@@ -5230,10 +5701,10 @@ int main() {
                     }
                 else {
                     // first message sent okay
-                    newConnection.sockBuffer = new SimpleVector<char>();
+                    newConnection.sockBuffer = new MessageFramer();
                     
 
-                    sockPoll.addSocket( sock );
+                    newConnection.sockEntry = sockPoll.addSocket( sock );
 
                     newConnections.push_back( newConnection );
                     }
@@ -5312,8 +5783,10 @@ int main() {
                             processLoggedInPlayer( 
                                 nextConnection->sock,
                                 nextConnection->sockBuffer,
+                                nextConnection->sockEntry,
                                 nextConnection->email,
-                                nextConnection->tutorialNumber );
+                                nextConnection->tutorialNumber,
+                                nextConnection->mapChunkFormat );
                             
                             delete nextConnection->ticketServerRequest;
                             newConnections.deleteElement( i );
@@ -5340,9 +5813,14 @@ int main() {
 
                 
 
-                char result = 
-                    readSocketFull( nextConnection->sock,
-                                    nextConnection->sockBuffer );
+                char result = true;
+                
+                if( nextConnection->sockEntry->ready ) {
+                    // only read sockets that had something arrive
+                    result = readSocketFull( nextConnection->sock,
+                                             nextConnection->sockBuffer );
+                    nextConnection->sockEntry->ready = false;
+                    }
                 
                 if( ! result ) {
                     AppLog::info( "Failed to read from client socket, "
@@ -5371,7 +5849,7 @@ int main() {
                         SimpleVector<char *> *tokens =
                             tokenizeString( message );
                         
-                        if( tokens->size() == 4 || tokens->size() == 5 ) {
+                        if( tokens->size() >= 4 && tokens->size() <= 6 ) {
                             
                             nextConnection->email = 
                                 stringDuplicate( 
@@ -5379,12 +5857,28 @@ int main() {
                             char *pwHash = tokens->getElementDirect( 2 );
                             char *keyHash = tokens->getElementDirect( 3 );
                             
-                            if( tokens->size() == 5 ) {
+                            if( tokens->size() >= 5 ) {
                                 sscanf( tokens->getElementDirect( 4 ),
                                         "%d", 
                                         &( nextConnection->tutorialNumber ) );
                                 }
                             
+                            if( tokens->size() == 6 ) {
+                                // highest map chunk format client can read
+                                int format = MAP_CHUNK_FORMAT_TEXT;
+                                
+                                sscanf( tokens->getElementDirect( 5 ),
+                                        "%d", &format );
+                                
+                                if( format > MAP_CHUNK_FORMAT_LATEST ) {
+                                    format = MAP_CHUNK_FORMAT_LATEST;
+                                    }
+                                if( format < MAP_CHUNK_FORMAT_TEXT ) {
+                                    format = MAP_CHUNK_FORMAT_TEXT;
+                                    }
+                                nextConnection->mapChunkFormat = format;
+                                }
+                            
                             char emailAlreadyLoggedIn = false;
                             
 
@@ -5492,8 +5986,10 @@ int main() {
                                     processLoggedInPlayer( 
                                         nextConnection->sock,
                                         nextConnection->sockBuffer,
+                                        nextConnection->sockEntry,
                                         nextConnection->email,
-                                        nextConnection->tutorialNumber );
+                                        nextConnection->tutorialNumber,
+                                        nextConnection->mapChunkFormat );
                                     
                                     delete nextConnection->ticketServerRequest;
                                     newConnections.deleteElement( i );
@@ -5520,8 +6016,6 @@ int main() {
                         nextConnection->errorCauseString =
                             "Unexpected first message";
                         }
-                    
-                    delete [] message;
                     }
                 else if( timeDelta > timeLimit ) {
                     if( nextConnection->shutdownMode ) {
@@ -5561,6 +6055,8 @@ int main() {
                                "(cause: %s)",
                                nextConnection->errorCauseString );
 
+                sockPoll.removeSocket( nextConnection->sockEntry );
+                
                 delete nextConnection->sock;
                 delete nextConnection->sockBuffer;
                 
@@ -5769,8 +6265,19 @@ int main() {
                 }
 
             
-            char result = 
-                readSocketFull( nextPlayer->sock, nextPlayer->sockBuffer );
+            char result = true;
+            
+            if( nextPlayer->sockEntry == NULL ) {
+                // no longer listening, but still drain anything they send
+                result = 
+                    readSocketFull( nextPlayer->sock, nextPlayer->sockBuffer );
+                }
+            else if( nextPlayer->sockEntry->ready ) {
+                // only read sockets that had something arrive
+                result = 
+                    readSocketFull( nextPlayer->sock, nextPlayer->sockBuffer );
+                nextPlayer->sockEntry->ready = false;
+                }
             
             if( ! result ) {
                 setDeathReason( nextPlayer, "disconnected" );
@@ -5790,8 +6297,6 @@ int main() {
                 
                 ClientMessage m = parseMessage( nextPlayer, message );
                 
-                delete [] message;
-                
                 if( m.type == UNKNOWN ) {
                     AppLog::info( "Client error, unknown message type." );
                     
@@ -5870,29 +6375,12 @@ int main() {
                     
 
                     if( allow ) {
-                        int length;
-                        unsigned char *mapChunkMessage = 
-                            getChunkMessage( m.x - chunkDimensionX / 2, 
-                                             m.y - chunkDimensionY / 2,
-                                             chunkDimensionX,
-                                             chunkDimensionY,
-                                             nextPlayer->birthPos,
-                                             &length );
-                        
-                        int numSent = 
-                            nextPlayer->sock->send( mapChunkMessage, 
-                                                    length, 
-                                                    false, false );
-                
-                        delete [] mapChunkMessage;
-
-                        if( numSent != length ) {
-                            setDeathReason( nextPlayer, "disconnected" );
-
-                            nextPlayer->error = true;
-                            nextPlayer->errorCauseString =
-                                "Socket write failed";
-                            }
+                        queueChunkMessageForPlayer( 
+                            nextPlayer,
+                            m.x - chunkDimensionX / 2, 
+                            m.y - chunkDimensionY / 2,
+                            chunkDimensionX,
+                            chunkDimensionY );
                         }
                     else {
                         AppLog::infoF( "Map pull request rejected for %s", 
@@ -6248,6 +6736,12 @@ int main() {
                                     currentBlocked = true;
                                     }
                                 
+                                // blockage in middle of path
+                                // checked in one batch against blocking map
+                                int firstBlockedStep =
+                                    getFirstBlockedPathStep(
+                                        unfilteredPath.getElement( 0 ),
+                                        unfilteredPath.size() );
 
                                 for( int p=0; 
                                      p<unfilteredPath.size(); p++ ) {
@@ -6255,7 +6749,7 @@ int main() {
                                     GridPos pos = 
                                         unfilteredPath.getElementDirect(p);
 
-                                    if( isMapSpotBlocking( pos.x, pos.y ) ) {
+                                    if( p == firstBlockedStep ) {
                                         // blockage in middle of path
                                         // terminate path here
                                         truncated = 1;
@@ -6328,6 +6822,30 @@ int main() {
                                     nextPlayer->pathToDest[ 
                                         nextPlayer->pathLength - 1 ].y;
 
+                                // start generating map beyond where
+                                // they're headed, before their next
+                                // map chunk needs it
+                                int aheadX = nextPlayer->xd;
+                                int aheadY = nextPlayer->yd;
+                                
+                                if( nextPlayer->xd > nextPlayer->xs ) {
+                                    aheadX += chunkDimensionX / 2;
+                                    }
+                                else if( nextPlayer->xd < nextPlayer->xs ) {
+                                    aheadX -= chunkDimensionX / 2;
+                                    }
+                                if( nextPlayer->yd > nextPlayer->ys ) {
+                                    aheadY += chunkDimensionY / 2;
+                                    }
+                                else if( nextPlayer->yd < nextPlayer->ys ) {
+                                    aheadY -= chunkDimensionY / 2;
+                                    }
+                                
+                                requestMapPregen( 
+                                    aheadX - chunkDimensionX / 2,
+                                    aheadY - chunkDimensionY / 2,
+                                    chunkDimensionX, chunkDimensionY );
+
                                 // distance is number of orthogonal steps
                             
                                 double dist = 
@@ -8474,7 +8992,8 @@ int main() {
                     }
                 else {
                     // stop listening for activity on this socket
-                    sockPoll.removeSocket( nextPlayer->sock );
+                    sockPoll.removeSocket( nextPlayer->sockEntry );
+                    nextPlayer->sockEntry = NULL;
                     }
                 
 
@@ -9481,356 +10000,63 @@ int main() {
             }
         
 
+        // recompute heat maps from scratch for players getting updates,
+        // a batch at a time
+        SimpleVector<int> heatPlayerIndices;
         
         for( int i=0; i<playerIndicesToSendUpdatesAbout.size(); i++ ) {
-            LiveObject *nextPlayer = players.getElement( 
-                playerIndicesToSendUpdatesAbout.getElementDirect( i ) );
-
-            if( nextPlayer->updateSent ) {
-                continue;
-                }
-            
-
-            // recompute heat map
-            
-            
-            // what if we recompute it from scratch every time?
-            for( int i=0; i<HEAT_MAP_D * HEAT_MAP_D; i++ ) {
-                nextPlayer->heatMap[i] = 0;
-                }
-
-            float heatOutputGrid[ HEAT_MAP_D * HEAT_MAP_D ];
-            float rGrid[ HEAT_MAP_D * HEAT_MAP_D ];
-
-            for( int y=0; y<HEAT_MAP_D; y++ ) {
-                int mapY = nextPlayer->ys + y - HEAT_MAP_D / 2;
-                
-                for( int x=0; x<HEAT_MAP_D; x++ ) {
-                    
-                    int mapX = nextPlayer->xs + x - HEAT_MAP_D / 2;
-                    
-                    int j = y * HEAT_MAP_D + x;
-                    heatOutputGrid[j] = 0;
-                    rGrid[j] = 0;
-                    
-                    heatOutputGrid[j] +=
-                        getBiomeHeatValue( getMapBiome( mapX, mapY ) );
-
-
-                    ObjectRecord *o = getObject( getMapObject( mapX, mapY ) );
-                    
-                    
-                    
-
-                    if( o != NULL ) {
-                        heatOutputGrid[j] += o->heatValue;
-                        if( o->permanent ) {
-                            // loose objects sitting on ground don't
-                            // contribute to r-value (like dropped clothing)
-                            rGrid[j] = o->rValue;
-                            }
-
-
-                        // skip checking for heat-producing contained items
-                        // for now.  Consumes too many server-side resources
-                        // can still check for heat produced by stuff in
-                        // held container (below).
-                        
-                        if( false && o->numSlots > 0 ) {
-                            // contained can produce heat shielded by container
-                            // r value
-                            double oRFactor = 1 - o->rValue;
-                            
-                            int numCont;
-                            int *cont = getContained( mapX, mapY, &numCont );
-                            
-                            if( cont != NULL ) {
-                                
-                                for( int c=0; c<numCont; c++ ) {
-                                    
-                                    int cID = cont[c];
-                                    char hasSub = false;
-                                    if( cID < 0 ) {
-                                        hasSub = true;
-                                        cID = -cID;
-                                        }
-
-                                    ObjectRecord *cO = getObject( cID );
-                                    heatOutputGrid[j] += 
-                                        cO->heatValue * oRFactor;
-                                    
-                                    if( hasSub ) {
-                                        double cRFactor = 1 - cO->rValue;
-                                        
-                                        int numSub;
-                                        int *sub = getContained( mapX, mapY, 
-                                                                 &numSub, 
-                                                                 c + 1 );
-                                        if( sub != NULL ) {
-                                            for( int s=0; s<numSub; s++ ) {
-                                                ObjectRecord *sO = 
-                                                    getObject( sub[s] );
-                                                
-                                                heatOutputGrid[j] += 
-                                                    sO->heatValue * 
-                                                    cRFactor * 
-                                                    oRFactor;
-                                                }
-                                            delete [] sub;
-                                            }
-                                        }
-                                    }
-                                delete [] cont;
-                                }
-                            }
-                        }
-                    
-
-                    // floor can insulate or produce heat too
-                    ObjectRecord *fO = getObject( getMapFloor( mapX, mapY ) );
-                    
-                    if( fO != NULL ) {
-                        heatOutputGrid[j] += fO->heatValue;
-                        rGrid[j] += fO->rValue;
-                        }
-                    }
-                }
-
-            // clothing is additive to R value at center spot
-
-            float headWeight = 0.25;
-            float chestWeight = 0.35;
-            float buttWeight = 0.2;
-            float eachFootWeigth = 0.1;
-            
-            float backWeight = 0.1;
-
-
-            float clothingR = 0;
+            int index = playerIndicesToSendUpdatesAbout.getElementDirect( i );
             
-            if( nextPlayer->clothing.hat != NULL ) {
-                clothingR += headWeight *  nextPlayer->clothing.hat->rValue;
-                }
-            if( nextPlayer->clothing.tunic != NULL ) {
-                clothingR += chestWeight * nextPlayer->clothing.tunic->rValue;
-                }
-            if( nextPlayer->clothing.frontShoe != NULL ) {
-                clothingR += 
-                    eachFootWeigth * nextPlayer->clothing.frontShoe->rValue;
-                }
-            if( nextPlayer->clothing.backShoe != NULL ) {
-                clothingR += eachFootWeigth * 
-                    nextPlayer->clothing.backShoe->rValue;
-                }
-            if( nextPlayer->clothing.bottom != NULL ) {
-                clothingR += buttWeight * nextPlayer->clothing.bottom->rValue;
-                }
-            if( nextPlayer->clothing.backpack != NULL ) {
-                clothingR += backWeight * nextPlayer->clothing.backpack->rValue;
+            if( players.getElement( index )->updateSent ||
+                heatPlayerIndices.getElementIndex( index ) != -1 ) {
+                continue;
                 }
-
-            //printf( "Clothing r = %f\n", clothingR );
-            
-            
-            int playerMapIndex = 
-                ( HEAT_MAP_D / 2 ) * HEAT_MAP_D +
-                ( HEAT_MAP_D / 2 );
-            
-
-            rGrid[ playerMapIndex ] += clothingR;
-            
+            heatPlayerIndices.push_back( index );
+            }
+        
+        clearCellHeatInputs();
+        
+        HeatBatch heatBatch;
+        
+        for( int b=0; b<heatPlayerIndices.size(); b += HEAT_BATCH_SIZE ) {
+            clearHeatBatch( &heatBatch );
             
-            if( rGrid[ playerMapIndex ] > 1 ) {
-                
-                rGrid[ playerMapIndex ] = 1;
+            int batchEnd = b + HEAT_BATCH_SIZE;
+            if( batchEnd > heatPlayerIndices.size() ) {
+                batchEnd = heatPlayerIndices.size();
                 }
             
-
-            // body itself produces 1 unit of heat
-            // (r value of clothing can hold this in
-            heatOutputGrid[ playerMapIndex ] += 1;
-            
-
-            // what player is holding can contribute heat
-            if( nextPlayer->holdingID > 0 ) {
-                ObjectRecord *heldO = getObject( nextPlayer->holdingID );
-                
-                heatOutputGrid[ playerMapIndex ] += heldO->heatValue;
+            for( int i=b; i<batchEnd; i++ ) {
+                LiveObject *nextPlayer = players.getElement( 
+                    heatPlayerIndices.getElementDirect( i ) );
                 
-                double heldRFactor = 1 - heldO->rValue;
+                float heatOutputGrid[ HEAT_MAP_CELLS ];
+                float rGrid[ HEAT_MAP_CELLS ];
                 
-                // contained can contribute too, but shielded by r-value
-                // of container
-                for( int c=0; c<nextPlayer->numContained; c++ ) {
-                    
-                    int cID = nextPlayer->containedIDs[c];
-                    char hasSub = false;
-                    
-                    if( cID < 0 ) {
-                        hasSub = true;
-                        cID = -cID;
-                        }
-
-                    ObjectRecord *contO = getObject( cID );
-                    
-                    heatOutputGrid[ playerMapIndex ] += 
-                        contO->heatValue * heldRFactor;
-                    
-
-                    if( hasSub ) {
-                        // sub contained too, but shielded by both r-values
-                        double contRFactor = 1 - contO->rValue;
-
-                        for( int s=0; 
-                             s<nextPlayer->subContainedIDs[c].size(); s++ ) {
-                        
-                            ObjectRecord *subO =
-                                getObject( nextPlayer->subContainedIDs[c].
-                                       getElementDirect( s ) );
-                            
-                            heatOutputGrid[ playerMapIndex ] += 
-                                subO->heatValue * 
-                                contRFactor * heldRFactor;
-                            }
-                        }
-                    }
-                }
-            
-            // clothing can contribute heat
-            for( int c=0; c<NUM_CLOTHING_PIECES; c++ ) {
+                getPlayerHeatInputs( nextPlayer, rGrid, heatOutputGrid );
                 
-                ObjectRecord *cO = clothingByIndex( nextPlayer->clothing, c );
-            
-                if( cO != NULL ) {
-                    heatOutputGrid[playerMapIndex ] += cO->heatValue;
-
-                    // contained items in clothing can contribute
-                    // heat, shielded by clothing r-values
-                    double cRFactor = 1 - cO->rValue;
-
-                    for( int s=0; 
-                         s < nextPlayer->clothingContained[c].size(); s++ ) {
-                        
-                        ObjectRecord *sO = 
-                            getObject( nextPlayer->clothingContained[c].
-                                       getElementDirect( s ) );
-                        
-                        heatOutputGrid[ playerMapIndex ] += 
-                            sO->heatValue * cRFactor;
-                        }
-                    }
+                addToHeatBatch( &heatBatch, rGrid, heatOutputGrid );
                 }
             
-
-            
-            //double startTime = Time::getCurrentTime();
-            
-            int numCycles = 8;
-            
-            int numNeighbors = 8;
-            int ndx[8] = { 0, 1,  0, -1,  1,  1, -1, -1 };
-            int ndy[8] = { 1, 0, -1,  0,  1, -1,  1, -1 };
-            
-            // found equation here:
-            // http://demonstrations.wolfram.com/
-            //        ACellularAutomatonBasedHeatEquation/
-            // diags have way less contact area
-            double nWeights[8] = { 4, 4, 4, 4, 1, 1, 1, 1 };
-            
-            double totalNWeight = 20;
+            simulateHeatBatch( &heatBatch );
             
-            
-            //double startTime = Time::getCurrentTime();
-
-            for( int c=0; c<numCycles; c++ ) {
-                
-                float tempHeatGrid[ HEAT_MAP_D * HEAT_MAP_D ];
-                memcpy( tempHeatGrid, nextPlayer->heatMap, 
-                        HEAT_MAP_D * HEAT_MAP_D * sizeof( float ) );
-                
-                for( int y=1; y<HEAT_MAP_D-1; y++ ) {
-                    for( int x=1; x<HEAT_MAP_D-1; x++ ) {
-                        int j = y * HEAT_MAP_D + x;
-            
-                        float heatDelta = 0;
-                
-                        float centerLeak = 1 - rGrid[j];
-
-                        float centerOldHeat = tempHeatGrid[j];
-
-                        for( int n=0; n<numNeighbors; n++ ) {
-                
-                            int nx = x + ndx[n];
-                            int ny = y + ndy[n];
-                        
-                            int nj = ny * HEAT_MAP_D + nx;
-                        
-                            float nLeak = 1 - rGrid[ nj ];
-                    
-                            heatDelta += nWeights[n] * centerLeak * nLeak *
-                                ( tempHeatGrid[ nj ] - centerOldHeat );
-                            }
-                
-                        nextPlayer->heatMap[j] = 
-                            tempHeatGrid[j] + heatDelta / totalNWeight;
+            for( int i=b; i<batchEnd; i++ ) {
+                LiveObject *nextPlayer = players.getElement( 
+                    heatPlayerIndices.getElementDirect( i ) );
                 
-                        nextPlayer->heatMap[j] += heatOutputGrid[j];
-                        }
-                    }
-                } 
+                getHeatBatchResult( &heatBatch, i - b, nextPlayer->heatMap );
+                }
+            }
+        
+        
+        for( int i=0; i<heatPlayerIndices.size(); i++ ) {
+            LiveObject *nextPlayer = players.getElement( 
+                heatPlayerIndices.getElementDirect( i ) );
             
-            //printf( "Computing %d cycles took %f ms\n",
-            //        numCycles, 
-            //        ( Time::getCurrentTime() - startTime ) * 1000 );
-            /*
-            printf( "Player heat map:\n" );
+            int playerMapIndex = 
+                ( HEAT_MAP_D / 2 ) * HEAT_MAP_D +
+                ( HEAT_MAP_D / 2 );
             
-            for( int y=0; y<HEAT_MAP_D; y++ ) {
-                
-                for( int x=0; x<HEAT_MAP_D; x++ ) {                    
-                    int j = y * HEAT_MAP_D + x;
-                    
-                    printf( "%04.1f ", 
-                            nextPlayer->heatMap[ j ] );
-                            //tempHeatGrid[ y * HEAT_MAP_D + x ] );
-                    }
-                printf( "\n" );
-
-                char anyTags = false;
-                for( int x=0; x<HEAT_MAP_D; x++ ) {
-                    int j = y * HEAT_MAP_D + x;
-                    
-                    if( j == playerMapIndex ) {
-                        anyTags = true;
-                        break;
-                        }
-                    if( heatOutputGrid[ j ] > 0 ) {
-                        anyTags = true;
-                        break;
-                        }
-                    }
-                
-                if( anyTags ) {
-                    for( int x=0; x<HEAT_MAP_D; x++ ) {                    
-                        int j = y * HEAT_MAP_D + x;
-                        if( j == playerMapIndex ) {
-                            printf( "p" );
-                            }
-                        else printf( " " );
-                        
-                        if( heatOutputGrid[j] > 0 ) {
-                            printf( "H%d   ", 
-                                    heatOutputGrid[j] );
-                            }
-                        else {
-                            printf( "    " );
-                            }
-                        }
-                    printf( "\n" );
-                    }
-                }
-            */
-
             float playerHeat = 
                 nextPlayer->heatMap[ playerMapIndex ];
             
@@ -9918,6 +10144,7 @@ int main() {
 
 
         unsigned char *speechMessage = NULL;
+        CompressionJob *speechJob = NULL;
         int speechMessageLength = 0;
         
         if( newSpeech.size() > 0 ) {
@@ -9934,17 +10161,15 @@ int main() {
                 }
             else {
                 // compress for all players once here
-                speechMessage = makeCompressedMessage( 
-                    speechMessageText, 
-                    speechMessageLength, &speechMessageLength );
-                
-                delete [] speechMessageText;
+                speechJob = startCompression( 
+                    (unsigned char*)speechMessageText, speechMessageLength );
                 }
 
             }
 
 
         unsigned char *lineageMessage = NULL;
+        CompressionJob *lineageJob = NULL;
         int lineageMessageLength = 0;
         
         if( playerIndicesToSendLineageAbout.size() > 0 ) {
@@ -9988,11 +10213,9 @@ int main() {
                     }
                 else {
                     // compress for all players once here
-                    lineageMessage = makeCompressedMessage( 
-                        lineageMessageText, 
-                        lineageMessageLength, &lineageMessageLength );
-                    
-                    delete [] lineageMessageText;
+                    lineageJob = startCompression( 
+                        (unsigned char*)lineageMessageText,
+                        lineageMessageLength );
                     }
                 }
             }
@@ -10001,6 +10224,7 @@ int main() {
 
 
         unsigned char *namesMessage = NULL;
+        CompressionJob *namesJob = NULL;
         int namesMessageLength = 0;
         
         if( playerIndicesToSendNamesAbout.size() > 0 ) {
@@ -10036,11 +10260,8 @@ int main() {
                     }
                 else {
                     // compress for all players once here
-                    namesMessage = makeCompressedMessage( 
-                        namesMessageText, 
-                        namesMessageLength, &namesMessageLength );
-                    
-                    delete [] namesMessageText;
+                    namesJob = startCompression( 
+                        (unsigned char*)namesMessageText, namesMessageLength );
                     }
                 }
             }
@@ -10048,6 +10269,7 @@ int main() {
 
 
         unsigned char *dyingMessage = NULL;
+        CompressionJob *dyingJob = NULL;
         int dyingMessageLength = 0;
         
         if( playerIndicesToSendDyingAbout.size() > 0 ) {
@@ -10083,11 +10305,8 @@ int main() {
                     }
                 else {
                     // compress for all players once here
-                    dyingMessage = makeCompressedMessage( 
-                        dyingMessageText, 
-                        dyingMessageLength, &dyingMessageLength );
-                    
-                    delete [] dyingMessageText;
+                    dyingJob = startCompression( 
+                        (unsigned char*)dyingMessageText, dyingMessageLength );
                     }
                 }
             }
@@ -10096,6 +10315,7 @@ int main() {
 
 
         unsigned char *healingMessage = NULL;
+        CompressionJob *healingJob = NULL;
         int healingMessageLength = 0;
         
         if( playerIndicesToSendHealingAbout.size() > 0 ) {
@@ -10131,11 +10351,9 @@ int main() {
                     }
                 else {
                     // compress for all players once here
-                    healingMessage = makeCompressedMessage( 
-                        healingMessageText, 
-                        healingMessageLength, &healingMessageLength );
-                    
-                    delete [] healingMessageText;
+                    healingJob = startCompression( 
+                        (unsigned char*)healingMessageText,
+                        healingMessageLength );
                     }
                 }
             }
@@ -10147,6 +10365,13 @@ int main() {
         SimpleVector<int> playersReceivingPlayerUpdate;
         
 
+        // each player only checks changes in nearby grid buckets
+        ChangePosGrid updatesGrid( &newUpdatesPos );
+        ChangePosGrid movesGrid( &movesPos );
+        ChangePosGrid mapChangesGrid( &mapChangesPos );
+        ChangePosGrid speechGrid( &newSpeechPos );
+        
+
         for( int i=0; i<numLive; i++ ) {
             
             LiveObject *nextPlayer = players.getElement(i);
@@ -10157,12 +10382,7 @@ int main() {
 
                 // first, send the map chunk around them
                 
-                int numSent = sendMapChunkMessage( nextPlayer );
-                
-                if( numSent == -2 ) {
-                    // still not sent, try again later
-                    continue;
-                    }
+                sendMapChunkMessage( nextPlayer );
 
 
 
@@ -10608,38 +10828,20 @@ int main() {
 
                 // do this first, so that PU messages about what they 
                 // are holding post-wound come later                
-                if( dyingMessage != NULL ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            dyingMessage, 
-                            dyingMessageLength, 
-                            false, false );
-                    
-                    if( numSent != dyingMessageLength ) {
-                        setDeathReason( nextPlayer, "disconnected" );
-
-                        nextPlayer->error = true;
-                        nextPlayer->errorCauseString =
-                            "Socket write failed";
-                        }
+                if( dyingMessage != NULL || dyingJob != NULL ) {
+                    queueMessageForPlayer( nextPlayer,
+                                           dyingMessage,
+                                           dyingMessageLength,
+                                           dyingJob );
                     }
 
 
                 // EVERYONE gets info about now-healed players           
-                if( healingMessage != NULL ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            healingMessage, 
-                            healingMessageLength, 
-                            false, false );
-                    
-                    if( numSent != healingMessageLength ) {
-                        setDeathReason( nextPlayer, "disconnected" );
-
-                        nextPlayer->error = true;
-                        nextPlayer->errorCauseString =
-                            "Socket write failed";
-                        }
+                if( healingMessage != NULL || healingJob != NULL ) {
+                    queueMessageForPlayer( nextPlayer,
+                                           healingMessage,
+                                           healingMessageLength,
+                                           healingJob );
                     }
 
 
@@ -10655,8 +10857,12 @@ int main() {
                     // greater than maxDis but within maxDist2
                     SimpleVector<int> middleDistancePlayerIDs;
                     
+                    SimpleVector<int> nearbyUpdates;
+                    updatesGrid.getNearby( playerXD, playerYD, maxDist2,
+                                           &nearbyUpdates );
 
-                    for( int u=0; u<newUpdatesPos.size(); u++ ) {
+                    for( int n=0; n<nearbyUpdates.size(); n++ ) {
+                        int u = nearbyUpdates.getElementDirect( n );
                         ChangePosition *p = newUpdatesPos.getElement( u );
                         
                         // update messages can be global when a new
@@ -10685,10 +10891,12 @@ int main() {
                         // compose PU mesage for this player
                         
                         unsigned char *updateMessage = NULL;
+                        CompressionJob *updateJob = NULL;
                         int updateMessageLength = 0;
                         SimpleVector<char> updateChars;
                         
-                        for( int u=0; u<newUpdates.size(); u++ ) {
+                        for( int n=0; n<nearbyUpdates.size(); n++ ) {
+                            int u = nearbyUpdates.getElementDirect( n );
                             ChangePosition *p = newUpdatesPos.getElement( u );
                         
                             double d = intDist( p->x, p->y, 
@@ -10724,32 +10932,25 @@ int main() {
                                     (unsigned char*)updateMessageText;
                                 }
                             else {
-                                updateMessage = makeCompressedMessage( 
-                                    updateMessageText, 
-                                    updateMessageLength, &updateMessageLength );
-                
-                                delete [] updateMessageText;
+                                updateJob = startCompression( 
+                                    (unsigned char*)updateMessageText,
+                                    updateMessageLength );
                                 }
                             }
 
-                        if( updateMessage != NULL ) {
+                        if( updateMessage != NULL || updateJob != NULL ) {
                             playersReceivingPlayerUpdate.push_back( 
                                 nextPlayer->id );
                             
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    updateMessage, 
-                                    updateMessageLength, 
-                                    false, false );
+                            queueMessageForPlayer( nextPlayer,
+                                                   updateMessage,
+                                                   updateMessageLength,
+                                                   updateJob );
                             
                             delete [] updateMessage;
-                            
-                            if( numSent != updateMessageLength ) {
-                                setDeathReason( nextPlayer, "disconnected" );
-                                
-                                nextPlayer->error = true;
-                                nextPlayer->errorCauseString =
-                                    "Socket write failed";
+
+                            if( updateJob != NULL ) {
+                                releaseCompressionJob( updateJob );
                                 }
                             }
                         }
@@ -10758,6 +10959,7 @@ int main() {
                     if( middleDistancePlayerIDs.size() > 0 ) {
 
                         unsigned char *outOfRangeMessage = NULL;
+                        CompressionJob *outOfRangeJob = NULL;
                         int outOfRangeMessageLength = 0;
         
                         if( middleDistancePlayerIDs.size() > 0 ) {
@@ -10790,29 +10992,21 @@ int main() {
                                 }
                             else {
                                 // compress 
-                                outOfRangeMessage = makeCompressedMessage( 
-                                    outOfRangeMessageText, 
-                                    outOfRangeMessageLength, 
-                                    &outOfRangeMessageLength );
-                
-                                delete [] outOfRangeMessageText;
+                                outOfRangeJob = startCompression( 
+                                    (unsigned char*)outOfRangeMessageText,
+                                    outOfRangeMessageLength );
                                 }
                             }
                         
-                        int numSent = 
-                            nextPlayer->sock->send( 
-                                outOfRangeMessage, 
-                                outOfRangeMessageLength, 
-                                false, false );
+                        queueMessageForPlayer( nextPlayer,
+                                               outOfRangeMessage,
+                                               outOfRangeMessageLength,
+                                               outOfRangeJob );
                         
                         delete [] outOfRangeMessage;
 
-                        if( numSent != outOfRangeMessageLength ) {
-                            setDeathReason( nextPlayer, "disconnected" );
-
-                            nextPlayer->error = true;
-                            nextPlayer->errorCauseString =
-                                "Socket write failed";
+                        if( outOfRangeJob != NULL ) {
+                            releaseCompressionJob( outOfRangeJob );
                             }
                         }
                     }
@@ -10824,7 +11018,12 @@ int main() {
                     
                     double minUpdateDist = 64;
                     
-                    for( int u=0; u<movesPos.size(); u++ ) {
+                    SimpleVector<int> nearbyMoves;
+                    movesGrid.getNearby( playerXD, playerYD, maxDist,
+                                         &nearbyMoves );
+
+                    for( int n=0; n<nearbyMoves.size(); n++ ) {
+                        int u = nearbyMoves.getElementDirect( n );
                         ChangePosition *p = movesPos.getElement( u );
                         
                         // move messages are never global
@@ -10844,7 +11043,8 @@ int main() {
                         
                         SimpleVector<MoveRecord> closeMoves;
                         
-                        for( int u=0; u<movesPos.size(); u++ ) {
+                        for( int n=0; n<nearbyMoves.size(); n++ ) {
+                            int u = nearbyMoves.getElementDirect( n );
                             ChangePosition *p = movesPos.getElement( u );
                             
                             // move messages are never global
@@ -10865,6 +11065,7 @@ int main() {
                                 &closeMoves, nextPlayer->birthPos );
                         
                             unsigned char *moveMessage = NULL;
+                            CompressionJob *moveJob = NULL;
                             int moveMessageLength = 0;
         
                             if( moveMessageText != NULL ) {
@@ -10872,28 +11073,22 @@ int main() {
                                 moveMessageLength = strlen( moveMessageText );
 
                                 if( moveMessageLength > maxUncompressedSize ) {
-                                    moveMessage = makeCompressedMessage( 
-                                        moveMessageText,
-                                        moveMessageLength,
-                                        &moveMessageLength );
-                                    delete [] moveMessageText;
+                                    moveJob = startCompression( 
+                                        (unsigned char*)moveMessageText,
+                                        moveMessageLength );
+                                    moveMessage = NULL;
                                     }    
                                 }
 
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    moveMessage, 
-                                    moveMessageLength, 
-                                    false, false );
+                            queueMessageForPlayer( nextPlayer,
+                                                   moveMessage,
+                                                   moveMessageLength,
+                                                   moveJob );
                             
                             delete [] moveMessage;
-                            
-                            if( numSent != moveMessageLength ) {
-                                setDeathReason( nextPlayer, "disconnected" );
-                                
-                                nextPlayer->error = true;
-                                nextPlayer->errorCauseString =
-                                    "Socket write failed";
+
+                            if( moveJob != NULL ) {
+                                releaseCompressionJob( moveJob );
                                 }
                             }
                         }
@@ -10904,7 +11099,12 @@ int main() {
                 if( mapChanges.size() > 0 ) {
                     double minUpdateDist = 64;
                     
-                    for( int u=0; u<mapChangesPos.size(); u++ ) {
+                    SimpleVector<int> nearbyMapChanges;
+                    mapChangesGrid.getNearby( playerXD, playerYD, maxDist,
+                                              &nearbyMapChanges );
+
+                    for( int n=0; n<nearbyMapChanges.size(); n++ ) {
+                        int u = nearbyMapChanges.getElementDirect( n );
                         ChangePosition *p = mapChangesPos.getElement( u );
                         
                         // map changes are never global
@@ -10925,10 +11125,12 @@ int main() {
                         
                         
                         unsigned char *mapChangeMessage = NULL;
+                        CompressionJob *mapChangeJob = NULL;
                         int mapChangeMessageLength = 0;
                         SimpleVector<char> mapChangeChars;
 
-                        for( int u=0; u<mapChanges.size(); u++ ) {
+                        for( int n=0; n<nearbyMapChanges.size(); n++ ) {
+                            int u = nearbyMapChanges.getElementDirect( n );
                             ChangePosition *p = mapChangesPos.getElement( u );
                         
                             double d = intDist( p->x, p->y, 
@@ -10969,40 +11171,38 @@ int main() {
                                     (unsigned char*)mapChangeMessageText;
                                 }
                             else {
-                                mapChangeMessage = makeCompressedMessage( 
-                                    mapChangeMessageText, 
-                                    mapChangeMessageLength, 
-                                    &mapChangeMessageLength );
-                
-                                delete [] mapChangeMessageText;
+                                mapChangeJob = startCompression( 
+                                    (unsigned char*)mapChangeMessageText,
+                                    mapChangeMessageLength );
                                 }
                             }
 
                         
-                        if( mapChangeMessage != NULL ) {
+                        if( mapChangeMessage != NULL || 
+                            mapChangeJob != NULL ) {
 
-                            int numSent = 
-                                nextPlayer->sock->send( 
-                                    mapChangeMessage, 
-                                    mapChangeMessageLength, 
-                                    false, false );
+                            queueMessageForPlayer( nextPlayer,
+                                                   mapChangeMessage,
+                                                   mapChangeMessageLength,
+                                                   mapChangeJob );
                             
                             delete [] mapChangeMessage;
 
-                            if( numSent != mapChangeMessageLength ) {
-                                setDeathReason( nextPlayer, "disconnected" );
-                                
-                                nextPlayer->error = true;
-                                nextPlayer->errorCauseString =
-                                    "Socket write failed";
+                            if( mapChangeJob != NULL ) {
+                                releaseCompressionJob( mapChangeJob );
                                 }
                             }
                         }
                     }
-                if( speechMessage != NULL ) {
+                if( speechMessage != NULL || speechJob != NULL ) {
                     double minUpdateDist = 64;
                     
-                    for( int u=0; u<newSpeechPos.size(); u++ ) {
+                    SimpleVector<int> nearbySpeech;
+                    speechGrid.getNearby( playerXD, playerYD, maxDist,
+                                          &nearbySpeech );
+
+                    for( int n=0; n<nearbySpeech.size(); n++ ) {
+                        int u = nearbySpeech.getElementDirect( n );
                         ChangePosition *p = newSpeechPos.getElement( u );
                         
                         // speech never global
@@ -11016,19 +11216,10 @@ int main() {
                         }
 
                     if( minUpdateDist <= maxDist ) {
-                        int numSent = 
-                            nextPlayer->sock->send( 
-                                speechMessage, 
-                                speechMessageLength, 
-                                false, false );
-                        
-                        if( numSent != speechMessageLength ) {
-                            setDeathReason( nextPlayer, "disconnected" );
-
-                            nextPlayer->error = true;
-                            nextPlayer->errorCauseString =
-                                "Socket write failed";
-                            }
+                        queueMessageForPlayer( nextPlayer,
+                                               speechMessage,
+                                               speechMessageLength,
+                                               speechJob );
                         }
                     }
                 
@@ -11036,6 +11227,7 @@ int main() {
                 // EVERYONE gets updates about deleted players
 
                 unsigned char *deleteUpdateMessage = NULL;
+                CompressionJob *deleteUpdateJob = NULL;
                 int deleteUpdateMessageLength = 0;
         
                 SimpleVector<char> deleteUpdateChars;
@@ -11068,67 +11260,41 @@ int main() {
                         }
                     else {
                         // compress for all players once here
-                        deleteUpdateMessage = makeCompressedMessage( 
-                            deleteUpdateMessageText, 
-                            deleteUpdateMessageLength, 
-                            &deleteUpdateMessageLength );
-                
-                        delete [] deleteUpdateMessageText;
+                        deleteUpdateJob = startCompression( 
+                            (unsigned char*)deleteUpdateMessageText,
+                            deleteUpdateMessageLength );
                         }
                     }
 
 
 
-                if( deleteUpdateMessage != NULL ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            deleteUpdateMessage, 
-                            deleteUpdateMessageLength, 
-                            false, false );
+                if( deleteUpdateMessage != NULL || deleteUpdateJob != NULL ) {
+                    queueMessageForPlayer( nextPlayer,
+                                           deleteUpdateMessage,
+                                           deleteUpdateMessageLength,
+                                           deleteUpdateJob );
                     
                     delete [] deleteUpdateMessage;
-                    
-                    if( numSent != deleteUpdateMessageLength ) {
-                        setDeathReason( nextPlayer, "disconnected" );
 
-                        nextPlayer->error = true;
-                        nextPlayer->errorCauseString =
-                            "Socket write failed";
+                    if( deleteUpdateJob != NULL ) {
+                        releaseCompressionJob( deleteUpdateJob );
                         }
                     }
 
                 // EVERYONE gets lineage info for new babies
-                if( lineageMessage != NULL ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            lineageMessage, 
-                            lineageMessageLength, 
-                            false, false );
-                    
-                    if( numSent != lineageMessageLength ) {
-                        setDeathReason( nextPlayer, "disconnected" );
-
-                        nextPlayer->error = true;
-                        nextPlayer->errorCauseString =
-                            "Socket write failed";
-                        }
+                if( lineageMessage != NULL || lineageJob != NULL ) {
+                    queueMessageForPlayer( nextPlayer,
+                                           lineageMessage,
+                                           lineageMessageLength,
+                                           lineageJob );
                     }
 
                 // EVERYONE gets newly-given names
-                if( namesMessage != NULL ) {
-                    int numSent = 
-                        nextPlayer->sock->send( 
-                            namesMessage, 
-                            namesMessageLength, 
-                            false, false );
-                    
-                    if( numSent != namesMessageLength ) {
-                        setDeathReason( nextPlayer, "disconnected" );
-
-                        nextPlayer->error = true;
-                        nextPlayer->errorCauseString =
-                            "Socket write failed";
-                        }
+                if( namesMessage != NULL || namesJob != NULL ) {
+                    queueMessageForPlayer( nextPlayer,
+                                           namesMessage,
+                                           namesMessageLength,
+                                           namesJob );
                     }
 
                 
@@ -11165,19 +11331,9 @@ int main() {
                      
                     int messageLength = strlen( foodMessage );
                     
-                    int numSent = 
-                         nextPlayer->sock->send( 
-                             (unsigned char*)foodMessage, 
-                             messageLength,
-                             false, false );
-
-                     if( numSent != messageLength ) {
-                         setDeathReason( nextPlayer, "disconnected" );
-
-                         nextPlayer->error = true;
-                         nextPlayer->errorCauseString =
-                             "Socket write failed";
-                         }
+                    queueMessageForPlayer( nextPlayer,
+                                           (unsigned char*)foodMessage,
+                                           messageLength );
                      
                      delete [] foodMessage;
                      
@@ -11201,6 +11357,25 @@ int main() {
             delete [] r->formatString;
             }
 
+        distanceChecksSaved += 
+            updatesGrid.getNumChecksSaved() +
+            movesGrid.getNumChecksSaved() +
+            mapChangesGrid.getNumChecksSaved() +
+            speechGrid.getNumChecksSaved();
+        
+        if( Time::getCurrentTime() - lastDistanceChecksLogTime > 
+            DISTANCE_CHECKS_LOG_INTERVAL_SECONDS ) {
+            
+            AppLog::infoF( "Change grid skipped %d distance checks in "
+                           "last %d seconds",
+                           distanceChecksSaved,
+                           DISTANCE_CHECKS_LOG_INTERVAL_SECONDS );
+            
+            distanceChecksSaved = 0;
+            lastDistanceChecksLogTime = Time::getCurrentTime();
+            }
+        
+
         if( newUpdates.size() > 0 ) {
             
             SimpleVector<char> playerList;
@@ -11239,20 +11414,89 @@ int main() {
         if( speechMessage != NULL ) {
             delete [] speechMessage;
             }
+        if( speechJob != NULL ) {
+            releaseCompressionJob( speechJob );
+            }
         if( lineageMessage != NULL ) {
             delete [] lineageMessage;
             }
+        if( lineageJob != NULL ) {
+            releaseCompressionJob( lineageJob );
+            }
         if( namesMessage != NULL ) {
             delete [] namesMessage;
             }
+        if( namesJob != NULL ) {
+            releaseCompressionJob( namesJob );
+            }
         if( dyingMessage != NULL ) {
             delete [] dyingMessage;
             }
+        if( dyingJob != NULL ) {
+            releaseCompressionJob( dyingJob );
+            }
         if( healingMessage != NULL ) {
             delete [] healingMessage;
             }
+        if( healingJob != NULL ) {
+            releaseCompressionJob( healingJob );
+            }
 
         
+        // payloads that finished compressing can go out now
+        stepCompressionPool();
+        
+        // send everything queued for players this step
+        // including those with errors, who may have a last message waiting
+        for( int i=0; i<players.size(); i++ ) {
+            LiveObject *nextPlayer = players.getElement(i);
+            
+            if( nextPlayer->outbound->flush( sendCoalesceSeconds ) == -1 &&
+                ! nextPlayer->error ) {
+                
+                setDeathReason( nextPlayer, "disconnected" );
+                
+                nextPlayer->error = true;
+                nextPlayer->errorCauseString = "Socket write failed";
+                }
+            }
+        outboundFlushSteps++;
+        
+        if( Time::getCurrentTime() - lastOutboundLogTime > 
+            OUTBOUND_LOG_INTERVAL_SECONDS ) {
+            
+            OutboundStats stats = getOutboundStats();
+            
+            AppLog::infoF( "Outbound:  %.0f bytes queued, %.0f sent, "
+                           "%d send calls over %d steps (%.2f per step), "
+                           "max backlog %d bytes, "
+                           "%.0f dropped with closed connections, "
+                           "in last %d seconds",
+                           stats.bytesQueued, stats.bytesSent,
+                           stats.sendCalls, outboundFlushSteps,
+                           (double)stats.sendCalls / outboundFlushSteps,
+                           stats.maxBacklog, stats.bytesDropped,
+                           OUTBOUND_LOG_INTERVAL_SECONDS );
+            
+            CompressionPoolStats compStats = getCompressionPoolStats();
+            
+            AppLog::infoF( "Compression:  %d jobs, %.0f bytes in, "
+                           "%.0f out, %.3f sec on workers, "
+                           "%.3f sec inline, max queue depth %d, "
+                           "%d outstanding, in last %d seconds",
+                           compStats.jobsStarted, 
+                           compStats.bytesIn, compStats.bytesOut,
+                           compStats.workerSeconds, 
+                           compStats.inlineSeconds,
+                           compStats.maxQueueDepth,
+                           getNumCompressionJobsOutstanding(),
+                           OUTBOUND_LOG_INTERVAL_SECONDS );
+            
+            outboundFlushSteps = 0;
+            lastOutboundLogTime = Time::getCurrentTime();
+            }
+        
+
         // handle closing any that have an error
         for( int i=0; i<players.size(); i++ ) {
             LiveObject *nextPlayer = players.getElement(i);
@@ -11260,13 +11504,19 @@ int main() {
             if( nextPlayer->error && nextPlayer->deleteSent &&
                 nextPlayer->deleteSentDoneETA < Time::getCurrentTime() ) {
                 AppLog::infoF( "Closing connection to player %d on error "
-                               "(cause: %s)",
-                               nextPlayer->id, nextPlayer->errorCauseString );
+                               "(cause: %s), dropping %d unsent bytes",
+                               nextPlayer->id, nextPlayer->errorCauseString,
+                               nextPlayer->outbound->getNumDropped() );
 
                 AppLog::infoF( "%d remaining player(s) alive on server ",
                                players.size() - 1 );
 
                 
+                if( nextPlayer->sockEntry != NULL ) {
+                    sockPoll.removeSocket( nextPlayer->sockEntry );
+                    }
+                
+                delete nextPlayer->outbound;
                 delete nextPlayer->sock;
                 delete nextPlayer->sockBuffer;
                 delete nextPlayer->lineage;
@@ -11314,7 +11564,13 @@ int main() {
                 delete nextPlayer->babyBirthTimes;
                 delete nextPlayer->babyIDs;
                 
+                int deadID = nextPlayer->id;
+                
+                removeFromMotherIndex( nextPlayer );
+                
                 players.deleteElement( i );
+                
+                removePlayerFromIndex( deadID, i );
                 i--;
                 }
             }
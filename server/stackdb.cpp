@@ -7,8 +7,11 @@
 #include <stdint.h>
 
 #ifdef _WIN32
+#include <io.h>
 #define fseeko fseeko64
 #define ftello ftello64
+#else
+#include <unistd.h>
 #endif
 
 
@@ -40,6 +43,7 @@ int STACKDB_open(
     unsigned int inValueSize ) {
 
     inDB->hashBinBuffer = NULL;
+    inDB->readOnlyGets = false;
     
     inDB->file = fopen( inPath, "r+b" );
     
@@ -251,6 +255,19 @@ void STACKDB_close( STACKDB *inDB ) {
 
 
 
+int STACKDB_sync( STACKDB *inDB ) {
+    if( fflush( inDB->file ) != 0 ) {
+        return -1;
+        }
+#ifdef _WIN32
+    return _commit( _fileno( inDB->file ) );
+#else
+    return fsync( fileno( inDB->file ) );
+#endif
+    }
+
+
+
 inline char keyComp( int inKeySize, const void *inKeyA, const void *inKeyB ) {
     uint8_t *a = (uint8_t*)inKeyA;
     uint8_t *b = (uint8_t*)inKeyB;
@@ -340,7 +357,7 @@ static int findValue( STACKDB *inDB, const void *inKey,
     if( val64 == 0 ) {
         // empty bin
 
-        if( inRecordMiss ) {
+        if( inRecordMiss && ! inDB->readOnlyGets ) {
             // remeber that this key was a miss
             fseeko( inDB->file, inDB->lastHashBinLoc, SEEK_SET );
             int numWritten = fwrite( inKey, inDB->keySize, 1, inDB->file );
@@ -401,7 +418,7 @@ static int findValue( STACKDB *inDB, const void *inKey,
             // reached end of stack
             
             
-            if( inRecordMiss ) {    
+            if( inRecordMiss && ! inDB->readOnlyGets ) {    
                 // remeber that this key was a miss
                 // we don't need to walk to the bottom of the stack
                 // next time we look for it
@@ -433,7 +450,7 @@ static int findValue( STACKDB *inDB, const void *inKey,
 
     int numWritten;
     
-    if( stackPos != 0 ) {
+    if( stackPos != 0 && ! inDB->readOnlyGets ) {
         // move to top of stack.
 
         if( lastRecordPointerLoc64 != 0 ) {
@@ -470,6 +487,12 @@ static int findValue( STACKDB *inDB, const void *inKey,
 
 
 
+void STACKDB_setReadOnlyGets( STACKDB *inDB, char inReadOnly ) {
+    inDB->readOnlyGets = inReadOnly;
+    }
+
+
+
 int STACKDB_get( STACKDB *inDB, const void *inKey, void *outValue ) {
     int result = findValue( inDB, inKey, true, outValue, false );
 
@@ -18,6 +18,9 @@ typedef struct {
         // that bin and a 64-bit file location for the top of the stack
         unsigned int hashBinSize;
         uint8_t *hashBinBuffer;
+
+        // when set, gets leave file untouched
+        char readOnlyGets;
     } STACKDB;
 
     
@@ -56,6 +59,28 @@ int STACKDB_open(
  */
 void STACKDB_close( STACKDB *inDB );
 
+
+/**
+ * Flush all writes through to disk
+ *
+ * @param db Database struct
+ * @return 0 on success, nonzero on error
+ */
+int STACKDB_sync( STACKDB *inDB );
+
+/**
+ * Stop or resume writes to file during gets
+ *
+ * Normally, a get moves the found record to the top of its bin and
+ * remembers misses, both of which write to the file.  While read-only,
+ * gets do neither, so the file can be copied safely as long as no puts
+ * are made.
+ *
+ * @param db Database struct
+ * @param inReadOnly true to stop writes during gets
+ */
+void STACKDB_setReadOnlyGets( STACKDB *inDB, char inReadOnly );
+
 /**
  * Get an entry
  *
@@ -5,6 +5,8 @@
 #include "minorGems/util/random/JenkinsRandomSource.h"
 #include "minorGems/formats/encodingUtils.h"
 
+#include "../gameSource/messageFramer.h"
+
 
 JenkinsRandomSource randSource;
 
@@ -25,7 +27,7 @@ typedef struct Client {
         int i;
         
         Socket *sock;
-        SimpleVector<unsigned char> buffer;
+        MessageFramer buffer;
         
         int skipCompressedData;
         
@@ -47,14 +49,14 @@ typedef struct Client {
 // NULL if no message read
 char *getNextMessage( Client *inC ) {
 
-    if( inC->skipCompressedData > 0 && inC->buffer.size() > 0 ) {
+    if( inC->skipCompressedData > 0 && inC->buffer.getNumBytes() > 0 ) {
         int numToDelete = inC->skipCompressedData;
         
-        if( numToDelete > inC->buffer.size() ) {
-            numToDelete = inC->buffer.size();
+        if( numToDelete > inC->buffer.getNumBytes() ) {
+            numToDelete = inC->buffer.getNumBytes();
             }
         
-        inC->buffer.deleteStartElements( numToDelete );
+        inC->buffer.takeBytes( numToDelete );
         inC->skipCompressedData -= numToDelete;
         }
     
@@ -98,10 +100,11 @@ char *getNextMessage( Client *inC ) {
         }
     
     
-    // read all available data
-    unsigned char buffer[512];
+    // read all available data, right into buffer
+    int space;
+    unsigned char *dest = inC->buffer.getWriteSpace( 512, &space );
     
-    int numRead = inC->sock->receive( buffer, 512, 0 );
+    int numRead = inC->sock->receive( dest, space, 0 );
 
     if( numRead == -1 ) {
         inC->disconnected = true;
@@ -109,8 +112,10 @@ char *getNextMessage( Client *inC ) {
     
     
     while( numRead > 0 ) {
-        inC->buffer.appendArray( buffer, numRead );
-        numRead = inC->sock->receive( buffer, 512, 0 );
+        inC->buffer.commitWrite( numRead );
+
+        dest = inC->buffer.getWriteSpace( 512, &space );
+        numRead = inC->sock->receive( dest, space, 0 );
         
         if( numRead == -1 ) {
             inC->disconnected = true;
@@ -119,24 +124,18 @@ char *getNextMessage( Client *inC ) {
 
 
     if( inC->pendingCMData ) {
-        if( inC->buffer.size() >= inC->pendingCMCompressedSize ) {
+        if( inC->buffer.getNumBytes() >= inC->pendingCMCompressedSize ) {
             inC->pendingCMData = false;
             
+            // in place in buffer
             unsigned char *compressedData = 
-                new unsigned char[ inC->pendingCMCompressedSize ];
-            
-            for( int i=0; i<inC->pendingCMCompressedSize; i++ ) {
-                compressedData[i] = inC->buffer.getElementDirect( i );
-                }
-            inC->buffer.deleteStartElements( inC->pendingCMCompressedSize );
+                inC->buffer.takeBytes( inC->pendingCMCompressedSize );
             
             unsigned char *decompressedMessage =
                 zipDecompress( compressedData, 
                                inC->pendingCMCompressedSize,
                                inC->pendingCMDecompressedSize );
 
-            delete [] compressedData;
-
             if( decompressedMessage == NULL ) {
                 printf( "Decompressing CM message failed\n" );
                 return NULL;
@@ -163,25 +162,18 @@ char *getNextMessage( Client *inC ) {
 
 
     // find first terminal character #
-    int index = inC->buffer.getElementIndex( '#' );
+    int messageLength;
+    char *bufferedMessage = inC->buffer.getNextMessage( &messageLength );
         
-    if( index == -1 ) {
+    if( bufferedMessage == NULL ) {
         return NULL;
         }
     
 
-    char *message = new char[ index + 1 ];
-    
-    // all but terminal character
-    for( int i=0; i<index; i++ ) {
-        message[i] = (char)( inC->buffer.getElementDirect( i ) );
-        }
-    
-    // delete from buffer, including terminal character
-    inC->buffer.deleteStartElements( index + 1 );
-
+    // copy out, caller destroys
+    char *message = new char[ messageLength + 1 ];
     
-    message[ index ] = '\0';
+    memcpy( message, bufferedMessage, messageLength + 1 );
     
     if( strstr( message, "CM" ) == message ) {
         inC->pendingCMData = true;
@@ -0,0 +1,425 @@
+#include "writeAheadLog.h"
+
+#include "minorGems/util/SimpleVector.h"
+#include "minorGems/util/stringUtils.h"
+#include "minorGems/util/log/AppLog.h"
+#include "minorGems/system/Time.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+
+// group header:
+//    magic, payload length, payload checksum, as 32-bit ints
+//    in server platform's byte order
+// payload:
+//    for each record, tag byte, length byte, data
+#define WAL_GROUP_MAGIC 0x4C41574DU
+
+#define WAL_HEADER_BYTES 12
+
+// bigger than this, must be garbage
+#define WAL_MAX_GROUP_BYTES ( 256 * 1024 * 1024 )
+
+
+
+static FILE *logFile = NULL;
+
+static char *logPath = NULL;
+static char *oldLogPath = NULL;
+
+static char oldSegmentExists = false;
+
+
+static int syncMilliseconds = 0;
+
+static double lastSyncTime = 0;
+static char unsyncedGroups = false;
+
+// set by first failed write or sync, after which nothing more is written
+static char writeFailed = false;
+
+
+// records appended since last commit
+static SimpleVector<unsigned char> groupPayload;
+static int numRecordsInGroup = 0;
+
+
+static WALStats stats = { 0, 0, 0, 0, 0, 0 };
+
+
+
+// FNV-1a
+static uint32_t computeChecksum( unsigned char *inData, int inLength ) {
+    uint32_t h = 2166136261U;
+
+    for( int i=0; i<inLength; i++ ) {
+        h ^= inData[i];
+        h *= 16777619U;
+        }
+    return h;
+    }
+
+
+
+static char *getOldPath( const char *inPath ) {
+    return autoSprintf( "%s.old", inPath );
+    }
+
+
+
+// returns number of records replayed from one segment file
+static int replaySegment( const char *inPath, WALRecordHandler inHandler ) {
+    FILE *f = fopen( inPath, "rb" );
+
+    if( f == NULL ) {
+        return 0;
+        }
+
+    int numRecords = 0;
+    int numGroups = 0;
+
+    long goodEnd = 0;
+
+    unsigned char *payload = NULL;
+    int payloadSize = 0;
+
+    while( true ) {
+        uint32_t header[3];
+
+        if( fread( header, WAL_HEADER_BYTES, 1, f ) != 1 ) {
+            break;
+            }
+
+        if( header[0] != WAL_GROUP_MAGIC ||
+            header[1] > WAL_MAX_GROUP_BYTES ) {
+            break;
+            }
+
+        int length = header[1];
+
+        if( length > payloadSize ) {
+            if( payload != NULL ) {
+                delete [] payload;
+                }
+            payload = new unsigned char[ length ];
+            payloadSize = length;
+            }
+
+        if( length > 0 && fread( payload, length, 1, f ) != 1 ) {
+            break;
+            }
+
+        if( computeChecksum( payload, length ) != header[2] ) {
+            break;
+            }
+
+        // whole group is good
+        int pos = 0;
+        while( pos + 2 <= length ) {
+            unsigned char tag = payload[ pos ];
+            int dataLength = payload[ pos + 1 ];
+            pos += 2;
+
+            if( pos + dataLength > length ) {
+                break;
+                }
+
+            inHandler( tag, &( payload[ pos ] ), dataLength );
+            numRecords++;
+
+            pos += dataLength;
+            }
+
+        numGroups++;
+        goodEnd = ftell( f );
+        }
+
+    fseek( f, 0, SEEK_END );
+    long fileEnd = ftell( f );
+
+    fclose( f );
+
+    if( payload != NULL ) {
+        delete [] payload;
+        }
+
+    AppLog::infoF( "Replayed %d records in %d groups from %s",
+                   numRecords, numGroups, inPath );
+
+    if( fileEnd > goodEnd ) {
+        AppLog::infoF( "Ignored %ld bytes of incomplete groups at end of %s",
+                       fileEnd - goodEnd, inPath );
+        }
+
+    return numRecords;
+    }
+
+
+
+int replayWriteAheadLog( const char *inPath, WALRecordHandler inHandler ) {
+    char *oldPath = getOldPath( inPath );
+
+    // older records first
+    int numRecords = replaySegment( oldPath, inHandler );
+
+    numRecords += replaySegment( inPath, inHandler );
+
+    delete [] oldPath;
+
+    return numRecords;
+    }
+
+
+
+char openWriteAheadLog( const char *inPath, int inSyncMilliseconds ) {
+    if( logPath != NULL ) {
+        closeWriteAheadLog();
+        }
+
+    logPath = stringDuplicate( inPath );
+    oldLogPath = getOldPath( inPath );
+
+    remove( oldLogPath );
+    oldSegmentExists = false;
+
+    logFile = fopen( logPath, "wb" );
+
+    if( logFile == NULL ) {
+        AppLog::errorF( "Failed to open write-ahead log %s", logPath );
+
+        delete [] logPath;
+        logPath = NULL;
+        delete [] oldLogPath;
+        oldLogPath = NULL;
+        return false;
+        }
+
+    syncMilliseconds = inSyncMilliseconds;
+    lastSyncTime = Time::getCurrentTime();
+    unsyncedGroups = false;
+    writeFailed = false;
+
+    groupPayload.deleteAll();
+    numRecordsInGroup = 0;
+
+    return true;
+    }
+
+
+
+static void noteWriteFailed( const char *inWhat ) {
+    if( ! writeFailed ) {
+        AppLog::errorF( "Write-ahead log %s failed for %s, "
+                        "no more records will be written to it",
+                        inWhat, logPath );
+        }
+    writeFailed = true;
+
+    groupPayload.deleteAll();
+    numRecordsInGroup = 0;
+    }
+
+
+
+static void syncLog() {
+    double startTime = Time::getCurrentTime();
+
+#ifdef _WIN32
+    int error = _commit( _fileno( logFile ) );
+#else
+    int error = fsync( fileno( logFile ) );
+#endif
+
+    if( error != 0 ) {
+        noteWriteFailed( "sync" );
+        }
+
+    lastSyncTime = Time::getCurrentTime();
+    unsyncedGroups = false;
+
+    stats.syncs++;
+    stats.syncSeconds += lastSyncTime - startTime;
+    }
+
+
+
+void closeWriteAheadLog() {
+    if( logPath == NULL ) {
+        return;
+        }
+
+    if( logFile != NULL ) {
+        // file may be gone after a failed rotate
+        walCommit();
+
+        if( unsyncedGroups && ! writeFailed ) {
+            syncLog();
+            }
+
+        fclose( logFile );
+        logFile = NULL;
+        }
+
+    delete [] logPath;
+    logPath = NULL;
+    delete [] oldLogPath;
+    oldLogPath = NULL;
+    }
+
+
+
+char isWriteAheadLogOpen() {
+    return ( logFile != NULL );
+    }
+
+
+
+void walAppend( unsigned char inTag,
+                const unsigned char *inData, int inLength ) {
+    if( logFile == NULL || writeFailed ) {
+        return;
+        }
+
+    groupPayload.push_back( inTag );
+    groupPayload.push_back( (unsigned char)inLength );
+    groupPayload.appendArray( (unsigned char*)inData, inLength );
+
+    numRecordsInGroup++;
+    }
+
+
+
+char walCommit() {
+    if( logFile == NULL || writeFailed ) {
+        return false;
+        }
+
+    if( numRecordsInGroup > 0 ) {
+        int length = groupPayload.size();
+        unsigned char *payload = groupPayload.getElementArray();
+
+        uint32_t header[3];
+        header[0] = WAL_GROUP_MAGIC;
+        header[1] = length;
+        header[2] = computeChecksum( payload, length );
+
+        char written =
+            fwrite( header, WAL_HEADER_BYTES, 1, logFile ) == 1 &&
+            fwrite( payload, length, 1, logFile ) == 1 &&
+            fflush( logFile ) == 0;
+
+        delete [] payload;
+
+        if( ! written ) {
+            // torn group at end, which replay will stop at
+            noteWriteFailed( "write" );
+            return false;
+            }
+
+        stats.groupsCommitted++;
+        stats.recordsCommitted += numRecordsInGroup;
+        stats.bytesWritten += WAL_HEADER_BYTES + length;
+
+        if( numRecordsInGroup > stats.maxRecordsInGroup ) {
+            stats.maxRecordsInGroup = numRecordsInGroup;
+            }
+
+        groupPayload.deleteAll();
+        numRecordsInGroup = 0;
+
+        unsyncedGroups = true;
+        }
+
+    if( unsyncedGroups &&
+        Time::getCurrentTime() - lastSyncTime >=
+        syncMilliseconds / 1000.0 ) {
+        syncLog();
+        }
+
+    return ! writeFailed;
+    }
+
+
+
+char walRotate() {
+    if( logFile == NULL || oldSegmentExists ) {
+        return false;
+        }
+
+    walCommit();
+
+    if( unsyncedGroups && ! writeFailed ) {
+        // old segment must be complete on disk before anything
+        // applied from it can be
+        syncLog();
+        }
+
+    if( writeFailed ) {
+        return false;
+        }
+
+    fclose( logFile );
+    logFile = NULL;
+
+    if( rename( logPath, oldLogPath ) != 0 ) {
+        // records stay at logPath, and must not be truncated until
+        // they are applied
+        AppLog::errorF( "Failed to rotate write-ahead log %s", logPath );
+        writeFailed = true;
+        logFile = fopen( logPath, "ab" );
+        return false;
+        }
+    
+    oldSegmentExists = true;
+
+    logFile = fopen( logPath, "wb" );
+
+    if( logFile == NULL ) {
+        AppLog::errorF( "Failed to reopen write-ahead log %s", logPath );
+        writeFailed = true;
+        return false;
+        }
+
+    return true;
+    }
+
+
+
+char walHasOldSegment() {
+    return oldSegmentExists;
+    }
+
+
+
+void walDropOldSegment() {
+    if( ! oldSegmentExists ) {
+        return;
+        }
+
+    remove( oldLogPath );
+    oldSegmentExists = false;
+    }
+
+
+
+WALStats getWALStats() {
+    WALStats s = stats;
+
+    stats.groupsCommitted = 0;
+    stats.recordsCommitted = 0;
+    stats.bytesWritten = 0;
+    stats.syncs = 0;
+    stats.syncSeconds = 0;
+    stats.maxRecordsInGroup = 0;
+
+    return s;
+    }
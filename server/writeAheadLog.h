@@ -0,0 +1,94 @@
+#ifndef WRITE_AHEAD_LOG_H_INCLUDED
+#define WRITE_AHEAD_LOG_H_INCLUDED
+
+
+// Append-only log of small records, written in groups.
+//
+// Records appended between commits are written together as one group,
+// with a checksum, so that after a crash, replay sees either all of a
+// group or none of it.  Groups are fsynced on commit, or at most every
+// inSyncMilliseconds.
+//
+// The log is kept in two segments, so that it can be rotated while the
+// records in the older segment are still being applied elsewhere.
+// Replay reads the old segment, then the current one.
+//
+// Record data can be at most 255 bytes.
+
+
+// called for each record during replay, in order
+typedef void (*WALRecordHandler)( unsigned char inTag,
+                                  unsigned char *inData, int inLength );
+
+
+// reads both segments of log at inPath, if present
+// stops at first incomplete or damaged group (a torn write from a crash)
+//
+// returns number of records replayed
+int replayWriteAheadLog( const char *inPath, WALRecordHandler inHandler );
+
+
+// starts a new, empty log at inPath, removing both old segments
+// any records in them must have been replayed and applied already
+//
+// inSyncMilliseconds of 0 syncs on every commit
+//
+// returns true on success
+char openWriteAheadLog( const char *inPath, int inSyncMilliseconds );
+
+
+// commits any records not committed yet, syncs, and closes
+void closeWriteAheadLog();
+
+
+char isWriteAheadLogOpen();
+
+
+
+void walAppend( unsigned char inTag,
+                const unsigned char *inData, int inLength );
+
+
+// writes all records appended since last commit as one group
+//
+// returns false if log can't be written (now or in an earlier call),
+// after which records are no longer logged, and caller must make sure
+// that they reach the DB files some other way
+char walCommit();
+
+
+
+// moves current segment to old segment, and starts a new current one
+// can't be called while old segment still exists
+// commits first
+//
+// returns false on failure, with log in same failed state as walCommit
+// (old segment may or may not exist)
+char walRotate();
+
+
+// true if old segment hasn't been dropped since last rotate
+char walHasOldSegment();
+
+
+// called once everything in old segment has been applied elsewhere
+void walDropOldSegment();
+
+
+
+// stats for logging
+typedef struct WALStats {
+        int groupsCommitted;
+        int recordsCommitted;
+        double bytesWritten;
+        int syncs;
+        double syncSeconds;
+        int maxRecordsInGroup;
+    } WALStats;
+
+
+// resets stats after returning them
+WALStats getWALStats();
+
+
+#endif